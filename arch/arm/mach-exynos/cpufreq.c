@@ -20,6 +20,7 @@
 #include <linux/cpufreq.h>
 #include <linux/suspend.h>
 #include <linux/reboot.h>
+#include <linux/sched.h>
 
 #include <mach/map.h>
 #include <mach/regs-clock.h>
@@ -561,6 +562,59 @@ static struct cpufreq_driver exynos_driver = {
 #endif
 };
 
+#ifdef CONFIG_SCHED_ENERGY
+/*
+ * Power of one Cortex-A9 core, dynamic power as C * V^2 * f with C in
+ * 0.01mW / (MHz V^2), and what a core draws clock gated in WFI.  These are
+ * estimates for EXYNOS4412 from the ARM rail; what matters to the
+ * scheduler is the ratio between the operating points.
+ */
+#define EXYNOS_CORE_POWER_COEF	42
+#define EXYNOS_CORE_IDLE_POWER	25	/* mW */
+
+/* All cores share the ARM clock: one energy model for all of them */
+static void __init exynos_cpufreq_energy_model(void)
+{
+	struct cpufreq_frequency_table *freq_table = exynos_info->freq_table;
+	unsigned int *volt_table = exynos_info->volt_table;
+	unsigned int max_freq = freq_table[exynos_info->max_support_idx].frequency;
+	struct sched_energy_state *states;
+	int i, nr = 0;
+
+	states = kcalloc(exynos_info->min_support_idx -
+			 exynos_info->max_support_idx + 1,
+			 sizeof(*states), GFP_KERNEL);
+	if (!states)
+		return;
+
+	/* The table goes from the highest frequency down */
+	for (i = exynos_info->min_support_idx;
+	     i >= (int)exynos_info->max_support_idx; i--) {
+		unsigned int freq = freq_table[i].frequency;
+		unsigned int mv = volt_table[i] / 1000;
+		u64 power;
+
+		if (freq == CPUFREQ_ENTRY_INVALID)
+			continue;
+
+		power = (u64)(freq / 1000) * mv * mv * EXYNOS_CORE_POWER_COEF;
+		do_div(power, 100000000);
+
+		states[nr].cap = freq * SCHED_POWER_SCALE / max_freq;
+		states[nr].power = power;
+		nr++;
+	}
+
+	if (sched_energy_register(cpu_possible_mask, states, nr,
+				  EXYNOS_CORE_IDLE_POWER))
+		pr_err("%s: invalid energy model\n", __func__);
+
+	kfree(states);
+}
+#else
+static inline void exynos_cpufreq_energy_model(void) { }
+#endif
+
 static int __init exynos_cpufreq_init(void)
 {
 	int ret = -EINVAL;
@@ -611,6 +665,8 @@ static int __init exynos_cpufreq_init(void)
 	g_cpufreq_lock_level = exynos_info->min_support_idx;
 	g_cpufreq_limit_level = exynos_info->max_support_idx;
 
+	exynos_cpufreq_energy_model();
+
 	if (cpufreq_register_driver(&exynos_driver)) {
 		pr_err("failed to register cpufreq driver\n");
 		goto err_cpufreq;
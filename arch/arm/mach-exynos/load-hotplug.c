@@ -0,0 +1,281 @@
+/* linux/arch/arm/mach-exynos/load-hotplug.c
+ *
+ * EXYNOS - Load based CPU hotplug
+ *
+ * Brings cpus up and takes them down from the averaged number of runnable
+ * tasks and the utilization the scheduler tracks for every cpu, sampled
+ * every sample_ms.  A cpu goes up when there are more runnable tasks than
+ * online cpus and those are busy; one goes down when the remaining cpus
+ * could take both the tasks and their utilization.  Either condition has
+ * to hold for up_delay_ms or down_delay_ms first.  The decision itself is
+ * in load-hotplug.h, so tools/power/hotplug-sim can replay traces of the
+ * load_hotplug_sample event against other tunables.
+ *
+ * Tunables are in /sys/devices/system/cpu/hotplug.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+*/
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/cpu.h>
+#include <linux/sched.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/suspend.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/load_hotplug.h>
+
+#include "load-hotplug.h"
+
+static struct lhp_tunables lhp_tunables = LHP_DEFAULT_TUNABLES(NR_CPUS);
+static struct lhp_state lhp_state;
+static bool lhp_enabled = true;
+static bool lhp_suspended;
+
+/* Protects the tunables, the state and the flags above */
+static DEFINE_MUTEX(lhp_lock);
+
+static struct workqueue_struct *lhp_wq;
+static struct delayed_work lhp_work;
+
+static void lhp_queue(void)
+{
+	queue_delayed_work_on(0, lhp_wq, &lhp_work,
+			      msecs_to_jiffies(lhp_tunables.sample_ms));
+}
+
+static void lhp_cpu_up(void)
+{
+	unsigned int cpu;
+	int ret;
+
+	for_each_present_cpu(cpu) {
+		if (cpu_online(cpu))
+			continue;
+		ret = cpu_up(cpu);
+		trace_load_hotplug_cpu(cpu, 1, ret);
+		return;
+	}
+}
+
+static void lhp_cpu_down(void)
+{
+	unsigned int cpu, last = 0;
+	int ret;
+
+	for_each_online_cpu(cpu)
+		last = cpu;
+	if (!last)
+		return;
+
+	ret = cpu_down(last);
+	trace_load_hotplug_cpu(last, 0, ret);
+}
+
+static void lhp_work_fn(struct work_struct *work)
+{
+	enum lhp_decision decision;
+	unsigned int nr, util = 0, online, cpu;
+
+	mutex_lock(&lhp_lock);
+	if (!lhp_enabled || lhp_suspended)
+		goto out;
+
+	get_online_cpus();
+	online = num_online_cpus();
+	for_each_online_cpu(cpu)
+		util += sched_cpu_util(cpu) * 100 >> SCHED_POWER_SHIFT;
+	put_online_cpus();
+
+	/* Leave out this worker itself */
+	nr = nr_running();
+	if (nr)
+		nr--;
+
+	decision = lhp_evaluate(&lhp_tunables, &lhp_state, nr, util, online);
+	trace_load_hotplug_sample(nr, lhp_state.avg_nr, util, online,
+				  decision);
+
+	if (decision == LHP_UP)
+		lhp_cpu_up();
+	else if (decision == LHP_DOWN)
+		lhp_cpu_down();
+
+	lhp_queue();
+out:
+	mutex_unlock(&lhp_lock);
+}
+
+static void lhp_start(void)
+{
+	memset(&lhp_state, 0, sizeof(lhp_state));
+	lhp_queue();
+}
+
+/* sysfs interface */
+
+#define show_one(name)							\
+static ssize_t show_##name(struct kobject *kobj,			\
+			   struct kobj_attribute *attr, char *buf)	\
+{									\
+	return sprintf(buf, "%u\n", lhp_tunables.name);			\
+}
+
+/* @cond is checked against the new value in val, under lhp_lock */
+#define store_one(name, cond)						\
+static ssize_t store_##name(struct kobject *kobj,			\
+			    struct kobj_attribute *attr,		\
+			    const char *buf, size_t count)		\
+{									\
+	unsigned long val;						\
+	ssize_t ret = count;						\
+									\
+	if (strict_strtoul(buf, 0, &val))				\
+		return -EINVAL;						\
+									\
+	mutex_lock(&lhp_lock);						\
+	if (cond)							\
+		lhp_tunables.name = val;				\
+	else								\
+		ret = -EINVAL;						\
+	mutex_unlock(&lhp_lock);					\
+									\
+	return ret;							\
+}
+
+#define lhp_attr(name, cond)						\
+show_one(name)								\
+store_one(name, cond)							\
+static struct kobj_attribute name##_attr =				\
+	__ATTR(name, 0644, show_##name, store_##name)
+
+lhp_attr(min_cpus, val >= 1 && val <= lhp_tunables.max_cpus);
+lhp_attr(max_cpus, val >= lhp_tunables.min_cpus && val <= nr_cpu_ids);
+lhp_attr(sample_ms, val >= 10 && val <= 10000);
+lhp_attr(up_nr_running, val > lhp_tunables.down_nr_running && val <= 1000);
+lhp_attr(down_nr_running, val < lhp_tunables.up_nr_running);
+lhp_attr(up_util, val > lhp_tunables.down_util && val <= 100);
+lhp_attr(down_util, val < lhp_tunables.up_util);
+lhp_attr(up_delay_ms, val <= 60000);
+lhp_attr(down_delay_ms, val <= 60000);
+
+static ssize_t show_enabled(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", lhp_enabled);
+}
+
+static ssize_t store_enabled(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	unsigned long val;
+	bool was;
+
+	if (strict_strtoul(buf, 0, &val))
+		return -EINVAL;
+
+	mutex_lock(&lhp_lock);
+	was = lhp_enabled;
+	lhp_enabled = !!val;
+	if (lhp_enabled && !was && !lhp_suspended)
+		lhp_start();
+	mutex_unlock(&lhp_lock);
+
+	if (!val && was) {
+		cancel_delayed_work_sync(&lhp_work);
+		/* An enable may have started the work again before the cancel */
+		mutex_lock(&lhp_lock);
+		if (lhp_enabled && !lhp_suspended)
+			lhp_start();
+		mutex_unlock(&lhp_lock);
+	}
+
+	return count;
+}
+
+static struct kobj_attribute enabled_attr =
+	__ATTR(enabled, 0644, show_enabled, store_enabled);
+
+static struct attribute *lhp_attributes[] = {
+	&enabled_attr.attr,
+	&min_cpus_attr.attr,
+	&max_cpus_attr.attr,
+	&sample_ms_attr.attr,
+	&up_nr_running_attr.attr,
+	&down_nr_running_attr.attr,
+	&up_util_attr.attr,
+	&down_util_attr.attr,
+	&up_delay_ms_attr.attr,
+	&down_delay_ms_attr.attr,
+	NULL
+};
+
+static struct attribute_group lhp_attr_group = {
+	.attrs = lhp_attributes,
+	.name = "hotplug",
+};
+
+static int lhp_pm_notifier(struct notifier_block *nb,
+			   unsigned long val, void *data)
+{
+	switch (val) {
+	case PM_SUSPEND_PREPARE:
+		mutex_lock(&lhp_lock);
+		lhp_suspended = true;
+		mutex_unlock(&lhp_lock);
+		cancel_delayed_work_sync(&lhp_work);
+		break;
+	case PM_POST_RESTORE:
+	case PM_POST_SUSPEND:
+		mutex_lock(&lhp_lock);
+		lhp_suspended = false;
+		if (lhp_enabled)
+			lhp_start();
+		mutex_unlock(&lhp_lock);
+		break;
+	}
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block lhp_pm_nb = {
+	.notifier_call = lhp_pm_notifier,
+};
+
+static int __init exynos_load_hotplug_init(void)
+{
+	int ret;
+
+	lhp_tunables.max_cpus = num_possible_cpus();
+
+	lhp_wq = create_freezable_workqueue("load_hotplug");
+	if (!lhp_wq)
+		return -ENOMEM;
+	INIT_DELAYED_WORK_DEFERRABLE(&lhp_work, lhp_work_fn);
+
+	ret = sysfs_create_group(&cpu_sysdev_class.kset.kobj, &lhp_attr_group);
+	if (ret) {
+		destroy_workqueue(lhp_wq);
+		return ret;
+	}
+
+	register_pm_notifier(&lhp_pm_nb);
+
+	mutex_lock(&lhp_lock);
+	lhp_start();
+	mutex_unlock(&lhp_lock);
+
+	printk(KERN_INFO "%s: sampling every %ums\n", __func__,
+	       lhp_tunables.sample_ms);
+
+	return 0;
+}
+
+late_initcall(exynos_load_hotplug_init);
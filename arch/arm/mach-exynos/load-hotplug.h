@@ -0,0 +1,120 @@
+/* linux/arch/arm/mach-exynos/load-hotplug.h
+ *
+ * EXYNOS - decision model of the load based CPU hotplug policy
+ *
+ * Plain C without kernel dependencies: tools/power/hotplug-sim includes
+ * this file to replay recorded load traces through the very same model.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+*/
+
+#ifndef __MACH_EXYNOS_LOAD_HOTPLUG_H
+#define __MACH_EXYNOS_LOAD_HOTPLUG_H
+
+enum lhp_decision {
+	LHP_HOLD,		/* nothing to do */
+	LHP_UP_PENDING,		/* want a cpu up, waiting for up_delay_ms */
+	LHP_DOWN_PENDING,	/* want a cpu down, waiting for down_delay_ms */
+	LHP_UP,			/* bring a cpu up now */
+	LHP_DOWN,		/* take a cpu down now */
+};
+
+struct lhp_tunables {
+	unsigned int min_cpus;
+	unsigned int max_cpus;
+	unsigned int sample_ms;
+	/*
+	 * Averaged runnable tasks, in hundredths, beyond the online cpus
+	 * needed to bring one more up, and beyond the cpus that would remain
+	 * allowed when taking one down.
+	 */
+	unsigned int up_nr_running;
+	unsigned int down_nr_running;
+	/*
+	 * Utilization per online cpu, in percent of a cpu busy at its top
+	 * speed, needed to bring one more up; and per remaining cpu
+	 * allowed when taking one down.
+	 */
+	unsigned int up_util;
+	unsigned int down_util;
+	/* How long a condition has to hold before acting on it */
+	unsigned int up_delay_ms;
+	unsigned int down_delay_ms;
+};
+
+#define LHP_DEFAULT_TUNABLES(ncpus) {		\
+	.min_cpus		= 1,		\
+	.max_cpus		= (ncpus),	\
+	.sample_ms		= 100,		\
+	.up_nr_running		= 100,		\
+	.down_nr_running	= 50,		\
+	.up_util		= 60,		\
+	.down_util		= 40,		\
+	.up_delay_ms		= 200,		\
+	.down_delay_ms		= 1000,		\
+}
+
+struct lhp_state {
+	unsigned int avg_nr;	/* averaged nr_running, in hundredths */
+	unsigned int up_ms;	/* time the up condition has held */
+	unsigned int down_ms;	/* time the down condition has held */
+};
+
+/*
+ * Feeds one sample to the model: @nr_running runnable tasks, a total
+ * utilization of @util percent of one cpu and @online cpus online.
+ * nr_running is averaged with a weight of 1/4 per sample, each step
+ * rounded away from zero so that a steady nr_running is reached exactly;
+ * utilization is expected to be averaged already.
+ */
+static inline enum lhp_decision lhp_evaluate(const struct lhp_tunables *t,
+					     struct lhp_state *s,
+					     unsigned int nr_running,
+					     unsigned int util,
+					     unsigned int online)
+{
+	int delta = (int)(nr_running * 100) - (int)s->avg_nr;
+	int up, down;
+
+	s->avg_nr += (delta + (delta > 0 ? 3 : -3)) / 4;
+
+	if (online < t->min_cpus) {
+		s->up_ms = s->down_ms = 0;
+		return LHP_UP;
+	}
+	if (online > t->max_cpus) {
+		s->up_ms = s->down_ms = 0;
+		return LHP_DOWN;
+	}
+
+	up = online < t->max_cpus &&
+	     s->avg_nr >= online * 100 + t->up_nr_running &&
+	     util >= online * t->up_util;
+	down = online > t->min_cpus &&
+	       s->avg_nr <= (online - 1) * 100 + t->down_nr_running &&
+	       util <= (online - 1) * t->down_util;
+
+	if (up) {
+		s->down_ms = 0;
+		s->up_ms += t->sample_ms;
+		if (s->up_ms < t->up_delay_ms)
+			return LHP_UP_PENDING;
+		s->up_ms = 0;
+		return LHP_UP;
+	}
+	if (down) {
+		s->up_ms = 0;
+		s->down_ms += t->sample_ms;
+		if (s->down_ms < t->down_delay_ms)
+			return LHP_DOWN_PENDING;
+		s->down_ms = 0;
+		return LHP_DOWN;
+	}
+
+	s->up_ms = s->down_ms = 0;
+	return LHP_HOLD;
+}
+
+#endif /* __MACH_EXYNOS_LOAD_HOTPLUG_H */
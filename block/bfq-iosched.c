@@ -0,0 +1,1214 @@
+/*
+ *  Budget Fair Queueing i/o scheduler.
+ *
+ *  Every process has a queue for its sync requests, and async requests
+ *  are queued per i/o class.  The device is given to one queue at a time,
+ *  for a budget of sectors, and the queues are picked with B-WF2Q+: each
+ *  queue has a virtual start and finish time, its finish time advancing by
+ *  the service it received over its weight, and the eligible queue with
+ *  the earliest finish time is served next.  Bandwidth is then shared in
+ *  proportion to the weights, whatever the speed of the device.
+ *
+ *  Interactive processes, whose queue turns busy after a while without
+ *  i/o, have their weight raised for some time so that they get their
+ *  reads through a stream of writeback.  Async service is charged more
+ *  than sync service, and a sync request preempts an async queue.
+ *
+ *  Idling for the next request of a sync queue is only done on rotational
+ *  devices: it keeps a sequential reader from losing the disk head, which
+ *  buys nothing on flash.
+ *
+ *  See Documentation/block/bfq-iosched.txt
+ */
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/jiffies.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+#include <linux/iocontext.h>
+#include <linux/hash.h>
+#include <linux/math64.h>
+#include <linux/blktrace_api.h>
+
+/*
+ * tunables
+ */
+/* max time before a request is served out of sector order */
+static const int bfq_fifo_expire[2] = { HZ / 4, HZ / 8 };
+/* max time a queue stays in service, async and sync */
+static const int bfq_timeout[2] = { HZ / 25, HZ / 8 };
+/* max budget of a queue, in sectors */
+static const int bfq_max_budget = 16 * 1024;
+/* time to wait for the next request of a sync queue, rotational only */
+static int bfq_slice_idle = HZ / 125;
+/* async service is charged this many times its size */
+static const int bfq_async_charge_factor = 3;
+/* time the weight of an interactive queue stays raised */
+static const int bfq_wr_max_time = 3 * HZ;
+
+/* a queue idle for this long is interactive when it turns busy */
+#define BFQ_WR_MIN_IDLE_TIME	(2 * HZ)
+#define BFQ_WR_COEFF		10
+/* the budgets range from max_budget / BFQ_MIN_BUDGET_DIV to max_budget */
+#define BFQ_MIN_BUDGET_DIV	32
+#define BFQ_WEIGHT_COEFF	10
+#define BFQ_SERVICE_SHIFT	22
+/* a sync queue unused for this long is freed */
+#define BFQ_QUEUE_REAP_TIME	(10 * HZ)
+#define BFQ_HASH_BITS		6
+#define BFQ_NR_CLASSES		3
+
+#define RQ_BFQQ(rq)		((struct bfq_queue *) (rq)->elevator_private[0])
+
+static struct kmem_cache *bfq_pool;
+
+/*
+ * why a queue left service
+ */
+enum bfq_expiration {
+	BFQ_EXP_BUDGET_EXHAUSTED,
+	BFQ_EXP_BUDGET_TIMEOUT,
+	BFQ_EXP_TOO_IDLE,
+	BFQ_EXP_NO_MORE_REQUESTS,
+	BFQ_EXP_PREEMPTED,
+};
+
+/*
+ * The busy queues of an i/o class, not counting the one in service,
+ * sorted by finish time.  wsum is the weight of all the busy queues of
+ * the class, the one in service included.
+ */
+struct bfq_service_tree {
+	struct rb_root active;
+	u64 vtime;
+	unsigned long wsum;
+};
+
+struct bfq_queue {
+	struct bfq_data *bfqd;
+	/* requests allocated from this queue */
+	int ref;
+	unsigned int flags;
+	/* tgid of the process, 0 for the shared queues */
+	pid_t pid;
+	struct hlist_node hash;
+
+	/* position in the service tree of the class */
+	struct rb_node rb_node;
+	u64 start;
+	u64 finish;
+	/* weight accounted in the service tree */
+	unsigned int weight;
+	unsigned int wr_coeff;
+	unsigned long wr_end;
+
+	unsigned short ioprio, ioprio_class;
+	/* priority of the last submitter, applied when the queue turns busy */
+	unsigned short new_ioprio, new_ioprio_class;
+
+	/* sectors the queue may get, and got, in its current turn */
+	int budget;
+	int service;
+	unsigned long budget_timeout;
+	unsigned long last_busy;
+
+	/* sorted list and fifo of the queued requests */
+	struct rb_root sort_list;
+	struct list_head fifo;
+	struct request *next_rq;
+	/* requests in the driver */
+	int dispatched;
+};
+
+struct bfq_data {
+	struct request_queue *queue;
+
+	struct bfq_service_tree st[BFQ_NR_CLASSES];
+	struct bfq_queue *in_service;
+	unsigned int busy_queues;
+	int rq_in_driver;
+
+	struct hlist_head hash[1 << BFQ_HASH_BITS];
+	/* async queues, per class */
+	struct bfq_queue async_bfqq[BFQ_NR_CLASSES];
+	/* fallback when a queue cannot be allocated */
+	struct bfq_queue oom_bfqq;
+
+	struct timer_list idle_slice_timer;
+	struct work_struct unplug_work;
+
+	/*
+	 * tunables, see top of file
+	 */
+	unsigned int bfq_fifo_expire[2];
+	unsigned int bfq_timeout[2];
+	unsigned int bfq_max_budget;
+	unsigned int bfq_slice_idle;
+	unsigned int bfq_async_charge_factor;
+	unsigned int bfq_low_latency;
+	unsigned int bfq_wr_max_time;
+};
+
+enum bfqq_state_flags {
+	BFQ_BFQQ_FLAG_busy = 0,		/* has requests or is in service */
+	BFQ_BFQQ_FLAG_sync,		/* serves sync requests */
+	BFQ_BFQQ_FLAG_wait_request,	/* idling for the next request */
+};
+
+#define BFQ_BFQQ_FNS(name)						\
+static inline void bfq_mark_bfqq_##name(struct bfq_queue *bfqq)		\
+{									\
+	(bfqq)->flags |= (1 << BFQ_BFQQ_FLAG_##name);			\
+}									\
+static inline void bfq_clear_bfqq_##name(struct bfq_queue *bfqq)	\
+{									\
+	(bfqq)->flags &= ~(1 << BFQ_BFQQ_FLAG_##name);			\
+}									\
+static inline int bfq_bfqq_##name(const struct bfq_queue *bfqq)		\
+{									\
+	return ((bfqq)->flags & (1 << BFQ_BFQQ_FLAG_##name)) != 0;	\
+}
+
+BFQ_BFQQ_FNS(busy);
+BFQ_BFQQ_FNS(sync);
+BFQ_BFQQ_FNS(wait_request);
+#undef BFQ_BFQQ_FNS
+
+#define bfq_log_bfqq(bfqd, bfqq, fmt, args...)	\
+	blk_add_trace_msg((bfqd)->queue, "bfq%d%c " fmt, (bfqq)->pid, \
+			bfq_bfqq_sync((bfqq)) ? 'S' : 'A', ##args)
+
+#define bfq_class_idle(bfqq)	((bfqq)->ioprio_class == IOPRIO_CLASS_IDLE)
+#define bfq_class_rt(bfqq)	((bfqq)->ioprio_class == IOPRIO_CLASS_RT)
+
+/* virtual times wrap, compare them like jiffies */
+#define bfq_vtime_after(a, b)	((s64)((a) - (b)) > 0)
+
+static inline struct bfq_service_tree *
+bfq_st(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	return &bfqd->st[bfqq->ioprio_class - 1];
+}
+
+static inline bool bfq_bio_sync(struct bio *bio)
+{
+	return bio_data_dir(bio) == READ || (bio->bi_rw & REQ_SYNC);
+}
+
+static inline u64 bfq_delta(unsigned long service, unsigned long weight)
+{
+	return div_u64((u64)service << BFQ_SERVICE_SHIFT, weight);
+}
+
+static inline int bfq_min_budget(struct bfq_data *bfqd)
+{
+	return bfqd->bfq_max_budget / BFQ_MIN_BUDGET_DIV;
+}
+
+/*
+ * scheduler run of queue, if there are requests pending and no one in the
+ * driver that will restart queueing
+ */
+static inline void bfq_schedule_dispatch(struct bfq_data *bfqd)
+{
+	if (bfqd->busy_queues)
+		kblockd_schedule_work(bfqd->queue, &bfqd->unplug_work);
+}
+
+/*
+ * The i/o priority of the submitting task, from its io_context if it set
+ * one, from its nice value otherwise.
+ */
+static void bfq_current_ioprio(unsigned short *ioprio_class,
+			       unsigned short *ioprio)
+{
+	struct io_context *ioc = current->io_context;
+
+	if (ioc && ioprio_valid(ioc->ioprio)) {
+		*ioprio_class = task_ioprio_class(ioc);
+		*ioprio = task_ioprio(ioc);
+	} else {
+		*ioprio_class = task_nice_ioclass(current);
+		*ioprio = task_nice_ioprio(current);
+	}
+
+	if (*ioprio_class == IOPRIO_CLASS_IDLE)
+		*ioprio = IOPRIO_BE_NR - 1;
+}
+
+/*
+ * Recompute the weight of a busy queue: its priority, multiplied while it
+ * is raised.
+ */
+static void bfq_update_weight(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_service_tree *st = bfq_st(bfqd, bfqq);
+	unsigned int weight;
+
+	if (bfqq->wr_coeff > 1 && time_after(jiffies, bfqq->wr_end)) {
+		bfq_log_bfqq(bfqd, bfqq, "weight raising ended");
+		bfqq->wr_coeff = 1;
+	}
+
+	weight = (IOPRIO_BE_NR - bfqq->ioprio) * BFQ_WEIGHT_COEFF;
+	weight *= bfqq->wr_coeff;
+
+	st->wsum += weight - bfqq->weight;
+	bfqq->weight = weight;
+}
+
+static void bfq_st_insert(struct bfq_service_tree *st, struct bfq_queue *bfqq)
+{
+	struct rb_node **p = &st->active.rb_node;
+	struct rb_node *parent = NULL;
+	struct bfq_queue *__bfqq;
+
+	while (*p) {
+		parent = *p;
+		__bfqq = rb_entry(parent, struct bfq_queue, rb_node);
+
+		if (bfq_vtime_after(__bfqq->finish, bfqq->finish))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	rb_link_node(&bfqq->rb_node, parent, p);
+	rb_insert_color(&bfqq->rb_node, &st->active);
+}
+
+static void bfq_st_remove(struct bfq_service_tree *st, struct bfq_queue *bfqq)
+{
+	rb_erase(&bfqq->rb_node, &st->active);
+	RB_CLEAR_NODE(&bfqq->rb_node);
+}
+
+/*
+ * Queue a busy queue for service with its current budget.  A queue which
+ * was served beyond the virtual time starts where its last turn finished,
+ * the others start now.
+ */
+static void bfq_activate(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_service_tree *st = bfq_st(bfqd, bfqq);
+
+	if (bfq_vtime_after(bfqq->finish, st->vtime))
+		bfqq->start = bfqq->finish;
+	else
+		bfqq->start = st->vtime;
+
+	bfqq->finish = bfqq->start + bfq_delta(bfqq->budget, bfqq->weight);
+	bfq_st_insert(st, bfqq);
+}
+
+static void bfq_add_bfqq_busy(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	BUG_ON(bfq_bfqq_busy(bfqq));
+
+	bfqq->ioprio = bfqq->new_ioprio;
+	bfqq->ioprio_class = bfqq->new_ioprio_class;
+
+	if (bfqd->bfq_low_latency && bfq_bfqq_sync(bfqq) &&
+	    bfqq->ioprio_class == IOPRIO_CLASS_BE &&
+	    time_after(jiffies, bfqq->last_busy + BFQ_WR_MIN_IDLE_TIME)) {
+		bfqq->wr_coeff = BFQ_WR_COEFF;
+		bfqq->wr_end = jiffies + bfqd->bfq_wr_max_time;
+		bfq_log_bfqq(bfqd, bfqq, "weight raised");
+	}
+
+	bfq_mark_bfqq_busy(bfqq);
+	bfqd->busy_queues++;
+
+	bfqq->weight = 0;
+	bfq_update_weight(bfqd, bfqq);
+	bfq_activate(bfqd, bfqq);
+}
+
+static void bfq_del_bfqq_busy(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_service_tree *st = bfq_st(bfqd, bfqq);
+
+	BUG_ON(!bfq_bfqq_busy(bfqq));
+
+	if (!RB_EMPTY_NODE(&bfqq->rb_node))
+		bfq_st_remove(st, bfqq);
+
+	st->wsum -= bfqq->weight;
+	bfqq->weight = 0;
+
+	bfq_clear_bfqq_busy(bfqq);
+	BUG_ON(!bfqd->busy_queues);
+	bfqd->busy_queues--;
+	bfqq->last_busy = jiffies;
+}
+
+/*
+ * The eligible queue, started by the virtual time, with the earliest
+ * finish time.  When none is eligible the virtual time jumps to the
+ * earliest start.
+ */
+static struct bfq_queue *bfq_first_eligible(struct bfq_service_tree *st)
+{
+	struct bfq_queue *bfqq, *first = NULL;
+	struct rb_node *n;
+
+	for (n = rb_first(&st->active); n; n = rb_next(n)) {
+		bfqq = rb_entry(n, struct bfq_queue, rb_node);
+		if (!bfq_vtime_after(bfqq->start, st->vtime))
+			return bfqq;
+		if (!first || bfq_vtime_after(first->start, bfqq->start))
+			first = bfqq;
+	}
+
+	if (first)
+		st->vtime = first->start;
+	return first;
+}
+
+static struct bfq_queue *bfq_get_next_queue(struct bfq_data *bfqd)
+{
+	int i;
+
+	for (i = 0; i < BFQ_NR_CLASSES; i++) {
+		struct bfq_service_tree *st = &bfqd->st[i];
+
+		if (!RB_EMPTY_ROOT(&st->active))
+			return bfq_first_eligible(st);
+	}
+
+	return NULL;
+}
+
+static void bfq_set_in_service(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	bfq_st_remove(bfq_st(bfqd, bfqq), bfqq);
+
+	bfqq->budget = clamp_t(int, bfqq->budget, bfq_min_budget(bfqd),
+			       bfqd->bfq_max_budget);
+	bfqq->service = 0;
+	bfqq->budget_timeout = jiffies +
+			       bfqd->bfq_timeout[bfq_bfqq_sync(bfqq)];
+	bfq_clear_bfqq_wait_request(bfqq);
+
+	bfqd->in_service = bfqq;
+	bfq_log_bfqq(bfqd, bfqq, "set_in_service budget=%d weight=%u",
+		     bfqq->budget, bfqq->weight);
+}
+
+/*
+ * Adapt the budget of a queue to how it used its last turn: a queue
+ * which exhausted its budget gets more, one which went idle before the
+ * end gets less.
+ */
+static void bfq_update_budget(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			      enum bfq_expiration reason)
+{
+	switch (reason) {
+	case BFQ_EXP_BUDGET_EXHAUSTED:
+		bfqq->budget = min_t(int, bfqq->budget * 2,
+				     bfqd->bfq_max_budget);
+		break;
+	case BFQ_EXP_TOO_IDLE:
+		bfqq->budget = max_t(int, bfqq->service,
+				     bfq_min_budget(bfqd));
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Take the queue in service out of it, charging it the service it got.
+ * A queue which ran out of time is charged at least its budget, or slow
+ * random i/o would get the device for less than its share.
+ */
+static void bfq_expire(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+		       enum bfq_expiration reason)
+{
+	struct bfq_service_tree *st = bfq_st(bfqd, bfqq);
+	unsigned long charge = bfqq->service;
+
+	BUG_ON(bfqq != bfqd->in_service);
+
+	bfq_log_bfqq(bfqd, bfqq, "expire reason=%d service=%d budget=%d",
+		     reason, bfqq->service, bfqq->budget);
+
+	if (!bfq_bfqq_sync(bfqq))
+		charge *= bfqd->bfq_async_charge_factor;
+	if (reason == BFQ_EXP_BUDGET_TIMEOUT && charge < bfqq->budget)
+		charge = bfqq->budget;
+
+	bfqq->finish = bfqq->start + bfq_delta(charge, bfqq->weight);
+	st->vtime += bfq_delta(charge, st->wsum);
+
+	bfq_update_budget(bfqd, bfqq, reason);
+
+	del_timer(&bfqd->idle_slice_timer);
+	bfq_clear_bfqq_wait_request(bfqq);
+	bfqd->in_service = NULL;
+
+	if (RB_EMPTY_ROOT(&bfqq->sort_list)) {
+		bfq_del_bfqq_busy(bfqd, bfqq);
+	} else {
+		bfq_update_weight(bfqd, bfqq);
+		bfq_activate(bfqd, bfqq);
+	}
+}
+
+static inline bool bfq_may_idle(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	return bfqd->bfq_slice_idle && bfq_bfqq_sync(bfqq) &&
+	       !bfq_class_idle(bfqq) && !blk_queue_nonrot(bfqd->queue);
+}
+
+static void bfq_arm_slice_timer(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = bfqd->in_service;
+
+	bfq_mark_bfqq_wait_request(bfqq);
+	mod_timer(&bfqd->idle_slice_timer, jiffies + bfqd->bfq_slice_idle);
+	bfq_log_bfqq(bfqd, bfqq, "arm_idle: %u", bfqd->bfq_slice_idle);
+}
+
+/*
+ * The next request of a queue: the oldest one on flash, on a disk the
+ * next in sector order unless the oldest has expired.
+ */
+static struct request *bfq_choose_req(struct bfq_data *bfqd,
+				      struct bfq_queue *bfqq)
+{
+	struct request *rq = rq_entry_fifo(bfqq->fifo.next);
+
+	if (blk_queue_nonrot(bfqd->queue) ||
+	    !time_before(jiffies, rq_fifo_time(rq)))
+		return rq;
+
+	return bfqq->next_rq;
+}
+
+/*
+ * Select the queue to dispatch from, expiring the one in service if its
+ * turn is over.
+ */
+static struct bfq_queue *bfq_select_queue(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = bfqd->in_service;
+	enum bfq_expiration reason;
+	struct request *rq;
+
+	if (!bfqq)
+		goto new_queue;
+
+	if (time_after(jiffies, bfqq->budget_timeout)) {
+		reason = BFQ_EXP_BUDGET_TIMEOUT;
+		goto expire;
+	}
+
+	if (!RB_EMPTY_ROOT(&bfqq->sort_list)) {
+		rq = bfq_choose_req(bfqd, bfqq);
+		if (bfqq->service &&
+		    bfqq->service + blk_rq_sectors(rq) > bfqq->budget) {
+			reason = BFQ_EXP_BUDGET_EXHAUSTED;
+			goto expire;
+		}
+
+		if (bfq_bfqq_wait_request(bfqq)) {
+			del_timer(&bfqd->idle_slice_timer);
+			bfq_clear_bfqq_wait_request(bfqq);
+		}
+		return bfqq;
+	}
+
+	/*
+	 * The queue is empty.  Keep it in service while idling, or until
+	 * its requests in the driver complete and idling starts.
+	 */
+	if (bfq_bfqq_wait_request(bfqq))
+		return NULL;
+	if (bfq_may_idle(bfqd, bfqq)) {
+		if (!bfqq->dispatched)
+			bfq_arm_slice_timer(bfqd);
+		return NULL;
+	}
+
+	reason = BFQ_EXP_NO_MORE_REQUESTS;
+expire:
+	bfq_expire(bfqd, bfqq, reason);
+new_queue:
+	bfqq = bfq_get_next_queue(bfqd);
+	if (bfqq)
+		bfq_set_in_service(bfqd, bfqq);
+	return bfqq;
+}
+
+static void bfq_remove_request(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	if (bfqq->next_rq == rq) {
+		struct rb_node *n = rb_next(&rq->rb_node);
+
+		if (!n)
+			n = rb_first(&bfqq->sort_list);
+		bfqq->next_rq = n != &rq->rb_node ? rb_entry_rq(n) : NULL;
+	}
+
+	rq_fifo_clear(rq);
+	elv_rb_del(&bfqq->sort_list, rq);
+
+	if (RB_EMPTY_ROOT(&bfqq->sort_list) && bfq_bfqq_busy(bfqq) &&
+	    bfqq != bfqd->in_service)
+		bfq_del_bfqq_busy(bfqd, bfqq);
+}
+
+/*
+ * Move request from internal lists to the request queue dispatch list.
+ */
+static void bfq_dispatch_insert(struct request_queue *q, struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	bfq_remove_request(rq);
+	bfqq->dispatched++;
+	bfqq->service += blk_rq_sectors(rq);
+	elv_dispatch_sort(q, rq);
+}
+
+static void bfq_add_rq_rb(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct request *__alias;
+
+	/*
+	 * looks a little odd, but the first insert might return an alias.
+	 * if that happens, put the alias on the dispatch list
+	 */
+	while ((__alias = elv_rb_add(&bfqq->sort_list, rq)) != NULL)
+		bfq_dispatch_insert(bfqq->bfqd->queue, __alias);
+
+	if (!bfqq->next_rq)
+		bfqq->next_rq = rq;
+}
+
+/*
+ * Does the new request of bfqq deserve the device before the queue in
+ * service is done?
+ */
+static bool bfq_should_preempt(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			       struct request *rq)
+{
+	struct bfq_queue *in_service = bfqd->in_service;
+
+	if (!in_service)
+		return false;
+
+	if (bfq_class_idle(bfqq))
+		return false;
+	if (bfq_class_idle(in_service))
+		return true;
+
+	if (bfq_class_rt(bfqq) && !bfq_class_rt(in_service))
+		return true;
+	if (bfq_class_rt(in_service) || !rq_is_sync(rq))
+		return false;
+
+	/* sync requests preempt async ones */
+	if (!bfq_bfqq_sync(in_service))
+		return true;
+
+	/* an interactive process preempts one which is not */
+	return bfqq->wr_coeff > 1 && in_service->wr_coeff == 1;
+}
+
+static void bfq_insert_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	rq_set_fifo_time(rq, jiffies + bfqd->bfq_fifo_expire[rq_is_sync(rq)]);
+	list_add_tail(&rq->queuelist, &bfqq->fifo);
+	bfq_add_rq_rb(rq);
+
+	if (!bfq_bfqq_busy(bfqq))
+		bfq_add_bfqq_busy(bfqd, bfqq);
+
+	if (bfqq == bfqd->in_service) {
+		if (bfq_bfqq_wait_request(bfqq)) {
+			del_timer(&bfqd->idle_slice_timer);
+			bfq_clear_bfqq_wait_request(bfqq);
+			__blk_run_queue(q);
+		}
+	} else if (bfq_should_preempt(bfqd, bfqq, rq)) {
+		bfq_log_bfqq(bfqd, bfqq, "preempt");
+		bfq_expire(bfqd, bfqd->in_service, BFQ_EXP_PREEMPTED);
+		__blk_run_queue(q);
+	}
+}
+
+/*
+ * Drain all the queues, used when switching the elevator or on a barrier.
+ */
+static int bfq_forced_dispatch(struct bfq_data *bfqd)
+{
+	struct request_queue *q = bfqd->queue;
+	struct bfq_queue *bfqq;
+	struct rb_node *n;
+	int i, dispatched = 0;
+
+	if (bfqd->in_service)
+		bfq_expire(bfqd, bfqd->in_service, BFQ_EXP_PREEMPTED);
+
+	for (i = 0; i < BFQ_NR_CLASSES; i++) {
+		while ((n = rb_first(&bfqd->st[i].active)) != NULL) {
+			bfqq = rb_entry(n, struct bfq_queue, rb_node);
+			while (!RB_EMPTY_ROOT(&bfqq->sort_list)) {
+				bfq_dispatch_insert(q, bfqq->next_rq);
+				dispatched++;
+			}
+		}
+	}
+
+	BUG_ON(bfqd->busy_queues);
+	return dispatched;
+}
+
+static int bfq_dispatch_requests(struct request_queue *q, int force)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq;
+
+	if (!bfqd->busy_queues)
+		return 0;
+
+	if (unlikely(force))
+		return bfq_forced_dispatch(bfqd);
+
+	bfqq = bfq_select_queue(bfqd);
+	if (!bfqq)
+		return 0;
+
+	bfq_dispatch_insert(q, bfq_choose_req(bfqd, bfqq));
+	return 1;
+}
+
+static void bfq_activate_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	bfqd->rq_in_driver++;
+}
+
+static void bfq_deactivate_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	WARN_ON(!bfqd->rq_in_driver);
+	bfqd->rq_in_driver--;
+}
+
+static void bfq_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	WARN_ON(!bfqd->rq_in_driver);
+	WARN_ON(!bfqq->dispatched);
+	bfqd->rq_in_driver--;
+	bfqq->dispatched--;
+
+	/*
+	 * The last request of the queue in service is done, wait for the
+	 * next one from the same process.
+	 */
+	if (bfqq == bfqd->in_service && !bfqq->dispatched &&
+	    RB_EMPTY_ROOT(&bfqq->sort_list) && bfq_may_idle(bfqd, bfqq) &&
+	    !bfq_bfqq_wait_request(bfqq))
+		bfq_arm_slice_timer(bfqd);
+
+	if (!bfqd->rq_in_driver)
+		bfq_schedule_dispatch(bfqd);
+}
+
+static inline bool bfq_queue_unused(struct bfq_data *bfqd,
+				    struct bfq_queue *bfqq)
+{
+	return !bfqq->ref && !bfq_bfqq_busy(bfqq) &&
+	       time_after(jiffies, bfqq->last_busy + BFQ_QUEUE_REAP_TIME);
+}
+
+/*
+ * Find the sync queue of a process, freeing the unused queues of its
+ * hash chain on the way.
+ */
+static struct bfq_queue *bfq_find_sync_queue(struct bfq_data *bfqd, pid_t pid)
+{
+	struct hlist_head *head = &bfqd->hash[hash_32(pid, BFQ_HASH_BITS)];
+	struct bfq_queue *bfqq, *found = NULL;
+	struct hlist_node *entry, *next;
+
+	hlist_for_each_entry_safe(bfqq, entry, next, head, hash) {
+		if (bfqq->pid == pid) {
+			found = bfqq;
+		} else if (bfq_queue_unused(bfqd, bfqq)) {
+			hlist_del(&bfqq->hash);
+			kmem_cache_free(bfq_pool, bfqq);
+		}
+	}
+
+	return found;
+}
+
+/*
+ * The queue a request of the current task goes to, NULL if its sync
+ * queue does not exist yet.
+ */
+static struct bfq_queue *bfq_lookup_queue(struct bfq_data *bfqd, bool is_sync)
+{
+	unsigned short ioprio_class, ioprio;
+
+	if (!is_sync) {
+		bfq_current_ioprio(&ioprio_class, &ioprio);
+		return &bfqd->async_bfqq[ioprio_class - 1];
+	}
+
+	return bfq_find_sync_queue(bfqd, current->tgid);
+}
+
+static void bfq_init_bfqq(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			  pid_t pid, bool is_sync)
+{
+	bfqq->bfqd = bfqd;
+	bfqq->pid = pid;
+	RB_CLEAR_NODE(&bfqq->rb_node);
+	bfqq->sort_list = RB_ROOT;
+	INIT_LIST_HEAD(&bfqq->fifo);
+
+	if (is_sync)
+		bfq_mark_bfqq_sync(bfqq);
+
+	bfqq->ioprio_class = bfqq->new_ioprio_class = IOPRIO_CLASS_BE;
+	bfqq->ioprio = bfqq->new_ioprio = IOPRIO_NORM;
+	bfqq->wr_coeff = 1;
+	bfqq->budget = bfqd->bfq_max_budget / 4;
+	/* a new process counts as interactive */
+	bfqq->last_busy = jiffies - BFQ_WR_MIN_IDLE_TIME - 1;
+}
+
+/*
+ * queue lock must be held here, it is dropped to allocate a new queue
+ * if we may sleep
+ */
+static struct bfq_queue *
+bfq_get_queue(struct bfq_data *bfqd, bool is_sync, gfp_t gfp_mask)
+{
+	struct bfq_queue *bfqq, *new_bfqq = NULL;
+	unsigned short ioprio_class, ioprio;
+	pid_t pid = current->tgid;
+
+	bfq_current_ioprio(&ioprio_class, &ioprio);
+	if (!is_sync)
+		return &bfqd->async_bfqq[ioprio_class - 1];
+
+	bfqq = bfq_find_sync_queue(bfqd, pid);
+	if (!bfqq) {
+		if (gfp_mask & __GFP_WAIT) {
+			spin_unlock_irq(bfqd->queue->queue_lock);
+			new_bfqq = kmem_cache_alloc_node(bfq_pool,
+					gfp_mask | __GFP_ZERO,
+					bfqd->queue->node);
+			spin_lock_irq(bfqd->queue->queue_lock);
+			bfqq = bfq_find_sync_queue(bfqd, pid);
+		} else {
+			new_bfqq = kmem_cache_alloc_node(bfq_pool,
+					gfp_mask | __GFP_ZERO,
+					bfqd->queue->node);
+		}
+
+		if (bfqq) {
+			if (new_bfqq)
+				kmem_cache_free(bfq_pool, new_bfqq);
+		} else if (new_bfqq) {
+			bfqq = new_bfqq;
+			bfq_init_bfqq(bfqd, bfqq, pid, true);
+			hlist_add_head(&bfqq->hash,
+				&bfqd->hash[hash_32(pid, BFQ_HASH_BITS)]);
+			bfq_log_bfqq(bfqd, bfqq, "alloced");
+		} else {
+			bfqq = &bfqd->oom_bfqq;
+		}
+	}
+
+	bfqq->new_ioprio_class = ioprio_class;
+	bfqq->new_ioprio = ioprio;
+	return bfqq;
+}
+
+static int
+bfq_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq;
+	unsigned long flags;
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	bfqq = bfq_get_queue(bfqd, rq_is_sync(rq), gfp_mask);
+	bfqq->ref++;
+	rq->elevator_private[0] = bfqq;
+	spin_unlock_irqrestore(q->queue_lock, flags);
+
+	return 0;
+}
+
+/*
+ * queue lock held here
+ */
+static void bfq_put_request(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	if (bfqq) {
+		BUG_ON(!bfqq->ref);
+		bfqq->ref--;
+		rq->elevator_private[0] = NULL;
+	}
+}
+
+static int bfq_may_queue(struct request_queue *q, int rw)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq;
+
+	/*
+	 * Let the process we are idling for allocate a request even if the
+	 * queue is congested, or the idling is wasted.
+	 */
+	bfqq = bfqd->in_service;
+	if (bfqq && bfq_bfqq_wait_request(bfqq) &&
+	    bfq_lookup_queue(bfqd, rw_is_sync(rw)) == bfqq)
+		return ELV_MQUEUE_MUST;
+
+	return ELV_MQUEUE_MAY;
+}
+
+static int bfq_merge(struct request_queue *q, struct request **req,
+		     struct bio *bio)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq;
+	struct request *__rq;
+
+	bfqq = bfq_lookup_queue(bfqd, bfq_bio_sync(bio));
+	if (!bfqq)
+		return ELEVATOR_NO_MERGE;
+
+	__rq = elv_rb_find(&bfqq->sort_list, bio->bi_sector + bio_sectors(bio));
+	if (__rq && elv_rq_merge_ok(__rq, bio)) {
+		*req = __rq;
+		return ELEVATOR_FRONT_MERGE;
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void bfq_merged_request(struct request_queue *q, struct request *req,
+			       int type)
+{
+	if (type == ELEVATOR_FRONT_MERGE) {
+		struct bfq_queue *bfqq = RQ_BFQQ(req);
+
+		elv_rb_del(&bfqq->sort_list, req);
+		bfq_add_rq_rb(req);
+	}
+}
+
+static void
+bfq_merged_requests(struct request_queue *q, struct request *rq,
+		    struct request *next)
+{
+	/*
+	 * reposition in fifo if next is older than rq
+	 */
+	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist) &&
+	    time_before(rq_fifo_time(next), rq_fifo_time(rq))) {
+		list_move(&rq->queuelist, &next->queuelist);
+		rq_set_fifo_time(rq, rq_fifo_time(next));
+	}
+
+	bfq_remove_request(next);
+}
+
+static int bfq_allow_merge(struct request_queue *q, struct request *rq,
+			   struct bio *bio)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	/*
+	 * Disallow merge of a sync bio into an async request.
+	 */
+	if (bfq_bio_sync(bio) && !rq_is_sync(rq))
+		return false;
+
+	/*
+	 * Allow merge only if rq is queued where the bio would be.
+	 */
+	return bfq_lookup_queue(bfqd, bfq_bio_sync(bio)) == RQ_BFQQ(rq);
+}
+
+static void bfq_kick_queue(struct work_struct *work)
+{
+	struct bfq_data *bfqd =
+		container_of(work, struct bfq_data, unplug_work);
+	struct request_queue *q = bfqd->queue;
+
+	spin_lock_irq(q->queue_lock);
+	__blk_run_queue(q);
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * Timer running if the queue in service is idling
+ */
+static void bfq_idle_slice_timer(unsigned long data)
+{
+	struct bfq_data *bfqd = (struct bfq_data *) data;
+	struct bfq_queue *bfqq;
+	unsigned long flags;
+
+	spin_lock_irqsave(bfqd->queue->queue_lock, flags);
+
+	bfqq = bfqd->in_service;
+	if (bfqq && bfq_bfqq_wait_request(bfqq)) {
+		bfq_log_bfqq(bfqd, bfqq, "idle timer fired");
+		if (RB_EMPTY_ROOT(&bfqq->sort_list))
+			bfq_expire(bfqd, bfqq, BFQ_EXP_TOO_IDLE);
+		else
+			bfq_clear_bfqq_wait_request(bfqq);
+	}
+
+	bfq_schedule_dispatch(bfqd);
+
+	spin_unlock_irqrestore(bfqd->queue->queue_lock, flags);
+}
+
+static void bfq_shutdown_timer_wq(struct bfq_data *bfqd)
+{
+	del_timer_sync(&bfqd->idle_slice_timer);
+	cancel_work_sync(&bfqd->unplug_work);
+}
+
+static void bfq_exit_queue(struct elevator_queue *e)
+{
+	struct bfq_data *bfqd = e->elevator_data;
+	struct request_queue *q = bfqd->queue;
+	struct hlist_node *entry, *next;
+	struct bfq_queue *bfqq;
+	int i;
+
+	bfq_shutdown_timer_wq(bfqd);
+
+	spin_lock_irq(q->queue_lock);
+
+	if (bfqd->in_service)
+		bfq_expire(bfqd, bfqd->in_service, BFQ_EXP_PREEMPTED);
+
+	for (i = 0; i < ARRAY_SIZE(bfqd->hash); i++) {
+		hlist_for_each_entry_safe(bfqq, entry, next, &bfqd->hash[i],
+					  hash) {
+			hlist_del(&bfqq->hash);
+			kmem_cache_free(bfq_pool, bfqq);
+		}
+	}
+
+	spin_unlock_irq(q->queue_lock);
+
+	bfq_shutdown_timer_wq(bfqd);
+
+	kfree(bfqd);
+}
+
+static void *bfq_init_queue(struct request_queue *q)
+{
+	struct bfq_data *bfqd;
+	int i;
+
+	bfqd = kmalloc_node(sizeof(*bfqd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!bfqd)
+		return NULL;
+
+	bfqd->queue = q;
+
+	bfqd->bfq_fifo_expire[0] = bfq_fifo_expire[0];
+	bfqd->bfq_fifo_expire[1] = bfq_fifo_expire[1];
+	bfqd->bfq_timeout[0] = bfq_timeout[0];
+	bfqd->bfq_timeout[1] = bfq_timeout[1];
+	bfqd->bfq_max_budget = bfq_max_budget;
+	bfqd->bfq_slice_idle = bfq_slice_idle;
+	bfqd->bfq_async_charge_factor = bfq_async_charge_factor;
+	bfqd->bfq_low_latency = 1;
+	bfqd->bfq_wr_max_time = bfq_wr_max_time;
+
+	for (i = 0; i < BFQ_NR_CLASSES; i++)
+		bfqd->st[i].active = RB_ROOT;
+
+	for (i = 0; i < ARRAY_SIZE(bfqd->hash); i++)
+		INIT_HLIST_HEAD(&bfqd->hash[i]);
+
+	for (i = 0; i < BFQ_NR_CLASSES; i++) {
+		struct bfq_queue *bfqq = &bfqd->async_bfqq[i];
+
+		bfq_init_bfqq(bfqd, bfqq, 0, false);
+		bfqq->ioprio_class = bfqq->new_ioprio_class = i + 1;
+	}
+	bfq_init_bfqq(bfqd, &bfqd->oom_bfqq, 0, true);
+
+	init_timer(&bfqd->idle_slice_timer);
+	bfqd->idle_slice_timer.function = bfq_idle_slice_timer;
+	bfqd->idle_slice_timer.data = (unsigned long) bfqd;
+
+	INIT_WORK(&bfqd->unplug_work, bfq_kick_queue);
+
+	return bfqd;
+}
+
+/*
+ * sysfs parts below -->
+ */
+static ssize_t
+bfq_var_show(unsigned int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+bfq_var_store(unsigned int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtoul(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct bfq_data *bfqd = e->elevator_data;			\
+	unsigned int __data = __VAR;					\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return bfq_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(bfq_fifo_expire_sync_show, bfqd->bfq_fifo_expire[1], 1);
+SHOW_FUNCTION(bfq_fifo_expire_async_show, bfqd->bfq_fifo_expire[0], 1);
+SHOW_FUNCTION(bfq_timeout_sync_show, bfqd->bfq_timeout[1], 1);
+SHOW_FUNCTION(bfq_timeout_async_show, bfqd->bfq_timeout[0], 1);
+SHOW_FUNCTION(bfq_max_budget_show, bfqd->bfq_max_budget, 0);
+SHOW_FUNCTION(bfq_slice_idle_show, bfqd->bfq_slice_idle, 1);
+SHOW_FUNCTION(bfq_async_charge_factor_show, bfqd->bfq_async_charge_factor, 0);
+SHOW_FUNCTION(bfq_low_latency_show, bfqd->bfq_low_latency, 0);
+SHOW_FUNCTION(bfq_wr_max_time_show, bfqd->bfq_wr_max_time, 1);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct bfq_data *bfqd = e->elevator_data;			\
+	unsigned int __data;						\
+	int ret = bfq_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(bfq_fifo_expire_sync_store, &bfqd->bfq_fifo_expire[1], 1,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_fifo_expire_async_store, &bfqd->bfq_fifo_expire[0], 1,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_timeout_sync_store, &bfqd->bfq_timeout[1], 1, INT_MAX, 1);
+STORE_FUNCTION(bfq_timeout_async_store, &bfqd->bfq_timeout[0], 1, INT_MAX, 1);
+STORE_FUNCTION(bfq_max_budget_store, &bfqd->bfq_max_budget,
+		BFQ_MIN_BUDGET_DIV, INT_MAX / 4, 0);
+STORE_FUNCTION(bfq_slice_idle_store, &bfqd->bfq_slice_idle, 0, UINT_MAX, 1);
+STORE_FUNCTION(bfq_async_charge_factor_store, &bfqd->bfq_async_charge_factor,
+		1, 64, 0);
+STORE_FUNCTION(bfq_low_latency_store, &bfqd->bfq_low_latency, 0, 1, 0);
+STORE_FUNCTION(bfq_wr_max_time_store, &bfqd->bfq_wr_max_time, 0, INT_MAX, 1);
+#undef STORE_FUNCTION
+
+#define BFQ_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, bfq_##name##_show, bfq_##name##_store)
+
+static struct elv_fs_entry bfq_attrs[] = {
+	BFQ_ATTR(fifo_expire_sync),
+	BFQ_ATTR(fifo_expire_async),
+	BFQ_ATTR(timeout_sync),
+	BFQ_ATTR(timeout_async),
+	BFQ_ATTR(max_budget),
+	BFQ_ATTR(slice_idle),
+	BFQ_ATTR(async_charge_factor),
+	BFQ_ATTR(low_latency),
+	BFQ_ATTR(wr_max_time),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_bfq = {
+	.ops = {
+		.elevator_merge_fn = 		bfq_merge,
+		.elevator_merged_fn =		bfq_merged_request,
+		.elevator_merge_req_fn =	bfq_merged_requests,
+		.elevator_allow_merge_fn =	bfq_allow_merge,
+		.elevator_dispatch_fn =		bfq_dispatch_requests,
+		.elevator_add_req_fn =		bfq_insert_request,
+		.elevator_activate_req_fn =	bfq_activate_request,
+		.elevator_deactivate_req_fn =	bfq_deactivate_request,
+		.elevator_completed_req_fn =	bfq_completed_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_set_req_fn =		bfq_set_request,
+		.elevator_put_req_fn =		bfq_put_request,
+		.elevator_may_queue_fn =	bfq_may_queue,
+		.elevator_init_fn =		bfq_init_queue,
+		.elevator_exit_fn =		bfq_exit_queue,
+	},
+	.elevator_attrs =	bfq_attrs,
+	.elevator_name =	"bfq",
+	.elevator_owner =	THIS_MODULE,
+};
+
+static int __init bfq_init(void)
+{
+	/*
+	 * could be 0 on HZ < 1000 setups
+	 */
+	if (!bfq_slice_idle)
+		bfq_slice_idle = 1;
+
+	bfq_pool = KMEM_CACHE(bfq_queue, 0);
+	if (!bfq_pool)
+		return -ENOMEM;
+
+	elv_register(&iosched_bfq);
+
+	return 0;
+}
+
+static void __exit bfq_exit(void)
+{
+	elv_unregister(&iosched_bfq);
+	kmem_cache_destroy(bfq_pool);
+}
+
+module_init(bfq_init);
+module_exit(bfq_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Budget Fair Queueing IO scheduler");
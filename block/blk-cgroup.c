@@ -119,6 +119,18 @@ struct blkio_cgroup *task_blkio_cgroup(struct task_struct *tsk)
 }
 EXPORT_SYMBOL_GPL(task_blkio_cgroup);
 
+/* Returns the cgroup of css id @id, or NULL if it is gone. Under rcu. */
+struct blkio_cgroup *blkio_cgroup_lookup(unsigned short id)
+{
+	struct cgroup_subsys_state *css;
+
+	css = css_lookup(&blkio_subsys, id);
+	if (!css)
+		return NULL;
+	return container_of(css, struct blkio_cgroup, css);
+}
+EXPORT_SYMBOL_GPL(blkio_cgroup_lookup);
+
 static inline void
 blkio_update_group_weight(struct blkio_group *blkg, unsigned int weight)
 {
@@ -180,6 +192,23 @@ static inline void blkio_update_group_iops(struct blkio_group *blkg,
 	}
 }
 
+static inline void blkio_update_group_latency_target(struct blkio_group *blkg,
+			unsigned int latency)
+{
+	struct blkio_policy_type *blkiop;
+
+	list_for_each_entry(blkiop, &blkio_list, list) {
+
+		/* If this policy does not own the blkg, do not send updates */
+		if (blkiop->plid != blkg->plid)
+			continue;
+
+		if (blkiop->ops.blkio_update_group_latency_target_fn)
+			blkiop->ops.blkio_update_group_latency_target_fn(
+						blkg->key, blkg, latency);
+	}
+}
+
 /*
  * Add to the appropriate stat variable depending on the request type.
  * This should be called with the blkg->stats_lock held.
@@ -439,6 +468,50 @@ void blkiocg_update_completion_stats(struct blkio_group *blkg,
 }
 EXPORT_SYMBOL_GPL(blkiocg_update_completion_stats);
 
+static int blkio_lat_bucket(uint64_t usecs)
+{
+	int order;
+
+	if (usecs < BLKIO_LAT_LINEAR)
+		return usecs;
+
+	order = fls64(usecs) - 1;
+	if (order >= BLKIO_LAT_MAX_ORDER)
+		return BLKIO_LAT_BUCKETS - 1;
+
+	return BLKIO_LAT_LINEAR +
+		((order - BLKIO_LAT_SUB_BITS - 1) << BLKIO_LAT_SUB_BITS) +
+		((usecs >> (order - BLKIO_LAT_SUB_BITS)) &
+		 ((1 << BLKIO_LAT_SUB_BITS) - 1));
+}
+
+/* The largest latency in usecs which falls in @bucket */
+static uint64_t blkio_lat_bucket_max(int bucket)
+{
+	int order, sub;
+
+	if (bucket < BLKIO_LAT_LINEAR)
+		return bucket;
+
+	bucket -= BLKIO_LAT_LINEAR;
+	order = (bucket >> BLKIO_LAT_SUB_BITS) + BLKIO_LAT_SUB_BITS + 1;
+	sub = bucket & ((1 << BLKIO_LAT_SUB_BITS) - 1);
+
+	return (((uint64_t)(1 << BLKIO_LAT_SUB_BITS) + sub + 1)
+				<< (order - BLKIO_LAT_SUB_BITS)) - 1;
+}
+
+void blkiocg_update_latency_stats(struct blkio_group *blkg, uint64_t usecs,
+					bool direction)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&blkg->stats_lock, flags);
+	blkg->stats.lat_hist[direction][blkio_lat_bucket(usecs)]++;
+	spin_unlock_irqrestore(&blkg->stats_lock, flags);
+}
+EXPORT_SYMBOL_GPL(blkiocg_update_latency_stats);
+
 /*  Merged stats are per cpu.  */
 void blkiocg_update_io_merged_stats(struct blkio_group *blkg, bool direction,
 					bool sync)
@@ -665,6 +738,57 @@ static uint64_t blkio_fill_stat(char *str, int chars_left, uint64_t val,
 	return val;
 }
 
+/* Percentiles shown by io_latency, in tenths of a percent */
+static const int blkio_lat_pct[] = { 500, 900, 990, 999 };
+
+/*
+ * Fills "maj:min Read p50" ... "maj:min Write p99.9" with the completion
+ * latency percentiles in usecs, and "maj:min Read count" with the number
+ * of samples.  Should be called with blkg->stats_lock held.
+ */
+static uint64_t blkio_get_latency_stat(struct blkio_group *blkg,
+		struct cgroup_map_cb *cb, dev_t dev)
+{
+	char key_str[MAX_KEY_LEN], pct_str[16];
+	uint64_t *hist, nr, sum, want;
+	int rw, i, b;
+
+	for (rw = READ; rw <= WRITE; rw++) {
+		hist = blkg->stats.lat_hist[rw];
+		for (nr = 0, b = 0; b < BLKIO_LAT_BUCKETS; b++)
+			nr += hist[b];
+
+		blkio_get_key_name(rw == READ ? BLKIO_STAT_READ :
+				BLKIO_STAT_WRITE, dev, key_str, MAX_KEY_LEN,
+				false);
+		strlcat(key_str, " count", MAX_KEY_LEN);
+		cb->fill(cb, key_str, nr);
+
+		for (i = 0, b = 0, sum = 0; i < ARRAY_SIZE(blkio_lat_pct);
+				i++) {
+			want = nr * blkio_lat_pct[i] + 999;
+			do_div(want, 1000);
+			while (nr && b < BLKIO_LAT_BUCKETS - 1 &&
+					sum + hist[b] < want)
+				sum += hist[b++];
+
+			blkio_get_key_name(rw == READ ? BLKIO_STAT_READ :
+					BLKIO_STAT_WRITE, dev, key_str,
+					MAX_KEY_LEN, false);
+			if (blkio_lat_pct[i] % 10)
+				snprintf(pct_str, sizeof(pct_str), " p%d.%d",
+					blkio_lat_pct[i] / 10,
+					blkio_lat_pct[i] % 10);
+			else
+				snprintf(pct_str, sizeof(pct_str), " p%d",
+					blkio_lat_pct[i] / 10);
+			strlcat(key_str, pct_str, MAX_KEY_LEN);
+			cb->fill(cb, key_str, nr ? blkio_lat_bucket_max(b) : 0);
+		}
+	}
+	return 0;
+}
+
 
 static uint64_t blkio_read_stat_cpu(struct blkio_group *blkg,
 			enum stat_type_cpu type, enum stat_sub_type sub_type)
@@ -729,6 +853,8 @@ static uint64_t blkio_get_stat(struct blkio_group *blkg,
 	if (type == BLKIO_STAT_TIME)
 		return blkio_fill_stat(key_str, MAX_KEY_LEN - 1,
 					blkg->stats.time, cb, dev);
+	if (type == BLKIO_STAT_LATENCY)
+		return blkio_get_latency_stat(blkg, cb, dev);
 #ifdef CONFIG_DEBUG_BLK_CGROUP
 	if (type == BLKIO_STAT_UNACCOUNTED_TIME)
 		return blkio_fill_stat(key_str, MAX_KEY_LEN - 1,
@@ -866,6 +992,14 @@ static int blkio_policy_parse_and_set(char *buf,
 			newpn->fileid = fileid;
 			newpn->val.iops = (unsigned int)temp;
 			break;
+		case BLKIO_THROTL_latency_target_device:
+			if (temp > UINT_MAX)
+				return -EINVAL;
+
+			newpn->plid = plid;
+			newpn->fileid = fileid;
+			newpn->val.latency = (unsigned int)temp;
+			break;
 		}
 		break;
 	default:
@@ -935,6 +1069,18 @@ unsigned int blkcg_get_write_iops(struct blkio_cgroup *blkcg, dev_t dev)
 		return -1;
 }
 
+unsigned int blkcg_get_latency_target(struct blkio_cgroup *blkcg, dev_t dev)
+{
+	struct blkio_policy_node *pn;
+
+	pn = blkio_policy_search_node(blkcg, dev, BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_latency_target_device);
+	if (pn)
+		return pn->val.latency;
+	else
+		return 0;
+}
+
 /* Checks whether user asked for deleting a policy rule */
 static bool blkio_delete_rule_command(struct blkio_policy_node *pn)
 {
@@ -954,6 +1100,10 @@ static bool blkio_delete_rule_command(struct blkio_policy_node *pn)
 		case BLKIO_THROTL_write_iops_device:
 			if (pn->val.iops == 0)
 				return 1;
+			break;
+		case BLKIO_THROTL_latency_target_device:
+			if (pn->val.latency == 0)
+				return 1;
 		}
 		break;
 	default:
@@ -979,6 +1129,9 @@ static void blkio_update_policy_rule(struct blkio_policy_node *oldpn,
 		case BLKIO_THROTL_read_iops_device:
 		case BLKIO_THROTL_write_iops_device:
 			oldpn->val.iops = newpn->val.iops;
+			break;
+		case BLKIO_THROTL_latency_target_device:
+			oldpn->val.latency = newpn->val.latency;
 		}
 		break;
 	default:
@@ -1014,6 +1167,10 @@ static void blkio_update_blkg_policy(struct blkio_cgroup *blkcg,
 			iops = pn->val.iops ? pn->val.iops : (-1);
 			blkio_update_group_iops(blkg, iops, pn->fileid);
 			break;
+		case BLKIO_THROTL_latency_target_device:
+			blkio_update_group_latency_target(blkg,
+							pn->val.latency);
+			break;
 		}
 		break;
 	default:
@@ -1124,6 +1281,10 @@ blkio_print_policy_node(struct seq_file *m, struct blkio_policy_node *pn)
 				seq_printf(m, "%u:%u\t%u\n", MAJOR(pn->dev),
 					MINOR(pn->dev), pn->val.iops);
 				break;
+			case BLKIO_THROTL_latency_target_device:
+				seq_printf(m, "%u:%u\t%u\n", MAJOR(pn->dev),
+					MINOR(pn->dev), pn->val.latency);
+				break;
 			}
 			break;
 		default:
@@ -1173,6 +1334,7 @@ static int blkiocg_file_read(struct cgroup *cgrp, struct cftype *cft,
 		case BLKIO_THROTL_write_bps_device:
 		case BLKIO_THROTL_read_iops_device:
 		case BLKIO_THROTL_write_iops_device:
+		case BLKIO_THROTL_latency_target_device:
 			blkio_read_policy_node_files(cft, blkcg, m);
 			return 0;
 		default:
@@ -1285,6 +1447,9 @@ static int blkiocg_file_read_map(struct cgroup *cgrp, struct cftype *cft,
 		case BLKIO_THROTL_io_serviced:
 			return blkio_read_blkg_stats(blkcg, cft, cb,
 						BLKIO_STAT_CPU_SERVICED, 1, 1);
+		case BLKIO_THROTL_io_latency:
+			return blkio_read_blkg_stats(blkcg, cft, cb,
+						BLKIO_STAT_LATENCY, 0, 0);
 		default:
 			BUG();
 		}
@@ -1481,6 +1646,20 @@ struct cftype blkio_files[] = {
 				BLKIO_THROTL_io_serviced),
 		.read_map = blkiocg_file_read_map,
 	},
+	{
+		.name = "throttle.latency_target_device",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_latency_target_device),
+		.read_seq_string = blkiocg_file_read,
+		.write_string = blkiocg_file_write,
+		.max_write_len = 256,
+	},
+	{
+		.name = "throttle.io_latency",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_io_latency),
+		.read_map = blkiocg_file_read_map,
+	},
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
 #ifdef CONFIG_DEBUG_BLK_CGROUP
@@ -0,0 +1,141 @@
+/*
+ * Tag allocation for the multi-queue block layer
+ *
+ * Every hardware queue has a bitmap of queue_depth tags, the tag of a request
+ * is its index in the preallocated requests of that queue.  Allocation is
+ * lockless: each cpu starts looking for a free bit after the tag it last
+ * got, which spreads the cpus over the bitmap and mostly keeps them from
+ * bouncing the same cache lines.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/blkdev.h>
+
+#include "blk-mq.h"
+
+struct blk_mq_tags {
+	unsigned int nr_tags;
+	unsigned long *map;
+	unsigned int __percpu *hint;
+	wait_queue_head_t wait;
+};
+
+static int __blk_mq_get_tag(struct blk_mq_tags *tags)
+{
+	unsigned int start, tag;
+
+	start = this_cpu_read(*tags->hint);
+	if (start >= tags->nr_tags)
+		start = 0;
+
+	tag = start;
+	do {
+		tag = find_next_zero_bit(tags->map, tags->nr_tags, tag);
+		if (tag >= tags->nr_tags) {
+			if (!start)
+				return -1;
+			/* wrap around once, and look below the hint */
+			tag = find_first_zero_bit(tags->map, start);
+			if (tag >= start)
+				return -1;
+			start = 0;
+		}
+	} while (test_and_set_bit(tag, tags->map));
+
+	this_cpu_write(*tags->hint, tag + 1);
+	return tag;
+}
+
+bool blk_mq_has_free_tags(struct blk_mq_tags *tags)
+{
+	return find_first_zero_bit(tags->map, tags->nr_tags) < tags->nr_tags;
+}
+
+/*
+ * Returns a free tag, or -1 if there is none and @gfp does not allow
+ * waiting for one to be released.
+ */
+int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp)
+{
+	DEFINE_WAIT(wait);
+	int tag;
+
+	tag = __blk_mq_get_tag(tags);
+	if (tag >= 0 || !(gfp & __GFP_WAIT))
+		return tag;
+
+	for (;;) {
+		prepare_to_wait_exclusive(&tags->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		tag = __blk_mq_get_tag(tags);
+		if (tag >= 0)
+			break;
+		io_schedule();
+	}
+	finish_wait(&tags->wait, &wait);
+
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	BUG_ON(tag >= tags->nr_tags);
+
+	clear_bit(tag, tags->map);
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node)
+{
+	struct blk_mq_tags *tags;
+
+	tags = kzalloc_node(sizeof(*tags), GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->nr_tags = nr_tags;
+	init_waitqueue_head(&tags->wait);
+
+	tags->map = kzalloc_node(BITS_TO_LONGS(nr_tags) * sizeof(long),
+				 GFP_KERNEL, node);
+	if (!tags->map)
+		goto err_free;
+
+	tags->hint = alloc_percpu(unsigned int);
+	if (!tags->hint)
+		goto err_free_map;
+
+	return tags;
+
+err_free_map:
+	kfree(tags->map);
+err_free:
+	kfree(tags);
+	return NULL;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	free_percpu(tags->hint);
+	kfree(tags->map);
+	kfree(tags);
+}
+
+ssize_t blk_mq_tag_sysfs_show(struct blk_mq_tags *tags, char *page)
+{
+	unsigned int used;
+
+	if (!tags)
+		return 0;
+
+	used = bitmap_weight(tags->map, tags->nr_tags);
+	return sprintf(page, "nr_tags=%u, nr_free=%u\n", tags->nr_tags,
+		       tags->nr_tags - used);
+}
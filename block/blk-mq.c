@@ -0,0 +1,978 @@
+/*
+ * Multi-queue block layer
+ *
+ * Bios are turned into requests and staged on a software queue per cpu,
+ * each of which is mapped to one of the hardware queues of the driver.
+ * Requests are preallocated per hardware queue and identified by a tag,
+ * and a hardware queue is run by gathering the software queues mapped to
+ * it and handing their requests to the driver.  There is no queue_lock and
+ * no elevator: the submission path only takes the lock of the local
+ * software queue, dispatch the lock of the hardware queue.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/smp.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/log2.h>
+#include <linux/hrtimer.h>
+#include <linux/sched.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-wbt.h"
+
+static struct blk_mq_ctx *__blk_mq_get_ctx(struct request_queue *q,
+					   unsigned int cpu)
+{
+	return per_cpu_ptr(q->queue_ctx, cpu);
+}
+
+/*
+ * This assumes per-cpu software queueing queues. They could be per-node
+ * as well, for instance. For now this is hardcoded as-is. Note that we don't
+ * care about preemption, since we know the ctx's are persistent. This does
+ * mean that we can't rely on ctx always matching the currently running CPU.
+ */
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return __blk_mq_get_ctx(q, get_cpu());
+}
+
+static void blk_mq_put_ctx(struct blk_mq_ctx *ctx)
+{
+	put_cpu();
+}
+
+/*
+ * Spread the possible cpus evenly over the hardware queues, consecutive
+ * cpus sharing a queue.
+ */
+static void blk_mq_update_queue_map(unsigned int *map,
+				    unsigned int nr_queues)
+{
+	unsigned int i = 0, nr_cpus = num_possible_cpus();
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		map[cpu] = i++ * nr_queues / nr_cpus;
+}
+
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+static void blk_mq_hctx_mark_pending(struct blk_mq_hw_ctx *hctx,
+				     struct blk_mq_ctx *ctx)
+{
+	if (!test_bit(ctx->index_hw, hctx->ctx_map))
+		set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+static struct request *__blk_mq_alloc_request(struct blk_mq_hw_ctx *hctx,
+					      struct blk_mq_ctx *ctx,
+					      int rw, gfp_t gfp)
+{
+	struct request *rq;
+	int tag;
+
+	tag = blk_mq_get_tag(hctx->tags, gfp);
+	if (tag < 0)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	blk_rq_init(hctx->queue, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+	rq->cmd_flags = rw;
+	return rq;
+}
+
+/*
+ * Get a request, waiting for a tag if @gfp allows it.  Before waiting, run
+ * the hardware queue: what is staged on the software queues holds tags,
+ * and would otherwise only be dispatched by the next submission.
+ */
+static struct request *blk_mq_alloc_request_wait(struct request_queue *q,
+						 int rw, gfp_t gfp)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	rq = __blk_mq_alloc_request(hctx, ctx, rw, gfp & ~__GFP_WAIT);
+	blk_mq_put_ctx(ctx);
+
+	if (!rq && (gfp & __GFP_WAIT)) {
+		blk_mq_run_hw_queue(hctx, false);
+		rq = __blk_mq_alloc_request(hctx, ctx, rw, gfp);
+	}
+
+	return rq;
+}
+
+/**
+ * blk_mq_alloc_request - allocate a request from a multi-queue queue
+ * @q:		the queue
+ * @rw:		READ or WRITE
+ * @gfp:	allocation flags, __GFP_WAIT waits for a free tag
+ *
+ * Returns a request with no bio attached, for the callers which build
+ * requests themselves, as blk_get_request() does for legacy queues.  Free
+ * it with blk_mq_free_request() if it is never started.
+ */
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp)
+{
+	if (unlikely(test_bit(QUEUE_FLAG_DEAD, &q->queue_flags)))
+		return NULL;
+
+	return blk_mq_alloc_request_wait(q, rw, gfp);
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	const int rw = rq_data_dir(rq);
+
+	/* this is a bio leak */
+	WARN_ON(rq->bio != NULL);
+
+	blk_throtl_rq_free(rq);
+	blk_wbt_rq_free(rq);
+	ctx->rq_completed[rw]++;
+	rq->cmd_flags = 0;
+	blk_mq_put_tag(hctx->tags, rq->tag);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+/**
+ * blk_mq_end_io - end I/O on a request of a multi-queue queue
+ * @rq:		the request
+ * @error:	%0 for success, < %0 for error
+ *
+ * Completes all the bios of @rq, then calls its end_io callback or frees
+ * it.  May be called from interrupt context.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	blk_account_io_done(rq);
+	blk_throtl_rq_done(rq);
+	blk_wbt_rq_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+/**
+ * blk_mq_complete_request - end I/O on a request from the block softirq
+ * @rq:		the request
+ *
+ * For drivers with a ->complete operation: the request is handed to it
+ * from the block softirq, on the submitting cpu if QUEUE_FLAG_SAME_COMP is
+ * set, and ->complete() ends it with blk_mq_end_io().  Without one, the
+ * request is ended right away with rq->errors.
+ */
+void blk_mq_complete_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	if (!q->mq_ops->complete)
+		blk_mq_end_io(rq, rq->errors);
+	else
+		blk_complete_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+static void blk_mq_start_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	trace_block_rq_issue(q, rq);
+
+	rq->cmd_flags |= REQ_STARTED;
+	rq->mq_ctx->rq_dispatched[rq_is_sync(rq)]++;
+	blk_wbt_rq_issue(rq);
+}
+
+/**
+ * blk_mq_requeue_request - give a started request back to the block layer
+ * @rq:		the request
+ *
+ * The request is put at the head of its hardware queue, and dispatched
+ * again the next time the queue runs.  It is up to the driver to run or
+ * restart the queue.
+ */
+void blk_mq_requeue_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+	unsigned long flags;
+
+	trace_block_rq_requeue(q, rq);
+	rq->cmd_flags &= ~REQ_STARTED;
+	blk_clear_rq_complete(rq);
+
+	spin_lock_irqsave(&hctx->lock, flags);
+	list_add(&rq->queuelist, &hctx->dispatch);
+	spin_unlock_irqrestore(&hctx->lock, flags);
+}
+EXPORT_SYMBOL(blk_mq_requeue_request);
+
+/*
+ * Run this hardware queue, pulling any software queues mapped to it in.
+ * The queue may be run from several cpus at once, each dispatching what it
+ * gathered: there is no ordering between the software queues, and
+ * ->queue_rq() has to do its own locking.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int bit, queued;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	hctx->run++;
+
+	/*
+	 * Touch any software queue that has pending entries.
+	 */
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+		BUG_ON(bit != ctx->index_hw);
+
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	/*
+	 * If we have previous entries on our dispatch list, grab them
+	 * and stuff them at the front for more fair dispatch.
+	 */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock_irq(&hctx->lock);
+		if (!list_empty(&hctx->dispatch))
+			list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock_irq(&hctx->lock);
+	}
+
+	/*
+	 * Now process all the entries, sending them to the driver.
+	 */
+	queued = 0;
+	while (!list_empty(&rq_list)) {
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		blk_mq_start_request(rq);
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		switch (ret) {
+		case BLK_MQ_RQ_QUEUE_OK:
+			queued++;
+			continue;
+		case BLK_MQ_RQ_QUEUE_BUSY:
+			/*
+			 * Keep it and the rest for the next run.  A driver
+			 * which is full stops the queue, and restarts it
+			 * when requests complete.
+			 */
+			list_add(&rq->queuelist, &rq_list);
+			rq->cmd_flags &= ~REQ_STARTED;
+			break;
+		default:
+			pr_err("blk-mq: bad return on queue: %d\n", ret);
+		case BLK_MQ_RQ_QUEUE_ERROR:
+			rq->errors = -EIO;
+			blk_mq_end_io(rq, rq->errors);
+			break;
+		}
+
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY)
+			break;
+	}
+
+	if (!queued)
+		hctx->dispatched[0]++;
+	else if (queued < (1 << (BLK_MQ_MAX_DISPATCH_ORDER - 1)))
+		hctx->dispatched[ilog2(queued) + 1]++;
+	else
+		hctx->dispatched[BLK_MQ_MAX_DISPATCH_ORDER - 1]++;
+
+	/*
+	 * Any items that need requeuing? Stuff them into hctx->dispatch,
+	 * that is where we will continue on next queue run.
+	 */
+	if (!list_empty(&rq_list)) {
+		spin_lock_irq(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock_irq(&hctx->lock);
+
+		/*
+		 * The driver stopped the queue before returning busy, but
+		 * completions may have restarted it already, and run it with
+		 * these requests still on our list.
+		 */
+		smp_mb();
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			blk_mq_run_hw_queue(hctx, true);
+	}
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch the pending requests of a hardware queue
+ * @hctx:	the hardware queue
+ * @async:	run it from kblockd instead of the caller's context
+ *
+ * Must be run asynchronously from hard interrupt context, and from any
+ * context the driver's ->queue_rq() may not be called from.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (!async)
+		__blk_mq_run_hw_queue(hctx);
+	else
+		kblockd_schedule_delayed_work(hctx->queue, &hctx->run_work, 0);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_run_hw_queue(hctx, async);
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+/**
+ * blk_mq_stop_hw_queue - stop dispatching to a hardware queue
+ * @hctx:	the hardware queue
+ *
+ * The multi-queue counterpart of blk_stop_queue(): typically called from
+ * ->queue_rq() when the hardware is full, with the driver restarting the
+ * queue when requests complete.
+ */
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->run_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	__blk_mq_run_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+void blk_mq_start_stopped_hw_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_and_clear_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+/*
+ * Mean completion time of the polled ios, the last one weighing 1/8.
+ */
+static void blk_poll_stat_add(struct request_queue *q, int rw, ktime_t start)
+{
+	s64 nsec = ktime_to_ns(ktime_sub(ktime_get(), start));
+	unsigned long mean = q->poll_mean_nsec[rw];
+
+	if (nsec <= 0 || nsec > INT_MAX)
+		return;
+
+	if (mean)
+		mean = mean - (mean >> 3) + ((unsigned long)nsec >> 3);
+	else
+		mean = nsec;
+	q->poll_mean_nsec[rw] = mean;
+	q->poll_samples[rw]++;
+}
+
+/*
+ * Spinning for all of a 100 usec io burns a cpu to save the couple of
+ * usecs of the wakeup.  Sleep until it is nearly done instead: half the
+ * mean completion time after @start, or io_poll_delay.  Returns false if
+ * there is no time left to sleep.
+ */
+static bool blk_poll_hybrid_sleep(struct request_queue *q,
+				  struct blk_mq_hw_ctx *hctx, int rw,
+				  ktime_t start)
+{
+	struct hrtimer_sleeper hs;
+	ktime_t expires;
+	unsigned long nsec;
+
+	if (q->poll_nsec < 0)
+		return false;
+	nsec = q->poll_nsec ? q->poll_nsec : q->poll_mean_nsec[rw] / 2;
+	if (!nsec)
+		return false;
+
+	expires = ktime_add_ns(start, nsec);
+	if (ktime_to_ns(ktime_sub(expires, ktime_get())) <= 0)
+		return false;
+
+	hctx->poll_slept++;
+	hrtimer_init_on_stack(&hs.timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	hrtimer_set_expires(&hs.timer, expires);
+	hrtimer_init_sleeper(&hs, current);
+	hrtimer_start_expires(&hs.timer, HRTIMER_MODE_ABS);
+	if (hs.task)
+		io_schedule();
+	hrtimer_cancel(&hs.timer);
+	destroy_hrtimer_on_stack(&hs.timer);
+
+	/* woken by the completion rather than by the timer */
+	if (hs.task)
+		blk_poll_stat_add(q, rw, start);
+	return true;
+}
+
+/**
+ * blk_poll - wait for a synchronous io by polling the driver
+ * @q:		the queue the io was submitted to
+ * @rw:		READ or WRITE, for the completion time estimate
+ * @start:	when the io was submitted
+ *
+ * For a task which has set itself TASK_UNINTERRUPTIBLE to wait for its io,
+ * in place of io_schedule(), when io_poll is set on @q.  The completion
+ * wakes the task as usual, but it does not have to go through an
+ * interrupt and a context switch first: the task sleeps for the part of
+ * the io it can (see blk_poll_hybrid_sleep), then calls the driver's
+ * ->poll() on the hardware queue of its cpu until it has been woken.
+ *
+ * Returns true when the task is TASK_RUNNING again and should check what
+ * it waits for, false when it should io_schedule() after all.
+ */
+bool blk_poll(struct request_queue *q, int rw, ktime_t start)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	if (!q->mq_ops || !q->mq_ops->poll || !blk_queue_poll(q))
+		return false;
+
+	hctx = q->mq_ops->map_queue(q, get_cpu());
+	put_cpu();
+	hctx->poll_considered++;
+
+	if (blk_poll_hybrid_sleep(q, hctx, rw, start))
+		return true;
+
+	while (!need_resched()) {
+		int ret;
+
+		hctx->poll_invoked++;
+		ret = q->mq_ops->poll(hctx);
+		if (ret > 0)
+			hctx->poll_success++;
+
+		if (current->state == TASK_RUNNING) {
+			blk_poll_stat_add(q, rw, start);
+			return true;
+		}
+
+		cpu_relax();
+	}
+
+	return false;
+}
+EXPORT_SYMBOL_GPL(blk_poll);
+
+static void blk_mq_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, run_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
+				    struct request *rq, bool at_head)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+
+	trace_block_rq_insert(hctx->queue, rq);
+
+	spin_lock(&ctx->lock);
+	if (at_head)
+		list_add(&rq->queuelist, &ctx->rq_list);
+	else
+		list_add_tail(&rq->queuelist, &ctx->rq_list);
+	blk_mq_hctx_mark_pending(hctx, ctx);
+	spin_unlock(&ctx->lock);
+
+	hctx->queued++;
+}
+
+/*
+ * Stage @rq on the software queue it was allocated from, the one its tag
+ * belongs to, whichever cpu we are on now.
+ */
+void blk_mq_insert_request(struct request *rq, bool at_head, bool run_queue,
+			   bool async)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+
+	__blk_mq_insert_request(hctx, rq, at_head);
+
+	if (run_queue)
+		blk_mq_run_hw_queue(hctx, async);
+}
+
+/*
+ * Only the tail of the software queue is looked at: the requests of a
+ * sequential stream from this cpu, which the software queue is too short
+ * lived to hold many of anyway.
+ */
+static bool blk_mq_attempt_merge(struct request_queue *q,
+				 struct blk_mq_ctx *ctx, struct bio *bio)
+{
+	struct request *rq;
+	bool merged = false;
+
+	spin_lock(&ctx->lock);
+	if (!list_empty(&ctx->rq_list)) {
+		rq = list_entry_rq(ctx->rq_list.prev);
+		if (elv_try_merge(rq, bio) == ELEVATOR_BACK_MERGE &&
+		    bio_attempt_back_merge(q, rq, bio)) {
+			ctx->rq_merged++;
+			merged = true;
+		}
+	}
+	spin_unlock(&ctx->lock);
+
+	return merged;
+}
+
+struct blk_mq_flush_wait {
+	struct completion done;
+	int error;
+};
+
+static void blk_mq_flush_rq_end_io(struct request *rq, int error)
+{
+	struct blk_mq_flush_wait *wait = rq->end_io_data;
+
+	wait->error = error;
+	complete(&wait->done);
+}
+
+static int blk_mq_issue_flush(struct request_queue *q, struct gendisk *disk)
+{
+	struct blk_mq_flush_wait wait;
+	struct request *rq;
+
+	rq = blk_mq_alloc_request(q, WRITE, GFP_NOIO);
+	if (!rq)
+		return -ENXIO;
+
+	init_completion(&wait.done);
+	rq->cmd_type = REQ_TYPE_FS;
+	rq->cmd_flags |= REQ_FLUSH | REQ_FLUSH_SEQ;
+	rq->rq_disk = disk;
+	rq->end_io = blk_mq_flush_rq_end_io;
+	rq->end_io_data = &wait;
+	blk_mq_insert_request(rq, false, true, false);
+
+	wait_for_completion(&wait.done);
+	blk_mq_free_request(rq);
+	return wait.error;
+}
+
+static void blk_mq_flush_bio_end_io(struct bio *bio, int error)
+{
+	struct blk_mq_flush_wait *wait = bio->bi_private;
+
+	wait->error = error;
+	complete(&wait->done);
+}
+
+static void __blk_mq_make_request(struct request_queue *q, struct bio *bio);
+
+/*
+ * Sequence a REQ_FLUSH/REQ_FUA bio: a preflush if it asks for one, the
+ * data, with REQ_FUA if the device supports it, then a postflush if it
+ * asked for FUA and the device does not support it.  Each step is waited
+ * for before the next is issued.
+ */
+static void blk_mq_flush_bio(struct request_queue *q, struct bio *bio)
+{
+	struct gendisk *disk = bio->bi_bdev->bd_disk;
+	bool postflush = false;
+	int error = 0;
+
+	if (bio->bi_rw & REQ_FLUSH) {
+		bio->bi_rw &= ~REQ_FLUSH;
+		if (q->flush_flags & REQ_FLUSH)
+			error = blk_mq_issue_flush(q, disk);
+	}
+	if (bio->bi_rw & REQ_FUA) {
+		if (!(q->flush_flags & REQ_FUA)) {
+			bio->bi_rw &= ~REQ_FUA;
+			postflush = q->flush_flags & REQ_FLUSH;
+		}
+	}
+
+	if (!error && bio_has_data(bio)) {
+		bio_end_io_t *end_io = bio->bi_end_io;
+		void *private = bio->bi_private;
+		struct blk_mq_flush_wait wait;
+
+		init_completion(&wait.done);
+		bio->bi_end_io = blk_mq_flush_bio_end_io;
+		bio->bi_private = &wait;
+		__blk_mq_make_request(q, bio);
+		wait_for_completion(&wait.done);
+		bio->bi_end_io = end_io;
+		bio->bi_private = private;
+		error = wait.error;
+	}
+
+	if (!error && postflush)
+		error = blk_mq_issue_flush(q, disk);
+
+	bio_endio(bio, error);
+}
+
+static void blk_mq_flush_work(struct work_struct *work)
+{
+	struct request_queue *q;
+	struct bio *bio;
+
+	q = container_of(work, struct request_queue, mq_flush_work);
+
+	for (;;) {
+		spin_lock_irq(&q->mq_flush_lock);
+		bio = bio_list_pop(&q->mq_flush_bios);
+		spin_unlock_irq(&q->mq_flush_lock);
+		if (!bio)
+			break;
+
+		blk_mq_flush_bio(q, bio);
+	}
+}
+
+static void __blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const bool is_sync = rw_is_sync(bio->bi_rw);
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	int rw = bio_data_dir(bio);
+	bool wb_acct;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	if ((hctx->flags & BLK_MQ_F_SHOULD_MERGE) && !blk_queue_nomerges(q) &&
+	    blk_mq_attempt_merge(q, ctx, bio)) {
+		blk_mq_put_ctx(ctx);
+		return;
+	}
+	blk_mq_put_ctx(ctx);
+
+	wb_acct = blk_wbt_wait(q, bio, NULL);
+
+	if (is_sync)
+		rw |= REQ_SYNC;
+	trace_block_getrq(q, bio, rw);
+	rq = blk_mq_alloc_request_wait(q, rw, GFP_NOIO);
+
+	if (blk_queue_io_stat(q))
+		rq->cmd_flags |= REQ_IO_STAT;
+	init_request_from_bio(rq, bio);
+	blk_wbt_track(rq, wb_acct);
+
+	if (test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags) ||
+	    bio_flagged(bio, BIO_CPU_AFFINE))
+		rq->cpu = blk_cpu_to_group(rq->mq_ctx->cpu);
+
+	drive_stat_acct(rq, 1);
+
+	/*
+	 * Sync requests are dispatched from the submitter.  Async ones, and
+	 * those submitted under a plug, are left to kblockd, which lets the
+	 * requests that follow them merge in or at least batch up.
+	 */
+	blk_mq_insert_request(rq, false, true, !is_sync || current->plug);
+}
+
+/*
+ * Flushes and FUA writes are sequenced by a work item per queue, every
+ * other bio is merged into or staged on the software queue of this cpu.
+ * The per-process plug lists are not used.
+ */
+static int blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	blk_queue_bounce(q, &bio);
+
+	if (unlikely(bio->bi_rw & (REQ_FLUSH | REQ_FUA))) {
+		unsigned long flags;
+
+		spin_lock_irqsave(&q->mq_flush_lock, flags);
+		bio_list_add(&q->mq_flush_bios, bio);
+		spin_unlock_irqrestore(&q->mq_flush_lock, flags);
+		kblockd_schedule_work(q, &q->mq_flush_work);
+		return 0;
+	}
+
+	__blk_mq_make_request(q, bio);
+	return 0;
+}
+
+static void blk_mq_free_rq_map(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->rqs) {
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+		kfree(hctx->rqs);
+	}
+	if (hctx->tags)
+		blk_mq_free_tags(hctx->tags);
+}
+
+/*
+ * The requests are allocated one by one, the driver data behind them may
+ * be handed to the device for DMA.
+ */
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
+			      struct blk_mq_reg *reg, int node)
+{
+	unsigned int i;
+
+	hctx->tags = blk_mq_init_tags(hctx->queue_depth, node);
+	if (!hctx->tags)
+		return -ENOMEM;
+
+	hctx->rqs = kzalloc_node(hctx->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL, node);
+	if (!hctx->rqs)
+		goto err;
+
+	for (i = 0; i < hctx->queue_depth; i++) {
+		hctx->rqs[i] = kzalloc_node(sizeof(struct request) +
+					    reg->cmd_size, GFP_KERNEL, node);
+		if (!hctx->rqs[i])
+			goto err;
+	}
+
+	return 0;
+err:
+	blk_mq_free_rq_map(hctx);
+	return -ENOMEM;
+}
+
+static void blk_mq_free_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!hctx)
+			continue;
+		blk_mq_free_rq_map(hctx);
+		kfree(hctx->ctxs);
+		kfree(hctx->ctx_map);
+		kfree(hctx);
+	}
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+	int cpu;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		int node = reg->numa_node;
+
+		hctx = kzalloc_node(sizeof(*hctx), GFP_KERNEL, node);
+		if (!hctx)
+			return -ENOMEM;
+		q->queue_hw_ctx[i] = hctx;
+
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		INIT_DELAYED_WORK(&hctx->run_work, blk_mq_work_fn);
+		hctx->queue = q;
+		hctx->queue_num = i;
+		hctx->flags = reg->flags;
+		hctx->queue_depth = reg->queue_depth;
+
+		hctx->ctxs = kcalloc(nr_cpu_ids, sizeof(void *), GFP_KERNEL);
+		hctx->ctx_map = kzalloc(BITS_TO_LONGS(nr_cpu_ids) *
+					sizeof(long), GFP_KERNEL);
+		if (!hctx->ctxs || !hctx->ctx_map)
+			return -ENOMEM;
+
+		if (blk_mq_init_rq_map(hctx, reg, node))
+			return -ENOMEM;
+	}
+
+	/*
+	 * Map the software queues to the hardware queues, and give every
+	 * software queue its index in the pending map of its hardware queue.
+	 */
+	for_each_possible_cpu(cpu) {
+		struct blk_mq_ctx *ctx = __blk_mq_get_ctx(q, cpu);
+
+		hctx = q->mq_ops->map_queue(q, cpu);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (reg->ops->init_hctx &&
+		    reg->ops->init_hctx(hctx, driver_data, i)) {
+			/* only exit the ones which were set up */
+			while (i--) {
+				hctx = q->queue_hw_ctx[i];
+				if (reg->ops->exit_hctx)
+					reg->ops->exit_hctx(hctx, i);
+			}
+			return -ENODEV;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * blk_mq_init_queue - allocate and set up a multi-queue request queue
+ * @reg:	the driver's queues and operations
+ * @driver_data: passed to ->init_hctx()
+ *
+ * Returns the queue, to be released with blk_cleanup_queue() as any other
+ * queue, or an ERR_PTR().
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct request_queue *q;
+	int i, err = -ENOMEM;
+
+	if (!reg->nr_hw_queues || !reg->ops->queue_rq || !reg->ops->map_queue ||
+	    !reg->queue_depth || reg->queue_depth > BLK_MQ_MAX_DEPTH)
+		return ERR_PTR(-EINVAL);
+
+	reg->nr_hw_queues = min_t(unsigned int, reg->nr_hw_queues,
+				  num_possible_cpus());
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return ERR_PTR(-ENOMEM);
+
+	q->mq_ops = reg->ops;
+
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	q->queue_hw_ctx = kcalloc(reg->nr_hw_queues, sizeof(void *),
+				  GFP_KERNEL);
+	q->mq_map = kcalloc(nr_cpu_ids, sizeof(unsigned int), GFP_KERNEL);
+	if (!q->queue_ctx || !q->queue_hw_ctx || !q->mq_map)
+		goto err_put;
+
+	for_each_possible_cpu(i) {
+		struct blk_mq_ctx *ctx = __blk_mq_get_ctx(q, i);
+
+		memset(ctx, 0, sizeof(*ctx));
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = i;
+		ctx->queue = q;
+	}
+
+	blk_mq_update_queue_map(q->mq_map, reg->nr_hw_queues);
+	q->nr_hw_queues = reg->nr_hw_queues;
+
+	err = blk_mq_init_hw_queues(q, reg, driver_data);
+	if (err)
+		goto err_hw;
+
+	spin_lock_init(&q->mq_flush_lock);
+	bio_list_init(&q->mq_flush_bios);
+	INIT_WORK(&q->mq_flush_work, blk_mq_flush_work);
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	blk_queue_softirq_done(q, reg->ops->complete);
+	q->nr_requests = reg->queue_depth;
+	q->queue_flags |= 1 << QUEUE_FLAG_IO_STAT;
+	blk_wbt_init(q);
+
+	return q;
+
+err_hw:
+	blk_mq_free_hw_queues(q);
+err_put:
+	kfree(q->mq_map);
+	kfree(q->queue_hw_ctx);
+	free_percpu(q->queue_ctx);
+	q->mq_ops = NULL;
+	blk_put_queue(q);
+	return ERR_PTR(err);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (q->mq_ops->exit_hctx)
+			q->mq_ops->exit_hctx(hctx, i);
+	}
+	blk_mq_free_hw_queues(q);
+
+	kfree(q->mq_map);
+	kfree(q->queue_hw_ctx);
+	free_percpu(q->queue_ctx);
+}
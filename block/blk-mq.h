@@ -0,0 +1,43 @@
+#ifndef INT_BLK_MQ_H
+#define INT_BLK_MQ_H
+
+struct blk_mq_ctx {
+	struct {
+		spinlock_t		lock;
+		struct list_head	rq_list;
+	}  ____cacheline_aligned_in_smp;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* bit in hctx->ctx_map */
+
+	/* incremented at dispatch time */
+	unsigned long		rq_dispatched[2];
+	unsigned long		rq_merged;
+
+	/* incremented at completion time */
+	unsigned long		____cacheline_aligned_in_smp rq_completed[2];
+
+	struct request_queue	*queue;
+};
+
+void blk_mq_insert_request(struct request *rq, bool at_head, bool run_queue,
+			   bool async);
+void blk_mq_free_queue(struct request_queue *q);
+
+/*
+ * Tags
+ */
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node);
+void blk_mq_free_tags(struct blk_mq_tags *tags);
+int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp);
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag);
+bool blk_mq_has_free_tags(struct blk_mq_tags *tags);
+ssize_t blk_mq_tag_sysfs_show(struct blk_mq_tags *tags, char *page);
+
+/*
+ * sysfs
+ */
+int blk_mq_register_disk(struct gendisk *disk);
+void blk_mq_unregister_disk(struct gendisk *disk);
+
+#endif
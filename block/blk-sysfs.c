@@ -7,8 +7,11 @@
 #include <linux/bio.h>
 #include <linux/blkdev.h>
 #include <linux/blktrace_api.h>
+#include <linux/blk-mq.h>
 
 #include "blk.h"
+#include "blk-mq.h"
+#include "blk-wbt.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -78,6 +81,8 @@ queue_requests_store(struct request_queue *q, const char *page, size_t count)
 		wake_up(&rl->wait[BLK_RW_ASYNC]);
 	}
 	spin_unlock_irq(q->queue_lock);
+
+	blk_wbt_update_limit(q);
 	return ret;
 }
 
@@ -266,6 +271,125 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+static ssize_t queue_poll_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_queue_poll(q), page);
+}
+
+static ssize_t
+queue_poll_store(struct request_queue *q, const char *page, size_t count)
+{
+	unsigned long val;
+	ssize_t ret;
+
+	if (!q->mq_ops || !q->mq_ops->poll)
+		return -EINVAL;
+
+	ret = queue_var_store(&val, page, count);
+	spin_lock_irq(q->queue_lock);
+	if (val)
+		queue_flag_set(QUEUE_FLAG_POLL, q);
+	else
+		queue_flag_clear(QUEUE_FLAG_POLL, q);
+	spin_unlock_irq(q->queue_lock);
+	return ret;
+}
+
+static ssize_t queue_poll_delay_show(struct request_queue *q, char *page)
+{
+	int val = q->poll_nsec;
+
+	if (val > 0)
+		val /= NSEC_PER_USEC;
+	return sprintf(page, "%d\n", val);
+}
+
+static ssize_t
+queue_poll_delay_store(struct request_queue *q, const char *page, size_t count)
+{
+	long val;
+
+	if (strict_strtol(page, 10, &val) || val < -1 ||
+	    val > INT_MAX / NSEC_PER_USEC)
+		return -EINVAL;
+
+	q->poll_nsec = val > 0 ? val * NSEC_PER_USEC : val;
+	return count;
+}
+
+static ssize_t queue_poll_stat_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "read: mean_nsec=%lu samples=%lu\n"
+		       "write: mean_nsec=%lu samples=%lu\n",
+		       q->poll_mean_nsec[READ], q->poll_samples[READ],
+		       q->poll_mean_nsec[WRITE], q->poll_samples[WRITE]);
+}
+
+#ifdef CONFIG_BLK_WBT
+static ssize_t queue_wb_lat_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	return sprintf(page, "%llu\n",
+		       div_u64(blk_wbt_lat_nsec(q->rq_wb), NSEC_PER_USEC));
+}
+
+static ssize_t
+queue_wb_lat_store(struct request_queue *q, const char *page, size_t count)
+{
+	long long val;
+
+	if (!q->rq_wb)
+		return -EINVAL;
+	if (strict_strtoll(page, 10, &val) || val < -1 ||
+	    val > LLONG_MAX / NSEC_PER_USEC)
+		return -EINVAL;
+
+	blk_wbt_set_lat(q->rq_wb, val > 0 ? val * NSEC_PER_USEC : val);
+	return count;
+}
+
+static ssize_t queue_wb_win_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	return sprintf(page, "%llu\n",
+		       div_u64(q->rq_wb->win_nsec, NSEC_PER_USEC));
+}
+
+static ssize_t
+queue_wb_win_store(struct request_queue *q, const char *page, size_t count)
+{
+	unsigned long long val;
+
+	if (!q->rq_wb)
+		return -EINVAL;
+	if (strict_strtoull(page, 10, &val) || !val ||
+	    val > ULLONG_MAX / NSEC_PER_USEC)
+		return -EINVAL;
+
+	q->rq_wb->win_nsec = val * NSEC_PER_USEC;
+	return count;
+}
+
+static ssize_t queue_wb_stat_show(struct request_queue *q, char *page)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return -EINVAL;
+
+	return sprintf(page, "depth=%u max=%u inflight=%d scale_step=%d\n"
+		       "windows=%lu missed=%lu throttled=%lu\n",
+		       rwb->limit, blk_wbt_max_depth(rwb),
+		       atomic_read(&rwb->inflight), rwb->scale_step,
+		       rwb->windows, rwb->missed,
+		       atomic_long_read(&rwb->throttled));
+}
+#endif
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -380,6 +504,42 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+static struct queue_sysfs_entry queue_poll_entry = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_show,
+	.store = queue_poll_store,
+};
+
+static struct queue_sysfs_entry queue_poll_delay_entry = {
+	.attr = {.name = "io_poll_delay", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_delay_show,
+	.store = queue_poll_delay_store,
+};
+
+static struct queue_sysfs_entry queue_poll_stat_entry = {
+	.attr = {.name = "io_poll_stat", .mode = S_IRUGO },
+	.show = queue_poll_stat_show,
+};
+
+#ifdef CONFIG_BLK_WBT
+static struct queue_sysfs_entry queue_wb_lat_entry = {
+	.attr = {.name = "wbt_lat_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_wb_lat_show,
+	.store = queue_wb_lat_store,
+};
+
+static struct queue_sysfs_entry queue_wb_win_entry = {
+	.attr = {.name = "wbt_window_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_wb_win_show,
+	.store = queue_wb_win_store,
+};
+
+static struct queue_sysfs_entry queue_wb_stat_entry = {
+	.attr = {.name = "wbt_stat", .mode = S_IRUGO },
+	.show = queue_wb_stat_show,
+};
+#endif
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -402,6 +562,14 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+	&queue_poll_entry.attr,
+	&queue_poll_delay_entry.attr,
+	&queue_poll_stat_entry.attr,
+#ifdef CONFIG_BLK_WBT
+	&queue_wb_lat_entry.attr,
+	&queue_wb_win_entry.attr,
+	&queue_wb_stat_entry.attr,
+#endif
 	NULL,
 };
 
@@ -476,6 +644,10 @@ static void blk_release_queue(struct kobject *kobj)
 		elevator_exit(q->elevator);
 
 	blk_throtl_exit(q);
+	blk_wbt_exit(q);
+
+	if (q->mq_ops)
+		blk_mq_free_queue(q);
 
 	if (rl->rq_pool)
 		mempool_destroy(rl->rq_pool);
@@ -521,6 +693,17 @@ int blk_register_queue(struct gendisk *disk)
 
 	kobject_uevent(&q->kobj, KOBJ_ADD);
 
+	if (q->mq_ops) {
+		ret = blk_mq_register_disk(disk);
+		if (ret) {
+			kobject_uevent(&q->kobj, KOBJ_REMOVE);
+			kobject_del(&q->kobj);
+			blk_trace_remove_sysfs(dev);
+			kobject_put(&dev->kobj);
+			return ret;
+		}
+	}
+
 	if (!q->request_fn)
 		return 0;
 
@@ -543,6 +726,9 @@ void blk_unregister_queue(struct gendisk *disk)
 	if (WARN_ON(!q))
 		return;
 
+	if (q->mq_ops)
+		blk_mq_unregister_disk(disk);
+
 	if (q->request_fn)
 		elv_unregister_queue(q);
 
@@ -20,6 +20,21 @@ static int throtl_quantum = 32;
 /* Throttling is performed over 100ms slice and after that slice is renewed */
 static unsigned long throtl_slice = HZ/10;	/* 100 ms */
 
+/*
+ * Latency targets are checked over windows of at least throtl_slice and
+ * this many completions.  A group misses its target in a window when more
+ * than throtl_lat_miss_pct of its requests took longer.
+ */
+static unsigned int throtl_lat_min_samples = 4;
+static unsigned int throtl_lat_miss_pct = 10;
+
+/*
+ * Requests in flight allowed to each group held back for a latency target:
+ * halved on every miss, grown by one per window without, and unlimited
+ * again past this.
+ */
+#define THROTL_LAT_DEPTH_MAX	32
+
 /* A workqueue to queue throttle related work */
 static struct workqueue_struct *kthrotld_workqueue;
 static void throtl_schedule_delayed_work(struct throtl_data *td,
@@ -79,6 +94,17 @@ struct throtl_grp {
 	/* Some throttle limits got updated for the group */
 	int limits_changed;
 
+	/* Target completion latency in usecs, 0 if the group has none */
+	unsigned int latency_target;
+
+	/* Requests charged to the group and not completed yet */
+	atomic_t nr_inflight;
+
+	/* Completions, and those over latency_target, in the window */
+	unsigned int lat_nr;
+	unsigned int lat_missed;
+	unsigned long lat_win_start;
+
 	struct rcu_head rcu_head;
 };
 
@@ -105,6 +131,21 @@ struct throtl_data
 	struct delayed_work throtl_work;
 
 	int limits_changed;
+
+	/*
+	 * Latency targets.  While a group misses its target, every group
+	 * with a looser target, or none, may only have lat_depth requests
+	 * in flight.  lat_depth is 0 when nobody is held back.  Updated at
+	 * completion under lat_lock.
+	 */
+	unsigned int lat_depth;
+	unsigned int lat_missed_target;
+	unsigned long lat_last_miss;
+	unsigned long lat_last_adjust;
+	spinlock_t lat_lock;
+
+	/* Work for recomputing dispatch times when lat_depth allows more */
+	struct work_struct lat_work;
 };
 
 enum tg_state_flags {
@@ -191,6 +232,7 @@ static void throtl_init_group(struct throtl_grp *tg)
 	/* Practically unlimited BW */
 	tg->bps[0] = tg->bps[1] = -1;
 	tg->iops[0] = tg->iops[1] = -1;
+	tg->lat_win_start = jiffies;
 
 	/*
 	 * Take the initial reference that will be released on destroy
@@ -258,6 +300,7 @@ static void throtl_init_add_tg_lists(struct throtl_data *td,
 	tg->bps[WRITE] = blkcg_get_write_bps(blkcg, tg->blkg.dev);
 	tg->iops[READ] = blkcg_get_read_iops(blkcg, tg->blkg.dev);
 	tg->iops[WRITE] = blkcg_get_write_iops(blkcg, tg->blkg.dev);
+	tg->latency_target = blkcg_get_latency_target(blkcg, tg->blkg.dev);
 
 	throtl_add_group_to_td_list(td, tg);
 }
@@ -302,6 +345,22 @@ throtl_grp *throtl_find_tg(struct throtl_data *td, struct blkio_cgroup *blkcg)
 	return tg;
 }
 
+/*
+ * Returns the group of the cgroup with css id @id, from the completion
+ * path.  Should be called under rcu, the group might be going away.
+ */
+static struct throtl_grp *throtl_lookup_tg(struct throtl_data *td,
+						unsigned short id)
+{
+	struct blkio_cgroup *blkcg = blkio_cgroup_lookup(id);
+
+	if (!blkcg)
+		return NULL;
+	if (blkcg == &blkio_root_cgroup)
+		return td->root_tg;
+	return tg_of_blkg(blkiocg_lookup_group(blkcg, td));
+}
+
 /*
  * This function returns with queue lock unlocked in case of error, like
  * request queue is no more
@@ -682,8 +741,33 @@ static bool tg_with_in_bps_limit(struct throtl_data *td, struct throtl_grp *tg,
 	return 0;
 }
 
-static bool tg_no_rule_group(struct throtl_grp *tg, bool rw) {
-	if (tg->bps[rw] == -1 && tg->iops[rw] == -1)
+/*
+ * Whether @tg is held back for a group with a tighter latency target.
+ * Read without locks from the fast path, being off by a bio is fine.
+ */
+static bool tg_lat_limited(struct throtl_data *td, struct throtl_grp *tg)
+{
+	if (!ACCESS_ONCE(td->lat_depth))
+		return 0;
+	return !tg->latency_target ||
+		tg->latency_target > td->lat_missed_target;
+}
+
+/* How many more requests @tg may have in flight */
+static unsigned int tg_lat_room(struct throtl_data *td, struct throtl_grp *tg)
+{
+	int depth = ACCESS_ONCE(td->lat_depth);
+	int inflight = atomic_read(&tg->nr_inflight);
+
+	if (!tg_lat_limited(td, tg))
+		return UINT_MAX;
+	return inflight < depth ? depth - inflight : 0;
+}
+
+static bool tg_no_rule_group(struct throtl_data *td, struct throtl_grp *tg,
+				bool rw) {
+	if (tg->bps[rw] == -1 && tg->iops[rw] == -1 &&
+	    !tg_lat_limited(td, tg))
 		return 1;
 	return 0;
 }
@@ -706,6 +790,16 @@ static bool tg_may_dispatch(struct throtl_data *td, struct throtl_grp *tg,
 	 */
 	BUG_ON(tg->nr_queued[rw] && bio != bio_list_peek(&tg->bio_lists[rw]));
 
+	/*
+	 * Held back for a latency target.  The group is looked at again when
+	 * one of its requests completes, throtl_slice is only a fallback.
+	 */
+	if (!tg_lat_room(td, tg)) {
+		if (wait)
+			*wait = throtl_slice;
+		return 0;
+	}
+
 	/* If tg->bps = -1, then BW is unlimited */
 	if (tg->bps[rw] == -1 && tg->iops[rw] == -1) {
 		if (wait)
@@ -814,12 +908,13 @@ static int throtl_dispatch_tg(struct throtl_data *td, struct throtl_grp *tg,
 	unsigned int nr_reads = 0, nr_writes = 0;
 	unsigned int max_nr_reads = throtl_grp_quantum*3/4;
 	unsigned int max_nr_writes = throtl_grp_quantum - max_nr_reads;
+	unsigned int room = tg_lat_room(td, tg);
 	struct bio *bio;
 
 	/* Try to dispatch 75% READS and 25% WRITES */
 
 	while ((bio = bio_list_peek(&tg->bio_lists[READ]))
-		&& tg_may_dispatch(td, tg, bio, NULL)) {
+		&& nr_reads < room && tg_may_dispatch(td, tg, bio, NULL)) {
 
 		tg_dispatch_one_bio(td, tg, bio_data_dir(bio), bl);
 		nr_reads++;
@@ -829,6 +924,7 @@ static int throtl_dispatch_tg(struct throtl_data *td, struct throtl_grp *tg,
 	}
 
 	while ((bio = bio_list_peek(&tg->bio_lists[WRITE]))
+		&& nr_reads + nr_writes < room
 		&& tg_may_dispatch(td, tg, bio, NULL)) {
 
 		tg_dispatch_one_bio(td, tg, bio_data_dir(bio), bl);
@@ -863,6 +959,18 @@ static int throtl_select_dispatch(struct throtl_data *td, struct bio_list *bl)
 		if (tg->nr_queued[0] || tg->nr_queued[1]) {
 			tg_update_disptime(td, tg);
 			throtl_enqueue_tg(td, tg);
+
+			/*
+			 * The bios just dispatched have no request in flight
+			 * yet, leave a group held back for a latency target
+			 * to the next round.
+			 */
+			if (tg_lat_limited(td, tg) &&
+			    !time_after(tg->disptime, jiffies)) {
+				throtl_dequeue_tg(td, tg);
+				tg->disptime = jiffies + 1;
+				throtl_enqueue_tg(td, tg);
+			}
 		}
 
 		if (nr_disp >= throtl_quantum)
@@ -876,6 +984,7 @@ static void throtl_process_limit_change(struct throtl_data *td)
 {
 	struct throtl_grp *tg;
 	struct hlist_node *pos, *n;
+	unsigned int nr_lat_grps = 0;
 
 	if (!td->limits_changed)
 		return;
@@ -885,6 +994,9 @@ static void throtl_process_limit_change(struct throtl_data *td)
 	throtl_log(td, "limits changed");
 
 	hlist_for_each_entry_safe(tg, pos, n, &td->tg_list, tg_node) {
+		if (tg->latency_target)
+			nr_lat_grps++;
+
 		if (!tg->limits_changed)
 			continue;
 
@@ -892,8 +1004,9 @@ static void throtl_process_limit_change(struct throtl_data *td)
 			continue;
 
 		throtl_log_tg(td, tg, "limit change rbps=%llu wbps=%llu"
-			" riops=%u wiops=%u", tg->bps[READ], tg->bps[WRITE],
-			tg->iops[READ], tg->iops[WRITE]);
+			" riops=%u wiops=%u lat=%u", tg->bps[READ],
+			tg->bps[WRITE], tg->iops[READ], tg->iops[WRITE],
+			tg->latency_target);
 
 		/*
 		 * Restart the slices for both READ and WRITES. It
@@ -907,6 +1020,16 @@ static void throtl_process_limit_change(struct throtl_data *td)
 		if (throtl_tg_on_rr(tg))
 			tg_update_disptime(td, tg);
 	}
+
+	/* Nobody left to protect, stop holding the others back */
+	if (!nr_lat_grps && td->lat_depth) {
+		spin_lock(&td->lat_lock);
+		td->lat_depth = 0;
+		spin_unlock(&td->lat_lock);
+		hlist_for_each_entry(tg, pos, &td->tg_list, tg_node)
+			if (throtl_tg_on_rr(tg))
+				tg_update_disptime(td, tg);
+	}
 }
 
 /* Dispatch throttled bios. Should be called without queue lock held. */
@@ -1101,11 +1224,22 @@ static void throtl_update_blkio_group_write_iops(void *key,
 	throtl_update_blkio_group_common(td, tg);
 }
 
+static void throtl_update_blkio_group_latency_target(void *key,
+			struct blkio_group *blkg, unsigned int latency)
+{
+	struct throtl_data *td = key;
+	struct throtl_grp *tg = tg_of_blkg(blkg);
+
+	tg->latency_target = latency;
+	throtl_update_blkio_group_common(td, tg);
+}
+
 static void throtl_shutdown_wq(struct request_queue *q)
 {
 	struct throtl_data *td = q->td;
 
 	cancel_delayed_work_sync(&td->throtl_work);
+	cancel_work_sync(&td->lat_work);
 }
 
 static struct blkio_policy_type blkio_policy_throtl = {
@@ -1119,6 +1253,8 @@ static struct blkio_policy_type blkio_policy_throtl = {
 					throtl_update_blkio_group_read_iops,
 		.blkio_update_group_write_iops_fn =
 					throtl_update_blkio_group_write_iops,
+		.blkio_update_group_latency_target_fn =
+				throtl_update_blkio_group_latency_target,
 	},
 	.plid = BLKIO_POLICY_THROTL,
 };
@@ -1144,11 +1280,14 @@ int blk_throtl_bio(struct request_queue *q, struct bio **biop)
 
 	rcu_read_lock();
 	blkcg = task_blkio_cgroup(current);
+	/* The request of the bio is charged to the submitter's group */
+	if (!bio->bi_blkcg_id)
+		bio->bi_blkcg_id = css_id(&blkcg->css);
 	tg = throtl_find_tg(td, blkcg);
 	if (tg) {
 		throtl_tg_fill_dev_details(td, tg);
 
-		if (tg_no_rule_group(tg, rw)) {
+		if (tg_no_rule_group(td, tg, rw)) {
 			blkiocg_update_dispatch_stats(&tg->blkg, bio->bi_size,
 					rw, bio->bi_rw & REQ_SYNC);
 			rcu_read_unlock();
@@ -1224,6 +1363,172 @@ out:
 	return 0;
 }
 
+/*
+ * Latency targets.  Every request allocated for a bio is charged to the
+ * group of the bio's submitter, carried in bi_blkcg_id across kthrotld,
+ * and its latency, from allocation to completion, goes to the histogram
+ * of the group and, if the group has a target, to its current window.
+ */
+
+/* Kicks the groups which were held back, lat_depth allows more now. */
+static void throtl_lat_work(struct work_struct *work)
+{
+	struct throtl_data *td = container_of(work, struct throtl_data,
+					lat_work);
+	struct request_queue *q = td->queue;
+	struct hlist_node *pos;
+	struct throtl_grp *tg;
+
+	spin_lock_irq(q->queue_lock);
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node)
+		if (throtl_tg_on_rr(tg))
+			tg_update_disptime(td, tg);
+	throtl_schedule_next_dispatch(td);
+	spin_unlock_irq(q->queue_lock);
+}
+
+/* Should be called with lat_lock held */
+static void throtl_lat_missed(struct throtl_data *td, struct throtl_grp *tg)
+{
+	bool recent = td->lat_depth &&
+		time_before(jiffies, td->lat_last_miss + throtl_slice);
+
+	/* Hold back the groups looser than the tightest target missed */
+	if (!recent || tg->latency_target < td->lat_missed_target)
+		td->lat_missed_target = tg->latency_target;
+	td->lat_last_miss = jiffies;
+
+	/* One step per window, however many groups missed */
+	if (td->lat_depth &&
+	    time_before(jiffies, td->lat_last_adjust + throtl_slice))
+		return;
+
+	td->lat_last_adjust = jiffies;
+	if (td->lat_depth)
+		td->lat_depth = max(td->lat_depth / 2, 1U);
+	else
+		td->lat_depth = THROTL_LAT_DEPTH_MAX / 2;
+
+	throtl_log_tg(td, tg, "latency target=%u missed depth=%u",
+			tg->latency_target, td->lat_depth);
+}
+
+/* Should be called with lat_lock held */
+static void throtl_lat_met(struct throtl_data *td)
+{
+	if (!td->lat_depth ||
+	    time_before(jiffies, td->lat_last_miss + throtl_slice) ||
+	    time_before(jiffies, td->lat_last_adjust + throtl_slice))
+		return;
+
+	td->lat_last_adjust = jiffies;
+	if (++td->lat_depth > THROTL_LAT_DEPTH_MAX)
+		td->lat_depth = 0;
+
+	throtl_log(td, "latency targets met depth=%u", td->lat_depth);
+	queue_work(kthrotld_workqueue, &td->lat_work);
+}
+
+static void throtl_lat_sample(struct throtl_data *td, struct throtl_grp *tg,
+				u64 usecs)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&td->lat_lock, flags);
+	if (!tg->latency_target) {
+		/* A group held back completes, maybe it may go faster */
+		throtl_lat_met(td);
+		goto out;
+	}
+
+	tg->lat_nr++;
+	if (usecs > tg->latency_target)
+		tg->lat_missed++;
+
+	if (time_before(jiffies, tg->lat_win_start + throtl_slice) ||
+	    tg->lat_nr < throtl_lat_min_samples)
+		goto out;
+
+	if (tg->lat_missed * 100 > tg->lat_nr * throtl_lat_miss_pct)
+		throtl_lat_missed(td, tg);
+	else
+		throtl_lat_met(td);
+
+	tg->lat_nr = tg->lat_missed = 0;
+	tg->lat_win_start = jiffies;
+out:
+	spin_unlock_irqrestore(&td->lat_lock, flags);
+}
+
+/* A request of @tg left, let its throttled bios go if they waited for it */
+static void throtl_lat_put(struct throtl_data *td, struct throtl_grp *tg)
+{
+	atomic_dec(&tg->nr_inflight);
+	if ((tg->nr_queued[READ] || tg->nr_queued[WRITE]) &&
+	    tg_lat_limited(td, tg))
+		queue_work(kthrotld_workqueue, &td->lat_work);
+}
+
+void blk_throtl_rq_init(struct request *rq, struct bio *bio)
+{
+	struct throtl_grp *tg;
+
+	if (!bio->bi_blkcg_id)
+		return;
+
+	rcu_read_lock();
+	tg = throtl_lookup_tg(rq->q->td, bio->bi_blkcg_id);
+	if (tg) {
+		rq->blkcg_id = bio->bi_blkcg_id;
+		atomic_inc(&tg->nr_inflight);
+	}
+	rcu_read_unlock();
+}
+
+void blk_throtl_rq_done(struct request *rq)
+{
+	struct throtl_data *td = rq->q->td;
+	struct throtl_grp *tg;
+	u64 now, usecs = 0;
+
+	if (!rq->blkcg_id)
+		return;
+
+	now = sched_clock();
+	if (time_after64(now, rq_start_time_ns(rq))) {
+		usecs = now - rq_start_time_ns(rq);
+		do_div(usecs, NSEC_PER_USEC);
+	}
+
+	rcu_read_lock();
+	tg = throtl_lookup_tg(td, rq->blkcg_id);
+	if (tg) {
+		blkiocg_update_latency_stats(&tg->blkg, usecs,
+						rq_data_dir(rq));
+		if (tg->latency_target || ACCESS_ONCE(td->lat_depth))
+			throtl_lat_sample(td, tg, usecs);
+		throtl_lat_put(td, tg);
+	}
+	rcu_read_unlock();
+	rq->blkcg_id = 0;
+}
+
+/* A request freed without completing, eg. merged into another one */
+void blk_throtl_rq_free(struct request *rq)
+{
+	struct throtl_grp *tg;
+
+	if (!rq->blkcg_id)
+		return;
+
+	rcu_read_lock();
+	tg = throtl_lookup_tg(rq->q->td, rq->blkcg_id);
+	if (tg)
+		throtl_lat_put(rq->q->td, tg);
+	rcu_read_unlock();
+	rq->blkcg_id = 0;
+}
+
 int blk_throtl_init(struct request_queue *q)
 {
 	struct throtl_data *td;
@@ -1237,6 +1542,8 @@ int blk_throtl_init(struct request_queue *q)
 	td->tg_service_tree = THROTL_RB_ROOT;
 	td->limits_changed = false;
 	INIT_DELAYED_WORK(&td->throtl_work, blk_throtl_work);
+	spin_lock_init(&td->lat_lock);
+	INIT_WORK(&td->lat_work, throtl_lat_work);
 
 	/* alloc and Init root group. */
 	td->queue = q;
@@ -0,0 +1,313 @@
+/*
+ * Writeback throttling
+ *
+ * Background writeback submits as much as the request queue takes, and a
+ * read issued behind a queue full of writes waits for all of them.  The
+ * async writes in flight on a queue are limited to a depth which follows
+ * the read latency: the fastest of the reads completed in each window
+ * (win_nsec) is compared to a target (min_lat_nsec).  When even that read
+ * was late, the device is taken as congested by writes and the depth is
+ * halved.  Windows whose reads met the target bring the depth back one
+ * step at a time to the default, half of nr_requests, and windows with
+ * writes but no reads at all let writeback have the whole queue.
+ *
+ * Only plain async writes, that is writeback, are throttled: sync writes
+ * (fsync, O_DIRECT), flushes and discards are not, nor are bio based
+ * queues, which have no completion to measure.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+
+#include "blk-wbt.h"
+
+/* Default read latency targets, and window */
+#define WBT_LAT_NONROT		(2ULL * NSEC_PER_MSEC)
+#define WBT_LAT_ROT		(75ULL * NSEC_PER_MSEC)
+#define WBT_WIN			(100ULL * NSEC_PER_MSEC)
+
+static inline bool wbt_enabled(struct rq_wb *rwb)
+{
+	return rwb && rwb->min_lat_nsec;
+}
+
+u64 blk_wbt_lat_nsec(struct rq_wb *rwb)
+{
+	if (rwb->min_lat_nsec >= 0)
+		return rwb->min_lat_nsec;
+
+	return blk_queue_nonrot(rwb->queue) ? WBT_LAT_NONROT : WBT_LAT_ROT;
+}
+
+unsigned int blk_wbt_max_depth(struct rq_wb *rwb)
+{
+	return max_t(unsigned int, rwb->queue->nr_requests, 1);
+}
+
+/*
+ * Half the queue at scale_step 0, halved per step down to a single write,
+ * all of it at -1.
+ */
+static unsigned int wbt_calc_limit(struct rq_wb *rwb)
+{
+	unsigned int max = blk_wbt_max_depth(rwb);
+	int step = rwb->scale_step;
+
+	if (step < 0)
+		return max;
+
+	return max_t(unsigned int, ((max + 1) / 2) >> min(step, 31), 1);
+}
+
+/* After a change of nr_requests */
+void blk_wbt_update_limit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	unsigned long flags;
+
+	if (!rwb)
+		return;
+
+	spin_lock_irqsave(&rwb->lock, flags);
+	rwb->limit = wbt_calc_limit(rwb);
+	spin_unlock_irqrestore(&rwb->lock, flags);
+
+	wake_up_all(&rwb->wait);
+}
+
+/* 0 turns throttling off, -1 restores the default target */
+void blk_wbt_set_lat(struct rq_wb *rwb, s64 nsec)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&rwb->lock, flags);
+	rwb->min_lat_nsec = nsec;
+	rwb->scale_step = 0;
+	rwb->limit = wbt_calc_limit(rwb);
+	spin_unlock_irqrestore(&rwb->lock, flags);
+
+	wake_up_all(&rwb->wait);
+}
+
+static void wbt_arm_window(struct rq_wb *rwb)
+{
+	if (!timer_pending(&rwb->window))
+		mod_timer(&rwb->window,
+			  jiffies + max(nsecs_to_jiffies(rwb->win_nsec), 1UL));
+}
+
+static void wbt_window_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *)data;
+	unsigned int reads, old_limit;
+	unsigned long flags;
+	u64 min_ns;
+	bool busy;
+
+	spin_lock_irqsave(&rwb->lock, flags);
+	reads = rwb->win_reads;
+	min_ns = rwb->win_min_ns;
+	rwb->win_reads = 0;
+	rwb->win_min_ns = 0;
+	rwb->windows++;
+
+	old_limit = rwb->limit;
+	busy = atomic_read(&rwb->inflight) || waitqueue_active(&rwb->wait);
+
+	if (reads && min_ns > blk_wbt_lat_nsec(rwb)) {
+		/* even the fastest read was late: writes hold the device */
+		rwb->missed++;
+		if (rwb->limit > 1)
+			rwb->scale_step++;
+	} else if (reads) {
+		if (rwb->scale_step > 0)
+			rwb->scale_step--;
+		else
+			rwb->scale_step = 0;
+	} else if (atomic_read(&rwb->reads_inflight)) {
+		/* reads waiting a whole window are no reason to scale up */
+		if (rwb->scale_step < 0)
+			rwb->scale_step = 0;
+	} else if (busy)
+		rwb->scale_step = -1;
+	else
+		rwb->scale_step = 0;
+
+	rwb->limit = wbt_calc_limit(rwb);
+	spin_unlock_irqrestore(&rwb->lock, flags);
+
+	if (rwb->limit > old_limit)
+		wake_up_all(&rwb->wait);
+	if (busy || reads)
+		wbt_arm_window(rwb);
+}
+
+/* Background and periodic writeback: plain async writes */
+static bool wbt_should_throttle(struct bio *bio)
+{
+	return (bio->bi_rw & REQ_WRITE) &&
+	       !(bio->bi_rw & (REQ_SYNC | REQ_FLUSH | REQ_FUA | REQ_DISCARD));
+}
+
+static bool wbt_inflight_inc(struct rq_wb *rwb)
+{
+	unsigned int limit = ACCESS_ONCE(rwb->limit);
+	int cur;
+
+	do {
+		cur = atomic_read(&rwb->inflight);
+		if (cur >= limit)
+			return false;
+	} while (atomic_cmpxchg(&rwb->inflight, cur, cur + 1) != cur);
+
+	return true;
+}
+
+static void wbt_inflight_dec(struct rq_wb *rwb)
+{
+	int inflight = atomic_dec_return(&rwb->inflight);
+
+	/* let the waiters in by batches, once half the depth completed */
+	if (inflight <= ACCESS_ONCE(rwb->limit) / 2 &&
+	    waitqueue_active(&rwb->wait))
+		wake_up_all(&rwb->wait);
+}
+
+/**
+ * blk_wbt_wait - wait for room to submit a writeback bio
+ * @q:		the queue
+ * @bio:	the bio about to get a request
+ * @lock:	lock held by the caller, dropped while sleeping, or NULL
+ *
+ * Returns true if the bio was counted in flight: its request is then
+ * marked with blk_wbt_track(), and uncounted when it completes or is
+ * freed.
+ */
+bool blk_wbt_wait(struct request_queue *q, struct bio *bio, spinlock_t *lock)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	bool tracked = true;
+	DEFINE_WAIT(wait);
+
+	if (!wbt_enabled(rwb) || !wbt_should_throttle(bio))
+		return false;
+
+	if (!wbt_inflight_inc(rwb)) {
+		atomic_long_inc(&rwb->throttled);
+		for (;;) {
+			prepare_to_wait(&rwb->wait, &wait,
+					TASK_UNINTERRUPTIBLE);
+			if (!wbt_enabled(rwb)) {
+				tracked = false;
+				break;
+			}
+			if (wbt_inflight_inc(rwb))
+				break;
+
+			if (lock)
+				spin_unlock_irq(lock);
+			io_schedule();
+			if (lock)
+				spin_lock_irq(lock);
+		}
+		finish_wait(&rwb->wait, &wait);
+	}
+
+	if (tracked)
+		wbt_arm_window(rwb);
+	return tracked;
+}
+
+/* The request is handed to the driver: start timing the reads */
+void blk_wbt_rq_issue(struct request *rq)
+{
+	struct rq_wb *rwb = rq->q->rq_wb;
+
+	if (!wbt_enabled(rwb) || rq->cmd_type != REQ_TYPE_FS ||
+	    rq_data_dir(rq) != READ)
+		return;
+
+	rq->wbt_issue_ns = ktime_to_ns(ktime_get());
+	if (!(rq->wbt_flags & WBT_READ)) {
+		rq->wbt_flags |= WBT_READ;
+		atomic_inc(&rwb->reads_inflight);
+	}
+}
+
+void blk_wbt_rq_done(struct request *rq)
+{
+	struct rq_wb *rwb = rq->q->rq_wb;
+	unsigned long flags;
+	s64 lat;
+
+	if (!rq->wbt_flags)
+		return;
+
+	if (rq->wbt_flags & WBT_READ) {
+		lat = ktime_to_ns(ktime_get()) - rq->wbt_issue_ns;
+
+		spin_lock_irqsave(&rwb->lock, flags);
+		if (lat > 0 && (!rwb->win_reads || lat < rwb->win_min_ns))
+			rwb->win_min_ns = lat;
+		rwb->win_reads++;
+		spin_unlock_irqrestore(&rwb->lock, flags);
+	}
+
+	blk_wbt_rq_free(rq);
+}
+
+/* Also for a request freed without completing, eg. merged into another */
+void blk_wbt_rq_free(struct request *rq)
+{
+	struct rq_wb *rwb = rq->q->rq_wb;
+
+	if (!rq->wbt_flags)
+		return;
+
+	if (rq->wbt_flags & WBT_TRACKED)
+		wbt_inflight_dec(rwb);
+	if (rq->wbt_flags & WBT_READ)
+		atomic_dec(&rwb->reads_inflight);
+	rq->wbt_flags = 0;
+}
+
+/*
+ * Called for the request based queues.  Without the memory, the queue
+ * just runs unthrottled.
+ */
+void blk_wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	rwb = kzalloc_node(sizeof(*rwb), GFP_KERNEL, q->node);
+	if (!rwb)
+		return;
+
+	rwb->queue = q;
+	rwb->min_lat_nsec = -1;
+	rwb->win_nsec = WBT_WIN;
+	atomic_set(&rwb->inflight, 0);
+	atomic_set(&rwb->reads_inflight, 0);
+	init_waitqueue_head(&rwb->wait);
+	spin_lock_init(&rwb->lock);
+	setup_timer(&rwb->window, wbt_window_fn, (unsigned long)rwb);
+	rwb->limit = wbt_calc_limit(rwb);
+
+	q->rq_wb = rwb;
+}
+
+void blk_wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	del_timer_sync(&rwb->window);
+	q->rq_wb = NULL;
+	kfree(rwb);
+}
@@ -0,0 +1,80 @@
+#ifndef INT_BLK_WBT_H
+#define INT_BLK_WBT_H
+
+#include <linux/atomic.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+#include <linux/wait.h>
+
+/* rq->wbt_flags */
+enum {
+	WBT_TRACKED	= 1 << 0,	/* async write counted in inflight */
+	WBT_READ	= 1 << 1,	/* read issued, latency to be sampled */
+};
+
+/*
+ * Writeback throttling state of a request queue, see blk-wbt.c
+ */
+struct rq_wb {
+	struct request_queue	*queue;
+
+	/*
+	 * Read latency target and the window it is checked over, in nsecs.
+	 * min_lat_nsec is -1 for the default of the device type, 0 when
+	 * throttling is off.
+	 */
+	s64			min_lat_nsec;
+	u64			win_nsec;
+
+	/* async writes in flight, and the most allowed */
+	atomic_t		inflight;
+	unsigned int		limit;
+	int			scale_step;	/* > 0 scaled down */
+	wait_queue_head_t	wait;
+
+	atomic_t		reads_inflight;
+	struct timer_list	window;
+
+	spinlock_t		lock;		/* protects the window stats */
+	unsigned int		win_reads;
+	u64			win_min_ns;
+
+	unsigned long		windows;
+	unsigned long		missed;
+	atomic_long_t		throttled;
+};
+
+#ifdef CONFIG_BLK_WBT
+extern void blk_wbt_init(struct request_queue *q);
+extern void blk_wbt_exit(struct request_queue *q);
+extern bool blk_wbt_wait(struct request_queue *q, struct bio *bio,
+			 spinlock_t *lock);
+extern void blk_wbt_rq_issue(struct request *rq);
+extern void blk_wbt_rq_done(struct request *rq);
+extern void blk_wbt_rq_free(struct request *rq);
+extern void blk_wbt_update_limit(struct request_queue *q);
+extern u64 blk_wbt_lat_nsec(struct rq_wb *rwb);
+extern void blk_wbt_set_lat(struct rq_wb *rwb, s64 nsec);
+extern unsigned int blk_wbt_max_depth(struct rq_wb *rwb);
+
+static inline void blk_wbt_track(struct request *rq, bool tracked)
+{
+	if (tracked)
+		rq->wbt_flags |= WBT_TRACKED;
+}
+#else
+static inline void blk_wbt_init(struct request_queue *q) {}
+static inline void blk_wbt_exit(struct request_queue *q) {}
+static inline bool blk_wbt_wait(struct request_queue *q, struct bio *bio,
+				spinlock_t *lock)
+{
+	return false;
+}
+static inline void blk_wbt_rq_issue(struct request *rq) {}
+static inline void blk_wbt_rq_done(struct request *rq) {}
+static inline void blk_wbt_rq_free(struct request *rq) {}
+static inline void blk_wbt_update_limit(struct request_queue *q) {}
+static inline void blk_wbt_track(struct request *rq, bool tracked) {}
+#endif
+
+#endif
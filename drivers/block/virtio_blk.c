@@ -2,6 +2,7 @@
 #include <linux/spinlock.h>
 #include <linux/slab.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/hdreg.h>
 #include <linux/virtio.h>
 #include <linux/virtio_blk.h>
@@ -14,6 +15,14 @@
 static int major, index;
 struct workqueue_struct *virtblk_wq;
 
+static bool use_mq;
+module_param(use_mq, bool, 0444);
+MODULE_PARM_DESC(use_mq, "Use the multi-queue block layer");
+
+static unsigned int virtblk_queue_depth = 64;
+module_param_named(queue_depth, virtblk_queue_depth, uint, 0444);
+MODULE_PARM_DESC(queue_depth, "Tags per queue with use_mq");
+
 struct virtio_blk
 {
 	spinlock_t lock;
@@ -35,6 +44,9 @@ struct virtio_blk
 	/* What host tells us, plus 2 for header & tailer. */
 	unsigned int sg_elems;
 
+	/* Requests come through the multi-queue block layer */
+	bool mq;
+
 	/* Scatterlist: can be too big for stack. */
 	struct scatterlist sg[/*sg_elems*/];
 };
@@ -84,25 +96,26 @@ static void blk_done(struct virtqueue *vq)
 			break;
 		}
 
-		__blk_end_request_all(vbr->req, error);
 		list_del(&vbr->list);
-		mempool_free(vbr, vblk->pool);
+		if (vblk->mq) {
+			blk_mq_end_io(vbr->req, error);
+		} else {
+			__blk_end_request_all(vbr->req, error);
+			mempool_free(vbr, vblk->pool);
+		}
 	}
 	/* In case queue is stopped waiting for more buffers. */
-	blk_start_queue(vblk->disk->queue);
+	if (vblk->mq)
+		blk_mq_start_stopped_hw_queues(vblk->disk->queue, true);
+	else
+		blk_start_queue(vblk->disk->queue);
 	spin_unlock_irqrestore(&vblk->lock, flags);
 }
 
-static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
-		   struct request *req)
+static bool __do_req(struct request_queue *q, struct virtio_blk *vblk,
+		     struct virtblk_req *vbr, struct request *req)
 {
 	unsigned long num, out = 0, in = 0;
-	struct virtblk_req *vbr;
-
-	vbr = mempool_alloc(vblk->pool, GFP_ATOMIC);
-	if (!vbr)
-		/* When another request finishes we'll try again. */
-		return false;
 
 	vbr->req = req;
 
@@ -165,15 +178,30 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	if (virtqueue_add_buf(vblk->vq, vblk->sg, out, in, vbr) < 0) {
-		mempool_free(vbr, vblk->pool);
+	if (virtqueue_add_buf(vblk->vq, vblk->sg, out, in, vbr) < 0)
 		return false;
-	}
 
 	list_add_tail(&vbr->list, &vblk->reqs);
 	return true;
 }
 
+static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
+		   struct request *req)
+{
+	struct virtblk_req *vbr;
+
+	vbr = mempool_alloc(vblk->pool, GFP_ATOMIC);
+	if (!vbr)
+		/* When another request finishes we'll try again. */
+		return false;
+
+	if (!__do_req(q, vblk, vbr, req)) {
+		mempool_free(vbr, vblk->pool);
+		return false;
+	}
+	return true;
+}
+
 static void do_virtblk_request(struct request_queue *q)
 {
 	struct virtio_blk *vblk = q->queuedata;
@@ -197,6 +225,45 @@ static void do_virtblk_request(struct request_queue *q)
 		virtqueue_kick(vblk->vq);
 }
 
+/*
+ * With use_mq, the virtblk_req of a request is its driver data, and there
+ * is a single hardware queue for the single virtqueue: no mempool, and no
+ * queue_lock taken by the block layer on submission.
+ */
+static int virtblk_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *req)
+{
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	struct virtblk_req *vbr = blk_mq_rq_to_pdu(req);
+	unsigned long flags;
+
+	BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
+
+	spin_lock_irqsave(&vblk->lock, flags);
+	if (!__do_req(hctx->queue, vblk, vbr, req)) {
+		/* blk_done() restarts the queue when the ring has room */
+		blk_mq_stop_hw_queue(hctx);
+		spin_unlock_irqrestore(&vblk->lock, flags);
+		return BLK_MQ_RQ_QUEUE_BUSY;
+	}
+	virtqueue_kick(vblk->vq);
+	spin_unlock_irqrestore(&vblk->lock, flags);
+
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static struct blk_mq_ops virtio_mq_ops = {
+	.queue_rq	= virtblk_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+};
+
+static struct blk_mq_reg virtio_mq_reg = {
+	.ops		= &virtio_mq_ops,
+	.nr_hw_queues	= 1,
+	.cmd_size	= sizeof(struct virtblk_req),
+	.numa_node	= NUMA_NO_NODE,
+	.flags		= BLK_MQ_F_SHOULD_MERGE,
+};
+
 /* return id (s/n) string for *disk to *id_str
  */
 static int virtblk_get_id(struct gendisk *disk, char *id_str)
@@ -395,11 +462,22 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 		goto out_mempool;
 	}
 
-	q = vblk->disk->queue = blk_init_queue(do_virtblk_request, &vblk->lock);
-	if (!q) {
-		err = -ENOMEM;
-		goto out_put_disk;
+	if (use_mq) {
+		virtio_mq_reg.queue_depth = virtblk_queue_depth;
+		q = blk_mq_init_queue(&virtio_mq_reg, vblk);
+		if (IS_ERR(q)) {
+			err = PTR_ERR(q);
+			goto out_put_disk;
+		}
+		vblk->mq = true;
+	} else {
+		q = blk_init_queue(do_virtblk_request, &vblk->lock);
+		if (!q) {
+			err = -ENOMEM;
+			goto out_put_disk;
+		}
 	}
+	vblk->disk->queue = q;
 
 	q->queuedata = vblk;
 
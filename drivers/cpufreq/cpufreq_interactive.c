@@ -24,13 +24,53 @@
 #include <linux/tick.h>
 #include <linux/time.h>
 #include <linux/timer.h>
-#include <linux/workqueue.h>
 #include <linux/kthread.h>
-#include <linux/mutex.h>
+#include <linux/slab.h>
 
 #include <asm/cputime.h>
 
-static atomic_t active_count = ATOMIC_INIT(0);
+#define CREATE_TRACE_POINTS
+#include <trace/events/cpufreq_interactive.h>
+
+/* Go to hi speed when CPU load at or above this value. */
+#define DEFAULT_GO_HISPEED_LOAD 95
+
+/*
+ * The minimum amount of time to spend at a frequency before we can ramp down.
+ */
+#define DEFAULT_MIN_SAMPLE_TIME 20 * USEC_PER_MSEC
+
+/*
+ * The sample rate of the timer used to increase frequency
+ */
+#define DEFAULT_TIMER_RATE 20 * USEC_PER_MSEC
+
+/*
+ * State and tunables of one policy, shown in the policy's sysfs directory
+ * as interactive/.  Freed with its kobject.
+ */
+struct cpufreq_interactive_policy {
+	struct kobject kobj;
+	struct cpufreq_policy *policy;
+
+	/* Hi speed to bump to from lo speed when load burst (default max) */
+	unsigned int hispeed_freq;
+	unsigned long go_hispeed_load;
+	unsigned long min_sample_time;
+	unsigned long timer_rate;
+
+	/*
+	 * Speed change request slot.  The timers of the policy's cpus store
+	 * their own target in their cpuinfo, then set this and wake up
+	 * speedchange_task, which picks the highest target.  No lock is
+	 * taken on the way from the timer to the speed change.
+	 */
+	atomic_t speedchange_pending;
+	struct task_struct *speedchange_task;
+
+	/* Serializes speed changes with governor limits */
+	struct mutex set_speed_lock;
+};
 
 struct cpufreq_interactive_cpuinfo {
 	struct timer_list cpu_timer;
@@ -42,6 +82,7 @@ struct cpufreq_interactive_cpuinfo {
 	u64 freq_change_time;
 	u64 freq_change_time_in_idle;
 	struct cpufreq_policy *policy;
+	struct cpufreq_interactive_policy *ipolicy;
 	struct cpufreq_frequency_table *freq_table;
 	unsigned int target_freq;
 	int governor_enabled;
@@ -49,35 +90,6 @@ struct cpufreq_interactive_cpuinfo {
 
 static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
 
-/* Workqueues handle frequency scaling */
-static struct task_struct *up_task;
-static struct workqueue_struct *down_wq;
-static struct work_struct freq_scale_down_work;
-static cpumask_t up_cpumask;
-static spinlock_t up_cpumask_lock;
-static cpumask_t down_cpumask;
-static spinlock_t down_cpumask_lock;
-static struct mutex set_speed_lock;
-
-/* Hi speed to bump to from lo speed when load burst (default max) */
-static u64 hispeed_freq;
-
-/* Go to hi speed when CPU load at or above this value. */
-#define DEFAULT_GO_HISPEED_LOAD 95
-static unsigned long go_hispeed_load;
-
-/*
- * The minimum amount of time to spend at a frequency before we can ramp down.
- */
-#define DEFAULT_MIN_SAMPLE_TIME 20 * USEC_PER_MSEC
-static unsigned long min_sample_time;
-
-/*
- * The sample rate of the timer used to increase frequency
- */
-#define DEFAULT_TIMER_RATE 20 * USEC_PER_MSEC
-static unsigned long timer_rate;
-
 static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		unsigned int event);
 
@@ -91,6 +103,18 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
+/*
+ * Posts a speed change request for the policy.  Called from the timers
+ * after updating their own target_freq: the xchg orders that store before
+ * the request, and the request before the wakeup.
+ */
+static void cpufreq_interactive_request(
+	struct cpufreq_interactive_policy *ipolicy)
+{
+	atomic_xchg(&ipolicy->speedchange_pending, 1);
+	wake_up_process(ipolicy->speedchange_task);
+}
+
 static void cpufreq_interactive_timer(unsigned long data)
 {
 	unsigned int delta_idle;
@@ -101,16 +125,18 @@ static void cpufreq_interactive_timer(unsigned long data)
 	u64 idle_exit_time;
 	struct cpufreq_interactive_cpuinfo *pcpu =
 		&per_cpu(cpuinfo, data);
+	struct cpufreq_interactive_policy *ipolicy;
 	u64 now_idle;
 	unsigned int new_freq;
 	unsigned int index;
-	unsigned long flags;
 
 	smp_rmb();
 
 	if (!pcpu->governor_enabled)
 		goto exit;
 
+	ipolicy = pcpu->ipolicy;
+
 	/*
 	 * Once pcpu->timer_run_time is updated to >= pcpu->idle_exit_time,
 	 * this lets idle exit know the current idle time sample has
@@ -163,9 +189,9 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (load_since_change > cpu_load)
 		cpu_load = load_since_change;
 
-	if (cpu_load >= go_hispeed_load) {
+	if (cpu_load >= ipolicy->go_hispeed_load) {
 		if (pcpu->policy->cur == pcpu->policy->min)
-			new_freq = hispeed_freq;
+			new_freq = ipolicy->hispeed_freq;
 		else
 			new_freq = pcpu->policy->max * cpu_load / 100;
 	} else {
@@ -182,8 +208,11 @@ static void cpufreq_interactive_timer(unsigned long data)
 
 	new_freq = pcpu->freq_table[index].frequency;
 
-	if (pcpu->target_freq == new_freq)
+	if (pcpu->target_freq == new_freq) {
+		trace_cpufreq_interactive_already(data, cpu_load,
+				pcpu->target_freq, pcpu->policy->cur, new_freq);
 		goto rearm_if_notmax;
+	}
 
 	/*
 	 * Do not scale down unless we have been at this frequency for the
@@ -191,23 +220,17 @@ static void cpufreq_interactive_timer(unsigned long data)
 	 */
 	if (new_freq < pcpu->target_freq) {
 		if (cputime64_sub(pcpu->timer_run_time, pcpu->freq_change_time)
-		    < min_sample_time)
+		    < ipolicy->min_sample_time) {
+			trace_cpufreq_interactive_notyet(data, cpu_load,
+				pcpu->target_freq, pcpu->policy->cur, new_freq);
 			goto rearm;
+		}
 	}
 
-	if (new_freq < pcpu->target_freq) {
-		pcpu->target_freq = new_freq;
-		spin_lock_irqsave(&down_cpumask_lock, flags);
-		cpumask_set_cpu(data, &down_cpumask);
-		spin_unlock_irqrestore(&down_cpumask_lock, flags);
-		queue_work(down_wq, &freq_scale_down_work);
-	} else {
-		pcpu->target_freq = new_freq;
-		spin_lock_irqsave(&up_cpumask_lock, flags);
-		cpumask_set_cpu(data, &up_cpumask);
-		spin_unlock_irqrestore(&up_cpumask_lock, flags);
-		wake_up_process(up_task);
-	}
+	trace_cpufreq_interactive_target(data, cpu_load, pcpu->target_freq,
+					 pcpu->policy->cur, new_freq);
+	pcpu->target_freq = new_freq;
+	cpufreq_interactive_request(ipolicy);
 
 rearm_if_notmax:
 	/*
@@ -236,7 +259,7 @@ rearm:
 		pcpu->time_in_idle = get_cpu_idle_time_us(
 			data, &pcpu->idle_exit_time);
 		mod_timer(&pcpu->cpu_timer,
-			  jiffies + usecs_to_jiffies(timer_rate));
+			  jiffies + usecs_to_jiffies(ipolicy->timer_rate));
 	}
 
 exit:
@@ -270,8 +293,8 @@ static void cpufreq_interactive_idle_start(void)
 			pcpu->time_in_idle = get_cpu_idle_time_us(
 				smp_processor_id(), &pcpu->idle_exit_time);
 			pcpu->timer_idlecancel = 0;
-			mod_timer(&pcpu->cpu_timer,
-				  jiffies + usecs_to_jiffies(timer_rate));
+			mod_timer(&pcpu->cpu_timer, jiffies +
+				  usecs_to_jiffies(pcpu->ipolicy->timer_rate));
 		}
 #endif
 	} else {
@@ -321,120 +344,75 @@ static void cpufreq_interactive_idle_end(void)
 			get_cpu_idle_time_us(smp_processor_id(),
 					     &pcpu->idle_exit_time);
 		pcpu->timer_idlecancel = 0;
-		mod_timer(&pcpu->cpu_timer,
-			  jiffies + usecs_to_jiffies(timer_rate));
+		mod_timer(&pcpu->cpu_timer, jiffies +
+			  usecs_to_jiffies(pcpu->ipolicy->timer_rate));
 	}
 
 }
 
-static int cpufreq_interactive_up_task(void *data)
+/*
+ * Applies the highest target of the policy's cpus.  A request posted while
+ * this runs is picked up on the next pass of the speed change task.
+ */
+static void cpufreq_interactive_set_speed(
+	struct cpufreq_interactive_policy *ipolicy)
 {
-	unsigned int cpu;
-	cpumask_t tmp_mask;
-	unsigned long flags;
-	struct cpufreq_interactive_cpuinfo *pcpu;
-
-	while (1) {
-		set_current_state(TASK_INTERRUPTIBLE);
-		spin_lock_irqsave(&up_cpumask_lock, flags);
-
-		if (cpumask_empty(&up_cpumask)) {
-			spin_unlock_irqrestore(&up_cpumask_lock, flags);
-			schedule();
-
-			if (kthread_should_stop())
-				break;
-
-			spin_lock_irqsave(&up_cpumask_lock, flags);
-		}
-
-		set_current_state(TASK_RUNNING);
-		tmp_mask = up_cpumask;
-		cpumask_clear(&up_cpumask);
-		spin_unlock_irqrestore(&up_cpumask_lock, flags);
-
-		for_each_cpu(cpu, &tmp_mask) {
-			unsigned int j;
-			unsigned int max_freq = 0;
-
-			pcpu = &per_cpu(cpuinfo, cpu);
-			smp_rmb();
-
-			if (!pcpu->governor_enabled)
-				continue;
-
-			mutex_lock(&set_speed_lock);
+	struct cpufreq_policy *policy = ipolicy->policy;
+	struct cpufreq_interactive_cpuinfo *pjcpu;
+	unsigned int max_freq = 0;
+	unsigned int j;
 
-			for_each_cpu(j, pcpu->policy->cpus) {
-				struct cpufreq_interactive_cpuinfo *pjcpu =
-					&per_cpu(cpuinfo, j);
+	mutex_lock(&ipolicy->set_speed_lock);
 
-				if (pjcpu->target_freq > max_freq)
-					max_freq = pjcpu->target_freq;
-			}
+	for_each_cpu(j, policy->cpus) {
+		pjcpu = &per_cpu(cpuinfo, j);
+		if (pjcpu->target_freq > max_freq)
+			max_freq = pjcpu->target_freq;
+	}
 
-			if (max_freq != pcpu->policy->cur)
-				__cpufreq_driver_target(pcpu->policy,
-							max_freq,
-							CPUFREQ_RELATION_H);
-			mutex_unlock(&set_speed_lock);
+	if (max_freq != policy->cur) {
+		__cpufreq_driver_target(policy, max_freq, CPUFREQ_RELATION_H);
 
-			pcpu->freq_change_time_in_idle =
-				get_cpu_idle_time_us(cpu,
-						     &pcpu->freq_change_time);
+		for_each_cpu(j, policy->cpus) {
+			pjcpu = &per_cpu(cpuinfo, j);
+			pjcpu->freq_change_time_in_idle =
+				get_cpu_idle_time_us(j,
+						     &pjcpu->freq_change_time);
 		}
 	}
+	trace_cpufreq_interactive_setspeed(policy->cpu, max_freq, policy->cur);
 
-	return 0;
+	mutex_unlock(&ipolicy->set_speed_lock);
 }
 
-static void cpufreq_interactive_freq_down(struct work_struct *work)
+static int cpufreq_interactive_speedchange_task(void *data)
 {
-	unsigned int cpu;
-	cpumask_t tmp_mask;
-	unsigned long flags;
-	struct cpufreq_interactive_cpuinfo *pcpu;
-
-	spin_lock_irqsave(&down_cpumask_lock, flags);
-	tmp_mask = down_cpumask;
-	cpumask_clear(&down_cpumask);
-	spin_unlock_irqrestore(&down_cpumask_lock, flags);
+	struct cpufreq_interactive_policy *ipolicy = data;
 
-	for_each_cpu(cpu, &tmp_mask) {
-		unsigned int j;
-		unsigned int max_freq = 0;
-
-		pcpu = &per_cpu(cpuinfo, cpu);
-		smp_rmb();
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
 
-		if (!pcpu->governor_enabled)
+		if (!atomic_xchg(&ipolicy->speedchange_pending, 0)) {
+			if (kthread_should_stop())
+				break;
+			schedule();
 			continue;
-
-		mutex_lock(&set_speed_lock);
-
-		for_each_cpu(j, pcpu->policy->cpus) {
-			struct cpufreq_interactive_cpuinfo *pjcpu =
-				&per_cpu(cpuinfo, j);
-
-			if (pjcpu->target_freq > max_freq)
-				max_freq = pjcpu->target_freq;
 		}
 
-		if (max_freq != pcpu->policy->cur)
-			__cpufreq_driver_target(pcpu->policy, max_freq,
-						CPUFREQ_RELATION_H);
-
-		mutex_unlock(&set_speed_lock);
-		pcpu->freq_change_time_in_idle =
-			get_cpu_idle_time_us(cpu,
-					     &pcpu->freq_change_time);
+		__set_current_state(TASK_RUNNING);
+		cpufreq_interactive_set_speed(ipolicy);
 	}
+
+	__set_current_state(TASK_RUNNING);
+	return 0;
 }
 
+#define to_ipolicy(k) container_of(k, struct cpufreq_interactive_policy, kobj)
+
 static ssize_t show_hispeed_freq(struct kobject *kobj,
 				 struct attribute *attr, char *buf)
 {
-	return sprintf(buf, "%llu\n", hispeed_freq);
+	return sprintf(buf, "%u\n", to_ipolicy(kobj)->hispeed_freq);
 }
 
 static ssize_t store_hispeed_freq(struct kobject *kobj,
@@ -442,12 +420,12 @@ static ssize_t store_hispeed_freq(struct kobject *kobj,
 				  size_t count)
 {
 	int ret;
-	u64 val;
+	unsigned long val;
 
-	ret = strict_strtoull(buf, 0, &val);
+	ret = strict_strtoul(buf, 0, &val);
 	if (ret < 0)
 		return ret;
-	hispeed_freq = val;
+	to_ipolicy(kobj)->hispeed_freq = val;
 	return count;
 }
 
@@ -458,7 +436,7 @@ static struct global_attr hispeed_freq_attr = __ATTR(hispeed_freq, 0644,
 static ssize_t show_go_hispeed_load(struct kobject *kobj,
 				     struct attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", go_hispeed_load);
+	return sprintf(buf, "%lu\n", to_ipolicy(kobj)->go_hispeed_load);
 }
 
 static ssize_t store_go_hispeed_load(struct kobject *kobj,
@@ -470,7 +448,7 @@ static ssize_t store_go_hispeed_load(struct kobject *kobj,
 	ret = strict_strtoul(buf, 0, &val);
 	if (ret < 0)
 		return ret;
-	go_hispeed_load = val;
+	to_ipolicy(kobj)->go_hispeed_load = val;
 	return count;
 }
 
@@ -480,7 +458,7 @@ static struct global_attr go_hispeed_load_attr = __ATTR(go_hispeed_load, 0644,
 static ssize_t show_min_sample_time(struct kobject *kobj,
 				struct attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", min_sample_time);
+	return sprintf(buf, "%lu\n", to_ipolicy(kobj)->min_sample_time);
 }
 
 static ssize_t store_min_sample_time(struct kobject *kobj,
@@ -492,7 +470,7 @@ static ssize_t store_min_sample_time(struct kobject *kobj,
 	ret = strict_strtoul(buf, 0, &val);
 	if (ret < 0)
 		return ret;
-	min_sample_time = val;
+	to_ipolicy(kobj)->min_sample_time = val;
 	return count;
 }
 
@@ -502,7 +480,7 @@ static struct global_attr min_sample_time_attr = __ATTR(min_sample_time, 0644,
 static ssize_t show_timer_rate(struct kobject *kobj,
 			struct attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", timer_rate);
+	return sprintf(buf, "%lu\n", to_ipolicy(kobj)->timer_rate);
 }
 
 static ssize_t store_timer_rate(struct kobject *kobj,
@@ -514,7 +492,7 @@ static ssize_t store_timer_rate(struct kobject *kobj,
 	ret = strict_strtoul(buf, 0, &val);
 	if (ret < 0)
 		return ret;
-	timer_rate = val;
+	to_ipolicy(kobj)->timer_rate = val;
 	return count;
 }
 
@@ -529,17 +507,99 @@ static struct attribute *interactive_attributes[] = {
 	NULL,
 };
 
-static struct attribute_group interactive_attr_group = {
-	.attrs = interactive_attributes,
-	.name = "interactive",
+/*
+ * The tunables get a kobject of their own rather than a group of freq_attrs
+ * on the policy: those take the policy rwsem, which is held when the
+ * governor is stopped and the directory removed.
+ */
+static ssize_t interactive_sysfs_show(struct kobject *kobj,
+				      struct attribute *attr, char *buf)
+{
+	struct global_attr *gattr = container_of(attr, struct global_attr, attr);
+
+	return gattr->show ? gattr->show(kobj, attr, buf) : -EIO;
+}
+
+static ssize_t interactive_sysfs_store(struct kobject *kobj,
+		struct attribute *attr, const char *buf, size_t count)
+{
+	struct global_attr *gattr = container_of(attr, struct global_attr, attr);
+
+	return gattr->store ? gattr->store(kobj, attr, buf, count) : -EIO;
+}
+
+static const struct sysfs_ops interactive_sysfs_ops = {
+	.show = interactive_sysfs_show,
+	.store = interactive_sysfs_store,
 };
 
+static void cpufreq_interactive_policy_release(struct kobject *kobj)
+{
+	kfree(to_ipolicy(kobj));
+}
+
+static struct kobj_type interactive_ktype = {
+	.sysfs_ops = &interactive_sysfs_ops,
+	.default_attrs = interactive_attributes,
+	.release = cpufreq_interactive_policy_release,
+};
+
+static struct cpufreq_interactive_policy *
+cpufreq_interactive_policy_alloc(struct cpufreq_policy *policy)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
+	struct cpufreq_interactive_policy *ipolicy;
+	struct task_struct *task;
+	int rc;
+
+	ipolicy = kzalloc(sizeof(*ipolicy), GFP_KERNEL);
+	if (!ipolicy)
+		return ERR_PTR(-ENOMEM);
+
+	ipolicy->policy = policy;
+	ipolicy->hispeed_freq = policy->max;
+	ipolicy->go_hispeed_load = DEFAULT_GO_HISPEED_LOAD;
+	ipolicy->min_sample_time = DEFAULT_MIN_SAMPLE_TIME;
+	ipolicy->timer_rate = DEFAULT_TIMER_RATE;
+	mutex_init(&ipolicy->set_speed_lock);
+
+	task = kthread_create(cpufreq_interactive_speedchange_task, ipolicy,
+			      "kinteractive/%u", policy->cpu);
+	if (IS_ERR(task)) {
+		kfree(ipolicy);
+		return ERR_CAST(task);
+	}
+	sched_setscheduler_nocheck(task, SCHED_FIFO, &param);
+	get_task_struct(task);
+	ipolicy->speedchange_task = task;
+	wake_up_process(task);
+
+	rc = kobject_init_and_add(&ipolicy->kobj, &interactive_ktype,
+				  &policy->kobj, "interactive");
+	if (rc) {
+		kthread_stop(task);
+		put_task_struct(task);
+		kobject_put(&ipolicy->kobj);
+		return ERR_PTR(rc);
+	}
+
+	return ipolicy;
+}
+
+static void cpufreq_interactive_policy_free(
+	struct cpufreq_interactive_policy *ipolicy)
+{
+	kthread_stop(ipolicy->speedchange_task);
+	put_task_struct(ipolicy->speedchange_task);
+	kobject_put(&ipolicy->kobj);
+}
+
 static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		unsigned int event)
 {
-	int rc;
 	unsigned int j;
 	struct cpufreq_interactive_cpuinfo *pcpu;
+	struct cpufreq_interactive_policy *ipolicy;
 	struct cpufreq_frequency_table *freq_table;
 
 	switch (event) {
@@ -547,12 +607,17 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		if (!cpu_online(policy->cpu))
 			return -EINVAL;
 
+		ipolicy = cpufreq_interactive_policy_alloc(policy);
+		if (IS_ERR(ipolicy))
+			return PTR_ERR(ipolicy);
+
 		freq_table =
 			cpufreq_frequency_get_table(policy->cpu);
 
 		for_each_cpu(j, policy->cpus) {
 			pcpu = &per_cpu(cpuinfo, j);
 			pcpu->policy = policy;
+			pcpu->ipolicy = ipolicy;
 			pcpu->target_freq = policy->cur;
 			pcpu->freq_table = freq_table;
 			pcpu->freq_change_time_in_idle =
@@ -561,29 +626,25 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			pcpu->governor_enabled = 1;
 			smp_wmb();
 		}
-
-		if (!hispeed_freq)
-			hispeed_freq = policy->max;
-
-		/*
-		 * Do not register the idle hook and create sysfs
-		 * entries if we have already done so.
-		 */
-		if (atomic_inc_return(&active_count) > 1)
-			return 0;
-
-		rc = sysfs_create_group(cpufreq_global_kobject,
-				&interactive_attr_group);
-		if (rc)
-			return rc;
-
 		break;
 
 	case CPUFREQ_GOV_STOP:
+		ipolicy = per_cpu(cpuinfo, policy->cpu).ipolicy;
+
 		for_each_cpu(j, policy->cpus) {
 			pcpu = &per_cpu(cpuinfo, j);
 			pcpu->governor_enabled = 0;
 			smp_wmb();
+		}
+
+		/*
+		 * Idle notifiers run with preemption disabled; once those that
+		 * saw the governor enabled are done, no one re-arms the timers.
+		 */
+		synchronize_sched();
+
+		for_each_cpu(j, policy->cpus) {
+			pcpu = &per_cpu(cpuinfo, j);
 			del_timer_sync(&pcpu->cpu_timer);
 
 			/*
@@ -593,24 +654,23 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			 * that is trying to run.
 			 */
 			pcpu->idle_exit_time = 0;
+			pcpu->ipolicy = NULL;
 		}
 
-		flush_work(&freq_scale_down_work);
-		if (atomic_dec_return(&active_count) > 0)
-			return 0;
-
-		sysfs_remove_group(cpufreq_global_kobject,
-				&interactive_attr_group);
-
+		cpufreq_interactive_policy_free(ipolicy);
 		break;
 
 	case CPUFREQ_GOV_LIMITS:
+		ipolicy = per_cpu(cpuinfo, policy->cpu).ipolicy;
+
+		mutex_lock(&ipolicy->set_speed_lock);
 		if (policy->max < policy->cur)
 			__cpufreq_driver_target(policy,
 					policy->max, CPUFREQ_RELATION_H);
 		else if (policy->min > policy->cur)
 			__cpufreq_driver_target(policy,
 					policy->min, CPUFREQ_RELATION_L);
+		mutex_unlock(&ipolicy->set_speed_lock);
 		break;
 	}
 	return 0;
@@ -640,11 +700,6 @@ static int __init cpufreq_interactive_init(void)
 {
 	unsigned int i;
 	struct cpufreq_interactive_cpuinfo *pcpu;
-	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
-
-	go_hispeed_load = DEFAULT_GO_HISPEED_LOAD;
-	min_sample_time = DEFAULT_MIN_SAMPLE_TIME;
-	timer_rate = DEFAULT_TIMER_RATE;
 
 	/* Initalize per-cpu timers */
 	for_each_possible_cpu(i) {
@@ -654,35 +709,9 @@ static int __init cpufreq_interactive_init(void)
 		pcpu->cpu_timer.data = i;
 	}
 
-	up_task = kthread_create(cpufreq_interactive_up_task, NULL,
-				 "kinteractiveup");
-	if (IS_ERR(up_task))
-		return PTR_ERR(up_task);
-
-	sched_setscheduler_nocheck(up_task, SCHED_FIFO, &param);
-	get_task_struct(up_task);
-
-	/* No rescuer thread, bind to CPU queuing the work for possibly
-	   warm cache (probably doesn't matter much). */
-	down_wq = alloc_workqueue("knteractive_down", 0, 1);
-
-	if (!down_wq)
-		goto err_freeuptask;
-
-	INIT_WORK(&freq_scale_down_work,
-		  cpufreq_interactive_freq_down);
-
-	spin_lock_init(&up_cpumask_lock);
-	spin_lock_init(&down_cpumask_lock);
-	mutex_init(&set_speed_lock);
-
 	idle_notifier_register(&cpufreq_interactive_idle_nb);
 
 	return cpufreq_register_governor(&cpufreq_gov_interactive);
-
-err_freeuptask:
-	put_task_struct(up_task);
-	return -ENOMEM;
 }
 
 #ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_INTERACTIVE
@@ -694,9 +723,7 @@ module_init(cpufreq_interactive_init);
 static void __exit cpufreq_interactive_exit(void)
 {
 	cpufreq_unregister_governor(&cpufreq_gov_interactive);
-	kthread_stop(up_task);
-	put_task_struct(up_task);
-	destroy_workqueue(down_wq);
+	idle_notifier_unregister(&cpufreq_interactive_idle_nb);
 }
 
 module_exit(cpufreq_interactive_exit);
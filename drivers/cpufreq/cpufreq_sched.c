@@ -0,0 +1,443 @@
+/*
+ * drivers/cpufreq/cpufreq_sched.c
+ *
+ * Scheduler-driven cpu frequency selection.
+ *
+ * Rather than sampling idle time from a timer, this governor is told by
+ * the scheduler about every change of the fair class utilization of a cpu
+ * (on enqueue, dequeue and tick) and picks the frequency at which that
+ * utilization would keep the busiest cpu of the policy about 80% busy.
+ *
+ * The scheduler calls in with its runqueue lock held, so the frequency
+ * change itself is deferred: an irq_work kicks a per-policy SCHED_FIFO
+ * kthread, which calls into the cpufreq driver.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/cpufreq.h>
+#include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+static atomic_t active_count = ATOMIC_INIT(0);
+
+/*
+ * The minimum time between two requested frequency changes, when going
+ * up and when going down.
+ */
+#define DEFAULT_UP_RATE_LIMIT_US	500
+#define DEFAULT_DOWN_RATE_LIMIT_US	(20 * USEC_PER_MSEC)
+static unsigned long up_rate_limit_us = DEFAULT_UP_RATE_LIMIT_US;
+static unsigned long down_rate_limit_us = DEFAULT_DOWN_RATE_LIMIT_US;
+
+struct sched_gov_policy {
+	struct cpufreq_policy *policy;
+	struct cpufreq_frequency_table *freq_table;
+
+	/* Serializes the utilization updates of the policy's cpus */
+	raw_spinlock_t update_lock;
+	u64 last_freq_update_time;
+	unsigned int next_freq;
+	bool work_in_progress;
+
+	struct irq_work irq_work;
+	struct kthread_work work;
+	struct kthread_worker worker;
+	struct task_struct *thread;
+	struct mutex work_lock;
+};
+
+struct sched_gov_cpu {
+	struct update_util_data update_util;
+	struct sched_gov_policy *sg_policy;
+	unsigned long util;
+	unsigned long max;
+	u64 last_update;
+	/* cpuinfo.max_freq while the governor runs, 0 otherwise */
+	unsigned int max_freq;
+};
+
+static DEFINE_PER_CPU(struct sched_gov_cpu, sched_gov_cpu);
+
+/*
+ * Lowest frequency of the table, within the policy limits, that is at
+ * least @freq.  cpufreq_frequency_table_target() is not used here as it
+ * may print, and we run under the runqueue lock.
+ */
+static unsigned int sched_gov_resolve_freq(struct sched_gov_policy *sg_policy,
+					   unsigned int freq)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	struct cpufreq_frequency_table *table = sg_policy->freq_table;
+	unsigned int best = policy->max;
+	int i;
+
+	if (freq > policy->max)
+		freq = policy->max;
+	if (freq < policy->min)
+		freq = policy->min;
+	if (!table)
+		return freq;
+
+	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++) {
+		unsigned int f = table[i].frequency;
+
+		if (f == CPUFREQ_ENTRY_INVALID)
+			continue;
+		if (f < policy->min || f > policy->max)
+			continue;
+		if (f >= freq && f < best)
+			best = f;
+	}
+	return best;
+}
+
+/*
+ * util is invariant to the current frequency, so it translates directly
+ * to the top frequency: a cpu at util/max of its top speed would be busy
+ * all the time.  Add a quarter for headroom.
+ */
+static unsigned int sched_gov_next_freq(struct sched_gov_policy *sg_policy,
+					unsigned long util, unsigned long max)
+{
+	unsigned int max_freq = sg_policy->policy->cpuinfo.max_freq;
+	u64 freq = (u64)(max_freq + (max_freq >> 2)) * util;
+
+	return sched_gov_resolve_freq(sg_policy, div_u64(freq, max));
+}
+
+static bool sched_gov_should_update(struct sched_gov_policy *sg_policy,
+				    u64 time, unsigned int next_freq)
+{
+	unsigned int cur = sg_policy->policy->cur;
+	s64 delta_ns;
+
+	if (sg_policy->work_in_progress || next_freq == cur)
+		return false;
+
+	delta_ns = time - sg_policy->last_freq_update_time;
+	if (next_freq > cur)
+		return delta_ns >= (s64)up_rate_limit_us * NSEC_PER_USEC;
+	return delta_ns >= (s64)down_rate_limit_us * NSEC_PER_USEC;
+}
+
+static void sched_gov_update(struct update_util_data *data, u64 time,
+			     unsigned long util, unsigned long max)
+{
+	struct sched_gov_cpu *sg_cpu = container_of(data, struct sched_gov_cpu,
+						    update_util);
+	struct sched_gov_policy *sg_policy = sg_cpu->sg_policy;
+	unsigned int next_freq;
+	unsigned int j;
+
+	raw_spin_lock(&sg_policy->update_lock);
+
+	sg_cpu->util = util;
+	sg_cpu->max = max;
+	sg_cpu->last_update = time;
+
+	/*
+	 * The policy runs at the speed its busiest cpu needs.  A cpu that has
+	 * not reported for more than a tick is idle with its tick stopped;
+	 * what it reported last is stale.
+	 */
+	for_each_cpu(j, sg_policy->policy->cpus) {
+		struct sched_gov_cpu *j_sg_cpu = &per_cpu(sched_gov_cpu, j);
+		s64 delta_ns;
+
+		if (j_sg_cpu == sg_cpu)
+			continue;
+		delta_ns = time - j_sg_cpu->last_update;
+		if (delta_ns > TICK_NSEC)
+			continue;
+		if (j_sg_cpu->util * max > util * j_sg_cpu->max) {
+			util = j_sg_cpu->util;
+			max = j_sg_cpu->max;
+		}
+	}
+
+	next_freq = sched_gov_next_freq(sg_policy, util, max);
+	if (sched_gov_should_update(sg_policy, time, next_freq)) {
+		sg_policy->next_freq = next_freq;
+		sg_policy->last_freq_update_time = time;
+		sg_policy->work_in_progress = true;
+		irq_work_queue(&sg_policy->irq_work);
+	}
+
+	raw_spin_unlock(&sg_policy->update_lock);
+}
+
+static void sched_gov_irq_work(struct irq_work *irq_work)
+{
+	struct sched_gov_policy *sg_policy;
+
+	sg_policy = container_of(irq_work, struct sched_gov_policy, irq_work);
+	queue_kthread_work(&sg_policy->worker, &sg_policy->work);
+}
+
+static void sched_gov_work(struct kthread_work *work)
+{
+	struct sched_gov_policy *sg_policy;
+
+	sg_policy = container_of(work, struct sched_gov_policy, work);
+
+	mutex_lock(&sg_policy->work_lock);
+	__cpufreq_driver_target(sg_policy->policy, sg_policy->next_freq,
+				CPUFREQ_RELATION_L);
+	mutex_unlock(&sg_policy->work_lock);
+
+	sg_policy->work_in_progress = false;
+}
+
+static ssize_t show_up_rate_limit_us(struct kobject *kobj,
+				     struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", up_rate_limit_us);
+}
+
+static ssize_t store_up_rate_limit_us(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	up_rate_limit_us = val;
+	return count;
+}
+
+static struct global_attr up_rate_limit_us_attr = __ATTR(up_rate_limit_us,
+		0644, show_up_rate_limit_us, store_up_rate_limit_us);
+
+static ssize_t show_down_rate_limit_us(struct kobject *kobj,
+				       struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", down_rate_limit_us);
+}
+
+static ssize_t store_down_rate_limit_us(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	down_rate_limit_us = val;
+	return count;
+}
+
+static struct global_attr down_rate_limit_us_attr = __ATTR(down_rate_limit_us,
+		0644, show_down_rate_limit_us, store_down_rate_limit_us);
+
+static struct attribute *sched_gov_attributes[] = {
+	&up_rate_limit_us_attr.attr,
+	&down_rate_limit_us_attr.attr,
+	NULL,
+};
+
+static struct attribute_group sched_gov_attr_group = {
+	.attrs = sched_gov_attributes,
+	.name = "sched",
+};
+
+static void sched_gov_set_freq_scale(unsigned int cpu, unsigned int freq)
+{
+	unsigned int max_freq = per_cpu(sched_gov_cpu, cpu).max_freq;
+
+	if (max_freq)
+		sched_set_freq_scale(cpu,
+				     (unsigned long)freq * SCHED_POWER_SCALE /
+				     max_freq);
+}
+
+static int sched_gov_start(struct cpufreq_policy *policy)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO - 1 };
+	struct sched_gov_policy *sg_policy;
+	unsigned int j;
+	int rc;
+
+	if (!cpu_online(policy->cpu))
+		return -EINVAL;
+
+	sg_policy = kzalloc(sizeof(*sg_policy), GFP_KERNEL);
+	if (!sg_policy)
+		return -ENOMEM;
+
+	sg_policy->policy = policy;
+	sg_policy->freq_table = cpufreq_frequency_get_table(policy->cpu);
+	raw_spin_lock_init(&sg_policy->update_lock);
+	mutex_init(&sg_policy->work_lock);
+	init_irq_work(&sg_policy->irq_work, sched_gov_irq_work);
+	init_kthread_work(&sg_policy->work, sched_gov_work);
+	init_kthread_worker(&sg_policy->worker);
+
+	sg_policy->thread = kthread_create(kthread_worker_fn, &sg_policy->worker,
+					   "ksched_gov/%u", policy->cpu);
+	if (IS_ERR(sg_policy->thread)) {
+		rc = PTR_ERR(sg_policy->thread);
+		kfree(sg_policy);
+		return rc;
+	}
+	sched_setscheduler_nocheck(sg_policy->thread, SCHED_FIFO, &param);
+	wake_up_process(sg_policy->thread);
+
+	if (atomic_inc_return(&active_count) == 1) {
+		rc = sysfs_create_group(cpufreq_global_kobject,
+					&sched_gov_attr_group);
+		if (rc)
+			pr_warning("cpufreq_sched: no sysfs tunables (%d)\n",
+				   rc);
+	}
+
+	for_each_cpu(j, policy->cpus) {
+		struct sched_gov_cpu *sg_cpu = &per_cpu(sched_gov_cpu, j);
+
+		memset(sg_cpu, 0, sizeof(*sg_cpu));
+		sg_cpu->update_util.func = sched_gov_update;
+		sg_cpu->sg_policy = sg_policy;
+		sg_cpu->max_freq = policy->cpuinfo.max_freq;
+		sched_gov_set_freq_scale(j, policy->cur);
+		cpufreq_set_update_util_data(j, &sg_cpu->update_util);
+	}
+
+	return 0;
+}
+
+static void sched_gov_stop(struct cpufreq_policy *policy)
+{
+	struct sched_gov_policy *sg_policy;
+	unsigned int j;
+
+	sg_policy = per_cpu(sched_gov_cpu, policy->cpu).sg_policy;
+	if (!sg_policy)
+		return;
+
+	for_each_cpu(j, policy->cpus)
+		cpufreq_set_update_util_data(j, NULL);
+	synchronize_sched();
+
+	irq_work_sync(&sg_policy->irq_work);
+	flush_kthread_worker(&sg_policy->worker);
+	kthread_stop(sg_policy->thread);
+
+	for_each_cpu(j, policy->cpus) {
+		struct sched_gov_cpu *sg_cpu = &per_cpu(sched_gov_cpu, j);
+
+		sg_cpu->sg_policy = NULL;
+		sg_cpu->max_freq = 0;
+		sched_set_freq_scale(j, SCHED_POWER_SCALE);
+	}
+	kfree(sg_policy);
+
+	if (atomic_dec_return(&active_count) == 0)
+		sysfs_remove_group(cpufreq_global_kobject,
+				   &sched_gov_attr_group);
+}
+
+static int cpufreq_governor_sched(struct cpufreq_policy *policy,
+				  unsigned int event)
+{
+	struct sched_gov_policy *sg_policy;
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		return sched_gov_start(policy);
+
+	case CPUFREQ_GOV_STOP:
+		sched_gov_stop(policy);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		sg_policy = per_cpu(sched_gov_cpu, policy->cpu).sg_policy;
+		if (!sg_policy)
+			break;
+		mutex_lock(&sg_policy->work_lock);
+		if (policy->max < policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->max, CPUFREQ_RELATION_H);
+		else if (policy->min > policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->min, CPUFREQ_RELATION_L);
+		mutex_unlock(&sg_policy->work_lock);
+		break;
+	}
+	return 0;
+}
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED
+static
+#endif
+struct cpufreq_governor cpufreq_gov_sched = {
+	.name = "sched",
+	.governor = cpufreq_governor_sched,
+	.max_transition_latency = 10000000,
+	.owner = THIS_MODULE,
+};
+
+/* Keeps the scheduler's frequency invariance in step with the hardware */
+static int sched_gov_transition(struct notifier_block *nb,
+				unsigned long val, void *data)
+{
+	struct cpufreq_freqs *freqs = data;
+
+	if (val == CPUFREQ_POSTCHANGE)
+		sched_gov_set_freq_scale(freqs->cpu, freqs->new);
+	return 0;
+}
+
+static struct notifier_block sched_gov_transition_nb = {
+	.notifier_call = sched_gov_transition,
+};
+
+static int __init cpufreq_sched_init(void)
+{
+	int rc;
+
+	rc = cpufreq_register_notifier(&sched_gov_transition_nb,
+				       CPUFREQ_TRANSITION_NOTIFIER);
+	if (rc)
+		return rc;
+
+	rc = cpufreq_register_governor(&cpufreq_gov_sched);
+	if (rc)
+		cpufreq_unregister_notifier(&sched_gov_transition_nb,
+					    CPUFREQ_TRANSITION_NOTIFIER);
+	return rc;
+}
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED
+fs_initcall(cpufreq_sched_init);
+#else
+module_init(cpufreq_sched_init);
+#endif
+
+static void __exit cpufreq_sched_exit(void)
+{
+	cpufreq_unregister_governor(&cpufreq_gov_sched);
+	cpufreq_unregister_notifier(&sched_gov_transition_nb,
+				    CPUFREQ_TRANSITION_NOTIFIER);
+}
+
+module_exit(cpufreq_sched_exit);
+
+MODULE_DESCRIPTION("'cpufreq_sched' - A cpufreq governor driven by "
+	"scheduler utilization");
+MODULE_LICENSE("GPL");
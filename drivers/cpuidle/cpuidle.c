@@ -42,6 +42,48 @@ static void cpuidle_kick_cpus(void) {}
 
 static int __cpuidle_register_device(struct cpuidle_device *dev);
 
+/**
+ * cpuidle_account_residency - judges the state entered in hindsight
+ * @dev: the CPU
+ * @state: the state actually entered
+ *
+ * The state was too deep if the CPU woke up before its target residency,
+ * too shallow if a deeper state usable under the current latency
+ * constraint would have paid off, and a hit otherwise.  The shallowest
+ * state is never too deep.  States are ordered from shallow to deep.
+ */
+static void cpuidle_account_residency(struct cpuidle_device *dev,
+				      struct cpuidle_state *state)
+{
+	int residency = dev->last_residency;
+	int latency_req;
+	int i;
+
+	if (!(state->flags & CPUIDLE_FLAG_TIME_VALID))
+		return;
+
+	if (state != &dev->states[0] && residency < state->target_residency) {
+		state->above++;
+		return;
+	}
+
+	latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	for (i = state - dev->states + 1; i < dev->state_count; i++) {
+		struct cpuidle_state *s = &dev->states[i];
+
+		if (s->flags & CPUIDLE_FLAG_IGNORE)
+			continue;
+		if (s->exit_latency > latency_req)
+			continue;
+		if (s->target_residency <= residency) {
+			state->below++;
+			return;
+		}
+	}
+
+	state->hits++;
+}
+
 /**
  * cpuidle_idle_call - the main idle loop
  *
@@ -110,6 +152,7 @@ static void cpuidle_idle_call(void)
 
 	target_state->time += (unsigned long long)dev->last_residency;
 	target_state->usage++;
+	cpuidle_account_residency(dev, target_state);
 
 	/* give the governor an opportunity to reflect on the outcome */
 	if (cpuidle_curr_governor->reflect)
@@ -236,6 +279,9 @@ int cpuidle_enable_device(struct cpuidle_device *dev)
 	for (i = 0; i < dev->state_count; i++) {
 		dev->states[i].usage = 0;
 		dev->states[i].time = 0;
+		dev->states[i].hits = 0;
+		dev->states[i].above = 0;
+		dev->states[i].below = 0;
 	}
 	dev->last_residency = 0;
 	dev->last_state = NULL;
@@ -0,0 +1,264 @@
+/*
+ * predict.c - the wakeup history idle governor
+ *
+ * Based on menu.c.
+ *
+ * This code is licenced under the GPL version 2 as described
+ * in the COPYING file that acompanies the Linux Kernel.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/pm_qos_params.h>
+#include <linux/time.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/tick.h>
+#include <linux/kernel_stat.h>
+#include <linux/bitops.h>
+
+#define BINS		16	/* 1us, 2us, 4us ... 32ms and more */
+#define DECAY_SHIFT	3	/* each wakeup weighs 1/8 of the history */
+#define WEIGHT		1024
+#define TIMER_SLACK_US	20
+
+/*
+ * Concepts behind the predict governor
+ *
+ * The next timer event bounds the idle period, so the only question is
+ * whether something else will wake the CPU up earlier.  That depends a lot
+ * on where the wakeups come from: a CPU woken by device interrupts at a
+ * steady rate, or by IPIs from a producer on another CPU, sees a very
+ * different idle duration distribution than one that only waits for its
+ * timers.
+ *
+ * So every CPU keeps a histogram of recent idle durations, in power of two
+ * bins, for each source of wakeup:
+ *
+ *  - timer: the CPU woke up when its next timer event was due,
+ *  - irq: a device interrupt was handled before that,
+ *  - ipi: it woke up early and no device interrupt was counted, which in
+ *    practice means a reschedule or function call IPI.
+ *
+ * Every wakeup decays the whole history by 1/8 before it is added, so the
+ * histograms follow the recent behaviour of the CPU.
+ *
+ * To select a state, the history is split at the bin of the time until
+ * the next timer event.  Wakeups below it by an interrupt or an IPI are
+ * the early ones; every wakeup at or above it, by any source, would have
+ * let the CPU sleep until its timer.  When the early ones are in the
+ * majority, the predicted residency is the bin in which half the history
+ * has woken up, otherwise it is the time until the next timer event.  The
+ * deepest state whose target residency fits the prediction and whose exit
+ * latency fits the PM QoS constraint is selected.
+ *
+ * How good the choices turn out to be is visible in the hits, above and
+ * below counters of every state, see Documentation/cpuidle/sysfs.txt.
+ */
+
+enum predict_source {
+	WAKEUP_TIMER,
+	WAKEUP_IRQ,
+	WAKEUP_IPI,
+	WAKEUP_SOURCES,
+};
+
+struct predict_device {
+	int		last_state_idx;
+	int		needs_update;
+
+	unsigned int	sleep_us;	/* time until the next timer event */
+	unsigned long	irqs;		/* irqs_sum when going idle */
+
+	/* outcome of the last idle period, folded in at the next select */
+	enum predict_source last_source;
+	unsigned int	last_us;
+
+	unsigned int	hist[WAKEUP_SOURCES][BINS];
+};
+
+static DEFINE_PER_CPU(struct predict_device, predict_devices);
+
+static inline int which_bin(unsigned int us)
+{
+	if (!us)
+		return 0;
+	return min(fls(us) - 1, BINS - 1);
+}
+
+static void predict_update(struct predict_device *data)
+{
+	int src, bin;
+
+	for (src = 0; src < WAKEUP_SOURCES; src++)
+		for (bin = 0; bin < BINS; bin++)
+			data->hist[src][bin] -=
+				data->hist[src][bin] >> DECAY_SHIFT;
+
+	data->hist[data->last_source][which_bin(data->last_us)] += WEIGHT;
+}
+
+/* Expected idle time in us given the time until the next timer event */
+static unsigned int predict_residency(struct predict_device *data)
+{
+	unsigned int early = 0, late = 0, sum = 0;
+	int limit = which_bin(data->sleep_us);
+	int src, bin;
+
+	for (bin = 0; bin < BINS; bin++) {
+		if (bin < limit) {
+			early += data->hist[WAKEUP_IRQ][bin] +
+				 data->hist[WAKEUP_IPI][bin];
+			continue;
+		}
+		for (src = 0; src < WAKEUP_SOURCES; src++)
+			late += data->hist[src][bin];
+	}
+
+	if (early <= late)
+		return data->sleep_us;
+
+	for (bin = 0; bin < limit; bin++) {
+		sum += data->hist[WAKEUP_IRQ][bin] +
+		       data->hist[WAKEUP_IPI][bin];
+		if (sum * 2 >= early + late)
+			break;
+	}
+
+	return 1 << bin;
+}
+
+/**
+ * predict_select - selects the next idle state to enter
+ * @dev: the CPU
+ */
+static int predict_select(struct cpuidle_device *dev)
+{
+	struct predict_device *data = &__get_cpu_var(predict_devices);
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	unsigned int power_usage = -1;
+	unsigned int predicted_us;
+	struct timespec t;
+	int i;
+
+	if (data->needs_update) {
+		predict_update(data);
+		data->needs_update = 0;
+	}
+
+	data->last_state_idx = 0;
+
+	/* Special case when user has set very strict latency requirement */
+	if (unlikely(latency_req == 0))
+		return 0;
+
+	t = ktime_to_timespec(tick_nohz_get_sleep_length());
+	data->sleep_us = t.tv_sec * USEC_PER_SEC + t.tv_nsec / NSEC_PER_USEC;
+	data->irqs = kstat_this_cpu.irqs_sum;
+
+	predicted_us = predict_residency(data);
+
+	/*
+	 * We want to default to C1 (hlt), not to busy polling
+	 * unless the timer is happening really really soon.
+	 */
+	if (data->sleep_us > 5)
+		data->last_state_idx = CPUIDLE_DRIVER_STATE_START;
+
+	for (i = CPUIDLE_DRIVER_STATE_START; i < dev->state_count; i++) {
+		struct cpuidle_state *s = &dev->states[i];
+
+		if (s->flags & CPUIDLE_FLAG_IGNORE)
+			continue;
+		if (s->target_residency > predicted_us)
+			continue;
+		if (s->exit_latency > latency_req)
+			continue;
+
+		if (s->power_usage < power_usage) {
+			power_usage = s->power_usage;
+			data->last_state_idx = i;
+		}
+	}
+
+	return data->last_state_idx;
+}
+
+/**
+ * predict_reflect - classifies the wakeup that ended the idle period
+ * @dev: the CPU
+ *
+ * Runs with interrupts enabled again, so the interrupt that woke the CPU
+ * has been handled by now.  Only the classification is done here to keep
+ * the exit path short; the history is updated at the next select.
+ */
+static void predict_reflect(struct cpuidle_device *dev)
+{
+	struct predict_device *data = &__get_cpu_var(predict_devices);
+	struct cpuidle_state *target = dev->last_state;
+	unsigned int measured_us, exit_us = 0;
+
+	/*
+	 * Without residency measurements, assume the timer woke us up, as
+	 * menu does.
+	 */
+	if (!target || !(target->flags & CPUIDLE_FLAG_TIME_VALID))
+		measured_us = data->sleep_us;
+	else
+		measured_us = cpuidle_get_last_residency(dev);
+	if (target)
+		exit_us = target->exit_latency;
+
+	if (measured_us + exit_us + TIMER_SLACK_US >=
+	    data->sleep_us)
+		data->last_source = WAKEUP_TIMER;
+	else if (kstat_this_cpu.irqs_sum != data->irqs)
+		data->last_source = WAKEUP_IRQ;
+	else
+		data->last_source = WAKEUP_IPI;
+
+	data->last_us = measured_us;
+	data->needs_update = 1;
+}
+
+/**
+ * predict_enable_device - scans a CPU's states and does setup
+ * @dev: the CPU
+ */
+static int predict_enable_device(struct cpuidle_device *dev)
+{
+	struct predict_device *data = &per_cpu(predict_devices, dev->cpu);
+
+	memset(data, 0, sizeof(struct predict_device));
+
+	return 0;
+}
+
+static struct cpuidle_governor predict_governor = {
+	.name =		"predict",
+	.rating =	30,
+	.enable =	predict_enable_device,
+	.select =	predict_select,
+	.reflect =	predict_reflect,
+	.owner =	THIS_MODULE,
+};
+
+/**
+ * init_predict - initializes the governor
+ */
+static int __init init_predict(void)
+{
+	return cpuidle_register_governor(&predict_governor);
+}
+
+/**
+ * exit_predict - exits the governor
+ */
+static void __exit exit_predict(void)
+{
+	cpuidle_unregister_governor(&predict_governor);
+}
+
+MODULE_LICENSE("GPL");
+module_init(init_predict);
+module_exit(exit_predict);
@@ -17,8 +17,10 @@
 #include <linux/slab.h>
 #include <linux/crypto.h>
 #include <linux/workqueue.h>
+#include <linux/kthread.h>
 #include <linux/backing-dev.h>
 #include <linux/percpu.h>
+#include <linux/rbtree.h>
 #include <asm/atomic.h>
 #include <linux/scatterlist.h>
 #include <asm/page.h>
@@ -61,6 +63,9 @@ struct dm_crypt_io {
 	int error;
 	sector_t sector;
 	struct dm_crypt_io *base_io;
+
+	int cpu;		/* of the kcryptd worker converting it */
+	struct rb_node rb_node;	/* in write_tree, waiting for submission */
 };
 
 struct dm_crypt_request {
@@ -103,7 +108,8 @@ struct iv_lmk_private {
  * Crypt: maps a linear range of a block device
  * and encrypts / decrypts at the same time.
  */
-enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID };
+enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID,
+	     DM_CRYPT_SAME_CPU, DM_CRYPT_SAME_CPU_READ, DM_CRYPT_NO_OFFLOAD };
 
 /*
  * Duplicated per-CPU state for cipher.
@@ -112,12 +118,15 @@ struct crypt_cpu {
 	struct ablkcipher_request *req;
 	/* ESSIV: struct crypto_cipher *essiv_tfm */
 	void *iv_private;
+	/* kcryptd worker given the last bio submitted on this CPU */
+	int last_cpu;
 	struct crypto_ablkcipher *tfms[0];
 };
 
 /*
  * The fields in here must be read only after initialization,
- * changing state should be in crypt_cpu.
+ * changing state should be in crypt_cpu, except for the write
+ * tree which is protected by write_thread_wait.lock.
  */
 struct crypt_config {
 	struct dm_dev *dev;
@@ -135,6 +144,11 @@ struct crypt_config {
 	struct workqueue_struct *io_queue;
 	struct workqueue_struct *crypt_queue;
 
+	/* encrypted writes, sorted by sector, for dmcrypt_write */
+	struct task_struct *write_thread;
+	wait_queue_head_t write_thread_wait;
+	struct rb_root write_tree;
+
 	char *cipher;
 	char *cipher_string;
 
@@ -941,7 +955,12 @@ static void crypt_dec_pending(struct dm_crypt_io *io)
  * Needed because it would be very unwise to do decryption in an
  * interrupt context.
  *
- * kcryptd performs the actual encryption or decryption.
+ * kcryptd performs the actual encryption or decryption.  It has a
+ * worker per CPU, and the bios submitted on a CPU are dealt round robin
+ * to the online CPUs, so that a single submitter, such as the flusher
+ * thread, keeps all of them busy.  With same_cpu_crypt, bios are
+ * converted on the CPU they were submitted on, and with same_cpu_read
+ * only the reads are, where their data is about to be used.
  *
  * kcryptd_io performs the IO submission.
  *
@@ -949,6 +968,10 @@ static void crypt_dec_pending(struct dm_crypt_io *io)
  * starved by new requests which can block in the first stages due
  * to memory allocation.
  *
+ * dmcrypt_write submits the encrypted writes.  The kcryptd workers
+ * finish them in any order; the thread sorts them back by sector
+ * before passing them down, unless submit_from_crypt_cpus is set.
+ *
  * The work is done per CPU global for all dm-crypt instances.
  * They should not depend on each other and do not block.
  */
@@ -1047,6 +1070,93 @@ static void kcryptd_queue_io(struct dm_crypt_io *io)
 	queue_work(cc->io_queue, &io->work);
 }
 
+#define crypt_io_from_node(node) rb_entry((node), struct dm_crypt_io, rb_node)
+
+static int dmcrypt_write(void *data)
+{
+	struct crypt_config *cc = data;
+	struct dm_crypt_io *io;
+
+	while (1) {
+		struct rb_root write_tree;
+		struct blk_plug plug;
+
+		DECLARE_WAITQUEUE(wait, current);
+
+		spin_lock_irq(&cc->write_thread_wait.lock);
+continue_locked:
+
+		if (!RB_EMPTY_ROOT(&cc->write_tree))
+			goto pop_from_list;
+
+		__set_current_state(TASK_INTERRUPTIBLE);
+		__add_wait_queue(&cc->write_thread_wait, &wait);
+
+		spin_unlock_irq(&cc->write_thread_wait.lock);
+
+		if (unlikely(kthread_should_stop())) {
+			set_task_state(current, TASK_RUNNING);
+			remove_wait_queue(&cc->write_thread_wait, &wait);
+			break;
+		}
+
+		schedule();
+
+		set_task_state(current, TASK_RUNNING);
+		spin_lock_irq(&cc->write_thread_wait.lock);
+		__remove_wait_queue(&cc->write_thread_wait, &wait);
+		goto continue_locked;
+
+pop_from_list:
+		write_tree = cc->write_tree;
+		cc->write_tree = RB_ROOT;
+		spin_unlock_irq(&cc->write_thread_wait.lock);
+
+		BUG_ON(rb_parent(write_tree.rb_node));
+
+		/*
+		 * Note: we cannot walk the tree here with rb_next because
+		 * the structures may be freed when kcryptd_io_write is called.
+		 */
+		blk_start_plug(&plug);
+		do {
+			io = crypt_io_from_node(rb_first(&write_tree));
+			rb_erase(&io->rb_node, &write_tree);
+			kcryptd_io_write(io);
+		} while (!RB_EMPTY_ROOT(&write_tree));
+		blk_finish_plug(&plug);
+	}
+	return 0;
+}
+
+/*
+ * Hand an encrypted write to dmcrypt_write.  The io is queued until its
+ * clone is submitted, so it must not be reused for another fragment.
+ */
+static void crypt_queue_write(struct dm_crypt_io *io)
+{
+	struct crypt_config *cc = io->target->private;
+	struct rb_node **rbp, *parent;
+	unsigned long flags;
+	sector_t sector = io->sector;
+
+	spin_lock_irqsave(&cc->write_thread_wait.lock, flags);
+	rbp = &cc->write_tree.rb_node;
+	parent = NULL;
+	while (*rbp) {
+		parent = *rbp;
+		if (sector < crypt_io_from_node(parent)->sector)
+			rbp = &(*rbp)->rb_left;
+		else
+			rbp = &(*rbp)->rb_right;
+	}
+	rb_link_node(&io->rb_node, parent, rbp);
+	rb_insert_color(&io->rb_node, &cc->write_tree);
+
+	wake_up_locked(&cc->write_thread_wait);
+	spin_unlock_irqrestore(&cc->write_thread_wait.lock, flags);
+}
+
 static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io,
 					  int error, int async)
 {
@@ -1066,7 +1176,9 @@ static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io,
 
 	clone->bi_sector = cc->start + io->sector;
 
-	if (async)
+	if (!test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags))
+		crypt_queue_write(io);
+	else if (async)
 		kcryptd_queue_io(io);
 	else
 		generic_make_request(clone);
@@ -1078,6 +1190,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 	struct bio *clone;
 	struct dm_crypt_io *new_io;
 	int crypt_finished;
+	int offload = !test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
 	unsigned out_of_pages = 0;
 	unsigned remaining = io->base_bio->bi_size;
 	sector_t sector = io->sector;
@@ -1121,7 +1234,8 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 			if (unlikely(r < 0))
 				break;
 
-			io->sector = sector;
+			if (!offload)
+				io->sector = sector;
 		}
 
 		/*
@@ -1134,8 +1248,10 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 		/*
 		 * With async crypto it is unsafe to share the crypto context
 		 * between fragments, so switch to a new dm_crypt_io structure.
+		 * So does a fragment queued to dmcrypt_write, which owns its
+		 * io until it is submitted.
 		 */
-		if (unlikely(!crypt_finished && remaining)) {
+		if (unlikely((!crypt_finished || offload) && remaining)) {
 			new_io = crypt_io_alloc(io->target, io->base_bio,
 						sector);
 			crypt_inc_pending(new_io);
@@ -1231,7 +1347,39 @@ static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 	struct crypt_config *cc = io->target->private;
 
 	INIT_WORK(&io->work, kcryptd_crypt);
-	queue_work(cc->crypt_queue, &io->work);
+	if (likely(cpu_online(io->cpu)))
+		queue_work_on(io->cpu, cc->crypt_queue, &io->work);
+	else
+		queue_work(cc->crypt_queue, &io->work);
+}
+
+/*
+ * Choose the kcryptd worker for a bio being submitted on this CPU:
+ * the next online CPU after the one the previous bio went to.
+ */
+static int crypt_next_cpu(struct crypt_config *cc)
+{
+	struct crypt_cpu *this_cc;
+	int cpu;
+
+	this_cc = per_cpu_ptr(cc->cpu, get_cpu());
+	cpu = cpumask_next(this_cc->last_cpu, cpu_online_mask);
+	if (cpu >= nr_cpu_ids)
+		cpu = cpumask_first(cpu_online_mask);
+	this_cc->last_cpu = cpu;
+	put_cpu();
+
+	return cpu;
+}
+
+static int crypt_io_cpu(struct crypt_config *cc, struct bio *bio)
+{
+	if (test_bit(DM_CRYPT_SAME_CPU, &cc->flags) ||
+	    (bio_data_dir(bio) == READ &&
+	     test_bit(DM_CRYPT_SAME_CPU_READ, &cc->flags)))
+		return raw_smp_processor_id();
+
+	return crypt_next_cpu(cc);
 }
 
 /*
@@ -1368,6 +1516,9 @@ static void crypt_dtr(struct dm_target *ti)
 	if (!cc)
 		return;
 
+	if (cc->write_thread)
+		kthread_stop(cc->write_thread);
+
 	if (cc->io_queue)
 		destroy_workqueue(cc->io_queue);
 	if (cc->crypt_queue)
@@ -1568,9 +1719,38 @@ bad_mem:
 	return -ENOMEM;
 }
 
+static int crypt_ctr_optional(struct dm_target *ti, unsigned int argc,
+			      char **argv)
+{
+	struct crypt_config *cc = ti->private;
+	unsigned int opt_params, i;
+	char dummy;
+
+	if (sscanf(argv[0], "%u%c", &opt_params, &dummy) != 1 ||
+	    opt_params != argc - 1) {
+		ti->error = "Invalid number of feature args";
+		return -EINVAL;
+	}
+
+	for (i = 1; i <= opt_params; i++) {
+		if (!strcasecmp(argv[i], "same_cpu_crypt"))
+			set_bit(DM_CRYPT_SAME_CPU, &cc->flags);
+		else if (!strcasecmp(argv[i], "same_cpu_read"))
+			set_bit(DM_CRYPT_SAME_CPU_READ, &cc->flags);
+		else if (!strcasecmp(argv[i], "submit_from_crypt_cpus"))
+			set_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		else {
+			ti->error = "Invalid feature arguments";
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
 /*
  * Construct an encryption mapping:
- * <cipher> <key> <iv_offset> <dev_path> <start>
+ * <cipher> <key> <iv_offset> <dev_path> <start> [<#opt_params> <opt_params>]
  */
 static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 {
@@ -1579,7 +1759,7 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	unsigned long long tmpll;
 	int ret;
 
-	if (argc != 5) {
+	if (argc < 5) {
 		ti->error = "Not enough arguments";
 		return -EINVAL;
 	}
@@ -1648,6 +1828,12 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	}
 	cc->start = tmpll;
 
+	if (argc > 5) {
+		ret = crypt_ctr_optional(ti, argc - 5, argv + 5);
+		if (ret)
+			goto bad;
+	}
+
 	ret = -ENOMEM;
 	cc->io_queue = alloc_workqueue("kcryptd_io",
 				       WQ_NON_REENTRANT|
@@ -1668,6 +1854,21 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		goto bad;
 	}
 
+	init_waitqueue_head(&cc->write_thread_wait);
+	cc->write_tree = RB_ROOT;
+
+	if (!test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags)) {
+		cc->write_thread = kthread_create(dmcrypt_write, cc,
+						  "dmcrypt_write");
+		if (IS_ERR(cc->write_thread)) {
+			ret = PTR_ERR(cc->write_thread);
+			cc->write_thread = NULL;
+			ti->error = "Couldn't spawn write thread";
+			goto bad;
+		}
+		wake_up_process(cc->write_thread);
+	}
+
 	ti->num_flush_requests = 1;
 	return 0;
 
@@ -1688,7 +1889,9 @@ static int crypt_map(struct dm_target *ti, struct bio *bio,
 		return DM_MAPIO_REMAPPED;
 	}
 
+	cc = ti->private;
 	io = crypt_io_alloc(ti, bio, dm_target_offset(ti, bio->bi_sector));
+	io->cpu = crypt_io_cpu(cc, bio);
 
 	if (bio_data_dir(io->base_bio) == READ) {
 		if (kcryptd_io_read(io, GFP_NOWAIT))
@@ -1704,6 +1907,7 @@ static int crypt_status(struct dm_target *ti, status_type_t type,
 {
 	struct crypt_config *cc = ti->private;
 	unsigned int sz = 0;
+	int num_feature_args = 0;
 
 	switch (type) {
 	case STATUSTYPE_INFO:
@@ -1727,6 +1931,19 @@ static int crypt_status(struct dm_target *ti, status_type_t type,
 
 		DMEMIT(" %llu %s %llu", (unsigned long long)cc->iv_offset,
 				cc->dev->name, (unsigned long long)cc->start);
+
+		num_feature_args += test_bit(DM_CRYPT_SAME_CPU, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_SAME_CPU_READ, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		if (num_feature_args) {
+			DMEMIT(" %d", num_feature_args);
+			if (test_bit(DM_CRYPT_SAME_CPU, &cc->flags))
+				DMEMIT(" same_cpu_crypt");
+			if (test_bit(DM_CRYPT_SAME_CPU_READ, &cc->flags))
+				DMEMIT(" same_cpu_read");
+			if (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags))
+				DMEMIT(" submit_from_crypt_cpus");
+		}
 		break;
 	}
 	return 0;
@@ -1823,7 +2040,7 @@ static int crypt_iterate_devices(struct dm_target *ti,
 
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 10, 0},
+	.version = {1, 11, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
@@ -127,6 +127,24 @@ struct mmc_test_dbgfs_file {
 	struct dentry *file;
 };
 
+/**
+ * struct mmc_test_async_req - request for the non-blocking tests.
+ * @areq: request handed to mmc_start_req()
+ * @test: test the request belongs to
+ * @mrq: the request
+ * @cmd: its command
+ * @stop: its stop command
+ * @data: its data
+ */
+struct mmc_test_async_req {
+	struct mmc_async_req areq;
+	struct mmc_test_card *test;
+	struct mmc_request mrq;
+	struct mmc_command cmd;
+	struct mmc_command stop;
+	struct mmc_data data;
+};
+
 /**
  * struct mmc_test_card - test information.
  * @card: card under test
@@ -745,6 +763,64 @@ static int mmc_test_simple_transfer(struct mmc_test_card *test,
 	return mmc_test_check_result(test, &mrq);
 }
 
+static int mmc_test_check_result_async(struct mmc_card *card,
+				       struct mmc_async_req *areq)
+{
+	struct mmc_test_async_req *tareq =
+		container_of(areq, struct mmc_test_async_req, areq);
+
+	mmc_test_wait_busy(tareq->test);
+
+	return mmc_test_check_result(tareq->test, areq->mrq);
+}
+
+static void mmc_test_nonblock_reset(struct mmc_test_card *test,
+				    struct mmc_test_async_req *tareq)
+{
+	memset(&tareq->mrq, 0, sizeof(struct mmc_request));
+	memset(&tareq->cmd, 0, sizeof(struct mmc_command));
+	memset(&tareq->stop, 0, sizeof(struct mmc_command));
+	memset(&tareq->data, 0, sizeof(struct mmc_data));
+
+	tareq->mrq.cmd = &tareq->cmd;
+	tareq->mrq.data = &tareq->data;
+	tareq->mrq.stop = &tareq->stop;
+
+	tareq->areq.mrq = &tareq->mrq;
+	tareq->areq.err_check = mmc_test_check_result_async;
+	tareq->test = test;
+}
+
+/*
+ * Tests count consecutive transfers with non-blocking requests: each
+ * one is prepared by the host while the previous one is in progress.
+ */
+static int mmc_test_nonblock_transfer(struct mmc_test_card *test,
+	struct scatterlist *sg, unsigned sg_len, unsigned dev_addr,
+	unsigned blocks, unsigned blksz, int write, unsigned count)
+{
+	struct mmc_test_async_req tareq[2];
+	unsigned i;
+	int ret = 0;
+
+	for (i = 0; i < count && !ret; i++) {
+		/* The other request is the one in progress */
+		struct mmc_test_async_req *cur = &tareq[i & 1];
+
+		mmc_test_nonblock_reset(test, cur);
+		mmc_test_prepare_mrq(test, &cur->mrq, sg, sg_len, dev_addr,
+			blocks, blksz, write);
+		mmc_start_req(test->card->host, &cur->areq, &ret);
+		dev_addr += blocks;
+	}
+
+	/* Wait for the last one, the request is not started on errors */
+	if (!ret)
+		mmc_start_req(test->card->host, NULL, &ret);
+
+	return ret;
+}
+
 /*
  * Tests a transfer where the card will fail completely or partly
  */
@@ -1731,6 +1807,453 @@ static int mmc_test_profile_seq_write_perf(struct mmc_test_card *test)
 	return mmc_test_seq_write_perf(test, sz);
 }
 
+/*
+ * Consecutive transfers over the test area, waiting for each transfer
+ * before the next one is prepared or, with nonblock, preparing the next
+ * one while the previous one is in progress.
+ */
+static int mmc_test_seq_async_perf(struct mmc_test_card *test, int write,
+				   int nonblock, unsigned long sz)
+{
+	struct mmc_test_area *t = &test->area;
+	unsigned int dev_addr, i, cnt;
+	struct timespec ts1, ts2;
+	int ret;
+
+	if (write) {
+		ret = mmc_test_area_erase(test);
+		if (ret)
+			return ret;
+	}
+	ret = mmc_test_area_map(test, sz, 0);
+	if (ret)
+		return ret;
+	cnt = t->max_sz / sz;
+	dev_addr = t->dev_addr;
+	getnstimeofday(&ts1);
+	if (nonblock) {
+		ret = mmc_test_nonblock_transfer(test, t->sg, t->sg_len,
+						 dev_addr, t->blocks, 512,
+						 write, cnt);
+	} else {
+		for (i = 0; i < cnt && !ret; i++) {
+			ret = mmc_test_area_transfer(test, dev_addr, write);
+			dev_addr += t->blocks;
+		}
+	}
+	if (ret)
+		return ret;
+	getnstimeofday(&ts2);
+	mmc_test_print_avg_rate(test, sz, cnt, &ts1, &ts2);
+	return 0;
+}
+
+/*
+ * Consecutive transfer performance from 4KiB to the maximum transfer size.
+ */
+static int mmc_test_profile_async_perf(struct mmc_test_card *test, int write,
+				       int nonblock)
+{
+	struct mmc_test_area *t = &test->area;
+	unsigned long sz;
+	int ret;
+
+	for (sz = 4096; sz < t->max_tfr; sz <<= 1) {
+		ret = mmc_test_seq_async_perf(test, write, nonblock, sz);
+		if (ret)
+			return ret;
+	}
+	sz = t->max_tfr;
+	return mmc_test_seq_async_perf(test, write, nonblock, sz);
+}
+
+static int mmc_test_profile_read_blocking_perf(struct mmc_test_card *test)
+{
+	return mmc_test_profile_async_perf(test, 0, 0);
+}
+
+static int mmc_test_profile_read_nonblock_perf(struct mmc_test_card *test)
+{
+	return mmc_test_profile_async_perf(test, 0, 1);
+}
+
+static int mmc_test_profile_write_blocking_perf(struct mmc_test_card *test)
+{
+	return mmc_test_profile_async_perf(test, 1, 0);
+}
+
+static int mmc_test_profile_write_nonblock_perf(struct mmc_test_card *test)
+{
+	return mmc_test_profile_async_perf(test, 1, 1);
+}
+
+/*
+ * Packed write (eMMC 4.5): the requests are written by one CMD25 bounded
+ * by a CMD23 with the packed bit, their data following a header block
+ * which gives the CMD23 and CMD25 arguments of each of them.
+ */
+#define PACKED_CMD_VER		0x01
+#define PACKED_CMD_WR		0x02
+#define PACKED_HDR_WORDS	128
+#define PACKED_MAX_ENTRIES	(PACKED_HDR_WORDS / 2 - 1)
+
+/**
+ * struct mmc_test_packed - packed write.
+ * @nr: number of requests
+ * @addr: address of each request on the card
+ * @blocks: number of blocks of each request
+ * @hdr: header block
+ * @sg: scatterlist, the header then the data of the requests
+ */
+struct mmc_test_packed {
+	unsigned int nr;
+	unsigned int addr[PACKED_MAX_ENTRIES];
+	unsigned int blocks[PACKED_MAX_ENTRIES];
+	__le32 *hdr;
+	struct scatterlist sg[PACKED_MAX_ENTRIES + 1];
+};
+
+/*
+ * Find how many requests of up to @blocks blocks each can be packed on
+ * this card and host.
+ */
+static int mmc_test_packed_max(struct mmc_test_card *test, unsigned blocks,
+			       unsigned *max)
+{
+	struct mmc_card *card = test->card;
+	struct mmc_host *host = card->host;
+	unsigned int max_blk_count;
+
+	if (!mmc_card_mmc(card) || card->ext_csd.max_packed_writes < 2)
+		return RESULT_UNSUP_CARD;
+	if (!mmc_host_cmd23(host))
+		return RESULT_UNSUP_HOST;
+
+	max_blk_count = min(host->max_blk_count, host->max_req_size >> 9);
+	if (max_blk_count > 0xffff)
+		max_blk_count = 0xffff;
+
+	*max = min_t(unsigned int, card->ext_csd.max_packed_writes,
+		     PACKED_MAX_ENTRIES);
+	*max = min_t(unsigned int, *max, host->max_segs - 1);
+	*max = min(*max, (max_blk_count - 1) / blocks);
+	if (*max < 2)
+		return RESULT_UNSUP_HOST;
+
+	return 0;
+}
+
+static struct mmc_test_packed *mmc_test_packed_alloc(void)
+{
+	struct mmc_test_packed *packed;
+
+	packed = kzalloc(sizeof(struct mmc_test_packed), GFP_KERNEL);
+	if (!packed)
+		return NULL;
+	packed->hdr = kzalloc(PACKED_HDR_WORDS * sizeof(__le32), GFP_KERNEL);
+	if (!packed->hdr) {
+		kfree(packed);
+		return NULL;
+	}
+	return packed;
+}
+
+static void mmc_test_packed_free(struct mmc_test_packed *packed)
+{
+	kfree(packed->hdr);
+	kfree(packed);
+}
+
+/*
+ * Tell why the card failed a packed write, from the exception events.
+ */
+static int mmc_test_packed_check_status(struct mmc_test_card *test)
+{
+	struct mmc_card *card = test->card;
+	struct mmc_command cmd = {0};
+	u8 *ext_csd;
+	int ret;
+
+	cmd.opcode = MMC_SEND_STATUS;
+	cmd.arg = card->rca << 16;
+	cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
+	ret = mmc_wait_for_cmd(card->host, &cmd, 0);
+	if (ret)
+		return ret;
+	if (!(cmd.resp[0] & R1_EXCEPTION_EVENT))
+		return 0;
+
+	ext_csd = kmalloc(512, GFP_KERNEL);
+	if (!ext_csd)
+		return -ENOMEM;
+	ret = mmc_send_ext_csd(card, ext_csd);
+	if (!ret && (ext_csd[EXT_CSD_EXP_EVENTS_STATUS] &
+		     EXT_CSD_PACKED_FAILURE)) {
+		printk(KERN_INFO "%s: Packed command status %#x, failure "
+		       "index %u\n", mmc_hostname(card->host),
+		       ext_csd[EXT_CSD_PACKED_CMD_STATUS],
+		       ext_csd[EXT_CSD_PACKED_FAILURE_INDEX]);
+		ret = RESULT_FAIL;
+	}
+	kfree(ext_csd);
+	return ret;
+}
+
+/*
+ * Write the requests of @packed, whose data is mapped from packed->sg[1],
+ * with one packed command.
+ */
+static int mmc_test_packed_transfer(struct mmc_test_card *test,
+				    struct mmc_test_packed *packed)
+{
+	struct mmc_card *card = test->card;
+	struct mmc_request mrq = {0};
+	struct mmc_command sbc = {0};
+	struct mmc_command cmd = {0};
+	struct mmc_command stop = {0};
+	struct mmc_data data = {0};
+	unsigned int i, blocks = 0;
+	int ret;
+
+	memset(packed->hdr, 0, PACKED_HDR_WORDS * sizeof(__le32));
+	packed->hdr[0] = cpu_to_le32((packed->nr << 16) |
+				     (PACKED_CMD_WR << 8) | PACKED_CMD_VER);
+	for (i = 0; i < packed->nr; i++) {
+		unsigned int addr = packed->addr[i];
+
+		if (!mmc_card_blockaddr(card))
+			addr <<= 9;
+		packed->hdr[(i + 1) * 2] = cpu_to_le32(packed->blocks[i]);
+		packed->hdr[(i + 1) * 2 + 1] = cpu_to_le32(addr);
+		blocks += packed->blocks[i];
+	}
+	sg_set_buf(&packed->sg[0], packed->hdr,
+		   PACKED_HDR_WORDS * sizeof(__le32));
+
+	mrq.sbc = &sbc;
+	mrq.cmd = &cmd;
+	mrq.data = &data;
+	mrq.stop = &stop;
+
+	mmc_test_prepare_mrq(test, &mrq, packed->sg, packed->nr + 1,
+			     packed->addr[0], blocks + 1, 512, 1);
+
+	sbc.opcode = MMC_SET_BLOCK_COUNT;
+	sbc.arg = (1 << 30) | (blocks + 1);
+	sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	mmc_wait_for_req(card->host, &mrq);
+
+	ret = sbc.error;
+	if (!ret)
+		ret = mmc_test_check_result(test, &mrq);
+	if (ret)
+		return ret;
+
+	ret = mmc_test_wait_busy(test);
+	if (ret)
+		return ret;
+
+	return mmc_test_packed_check_status(test);
+}
+
+/*
+ * Pack @nr requests of 1 to @max_blocks blocks of test->buffer, written
+ * to the test area with a block left between them, and check what the
+ * card has, data and gaps.
+ */
+static int mmc_test_packed_verify(struct mmc_test_card *test, unsigned nr,
+				  unsigned max_blocks)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_test_packed *packed;
+	unsigned int buf_blocks = BUFFER_SIZE / 512;
+	unsigned int i, j, k, off = 0, dev_addr = t->dev_addr;
+	unsigned int offs[PACKED_MAX_ENTRIES];
+	int ret;
+
+	packed = mmc_test_packed_alloc();
+	if (!packed)
+		return -ENOMEM;
+
+	for (i = 0; i < BUFFER_SIZE; i++)
+		test->buffer[i] = (i * 7 + i / 512) & 0xff;
+
+	sg_init_table(packed->sg, nr + 1);
+	packed->nr = nr;
+	for (i = 0; i < nr; i++) {
+		packed->blocks[i] = i % max_blocks + 1;
+		if (off + packed->blocks[i] > buf_blocks)
+			off = 0;
+		offs[i] = off;
+		packed->addr[i] = dev_addr;
+		sg_set_buf(&packed->sg[i + 1], test->buffer + off * 512,
+			   packed->blocks[i] * 512);
+		off += packed->blocks[i];
+		dev_addr += packed->blocks[i] + 1;
+	}
+
+	/* Known data where the requests go and in the gaps */
+	memset(test->scratch, 0xDF, 512);
+	for (j = t->dev_addr; j < dev_addr; j++) {
+		ret = mmc_test_buffer_transfer(test, test->scratch, j, 512, 1);
+		if (ret)
+			goto out;
+	}
+
+	ret = mmc_test_packed_transfer(test, packed);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j <= packed->blocks[i]; j++) {
+			u8 *expect = test->buffer + (offs[i] + j) * 512;
+
+			ret = mmc_test_buffer_transfer(test, test->scratch,
+						packed->addr[i] + j, 512, 0);
+			if (ret)
+				goto out;
+
+			if (j == packed->blocks[i]) {
+				/* The gap must not have been written */
+				for (k = 0; k < 512; k++) {
+					if (test->scratch[k] != 0xDF)
+						ret = RESULT_FAIL;
+				}
+			} else if (memcmp(test->scratch, expect, 512)) {
+				ret = RESULT_FAIL;
+			}
+			if (ret) {
+				printk(KERN_INFO "%s: Request %u of %u: bad "
+				       "data at block %u\n",
+				       mmc_hostname(test->card->host), i + 1,
+				       nr, j);
+				goto out;
+			}
+		}
+	}
+
+out:
+	mmc_test_packed_free(packed);
+	return ret;
+}
+
+/*
+ * Packed write of a few requests of different sizes.
+ */
+static int mmc_test_packed_write_verify(struct mmc_test_card *test)
+{
+	unsigned int max;
+	int ret;
+
+	ret = mmc_test_packed_max(test, 4, &max);
+	if (ret)
+		return ret;
+	return mmc_test_packed_verify(test, min(max, 8u), 4);
+}
+
+/*
+ * Packed write of as many requests as the card and host allow.
+ */
+static int mmc_test_packed_write_max(struct mmc_test_card *test)
+{
+	unsigned int max;
+	int ret;
+
+	ret = mmc_test_packed_max(test, 1, &max);
+	if (ret)
+		return ret;
+	return mmc_test_packed_verify(test, max, 1);
+}
+
+/*
+ * Write @nr requests of @sz bytes, one @sz apart, over the test area, with
+ * packed commands of @nr requests or with one command per request.
+ */
+static int mmc_test_seq_packed_perf(struct mmc_test_card *test,
+				    struct mmc_test_packed *packed,
+				    unsigned int nr, unsigned long sz,
+				    int pack)
+{
+	struct mmc_test_area *t = &test->area;
+	unsigned int blocks = sz >> 9, dev_addr, i, k, cnt;
+	struct timespec ts1, ts2;
+	struct scatterlist sg;
+	int ret;
+
+	ret = mmc_test_area_erase(test);
+	if (ret)
+		return ret;
+
+	sg_init_table(packed->sg, nr + 1);
+	for (k = 0; k < nr; k++)
+		sg_set_page(&packed->sg[k + 1], t->mem->arr[0].page, sz, 0);
+	sg_init_table(&sg, 1);
+	sg_set_page(&sg, t->mem->arr[0].page, sz, 0);
+
+	packed->nr = nr;
+	cnt = t->max_sz / (2 * sz * nr);
+	dev_addr = t->dev_addr;
+	getnstimeofday(&ts1);
+	for (i = 0; i < cnt; i++) {
+		for (k = 0; k < nr; k++) {
+			packed->addr[k] = dev_addr;
+			packed->blocks[k] = blocks;
+			if (!pack) {
+				ret = mmc_test_simple_transfer(test, &sg, 1,
+						dev_addr, blocks, 512, 1);
+				if (ret)
+					return ret;
+			}
+			dev_addr += 2 * blocks;
+		}
+		if (pack) {
+			ret = mmc_test_packed_transfer(test, packed);
+			if (ret)
+				return ret;
+		}
+	}
+	getnstimeofday(&ts2);
+	printk(KERN_INFO "%s: %s of %u requests:\n",
+	       mmc_hostname(test->card->host),
+	       pack ? "Packed write" : "Write", nr);
+	mmc_test_print_avg_rate(test, sz * nr, cnt, &ts1, &ts2);
+	return 0;
+}
+
+/*
+ * 4KiB writes, from 2 to the most requests which can be packed, written
+ * with packed commands and one at a time.
+ */
+static int mmc_test_profile_packed_perf(struct mmc_test_card *test)
+{
+	struct mmc_test_packed *packed;
+	unsigned long sz = 4096;
+	unsigned int max, nr;
+	int ret;
+
+	ret = mmc_test_packed_max(test, sz >> 9, &max);
+	if (ret)
+		return ret;
+
+	packed = mmc_test_packed_alloc();
+	if (!packed)
+		return -ENOMEM;
+
+	for (nr = 2; ; nr *= 2) {
+		if (nr > max)
+			nr = max;
+		ret = mmc_test_seq_packed_perf(test, packed, nr, sz, 0);
+		if (!ret)
+			ret = mmc_test_seq_packed_perf(test, packed, nr, sz, 1);
+		if (ret || nr == max)
+			break;
+	}
+
+	mmc_test_packed_free(packed);
+	return ret;
+}
+
 /*
  * Consecutive trim performance by transfer size.
  */
@@ -2221,6 +2744,55 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.cleanup = mmc_test_area_cleanup,
 	},
 
+	{
+		.name = "Consecutive read performance with blocking requests",
+		.prepare = mmc_test_area_prepare_fill,
+		.run = mmc_test_profile_read_blocking_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Consecutive read performance with non-blocking requests",
+		.prepare = mmc_test_area_prepare_fill,
+		.run = mmc_test_profile_read_nonblock_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Consecutive write performance with blocking requests",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_profile_write_blocking_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Consecutive write performance with non-blocking requests",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_profile_write_nonblock_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Packed write with data verification",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_packed_write_verify,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Packed write of the most requests with data verification",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_packed_write_max,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Packed and single write performance",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_profile_packed_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
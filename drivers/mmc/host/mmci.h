@@ -165,6 +165,17 @@
 struct clk;
 struct variant_data;
 struct dma_chan;
+struct dma_async_tx_descriptor;
+
+/*
+ * DMA job prepared by mmci_pre_request() while the previous request is
+ * in progress, identified by the host_cookie of its data.
+ */
+struct mmci_host_next {
+	struct dma_async_tx_descriptor	*dma_desc;
+	struct dma_chan			*dma_chan;
+	s32				cookie;
+};
 
 struct mmci_host {
 	phys_addr_t		phybase;
@@ -203,6 +214,8 @@ struct mmci_host {
 	struct dma_chan		*dma_current;
 	struct dma_chan		*dma_rx_channel;
 	struct dma_chan		*dma_tx_channel;
+	struct dma_async_tx_descriptor	*dma_desc_current;
+	struct mmci_host_next	next_data;
 
 #define dma_inprogress(host)	((host)->dma_current)
 #else
@@ -450,20 +450,10 @@ static void mshci_set_mdma_desc(u8 *desc_vir, u8 *desc_phy,
 					sizeof(struct mshci_idmac);
 }
 
-static int mshci_mdma_table_pre(struct mshci_host *host,
-	struct mmc_data *data)
+static int mshci_dma_map_sg(struct mshci_host *host, struct mmc_data *data)
 {
 	int direction;
 
-	u8 *desc_vir, *desc_phy;
-	dma_addr_t addr;
-	int len;
-
-	struct scatterlist *sg;
-	int i;
-	u32 des_flag;
-	u32 size_idmac = sizeof(struct mshci_idmac);
-
 	if (data->flags & MMC_DATA_READ)
 		direction = DMA_FROM_DEVICE;
 	else
@@ -471,22 +461,65 @@ static int mshci_mdma_table_pre(struct mshci_host *host,
 
 	if (host->ops->dma_map_sg && data->blocks >= 2048) {
 		/* if transfer size is bigger than 1MiB */
-		host->sg_count = host->ops->dma_map_sg(host,
-			mmc_dev(host->mmc),
+		return host->ops->dma_map_sg(host, mmc_dev(host->mmc),
 			data->sg, data->sg_len, direction, 2);
 	} else if (host->ops->dma_map_sg && data->blocks >= 128) {
 		/* if transfer size is bigger than 64KiB */
-		host->sg_count = host->ops->dma_map_sg(host,
-			mmc_dev(host->mmc),
+		return host->ops->dma_map_sg(host, mmc_dev(host->mmc),
 			data->sg, data->sg_len, direction, 1);
 	} else if (host->ops->dma_map_sg) {
-		host->sg_count = host->ops->dma_map_sg(host,
-			mmc_dev(host->mmc),
+		return host->ops->dma_map_sg(host, mmc_dev(host->mmc),
+			data->sg, data->sg_len, direction, 0);
+	} else {
+		return dma_map_sg(mmc_dev(host->mmc),
+			data->sg, data->sg_len, direction);
+	}
+}
+
+static void mshci_dma_unmap_sg(struct mshci_host *host, struct mmc_data *data)
+{
+	int direction;
+
+	if (data->flags & MMC_DATA_READ)
+		direction = DMA_FROM_DEVICE;
+	else
+		direction = DMA_TO_DEVICE;
+
+	if (host->ops->dma_unmap_sg && data->blocks >= 2048) {
+		/* if transfer size is bigger than 1MiB */
+		host->ops->dma_unmap_sg(host, mmc_dev(host->mmc),
+			data->sg, data->sg_len, direction, 2);
+	} else if (host->ops->dma_unmap_sg && data->blocks >= 128) {
+		/* if transfer size is bigger than 64KiB */
+		host->ops->dma_unmap_sg(host, mmc_dev(host->mmc),
+			data->sg, data->sg_len, direction, 1);
+	} else if (host->ops->dma_unmap_sg) {
+		/* if transfer size is lower than 64KiB */
+		host->ops->dma_unmap_sg(host, mmc_dev(host->mmc),
 			data->sg, data->sg_len, direction, 0);
 	} else {
-		host->sg_count = dma_map_sg(mmc_dev(host->mmc),
+		dma_unmap_sg(mmc_dev(host->mmc),
 			data->sg, data->sg_len, direction);
 	}
+}
+
+static int mshci_mdma_table_pre(struct mshci_host *host,
+	struct mmc_data *data)
+{
+	u8 *desc_vir, *desc_phy;
+	dma_addr_t addr;
+	int len;
+
+	struct scatterlist *sg;
+	int i;
+	u32 des_flag;
+	u32 size_idmac = sizeof(struct mshci_idmac);
+
+	/* data mapped by mshci_pre_req() has its sg_count as cookie */
+	if (data->host_cookie)
+		host->sg_count = data->host_cookie;
+	else
+		host->sg_count = mshci_dma_map_sg(host, data);
 
 	if (host->sg_count == 0)
 		goto fail;
@@ -541,22 +574,9 @@ static int mshci_mdma_table_pre(struct mshci_host *host,
 	return 0;
 
 unmap_entries:
-	if (host->ops->dma_unmap_sg && data->blocks >= 2048) {
-		/* if transfer size is bigger than 1MiB */
-		host->ops->dma_unmap_sg(host, mmc_dev(host->mmc),
-			data->sg, data->sg_len, direction, 2);
-	} else if (host->ops->dma_unmap_sg && data->blocks >= 128) {
-		/* if transfer size is bigger than 64KiB */
-		host->ops->dma_unmap_sg(host, mmc_dev(host->mmc),
-			data->sg, data->sg_len, direction, 1);
-	} else if (host->ops->dma_unmap_sg) {
-		/* if transfer size is lower than 64KiB */
-		host->ops->dma_unmap_sg(host, mmc_dev(host->mmc),
-			data->sg, data->sg_len, direction, 0);
-	} else {
-		dma_unmap_sg(mmc_dev(host->mmc),
-			data->sg, data->sg_len, direction);
-	}
+	/* falls back to PIO, the data must not stay mapped */
+	mshci_dma_unmap_sg(host, data);
+	data->host_cookie = 0;
 fail:
 	return -EINVAL;
 }
@@ -564,32 +584,36 @@ fail:
 static void mshci_idma_table_post(struct mshci_host *host,
 	struct mmc_data *data)
 {
-	int direction;
-
-	if (data->flags & MMC_DATA_READ)
-		direction = DMA_FROM_DEVICE;
-	else
-		direction = DMA_TO_DEVICE;
-
 	dma_unmap_single(mmc_dev(host->mmc), host->idma_addr,
 		MSHCI_MAX_DMA_LIST*sizeof(struct mshci_idmac), DMA_TO_DEVICE);
 
-	if (host->ops->dma_unmap_sg && data->blocks >= 2048) {
-		/* if transfer size is bigger than 1MiB */
-		host->ops->dma_unmap_sg(host, mmc_dev(host->mmc),
-			data->sg, data->sg_len, direction, 2);
-	} else if (host->ops->dma_unmap_sg && data->blocks >= 128) {
-		/* if transfer size is bigger than 64KiB */
-		host->ops->dma_unmap_sg(host, mmc_dev(host->mmc),
-			data->sg, data->sg_len, direction, 1);
-	} else if (host->ops->dma_unmap_sg) {
-		/* if transfer size is lower than 64KiB */
-		host->ops->dma_unmap_sg(host, mmc_dev(host->mmc),
-			data->sg, data->sg_len, direction, 0);
-	} else {
-		dma_unmap_sg(mmc_dev(host->mmc),
-			data->sg, data->sg_len, direction);
+	/* else mshci_post_req() unmaps it */
+	if (!data->host_cookie)
+		mshci_dma_unmap_sg(host, data);
+}
+
+/*
+ * mshc's IDMAC can't transfer data that is not aligned or has length
+ * not divided by 4 byte.
+ */
+static bool mshci_dma_capable(struct mmc_data *data)
+{
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(data->sg, sg, data->sg_len, i) {
+		if (sg->length & 0x3) {
+			DBG("Reverting to PIO because of "
+				"transfer size (%d)\n",
+				sg->length);
+			return false;
+		} else if (sg->offset & 0x3) {
+			DBG("Reverting to PIO because of "
+				"bad alignment\n");
+			return false;
+		}
 	}
+	return true;
 }
 
 static u32 mshci_calc_timeout(struct mshci_host *host, struct mmc_data *data)
@@ -638,27 +662,8 @@ static void mshci_prepare_data(struct mshci_host *host, struct mmc_data *data)
 	 * FIXME: This doesn't account for merging when mapping the
 	 * scatterlist.
 	 */
-	if (host->flags & MSHCI_REQ_USE_DMA) {
-		/* mshc's IDMAC can't transfer data that is not aligned
-		 * or has length not divided by 4 byte. */
-		int i;
-		struct scatterlist *sg;
-
-			for_each_sg(data->sg, sg, data->sg_len, i) {
-				if (sg->length & 0x3) {
-					DBG("Reverting to PIO because of "
-						"transfer size (%d)\n",
-						sg->length);
-					host->flags &= ~MSHCI_REQ_USE_DMA;
-					break;
-			} else if (sg->offset & 0x3) {
-				DBG("Reverting to PIO because of "
-					"bad alignment\n");
-				host->flags &= ~MSHCI_REQ_USE_DMA;
-				break;
-			}
-		}
-	}
+	if ((host->flags & MSHCI_REQ_USE_DMA) && !mshci_dma_capable(data))
+		host->flags &= ~MSHCI_REQ_USE_DMA;
 
 	if (host->flags & MSHCI_REQ_USE_DMA) {
 		ret = mshci_mdma_table_pre(host, data);
@@ -1184,8 +1189,44 @@ out:
 	spin_unlock_irqrestore(&host->lock, flags);
 }
 
+/*
+ * The sg list of the next request is mapped while the current one is on
+ * the bus, so that cleaning or invalidating its buffers in the cache is
+ * done by then.  The IDMAC descriptors themselves are only written by
+ * mshci_prepare_data(), there is one table.
+ */
+static void mshci_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			  bool is_first_req)
+{
+	struct mshci_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (!data || data->host_cookie)
+		return;
+
+	if (!(host->flags & MSHCI_USE_IDMA) || !mshci_dma_capable(data))
+		return;
+
+	data->host_cookie = mshci_dma_map_sg(host, data);
+}
+
+static void mshci_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			   int err)
+{
+	struct mshci_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	mshci_dma_unmap_sg(host, data);
+	data->host_cookie = 0;
+}
+
 static struct mmc_host_ops mshci_ops = {
 	.request	= mshci_request,
+	.pre_req	= mshci_pre_req,
+	.post_req	= mshci_post_req,
 	.set_ios	= mshci_set_ios,
 	.get_ro		= mshci_get_ro,
 	.enable_sdio_irq = mshci_enable_sdio_irq,
@@ -459,6 +459,9 @@ void __bio_clone(struct bio *bio, struct bio *bio_src)
 	bio->bi_vcnt = bio_src->bi_vcnt;
 	bio->bi_size = bio_src->bi_size;
 	bio->bi_idx = bio_src->bi_idx;
+#ifdef CONFIG_BLK_DEV_THROTTLING
+	bio->bi_blkcg_id = bio_src->bi_blkcg_id;
+#endif
 }
 EXPORT_SYMBOL(__bio_clone);
 
@@ -105,6 +105,8 @@ struct dio {
 	unsigned long refcount;		/* direct_io_worker() and bios */
 	struct bio *bio_list;		/* singly linked via bi_private */
 	struct task_struct *waiter;	/* waiting task (NULL if none) */
+	struct request_queue *poll_queue; /* io_poll queue of a sync dio */
+	ktime_t submit_time;		/* last bio submission, for polling */
 
 	/* AIO related stuff */
 	struct kiocb *iocb;		/* kiocb */
@@ -369,6 +371,9 @@ static void dio_bio_submit(struct dio *dio)
 	if (dio->is_async && dio->rw == READ)
 		bio_set_pages_dirty(bio);
 
+	if (dio->poll_queue)
+		dio->submit_time = ktime_get();
+
 	if (dio->submit_io)
 		dio->submit_io(dio->rw, bio, dio->inode,
 			       dio->logical_offset_in_bio);
@@ -412,7 +417,9 @@ static struct bio *dio_await_one(struct dio *dio)
 		__set_current_state(TASK_UNINTERRUPTIBLE);
 		dio->waiter = current;
 		spin_unlock_irqrestore(&dio->bio_lock, flags);
-		io_schedule();
+		if (!dio->poll_queue || !blk_poll(dio->poll_queue,
+				dio->rw & WRITE, dio->submit_time))
+			io_schedule();
 		/* wake up sets us TASK_RUNNING */
 		spin_lock_irqsave(&dio->bio_lock, flags);
 		dio->waiter = NULL;
@@ -1246,6 +1253,10 @@ __blockdev_direct_IO(int rw, struct kiocb *iocb, struct inode *inode,
 	dio->is_async = !is_sync_kiocb(iocb) && !((rw & WRITE) &&
 		(end > i_size_read(inode)));
 
+	/* the submitter waits for its io, see blk_poll() */
+	if (bdev && is_sync_kiocb(iocb) && blk_queue_poll(bdev_get_queue(bdev)))
+		dio->poll_queue = bdev_get_queue(bdev);
+
 	retval = direct_io_worker(rw, iocb, inode, iov, offset,
 				nr_segs, blkbits, get_block, end_io,
 				submit_io, dio);
@@ -61,6 +61,11 @@ struct bio {
 
 	unsigned int		bi_comp_cpu;	/* completion CPU */
 
+#ifdef CONFIG_BLK_DEV_THROTTLING
+	/* css id of the blkio cgroup of the submitter, 0 until throttled */
+	unsigned short		bi_blkcg_id;
+#endif
+
 	atomic_t		bi_cnt;		/* pin count */
 
 	struct bio_vec		*bi_io_vec;	/* the actual vec list */
@@ -40,6 +40,9 @@ struct cpuidle_state {
 
 	unsigned long long	usage;
 	unsigned long long	time; /* in US */
+	unsigned long long	hits;  /* right state for the time spent idle */
+	unsigned long long	above; /* too deep: woke before target_residency */
+	unsigned long long	below; /* too shallow: a deeper state would do */
 
 	int (*enter)	(struct cpuidle_device *dev,
 			 struct cpuidle_state *state);
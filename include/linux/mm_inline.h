@@ -21,6 +21,57 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+#ifdef CONFIG_LRU_GEN
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/*
+ * Active pages enter the youngest generation, inactive ones the oldest
+ * generation of their type.
+ */
+static inline struct list_head *lru_gen_list(struct zone *zone,
+					     enum lru_list l)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	int file = is_file_lru(l);
+	unsigned long seq;
+
+	seq = is_active_lru(l) ? lrugen->max_seq : lrugen->min_seq[file];
+	return &lrugen->lists[lru_gen_from_seq(seq)][file];
+}
+
+static inline int lru_gen_enabled(struct zone *zone)
+{
+	return zone->lrugen.enabled;
+}
+#else
+static inline int lru_gen_enabled(struct zone *zone)
+{
+	return 0;
+}
+#endif
+
+/**
+ * zone_lru_head - list a page of type @l is put on
+ * @zone: zone the page belongs to
+ * @l: LRU list index as returned by page_lru()
+ *
+ * Returns the zone LRU list, or the matching generation list when the
+ * multi-generational LRU is enabled for @zone.  zone->lru_lock must be
+ * held, the answer may change as soon as it is dropped.
+ */
+static inline struct list_head *zone_lru_head(struct zone *zone,
+					      enum lru_list l)
+{
+#ifdef CONFIG_LRU_GEN
+	if (lru_gen_enabled(zone) && !is_unevictable_lru(l))
+		return lru_gen_list(zone, l);
+#endif
+	return &zone->lru[l].list;
+}
+
 static inline void
 __add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l,
 		       struct list_head *head)
@@ -33,7 +84,7 @@ __add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l,
 static inline void
 add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
-	__add_page_to_lru_list(zone, page, l, &zone->lru[l].list);
+	__add_page_to_lru_list(zone, page, l, zone_lru_head(zone, l));
 }
 
 static inline void
@@ -327,6 +327,15 @@ struct mm_struct {
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	pgtable_t pmd_huge_pte; /* protected by page_table_lock */
 #endif
+#ifdef CONFIG_KSM
+	/* protected by ksm_thread_mutex, shown in /proc/<pid>/ksm_stat */
+	unsigned long ksm_rmap_items;	/* pages of this mm tracked by ksmd */
+	unsigned long ksm_merging_pages;	/* of which mapped to ksm pages */
+#endif
+#ifdef CONFIG_LRU_GEN
+	/* on the list of mms whose page tables the LRU aging walks */
+	struct list_head lru_gen_list;
+#endif
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
 #endif
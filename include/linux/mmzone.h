@@ -106,6 +106,8 @@ enum zone_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_DIRTIED,		/* page dirtyings since bootup */
 	NR_WRITTEN,		/* page writings since bootup */
+	WORKINGSET_REFAULT,	/* evicted page cache faulted back in */
+	WORKINGSET_ACTIVATE,	/* refaults activated as thrashing */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -275,6 +277,29 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-generational LRU sorts the evictable pages of a zone into
+ * generations by age instead of the active/inactive lists.  Generations
+ * are numbered by an ever increasing sequence: max_seq is the youngest,
+ * min_seq[] the oldest one still holding anon [0] and file [1] pages.
+ * Sequence numbers map onto the list array modulo MAX_NR_GENS, and the
+ * lists of sequences outside [min_seq, max_seq] are always empty.
+ *
+ * Pages on these lists keep their PG_active state, so the per-zone
+ * NR_*_ANON/NR_*_FILE counters stay valid in both modes.
+ */
+#define MIN_NR_GENS	2
+#define MAX_NR_GENS	4
+
+struct lru_gen {
+	int			enabled;
+	unsigned long		max_seq;
+	unsigned long		min_seq[2];
+	struct list_head	lists[MAX_NR_GENS][2];
+};
+#endif
+
 struct zone {
 	/* Fields commonly accessed by the page allocator */
 
@@ -345,6 +370,12 @@ struct zone {
 	} lru[NR_LRU_LISTS];
 
 	struct zone_reclaim_stat reclaim_stat;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen		lrugen;
+#endif
+
+	/* Evictions and activations, the clock of refault distances */
+	atomic_long_t		inactive_age;
 
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	unsigned long		flags;		   /* zone flags, see below */
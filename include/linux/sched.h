@@ -39,6 +39,7 @@
 #define SCHED_BATCH		3
 /* SCHED_ISO: reserved but not implemented yet */
 #define SCHED_IDLE		5
+#define SCHED_DEADLINE		6
 /* Can be ORed in to make sure the process is reverted back to SCHED_NORMAL on fork */
 #define SCHED_RESET_ON_FORK     0x40000000
 
@@ -141,6 +142,40 @@ extern unsigned long nr_uninterruptible(void);
 extern unsigned long nr_iowait(void);
 extern unsigned long nr_iowait_cpu(int cpu);
 extern unsigned long this_cpu_load(void);
+extern unsigned long sched_cpu_util(int cpu);
+extern void sched_set_freq_scale(int cpu, unsigned long scale);
+
+#ifdef CONFIG_SCHED_ENERGY
+/*
+ * Energy model of cpus sharing a clock, one entry per operating point in
+ * increasing order: the capacity relative to the fastest cpu of the
+ * system (SCHED_POWER_SCALE) and the power one busy cpu draws at it.
+ */
+struct sched_energy_state {
+	unsigned long cap;
+	unsigned long power;
+};
+
+extern unsigned int sysctl_sched_energy_aware;
+extern int sched_energy_register(const struct cpumask *cpus,
+				 const struct sched_energy_state *states,
+				 int nr_states, unsigned long idle_power);
+#endif
+
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Utilization callback for cpufreq governors.  The scheduler calls ->func()
+ * with the runqueue lock held and interrupts disabled whenever the fair
+ * class utilization of the cpu changes: on enqueue, dequeue and tick.
+ */
+struct update_util_data {
+	void (*func)(struct update_util_data *data, u64 time,
+		     unsigned long util, unsigned long max);
+};
+
+extern void cpufreq_set_update_util_data(int cpu,
+					 struct update_util_data *data);
+#endif
 
 
 extern void calc_global_load(unsigned long ticks);
@@ -1096,6 +1131,7 @@ struct sched_class {
 
 #ifdef CONFIG_SMP
 	int  (*select_task_rq)(struct task_struct *p, int sd_flag, int flags);
+	void (*migrate_task_rq)(struct task_struct *p, int next_cpu);
 
 	void (*pre_schedule) (struct rq *this_rq, struct task_struct *task);
 	void (*post_schedule) (struct rq *this_rq);
@@ -1112,6 +1148,7 @@ struct sched_class {
 	void (*set_curr_task) (struct rq *rq);
 	void (*task_tick) (struct rq *rq, struct task_struct *p, int queued);
 	void (*task_fork) (struct task_struct *p);
+	void (*task_dead) (struct task_struct *p);
 
 	void (*switched_from) (struct rq *this_rq, struct task_struct *task);
 	void (*switched_to) (struct rq *this_rq, struct task_struct *task);
@@ -1163,9 +1200,31 @@ struct sched_statistics {
 	u64			nr_wakeups_affine_attempts;
 	u64			nr_wakeups_passive;
 	u64			nr_wakeups_idle;
+
+	/* wait latencies, see kernel/sched_stats.h */
+	u64			lat_start;
+	u64			wakeup_lat_max;
+	u64			preempt_lat_max;
+	int			lat_preempt;
 };
 #endif
 
+/*
+ * Per-entity load tracking: a geometric series over 1024us periods, with
+ * the contribution of a period halving every 32 periods.  load_avg is the
+ * runnable load weighted by the entity's load.weight; util_avg is the
+ * fraction of time spent running, scaled to SCHED_POWER_SCALE at the
+ * highest cpu frequency.
+ */
+struct sched_avg {
+	u64			last_update_time;
+	u64			load_sum;
+	u64			util_sum;
+	u32			period_contrib;
+	unsigned long		load_avg;
+	unsigned long		util_avg;
+};
+
 struct sched_entity {
 	struct load_weight	load;		/* for load-balancing */
 	struct rb_node		run_node;
@@ -1179,6 +1238,8 @@ struct sched_entity {
 
 	u64			nr_migrations;
 
+	struct sched_avg	avg;
+
 #ifdef CONFIG_SCHEDSTATS
 	struct sched_statistics statistics;
 #endif
@@ -1208,6 +1269,59 @@ struct sched_rt_entity {
 #endif
 };
 
+/*
+ * Extended scheduling parameters, for sched_setattr() and sched_getattr().
+ * The layout and the syscall numbers are those of later kernels so that
+ * binaries written against them work here.
+ *
+ * SCHED_DEADLINE tasks get sched_runtime nanoseconds of cpu time every
+ * sched_period nanoseconds, to be used within sched_deadline nanoseconds
+ * of the start of the period.  A period of 0 means the deadline.
+ */
+#define SCHED_FLAG_RESET_ON_FORK	0x01
+
+#define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+
+struct sched_attr {
+	u32 size;
+
+	u32 sched_policy;
+	u64 sched_flags;
+
+	/* SCHED_NORMAL, SCHED_BATCH */
+	s32 sched_nice;
+
+	/* SCHED_FIFO, SCHED_RR */
+	u32 sched_priority;
+
+	/* SCHED_DEADLINE */
+	u64 sched_runtime;
+	u64 sched_deadline;
+	u64 sched_period;
+};
+
+struct sched_dl_entity {
+	struct rb_node	rb_node;
+
+	/* parameters, see struct sched_attr */
+	u64 dl_runtime;
+	u64 dl_deadline;
+	u64 dl_period;
+	u64 dl_bw;		/* dl_runtime / dl_period, admitted */
+
+	/* current instance, in rq->clock time */
+	s64 runtime;		/* left in this period */
+	u64 deadline;		/* absolute */
+
+	unsigned int dl_new:1;		/* no instance yet */
+	unsigned int dl_throttled:1;	/* runtime exhausted */
+	unsigned int dl_yielded:1;	/* gave up the rest of its runtime */
+
+	/* throttled on its rq, waiting for dl_timer to replenish it */
+	struct list_head throttled_node;
+	struct hrtimer dl_timer;
+};
+
 struct rcu_node;
 
 enum perf_event_task_context {
@@ -1235,6 +1349,7 @@ struct task_struct {
 	const struct sched_class *sched_class;
 	struct sched_entity se;
 	struct sched_rt_entity rt;
+	struct sched_dl_entity dl;
 
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	/* list of struct preempt_notifier: */
@@ -1525,7 +1640,13 @@ struct task_struct {
 #ifdef CONFIG_FAULT_INJECTION
 	int make_it_fail;
 #endif
-	struct prop_local_single dirties;
+	/*
+	 * when (nr_dirtied >= nr_dirtied_pause), it's time to call
+	 * balance_dirty_pages() for some dirty throttling pause
+	 */
+	int nr_dirtied;
+	int nr_dirtied_pause;
+
 #ifdef CONFIG_LATENCYTOP
 	int latency_record_count;
 	struct latency_record latency_record[LT_SAVECOUNT];
@@ -1594,6 +1715,24 @@ struct task_struct {
 #define MAX_PRIO		(MAX_RT_PRIO + 40)
 #define DEFAULT_PRIO		(MAX_RT_PRIO + 20)
 
+/*
+ * SCHED_DEADLINE tasks have a priority below all others, MAX_DL_PRIO-1, so
+ * that rt_prio() is also true for them.
+ */
+#define MAX_DL_PRIO		0
+
+static inline int dl_prio(int prio)
+{
+	if (unlikely(prio < MAX_DL_PRIO))
+		return 1;
+	return 0;
+}
+
+static inline int dl_task(struct task_struct *p)
+{
+	return dl_prio(p->prio);
+}
+
 static inline int rt_prio(int prio)
 {
 	if (unlikely(prio < MAX_RT_PRIO))
@@ -1999,6 +2138,11 @@ static inline unsigned int get_sysctl_timer_migration(void)
 	return 1;
 }
 #endif
+#ifdef CONFIG_SMP
+extern int sysctl_sched_wake_affine_pct;
+extern unsigned int sysctl_sched_wake_affine_sync;
+#endif
+
 extern unsigned int sysctl_sched_rt_period;
 extern int sysctl_sched_rt_runtime;
 
@@ -2006,6 +2150,10 @@ int sched_rt_handler(struct ctl_table *table, int write,
 		void __user *buffer, size_t *lenp,
 		loff_t *ppos);
 
+#ifdef CONFIG_CFS_BANDWIDTH
+extern unsigned int sysctl_sched_cfs_bandwidth_slice;
+#endif
+
 #ifdef CONFIG_SCHED_AUTOGROUP
 extern unsigned int sysctl_sched_autogroup_enabled;
 
@@ -2047,6 +2195,8 @@ extern int sched_setscheduler(struct task_struct *, int,
 			      const struct sched_param *);
 extern int sched_setscheduler_nocheck(struct task_struct *, int,
 				      const struct sched_param *);
+extern int sched_setattr(struct task_struct *,
+			 const struct sched_attr *);
 extern struct task_struct *idle_task(int cpu);
 extern struct task_struct *curr_task(int cpu);
 extern void set_curr_task(int cpu, struct task_struct *p);
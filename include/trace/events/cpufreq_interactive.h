@@ -0,0 +1,98 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cpufreq_interactive
+
+#if !defined(_TRACE_CPUFREQ_INTERACTIVE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CPUFREQ_INTERACTIVE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * Load evaluation by the timer of one cpu: the load it measured, the
+ * target it had, the current policy speed and the target it came up with.
+ */
+DECLARE_EVENT_CLASS(loadeval,
+
+	TP_PROTO(unsigned long cpu_id, unsigned long load,
+		 unsigned long curtarg, unsigned long curactual,
+		 unsigned long newtarg),
+
+	TP_ARGS(cpu_id, load, curtarg, curactual, newtarg),
+
+	TP_STRUCT__entry(
+		__field(unsigned long,	cpu_id		)
+		__field(unsigned long,	load		)
+		__field(unsigned long,	curtarg		)
+		__field(unsigned long,	curactual	)
+		__field(unsigned long,	newtarg		)
+	),
+
+	TP_fast_assign(
+		__entry->cpu_id = cpu_id;
+		__entry->load = load;
+		__entry->curtarg = curtarg;
+		__entry->curactual = curactual;
+		__entry->newtarg = newtarg;
+	),
+
+	TP_printk("cpu=%lu load=%lu cur=%lu actual=%lu targ=%lu",
+		  __entry->cpu_id, __entry->load, __entry->curtarg,
+		  __entry->curactual, __entry->newtarg)
+);
+
+/* A new target was posted for the policy */
+DEFINE_EVENT(loadeval, cpufreq_interactive_target,
+
+	TP_PROTO(unsigned long cpu_id, unsigned long load,
+		 unsigned long curtarg, unsigned long curactual,
+		 unsigned long newtarg),
+
+	TP_ARGS(cpu_id, load, curtarg, curactual, newtarg)
+);
+
+/* The cpu is already at the target it came up with */
+DEFINE_EVENT(loadeval, cpufreq_interactive_already,
+
+	TP_PROTO(unsigned long cpu_id, unsigned long load,
+		 unsigned long curtarg, unsigned long curactual,
+		 unsigned long newtarg),
+
+	TP_ARGS(cpu_id, load, curtarg, curactual, newtarg)
+);
+
+/* A lower target was held back by min_sample_time */
+DEFINE_EVENT(loadeval, cpufreq_interactive_notyet,
+
+	TP_PROTO(unsigned long cpu_id, unsigned long load,
+		 unsigned long curtarg, unsigned long curactual,
+		 unsigned long newtarg),
+
+	TP_ARGS(cpu_id, load, curtarg, curactual, newtarg)
+);
+
+/* The speed change thread applied the highest target of the policy */
+TRACE_EVENT(cpufreq_interactive_setspeed,
+
+	TP_PROTO(u32 cpu_id, unsigned long targfreq, unsigned long actualfreq),
+
+	TP_ARGS(cpu_id, targfreq, actualfreq),
+
+	TP_STRUCT__entry(
+		__field(u32,		cpu_id		)
+		__field(unsigned long,	targfreq	)
+		__field(unsigned long,	actualfreq	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu_id = cpu_id;
+		__entry->targfreq = targfreq;
+		__entry->actualfreq = actualfreq;
+	),
+
+	TP_printk("cpu=%u targ=%lu actual=%lu",
+		  __entry->cpu_id, __entry->targfreq, __entry->actualfreq)
+);
+
+#endif /* _TRACE_CPUFREQ_INTERACTIVE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,74 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM load_hotplug
+
+#if !defined(_TRACE_LOAD_HOTPLUG_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LOAD_HOTPLUG_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * One evaluation of the hotplug policy: the runnable tasks it sampled,
+ * their average in hundredths, the total utilization in percent of one
+ * cpu, the online cpus and what it decided (enum lhp_decision).
+ */
+TRACE_EVENT(load_hotplug_sample,
+
+	TP_PROTO(unsigned int nr_running, unsigned int avg_nr,
+		 unsigned int util, unsigned int online, int decision),
+
+	TP_ARGS(nr_running, avg_nr, util, online, decision),
+
+	TP_STRUCT__entry(
+		__field(unsigned int,	nr_running	)
+		__field(unsigned int,	avg_nr		)
+		__field(unsigned int,	util		)
+		__field(unsigned int,	online		)
+		__field(int,		decision	)
+	),
+
+	TP_fast_assign(
+		__entry->nr_running = nr_running;
+		__entry->avg_nr = avg_nr;
+		__entry->util = util;
+		__entry->online = online;
+		__entry->decision = decision;
+	),
+
+	TP_printk("nr_running=%u avg_nr=%u.%02u util=%u online=%u decision=%s",
+		  __entry->nr_running, __entry->avg_nr / 100,
+		  __entry->avg_nr % 100, __entry->util, __entry->online,
+		  __print_symbolic(__entry->decision,
+				   { 0, "hold" },
+				   { 1, "up_pending" },
+				   { 2, "down_pending" },
+				   { 3, "up" },
+				   { 4, "down" }))
+);
+
+/* A cpu was brought up or taken down, with the result of doing so */
+TRACE_EVENT(load_hotplug_cpu,
+
+	TP_PROTO(unsigned int cpu, int up, int ret),
+
+	TP_ARGS(cpu, up, ret),
+
+	TP_STRUCT__entry(
+		__field(unsigned int,	cpu	)
+		__field(int,		up	)
+		__field(int,		ret	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu = cpu;
+		__entry->up = up;
+		__entry->ret = ret;
+	),
+
+	TP_printk("cpu=%u %s ret=%d", __entry->cpu,
+		  __entry->up ? "up" : "down", __entry->ret)
+);
+
+#endif /* _TRACE_LOAD_HOTPLUG_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
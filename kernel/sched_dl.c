@@ -0,0 +1,700 @@
+/*
+ * Deadline Scheduling Class (mapped to the SCHED_DEADLINE policy)
+ *
+ * Every task gets dl_runtime of cpu time every dl_period, to be used
+ * before dl_deadline from the start of the period.  The runnable tasks are
+ * run in earliest deadline first order, and each one is isolated from the
+ * others by a constant bandwidth server (CBS): a task that used up its
+ * runtime is throttled until its next period starts, and one that wakes up
+ * with more runtime left than it could use before its deadline without
+ * exceeding its bandwidth gets a new deadline.
+ *
+ * The sum of the bandwidths of all the tasks, dl_runtime / dl_period, is
+ * checked against the realtime limit (sched_rt_runtime_us /
+ * sched_rt_period_us of every online cpu) when a task asks for the policy,
+ * so that admitted tasks can meet their deadlines.
+ *
+ * See Documentation/scheduler/sched-deadline.txt.
+ */
+
+/* Bandwidths are in units of 1 / 2^DL_BW_SHIFT of a cpu */
+#define DL_BW_SHIFT	20
+
+/* Scaling of the runtime and deadline products of the CBS wakeup rule */
+#define DL_SCALE	10
+
+/* Protects dl_total_bw */
+static DEFINE_RAW_SPINLOCK(dl_bw_lock);
+static u64 dl_total_bw;
+
+static inline int dl_time_before(u64 a, u64 b)
+{
+	return (s64)(a - b) < 0;
+}
+
+static inline struct task_struct *dl_task_of(struct sched_dl_entity *dl_se)
+{
+	return container_of(dl_se, struct task_struct, dl);
+}
+
+static inline u64 dl_ratio(u64 period, u64 runtime)
+{
+	if (!period)
+		return 0;
+	return div64_u64(runtime << DL_BW_SHIFT, period);
+}
+
+/* Bandwidth @cpus cpus can give to deadline tasks, -1ULL if unlimited */
+static u64 dl_bw_limit(int cpus)
+{
+	if (global_rt_runtime() == RUNTIME_INF)
+		return -1ULL;
+	return dl_ratio(global_rt_period(), global_rt_runtime()) * cpus;
+}
+
+/*
+ * Admission control: account the bandwidth @p has with @policy and @attr
+ * in place of the one it has now, or fail with -EBUSY if that does not fit
+ * in the limit.  A policy other than SCHED_DEADLINE releases it.
+ */
+static int dl_admit(struct task_struct *p, int policy,
+		    const struct sched_attr *attr)
+{
+	u64 period = attr->sched_period ?: attr->sched_deadline;
+	u64 new_bw = 0;
+	int err = 0;
+
+	if (policy == SCHED_DEADLINE)
+		new_bw = dl_ratio(period, attr->sched_runtime);
+	if (new_bw == p->dl.dl_bw)
+		return 0;
+
+	raw_spin_lock(&dl_bw_lock);
+	if (new_bw > p->dl.dl_bw &&
+	    dl_total_bw - p->dl.dl_bw + new_bw > dl_bw_limit(num_online_cpus()))
+		err = -EBUSY;
+	else {
+		dl_total_bw = dl_total_bw - p->dl.dl_bw + new_bw;
+		p->dl.dl_bw = new_bw;
+	}
+	raw_spin_unlock(&dl_bw_lock);
+
+	return err;
+}
+
+static void sched_dl_release(struct task_struct *p)
+{
+	unsigned long flags;
+
+	if (!p->dl.dl_bw)
+		return;
+
+	raw_spin_lock_irqsave(&dl_bw_lock, flags);
+	dl_total_bw -= p->dl.dl_bw;
+	p->dl.dl_bw = 0;
+	raw_spin_unlock_irqrestore(&dl_bw_lock, flags);
+}
+
+/*
+ * Would the admitted bandwidth still fit with one cpu less?  Checked
+ * before taking a cpu down.
+ */
+static bool dl_cpu_busy(void)
+{
+	unsigned long flags;
+	bool busy;
+
+	raw_spin_lock_irqsave(&dl_bw_lock, flags);
+	busy = dl_total_bw > dl_bw_limit(num_online_cpus() - 1);
+	raw_spin_unlock_irqrestore(&dl_bw_lock, flags);
+
+	return busy;
+}
+
+/*
+ * Would the admitted bandwidth still fit in the realtime limit with the
+ * new sched_rt_runtime_us and sched_rt_period_us?
+ */
+static int sched_dl_global_constraints(void)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	raw_spin_lock_irqsave(&dl_bw_lock, flags);
+	if (dl_total_bw > dl_bw_limit(num_online_cpus()))
+		ret = -EBUSY;
+	raw_spin_unlock_irqrestore(&dl_bw_lock, flags);
+
+	return ret;
+}
+
+static void __setparam_dl(struct task_struct *p, const struct sched_attr *attr)
+{
+	struct sched_dl_entity *dl_se = &p->dl;
+
+	dl_se->dl_runtime = attr->sched_runtime;
+	dl_se->dl_deadline = attr->sched_deadline;
+	dl_se->dl_period = attr->sched_period ?: attr->sched_deadline;
+	dl_se->dl_throttled = 0;
+	dl_se->dl_yielded = 0;
+	dl_se->dl_new = 1;
+}
+
+static void __getparam_dl(struct task_struct *p, struct sched_attr *attr)
+{
+	struct sched_dl_entity *dl_se = &p->dl;
+
+	attr->sched_priority = p->rt_priority;
+	attr->sched_runtime = dl_se->dl_runtime;
+	attr->sched_deadline = dl_se->dl_deadline;
+	attr->sched_period = dl_se->dl_period;
+}
+
+/*
+ * The runtime has to be at least 2^DL_SCALE ns for the wakeup rule to see
+ * it, and runtime <= deadline <= period.  The top bit of the times is kept
+ * clear so that deadlines can be compared by difference.
+ */
+static bool __checkparam_dl(const struct sched_attr *attr)
+{
+	if (attr->sched_deadline == 0)
+		return false;
+	if (attr->sched_runtime < (1ULL << DL_SCALE))
+		return false;
+	if ((attr->sched_deadline | attr->sched_period) & (1ULL << 63))
+		return false;
+	if (attr->sched_period && attr->sched_period < attr->sched_deadline)
+		return false;
+	if (attr->sched_deadline < attr->sched_runtime)
+		return false;
+	return true;
+}
+
+/*
+ * Runqueue of the runnable tasks that have runtime left, by deadline.
+ */
+
+static inline int on_dl_tree(struct sched_dl_entity *dl_se)
+{
+	return !RB_EMPTY_NODE(&dl_se->rb_node);
+}
+
+static void __enqueue_dl_entity(struct dl_rq *dl_rq,
+				struct sched_dl_entity *dl_se)
+{
+	struct rb_node **link = &dl_rq->rb_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct sched_dl_entity *entry;
+	int leftmost = 1;
+
+	BUG_ON(on_dl_tree(dl_se));
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct sched_dl_entity, rb_node);
+		if (dl_time_before(dl_se->deadline, entry->deadline))
+			link = &parent->rb_left;
+		else {
+			link = &parent->rb_right;
+			leftmost = 0;
+		}
+	}
+
+	if (leftmost)
+		dl_rq->rb_leftmost = &dl_se->rb_node;
+
+	rb_link_node(&dl_se->rb_node, parent, link);
+	rb_insert_color(&dl_se->rb_node, &dl_rq->rb_root);
+}
+
+static void __dequeue_dl_entity(struct dl_rq *dl_rq,
+				struct sched_dl_entity *dl_se)
+{
+	if (!on_dl_tree(dl_se))
+		return;
+
+	if (dl_rq->rb_leftmost == &dl_se->rb_node)
+		dl_rq->rb_leftmost = rb_next(&dl_se->rb_node);
+
+	rb_erase(&dl_se->rb_node, &dl_rq->rb_root);
+	RB_CLEAR_NODE(&dl_se->rb_node);
+}
+
+static struct sched_dl_entity *__pick_first_dl_entity(struct dl_rq *dl_rq)
+{
+	if (!dl_rq->rb_leftmost)
+		return NULL;
+	return rb_entry(dl_rq->rb_leftmost, struct sched_dl_entity, rb_node);
+}
+
+/*
+ * Constant bandwidth server.
+ */
+
+/* First instance: a full runtime, due dl_deadline from now */
+static void setup_new_dl_entity(struct rq *rq, struct sched_dl_entity *dl_se)
+{
+	dl_se->deadline = rq->clock + dl_se->dl_deadline;
+	dl_se->runtime = dl_se->dl_runtime;
+	dl_se->dl_new = 0;
+}
+
+/*
+ * Give the task the runtime of as many periods as it takes to pay back
+ * its overrun, postponing the deadline by as much.  If that is still in
+ * the past, the task was late by more than its runtime allows for, so it
+ * starts over from now.
+ */
+static void replenish_dl_entity(struct rq *rq, struct sched_dl_entity *dl_se)
+{
+	if (dl_se->dl_new) {
+		setup_new_dl_entity(rq, dl_se);
+		return;
+	}
+
+	/* The runtime given up by sched_yield() is not owed back */
+	if (dl_se->dl_yielded && dl_se->runtime < 0)
+		dl_se->runtime = 0;
+	dl_se->dl_yielded = 0;
+
+	while (dl_se->runtime <= 0) {
+		dl_se->deadline += dl_se->dl_period;
+		dl_se->runtime += dl_se->dl_runtime;
+	}
+
+	if (dl_time_before(dl_se->deadline, rq->clock)) {
+		dl_se->deadline = rq->clock + dl_se->dl_deadline;
+		dl_se->runtime = dl_se->dl_runtime;
+	}
+}
+
+/*
+ * CBS wakeup rule: the remaining runtime can be used by the current
+ * deadline only if
+ *
+ *	runtime / (deadline - now) <= dl_runtime / dl_deadline
+ *
+ * otherwise the task would use more than its bandwidth, at the expense of
+ * the others.  Both sides are scaled down by 2^DL_SCALE so that the
+ * products fit in 64 bits.
+ */
+static bool dl_entity_overflow(struct sched_dl_entity *dl_se, u64 t)
+{
+	u64 left, right;
+
+	left = (dl_se->dl_deadline >> DL_SCALE) *
+	       (dl_se->runtime >> DL_SCALE);
+	right = ((dl_se->deadline - t) >> DL_SCALE) *
+		(dl_se->dl_runtime >> DL_SCALE);
+
+	return dl_time_before(right, left);
+}
+
+/* Called when the task wakes up, or enters the class */
+static void update_dl_entity(struct rq *rq, struct sched_dl_entity *dl_se)
+{
+	if (dl_se->dl_new) {
+		setup_new_dl_entity(rq, dl_se);
+		return;
+	}
+
+	if (dl_time_before(dl_se->deadline, rq->clock) ||
+	    dl_entity_overflow(dl_se, rq->clock)) {
+		dl_se->deadline = rq->clock + dl_se->dl_deadline;
+		dl_se->runtime = dl_se->dl_runtime;
+	}
+}
+
+/*
+ * Arm dl_timer for the start of the next period of @dl_se, returns 0 if
+ * that already passed.  Deadlines are in rq->clock time, the timer runs
+ * on CLOCK_MONOTONIC, so the difference between the two is added.
+ *
+ * A queued timer holds a reference on the task, see dl_task_timer().
+ */
+static int start_dl_timer(struct rq *rq, struct sched_dl_entity *dl_se)
+{
+	struct hrtimer *timer = &dl_se->dl_timer;
+	ktime_t now, act;
+	s64 delta;
+
+	act = ns_to_ktime(dl_se->deadline - dl_se->dl_deadline +
+			  dl_se->dl_period);
+	now = hrtimer_cb_get_time(timer);
+	delta = ktime_to_ns(now) - rq->clock;
+	act = ktime_add_ns(act, delta);
+
+	if (ktime_us_delta(act, now) < 0)
+		return 0;
+
+	if (!hrtimer_is_queued(timer))
+		get_task_struct(dl_task_of(dl_se));
+	__hrtimer_start_range_ns(timer, act, 0, HRTIMER_MODE_ABS, 0);
+
+	return 1;
+}
+
+static enum hrtimer_restart dl_task_timer(struct hrtimer *timer)
+{
+	struct sched_dl_entity *dl_se = container_of(timer,
+						     struct sched_dl_entity,
+						     dl_timer);
+	struct task_struct *p = dl_task_of(dl_se);
+	unsigned long flags;
+	struct rq *rq;
+
+	rq = task_rq_lock(p, &flags);
+
+	/*
+	 * The task may have left the class, or been replenished early by
+	 * migrate_dl_throttled() and throttled again, which requeued the
+	 * timer.
+	 */
+	if (p->sched_class != &dl_sched_class || !dl_se->dl_throttled ||
+	    hrtimer_is_queued(timer))
+		goto unlock;
+
+	update_rq_clock(rq);
+	dl_se->dl_throttled = 0;
+	replenish_dl_entity(rq, dl_se);
+
+	if (!list_empty(&dl_se->throttled_node)) {
+		list_del_init(&dl_se->throttled_node);
+		rq->dl.dl_nr_throttled--;
+		__enqueue_dl_entity(&rq->dl, dl_se);
+		if (rq->curr != p)
+			check_preempt_curr(rq, p, 0);
+	}
+unlock:
+	task_rq_unlock(rq, p, &flags);
+	put_task_struct(p);
+
+	return HRTIMER_NORESTART;
+}
+
+static void init_dl_task_timer(struct sched_dl_entity *dl_se)
+{
+	hrtimer_init(&dl_se->dl_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	dl_se->dl_timer.function = dl_task_timer;
+}
+
+/*
+ * Take @dl_se off the tree until its next period, or replenish it right
+ * away if that already started.
+ */
+static void throttle_dl_entity(struct rq *rq, struct sched_dl_entity *dl_se)
+{
+	int queued = on_dl_tree(dl_se);
+
+	__dequeue_dl_entity(&rq->dl, dl_se);
+
+	if (start_dl_timer(rq, dl_se)) {
+		dl_se->dl_throttled = 1;
+		if (queued) {
+			list_add_tail(&dl_se->throttled_node, &rq->dl.throttled);
+			rq->dl.dl_nr_throttled++;
+		}
+	} else {
+		replenish_dl_entity(rq, dl_se);
+		if (queued)
+			__enqueue_dl_entity(&rq->dl, dl_se);
+	}
+}
+
+/*
+ * Update the current task's runtime statistics, and throttle it when its
+ * runtime is used up.
+ */
+static void update_curr_dl(struct rq *rq)
+{
+	struct task_struct *curr = rq->curr;
+	struct sched_dl_entity *dl_se = &curr->dl;
+	u64 delta_exec;
+
+	if (curr->sched_class != &dl_sched_class)
+		return;
+
+	delta_exec = rq->clock_task - curr->se.exec_start;
+	if (unlikely((s64)delta_exec < 0))
+		delta_exec = 0;
+
+	schedstat_set(curr->se.statistics.exec_max, max(curr->se.statistics.exec_max, delta_exec));
+
+	curr->se.sum_exec_runtime += delta_exec;
+	account_group_exec_runtime(curr, delta_exec);
+
+	curr->se.exec_start = rq->clock_task;
+	cpuacct_charge(curr, delta_exec);
+
+	sched_rt_avg_update(rq, delta_exec);
+
+	dl_se->runtime -= delta_exec;
+	if (dl_se->runtime > 0 || dl_se->dl_throttled)
+		return;
+
+	throttle_dl_entity(rq, dl_se);
+	resched_task(curr);
+}
+
+static void
+enqueue_task_dl(struct rq *rq, struct task_struct *p, int flags)
+{
+	struct sched_dl_entity *dl_se = &p->dl;
+
+	if (dl_se->dl_new || (flags & ENQUEUE_WAKEUP))
+		update_dl_entity(rq, dl_se);
+
+	if (dl_se->dl_throttled) {
+		list_add_tail(&dl_se->throttled_node, &rq->dl.throttled);
+		rq->dl.dl_nr_throttled++;
+	} else
+		__enqueue_dl_entity(&rq->dl, dl_se);
+
+	rq->dl.dl_nr_running++;
+	inc_nr_running(rq);
+}
+
+static void dequeue_task_dl(struct rq *rq, struct task_struct *p, int flags)
+{
+	struct sched_dl_entity *dl_se = &p->dl;
+
+	update_curr_dl(rq);
+
+	if (!list_empty(&dl_se->throttled_node)) {
+		list_del_init(&dl_se->throttled_node);
+		rq->dl.dl_nr_throttled--;
+	} else
+		__dequeue_dl_entity(&rq->dl, dl_se);
+
+	rq->dl.dl_nr_running--;
+	dec_nr_running(rq);
+}
+
+/*
+ * sched_yield() gives up the rest of the runtime: the task sleeps until
+ * its next period, and is not charged for it.
+ */
+static void yield_task_dl(struct rq *rq)
+{
+	struct task_struct *p = rq->curr;
+
+	if (p->dl.runtime > 0) {
+		p->dl.dl_yielded = 1;
+		p->dl.runtime = 0;
+	}
+}
+
+/* Preempt the current task with a newly woken task if needed */
+static void check_preempt_curr_dl(struct rq *rq, struct task_struct *p,
+				  int flags)
+{
+	if (dl_time_before(p->dl.deadline, rq->curr->dl.deadline))
+		resched_task(rq->curr);
+}
+
+#ifdef CONFIG_SCHED_HRTICK
+static void start_hrtick_dl(struct rq *rq, struct task_struct *p)
+{
+	s64 delta = p->dl.runtime;
+
+	if (hrtick_enabled(rq) && delta > 10000)
+		hrtick_start(rq, delta);
+}
+#else
+static inline void start_hrtick_dl(struct rq *rq, struct task_struct *p)
+{
+}
+#endif
+
+static struct task_struct *pick_next_task_dl(struct rq *rq)
+{
+	struct sched_dl_entity *dl_se;
+	struct task_struct *p;
+
+	dl_se = __pick_first_dl_entity(&rq->dl);
+	if (!dl_se)
+		return NULL;
+
+	p = dl_task_of(dl_se);
+	p->se.exec_start = rq->clock_task;
+	start_hrtick_dl(rq, p);
+
+	return p;
+}
+
+static void put_prev_task_dl(struct rq *rq, struct task_struct *p)
+{
+	update_curr_dl(rq);
+}
+
+static void task_tick_dl(struct rq *rq, struct task_struct *p, int queued)
+{
+	update_curr_dl(rq);
+
+	if (!queued && rq->curr == p && !p->dl.dl_throttled)
+		start_hrtick_dl(rq, p);
+}
+
+static void set_curr_task_dl(struct rq *rq)
+{
+	struct task_struct *p = rq->curr;
+
+	p->se.exec_start = rq->clock_task;
+}
+
+/*
+ * The task is gone: release its bandwidth, and the reference a pending
+ * dl_timer holds on it.
+ */
+static void task_dead_dl(struct task_struct *p)
+{
+	if (hrtimer_cancel(&p->dl.dl_timer))
+		put_task_struct(p);
+
+	sched_dl_release(p);
+}
+
+#ifdef CONFIG_SMP
+/*
+ * Without push and pull of deadline tasks between runqueues, the only
+ * placement is done here: a woken task that would not preempt the
+ * deadline task running on its cpu goes where no deadline task runs, or
+ * else where the running one has the latest deadline, if that is later
+ * than its own.
+ */
+static int find_later_rq(struct task_struct *p, int cpu)
+{
+	u64 latest = p->dl.deadline;
+	int best = cpu, i;
+
+	for_each_cpu_and(i, cpu_active_mask, tsk_cpus_allowed(p)) {
+		struct rq *rq = cpu_rq(i);
+		struct task_struct *curr = ACCESS_ONCE(rq->curr);
+
+		if (!rq->dl.dl_nr_running)
+			return i;
+
+		if (curr->sched_class == &dl_sched_class &&
+		    dl_time_before(latest, curr->dl.deadline)) {
+			latest = curr->dl.deadline;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+static int
+select_task_rq_dl(struct task_struct *p, int sd_flag, int flags)
+{
+	struct task_struct *curr;
+	int cpu = task_cpu(p);
+
+	if (sd_flag != SD_BALANCE_WAKE || p->rt.nr_cpus_allowed < 2)
+		return cpu;
+
+	rcu_read_lock();
+	curr = ACCESS_ONCE(cpu_rq(cpu)->curr); /* unlocked access */
+	if (curr && curr->sched_class == &dl_sched_class &&
+	    !dl_time_before(p->dl.deadline, curr->dl.deadline))
+		cpu = find_later_rq(p, cpu);
+	rcu_read_unlock();
+
+	return cpu;
+}
+
+#ifdef CONFIG_HOTPLUG_CPU
+/*
+ * The cpu is going down, and throttled tasks are not on the tree where
+ * migrate_tasks() looks for them: give them their next runtime now.  Their
+ * timer finds them no longer throttled.
+ */
+static void migrate_dl_throttled(struct rq *rq)
+{
+	struct sched_dl_entity *dl_se, *tmp;
+
+	update_rq_clock(rq);
+	list_for_each_entry_safe(dl_se, tmp, &rq->dl.throttled,
+				 throttled_node) {
+		list_del_init(&dl_se->throttled_node);
+		rq->dl.dl_nr_throttled--;
+		dl_se->dl_throttled = 0;
+		replenish_dl_entity(rq, dl_se);
+		__enqueue_dl_entity(&rq->dl, dl_se);
+	}
+}
+#endif
+#endif
+
+static void switched_from_dl(struct rq *rq, struct task_struct *p)
+{
+	if (hrtimer_try_to_cancel(&p->dl.dl_timer) == 1)
+		put_task_struct(p);
+	p->dl.dl_throttled = 0;
+}
+
+static void switched_to_dl(struct rq *rq, struct task_struct *p)
+{
+	if (p->on_rq && rq->curr != p)
+		check_preempt_curr(rq, p, 0);
+}
+
+/*
+ * The deadline parameters changed while the task stayed in the class: it
+ * was requeued with a new instance.
+ */
+static void
+prio_changed_dl(struct rq *rq, struct task_struct *p, int oldprio)
+{
+	struct sched_dl_entity *first;
+
+	if (!p->on_rq)
+		return;
+
+	if (rq->curr == p) {
+		first = __pick_first_dl_entity(&rq->dl);
+		if (first && dl_time_before(first->deadline, p->dl.deadline))
+			resched_task(p);
+	} else
+		check_preempt_curr(rq, p, 0);
+}
+
+static unsigned int get_rr_interval_dl(struct rq *rq, struct task_struct *task)
+{
+	return 0;
+}
+
+static const struct sched_class dl_sched_class = {
+	.next			= &rt_sched_class,
+	.enqueue_task		= enqueue_task_dl,
+	.dequeue_task		= dequeue_task_dl,
+	.yield_task		= yield_task_dl,
+
+	.check_preempt_curr	= check_preempt_curr_dl,
+
+	.pick_next_task		= pick_next_task_dl,
+	.put_prev_task		= put_prev_task_dl,
+
+#ifdef CONFIG_SMP
+	.select_task_rq		= select_task_rq_dl,
+#endif
+
+	.set_curr_task		= set_curr_task_dl,
+	.task_tick		= task_tick_dl,
+	.task_dead		= task_dead_dl,
+
+	.get_rr_interval	= get_rr_interval_dl,
+
+	.prio_changed		= prio_changed_dl,
+	.switched_from		= switched_from_dl,
+	.switched_to		= switched_to_dl,
+};
+
+#ifdef CONFIG_SCHED_DEBUG
+extern void print_dl_rq(struct seq_file *m, int cpu, struct dl_rq *dl_rq);
+
+static void print_dl_stats(struct seq_file *m, int cpu)
+{
+	print_dl_rq(m, cpu, &cpu_rq(cpu)->dl);
+}
+#endif /* CONFIG_SCHED_DEBUG */
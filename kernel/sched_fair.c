@@ -89,6 +89,37 @@ const_debug unsigned int sysctl_sched_migration_cost = 500000UL;
  */
 unsigned int __read_mostly sysctl_sched_shares_window = 10000000UL;
 
+#ifdef CONFIG_SMP
+/*
+ * How much more loaded than prev_cpu, in percent, the waking cpu may be
+ * for an affine wakeup to still pull the task over to it.  -1 (default)
+ * uses half the imbalance_pct of the domain, 12% for most.
+ */
+int sysctl_sched_wake_affine_pct = -1;
+
+/*
+ * Honour sync wakeups, where the waker says it is about to sleep, by
+ * discounting it from the load of its cpu and pulling the wakee to it
+ * whenever the loads are balanced.
+ * (default: on)
+ */
+unsigned int sysctl_sched_wake_affine_sync = 1;
+#endif
+
+#ifdef CONFIG_CFS_BANDWIDTH
+/*
+ * Amount of runtime to allocate from global (tg) to local (per-cfs_rq) pool
+ * each time a cfs_rq requests quota.
+ *
+ * Note: in the case that the slice exceeds the runtime remaining (either due
+ * to consumption or the quota being specified to be smaller than the slice)
+ * we will always only issue the remaining available time.
+ *
+ * default: 5 msec, units: microseconds
+ */
+unsigned int sysctl_sched_cfs_bandwidth_slice = 5000UL;
+#endif
+
 static const struct sched_class fair_sched_class;
 
 /**************************************************************
@@ -548,6 +579,9 @@ static u64 sched_vslice(struct cfs_rq *cfs_rq, struct sched_entity *se)
 
 static void update_cfs_load(struct cfs_rq *cfs_rq, int global_update);
 static void update_cfs_shares(struct cfs_rq *cfs_rq);
+static __always_inline void account_cfs_rq_runtime(struct cfs_rq *cfs_rq,
+						   unsigned long delta_exec);
+static inline int throttled_hierarchy(struct cfs_rq *cfs_rq);
 
 /*
  * Update the current task's runtime statistics. Skip current tasks that
@@ -602,6 +636,8 @@ static void update_curr(struct cfs_rq *cfs_rq)
 		cpuacct_charge(curtask, delta_exec);
 		account_group_exec_runtime(curtask, delta_exec);
 	}
+
+	account_cfs_rq_runtime(cfs_rq, delta_exec);
 }
 
 static inline void
@@ -732,6 +768,10 @@ static void update_cfs_load(struct cfs_rq *cfs_rq, int global_update)
 	if (cfs_rq->tg == &root_task_group)
 		return;
 
+	/* throttled entities do not contribute to load */
+	if (throttled_hierarchy(cfs_rq))
+		return;
+
 	now = rq_of(cfs_rq)->clock_task;
 	delta = now - cfs_rq->load_stamp;
 
@@ -838,7 +878,7 @@ static void update_cfs_shares(struct cfs_rq *cfs_rq)
 
 	tg = cfs_rq->tg;
 	se = tg->se[cpu_of(rq_of(cfs_rq))];
-	if (!se)
+	if (!se || throttled_hierarchy(cfs_rq))
 		return;
 #ifndef CONFIG_SMP
 	if (likely(se->load.weight == tg->shares))
@@ -969,6 +1009,8 @@ place_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int initial)
 	se->vruntime = vruntime;
 }
 
+static void check_enqueue_throttle(struct cfs_rq *cfs_rq);
+
 static void
 enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 {
@@ -998,8 +1040,10 @@ enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 		__enqueue_entity(cfs_rq, se);
 	se->on_rq = 1;
 
-	if (cfs_rq->nr_running == 1)
+	if (cfs_rq->nr_running == 1) {
 		list_add_leaf_cfs_rq(cfs_rq);
+		check_enqueue_throttle(cfs_rq);
+	}
 }
 
 static void __clear_buddies_last(struct sched_entity *se)
@@ -1047,6 +1091,8 @@ static void clear_buddies(struct cfs_rq *cfs_rq, struct sched_entity *se)
 		__clear_buddies_skip(se);
 }
 
+static __always_inline void return_cfs_rq_runtime(struct cfs_rq *cfs_rq);
+
 static void
 dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 {
@@ -1085,6 +1131,9 @@ dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 	if (!(flags & DEQUEUE_SLEEP))
 		se->vruntime -= cfs_rq->min_vruntime;
 
+	/* return excess runtime on last dequeue */
+	return_cfs_rq_runtime(cfs_rq);
+
 	update_min_vruntime(cfs_rq);
 	update_cfs_shares(cfs_rq);
 }
@@ -1159,102 +1208,1027 @@ set_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 			se->sum_exec_runtime - se->prev_sum_exec_runtime);
 	}
 #endif
-	se->prev_sum_exec_runtime = se->sum_exec_runtime;
+	se->prev_sum_exec_runtime = se->sum_exec_runtime;
+}
+
+static int
+wakeup_preempt_entity(struct sched_entity *curr, struct sched_entity *se);
+
+/*
+ * Pick the next process, keeping these things in mind, in this order:
+ * 1) keep things fair between processes/task groups
+ * 2) pick the "next" process, since someone really wants that to run
+ * 3) pick the "last" process, for cache locality
+ * 4) do not run the "skip" process, if something else is available
+ */
+static struct sched_entity *pick_next_entity(struct cfs_rq *cfs_rq)
+{
+	struct sched_entity *se = __pick_first_entity(cfs_rq);
+	struct sched_entity *left = se;
+
+	/*
+	 * Avoid running the skip buddy, if running something else can
+	 * be done without getting too unfair.
+	 */
+	if (cfs_rq->skip == se) {
+		struct sched_entity *second = __pick_next_entity(se);
+		if (second && wakeup_preempt_entity(second, left) < 1)
+			se = second;
+	}
+
+	/*
+	 * Prefer last buddy, try to return the CPU to a preempted task.
+	 */
+	if (cfs_rq->last && wakeup_preempt_entity(cfs_rq->last, left) < 1)
+		se = cfs_rq->last;
+
+	/*
+	 * Someone really wants this to run. If it's not unfair, run it.
+	 */
+	if (cfs_rq->next && wakeup_preempt_entity(cfs_rq->next, left) < 1)
+		se = cfs_rq->next;
+
+	clear_buddies(cfs_rq, se);
+
+	return se;
+}
+
+static void check_cfs_rq_runtime(struct cfs_rq *cfs_rq);
+
+static void put_prev_entity(struct cfs_rq *cfs_rq, struct sched_entity *prev)
+{
+	/*
+	 * If still on the runqueue then deactivate_task()
+	 * was not called and update_curr() has to be done:
+	 */
+	if (prev->on_rq)
+		update_curr(cfs_rq);
+
+	/* throttle cfs_rqs exceeding runtime */
+	check_cfs_rq_runtime(cfs_rq);
+
+	check_spread(cfs_rq, prev);
+	if (prev->on_rq) {
+		update_stats_wait_start(cfs_rq, prev);
+		/* Put 'current' back into the tree. */
+		__enqueue_entity(cfs_rq, prev);
+	}
+	cfs_rq->curr = NULL;
+}
+
+static void
+entity_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr, int queued)
+{
+	/*
+	 * Update run-time statistics of the 'current'.
+	 */
+	update_curr(cfs_rq);
+
+	/*
+	 * Update share accounting for long-running entities.
+	 */
+	update_entity_shares_tick(cfs_rq);
+
+#ifdef CONFIG_SCHED_HRTICK
+	/*
+	 * queued ticks are scheduled to match the slice, so don't bother
+	 * validating it and just reschedule.
+	 */
+	if (queued) {
+		resched_task(rq_of(cfs_rq)->curr);
+		return;
+	}
+	/*
+	 * don't let the period tick interfere with the hrtick preemption
+	 */
+	if (!sched_feat(DOUBLE_TICK) &&
+			hrtimer_active(&rq_of(cfs_rq)->hrtick_timer))
+		return;
+#endif
+
+	if (cfs_rq->nr_running > 1 || !sched_feat(WAKEUP_PREEMPT))
+		check_preempt_tick(cfs_rq, curr);
+}
+
+/**************************************************
+ * CFS bandwidth control machinery
+ */
+
+#ifdef CONFIG_CFS_BANDWIDTH
+/*
+ * default period for cfs group bandwidth.
+ * default: 0.1s, units: nanoseconds
+ */
+static inline u64 default_cfs_period(void)
+{
+	return 100000000ULL;
+}
+
+static inline u64 sched_cfs_bandwidth_slice(void)
+{
+	return (u64)sysctl_sched_cfs_bandwidth_slice * NSEC_PER_USEC;
+}
+
+/*
+ * Replenish runtime according to assigned quota and update expiration time.
+ * We use sched_clock_cpu directly instead of rq->clock to avoid adding
+ * additional synchronization around rq->lock.
+ *
+ * requires cfs_b->lock
+ */
+static void __refill_cfs_bandwidth_runtime(struct cfs_bandwidth *cfs_b)
+{
+	u64 now;
+
+	if (cfs_b->quota == RUNTIME_INF)
+		return;
+
+	now = sched_clock_cpu(smp_processor_id());
+	cfs_b->runtime = cfs_b->quota;
+	cfs_b->runtime_expires = now + ktime_to_ns(cfs_b->period);
+}
+
+/* returns 0 on failure to allocate runtime */
+static int assign_cfs_rq_runtime(struct cfs_rq *cfs_rq)
+{
+	struct task_group *tg = cfs_rq->tg;
+	struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(tg);
+	u64 amount = 0, min_amount, expires;
+
+	/* note: this is a positive sum as runtime_remaining <= 0 */
+	min_amount = sched_cfs_bandwidth_slice() - cfs_rq->runtime_remaining;
+
+	raw_spin_lock(&cfs_b->lock);
+	if (cfs_b->quota == RUNTIME_INF)
+		amount = min_amount;
+	else {
+		/*
+		 * If the bandwidth pool has become inactive, then at least one
+		 * period must have elapsed since the last consumption.
+		 * Refresh the global state and ensure bandwidth timer becomes
+		 * active.
+		 */
+		if (!cfs_b->timer_active) {
+			__refill_cfs_bandwidth_runtime(cfs_b);
+			__start_cfs_bandwidth(cfs_b);
+		}
+
+		if (cfs_b->runtime > 0) {
+			amount = min(cfs_b->runtime, min_amount);
+			cfs_b->runtime -= amount;
+			cfs_b->idle = 0;
+		}
+	}
+	expires = cfs_b->runtime_expires;
+	raw_spin_unlock(&cfs_b->lock);
+
+	cfs_rq->runtime_remaining += amount;
+	/*
+	 * we may have advanced our local expiration to account for allowed
+	 * spread between our sched_clock and the one on which runtime was
+	 * issued.
+	 */
+	if ((s64)(expires - cfs_rq->runtime_expires) > 0)
+		cfs_rq->runtime_expires = expires;
+
+	return cfs_rq->runtime_remaining > 0;
+}
+
+/*
+ * Note: This depends on the synchronization provided by sched_clock and the
+ * fact that rq->clock snapshots this value.
+ */
+static void expire_cfs_rq_runtime(struct cfs_rq *cfs_rq)
+{
+	struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(cfs_rq->tg);
+	struct rq *rq = rq_of(cfs_rq);
+
+	/* if the deadline is ahead of our clock, nothing to do */
+	if (likely((s64)(rq->clock - cfs_rq->runtime_expires) < 0))
+		return;
+
+	if (cfs_rq->runtime_remaining < 0)
+		return;
+
+	/*
+	 * If the local deadline has passed we have to consider the
+	 * possibility that our sched_clock is 'fast' and the global deadline
+	 * has not truly expired.
+	 *
+	 * Fortunately we can check determine whether this the case by checking
+	 * whether the global deadline has advanced.
+	 */
+
+	if ((s64)(cfs_rq->runtime_expires - cfs_b->runtime_expires) >= 0) {
+		/* extend local deadline, drift is bounded above by 2 ticks */
+		cfs_rq->runtime_expires += TICK_NSEC;
+	} else {
+		/* global deadline is ahead, expiration has passed */
+		cfs_rq->runtime_remaining = 0;
+	}
+}
+
+static void __account_cfs_rq_runtime(struct cfs_rq *cfs_rq,
+				     unsigned long delta_exec)
+{
+	/* dock delta_exec before expiring quota (as it could span periods) */
+	cfs_rq->runtime_remaining -= delta_exec;
+	expire_cfs_rq_runtime(cfs_rq);
+
+	if (likely(cfs_rq->runtime_remaining > 0))
+		return;
+
+	/*
+	 * if we're unable to extend our runtime we resched so that the active
+	 * hierarchy can be throttled
+	 */
+	if (!assign_cfs_rq_runtime(cfs_rq) && likely(cfs_rq->curr))
+		resched_task(rq_of(cfs_rq)->curr);
+}
+
+static __always_inline void account_cfs_rq_runtime(struct cfs_rq *cfs_rq,
+						   unsigned long delta_exec)
+{
+	if (!cfs_rq->runtime_enabled)
+		return;
+
+	__account_cfs_rq_runtime(cfs_rq, delta_exec);
+}
+
+static inline int cfs_rq_throttled(struct cfs_rq *cfs_rq)
+{
+	return cfs_rq->throttled;
+}
+
+/* check whether cfs_rq, or any parent, is throttled */
+static inline int throttled_hierarchy(struct cfs_rq *cfs_rq)
+{
+	return cfs_rq->throttle_count;
+}
+
+/*
+ * Ensure that neither of the group entities corresponding to src_cpu or
+ * dest_cpu are members of a throttled hierarchy when performing group
+ * load-balance operations.
+ */
+static inline int throttled_lb_pair(struct task_group *tg,
+				    int src_cpu, int dest_cpu)
+{
+	struct cfs_rq *src_cfs_rq, *dest_cfs_rq;
+
+	src_cfs_rq = tg->cfs_rq[src_cpu];
+	dest_cfs_rq = tg->cfs_rq[dest_cpu];
+
+	return throttled_hierarchy(src_cfs_rq) ||
+	       throttled_hierarchy(dest_cfs_rq);
+}
+
+/* updated child weight may affect parent so we have to do this bottom up */
+static int tg_unthrottle_up(struct task_group *tg, void *data)
+{
+	struct rq *rq = data;
+	struct cfs_rq *cfs_rq = tg->cfs_rq[cpu_of(rq)];
+
+	cfs_rq->throttle_count--;
+#ifdef CONFIG_SMP
+	if (!cfs_rq->throttle_count) {
+		u64 delta = rq->clock_task - cfs_rq->load_stamp;
+
+		/* leaving throttled state, advance shares averaging windows */
+		cfs_rq->load_stamp += delta;
+		cfs_rq->load_last += delta;
+
+		/* update entity weight now that we are on_rq again */
+		update_cfs_shares(cfs_rq);
+	}
+#endif
+
+	return 0;
+}
+
+static int tg_throttle_down(struct task_group *tg, void *data)
+{
+	struct rq *rq = data;
+	struct cfs_rq *cfs_rq = tg->cfs_rq[cpu_of(rq)];
+
+	/* group is entering throttled state, record last load */
+	if (!cfs_rq->throttle_count)
+		update_cfs_load(cfs_rq, 0);
+	cfs_rq->throttle_count++;
+
+	return 0;
+}
+
+static void throttle_cfs_rq(struct cfs_rq *cfs_rq)
+{
+	struct rq *rq = rq_of(cfs_rq);
+	struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(cfs_rq->tg);
+	struct sched_entity *se;
+	long task_delta, dequeue = 1;
+
+	se = cfs_rq->tg->se[cpu_of(rq_of(cfs_rq))];
+
+	/* account load preceding throttle */
+	rcu_read_lock();
+	walk_tg_tree_from(cfs_rq->tg, tg_throttle_down, tg_nop, (void *)rq);
+	rcu_read_unlock();
+
+	task_delta = cfs_rq->h_nr_running;
+	for_each_sched_entity(se) {
+		struct cfs_rq *qcfs_rq = cfs_rq_of(se);
+		/* throttled entity or throttle-on-deactivate */
+		if (!se->on_rq)
+			break;
+
+		if (dequeue)
+			dequeue_entity(qcfs_rq, se, DEQUEUE_SLEEP);
+		qcfs_rq->h_nr_running -= task_delta;
+
+		if (qcfs_rq->load.weight)
+			dequeue = 0;
+	}
+
+	if (!se)
+		rq->nr_running -= task_delta;
+
+	cfs_rq->throttled = 1;
+	cfs_rq->throttled_timestamp = rq->clock;
+	raw_spin_lock(&cfs_b->lock);
+	list_add_tail_rcu(&cfs_rq->throttled_list, &cfs_b->throttled_cfs_rq);
+	raw_spin_unlock(&cfs_b->lock);
+}
+
+static void unthrottle_cfs_rq(struct cfs_rq *cfs_rq)
+{
+	struct rq *rq = rq_of(cfs_rq);
+	struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(cfs_rq->tg);
+	struct sched_entity *se;
+	int enqueue = 1;
+	long task_delta;
+
+	se = cfs_rq->tg->se[cpu_of(rq_of(cfs_rq))];
+
+	cfs_rq->throttled = 0;
+	raw_spin_lock(&cfs_b->lock);
+	cfs_b->throttled_time += rq->clock - cfs_rq->throttled_timestamp;
+	list_del_rcu(&cfs_rq->throttled_list);
+	raw_spin_unlock(&cfs_b->lock);
+	cfs_rq->throttled_timestamp = 0;
+
+	update_rq_clock(rq);
+	/* update hierarchical throttle state */
+	walk_tg_tree_from(cfs_rq->tg, tg_nop, tg_unthrottle_up, (void *)rq);
+
+	if (!cfs_rq->load.weight)
+		return;
+
+	task_delta = cfs_rq->h_nr_running;
+	for_each_sched_entity(se) {
+		if (se->on_rq)
+			enqueue = 0;
+
+		cfs_rq = cfs_rq_of(se);
+		if (enqueue)
+			enqueue_entity(cfs_rq, se, ENQUEUE_WAKEUP);
+		cfs_rq->h_nr_running += task_delta;
+
+		if (cfs_rq_throttled(cfs_rq))
+			break;
+	}
+
+	if (!se)
+		rq->nr_running += task_delta;
+
+	/* determine whether we need to wake up potentially idle cpu */
+	if (rq->curr == rq->idle && rq->cfs.nr_running)
+		resched_task(rq->curr);
+}
+
+static u64 distribute_cfs_runtime(struct cfs_bandwidth *cfs_b,
+		u64 remaining, u64 expires)
+{
+	struct cfs_rq *cfs_rq;
+	u64 runtime = remaining;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(cfs_rq, &cfs_b->throttled_cfs_rq,
+				throttled_list) {
+		struct rq *rq = rq_of(cfs_rq);
+
+		raw_spin_lock(&rq->lock);
+		if (!cfs_rq_throttled(cfs_rq))
+			goto next;
+
+		runtime = -cfs_rq->runtime_remaining + 1;
+		if (runtime > remaining)
+			runtime = remaining;
+		remaining -= runtime;
+
+		cfs_rq->runtime_remaining += runtime;
+		cfs_rq->runtime_expires = expires;
+
+		/* we check whether we're throttled above */
+		if (cfs_rq->runtime_remaining > 0)
+			unthrottle_cfs_rq(cfs_rq);
+
+next:
+		raw_spin_unlock(&rq->lock);
+
+		if (!remaining)
+			break;
+	}
+	rcu_read_unlock();
+
+	return remaining;
+}
+
+/*
+ * Responsible for refilling a task_group's bandwidth and unthrottling its
+ * cfs_rqs as appropriate. If there has been no activity within the last
+ * period the timer is deactivated until scheduling resumes; cfs_b->idle is
+ * used to track this state.
+ */
+static int do_sched_cfs_period_timer(struct cfs_bandwidth *cfs_b, int overrun)
+{
+	u64 runtime, runtime_expires;
+	int idle = 1, throttled;
+
+	raw_spin_lock(&cfs_b->lock);
+	/* no need to continue the timer with no bandwidth constraint */
+	if (cfs_b->quota == RUNTIME_INF)
+		goto out_unlock;
+
+	throttled = !list_empty(&cfs_b->throttled_cfs_rq);
+	/* idle depends on !throttled (for the case of a large deficit) */
+	idle = cfs_b->idle && !throttled;
+	cfs_b->nr_periods += overrun;
+
+	/* if we're going inactive then everything else can be deferred */
+	if (idle)
+		goto out_unlock;
+
+	__refill_cfs_bandwidth_runtime(cfs_b);
+
+	if (!throttled) {
+		/* mark as potentially idle for the upcoming period */
+		cfs_b->idle = 1;
+		goto out_unlock;
+	}
+
+	/* account preceding periods in which throttling occurred */
+	cfs_b->nr_throttled += overrun;
+
+	/*
+	 * There are throttled entities so we must first use the new bandwidth
+	 * to unthrottle them before making it generally available.  This
+	 * ensures that all existing debts will be paid before a new cfs_rq is
+	 * allowed to run.
+	 */
+	runtime = cfs_b->runtime;
+	runtime_expires = cfs_b->runtime_expires;
+	cfs_b->runtime = 0;
+
+	/*
+	 * This check is repeated as we are holding onto the new bandwidth
+	 * while we unthrottle.  This can potentially race with an unthrottled
+	 * group trying to acquire new bandwidth from the global pool.
+	 */
+	while (throttled && runtime > 0) {
+		raw_spin_unlock(&cfs_b->lock);
+		/* we can't nest cfs_b->lock while distributing bandwidth */
+		runtime = distribute_cfs_runtime(cfs_b, runtime,
+						 runtime_expires);
+		raw_spin_lock(&cfs_b->lock);
+
+		throttled = !list_empty(&cfs_b->throttled_cfs_rq);
+	}
+
+	/* return (any) remaining runtime */
+	cfs_b->runtime = runtime;
+	/*
+	 * While we are ensured activity in the period following an
+	 * unthrottle, this also covers the case in which the new bandwidth is
+	 * insufficient to cover the existing bandwidth deficit.  (Forcing the
+	 * timer to remain active while there are any throttled entities.)
+	 */
+	cfs_b->idle = 0;
+out_unlock:
+	if (idle)
+		cfs_b->timer_active = 0;
+	raw_spin_unlock(&cfs_b->lock);
+
+	return idle;
+}
+
+/* a cfs_rq won't donate quota below this amount */
+static const u64 min_cfs_rq_runtime = 1 * NSEC_PER_MSEC;
+/* minimum remaining period time to redistribute slack quota */
+static const u64 min_bandwidth_expiration = 2 * NSEC_PER_MSEC;
+/* how long we wait to gather additional slack before distributing */
+static const u64 cfs_bandwidth_slack_period = 5 * NSEC_PER_MSEC;
+
+/* are we near the end of the current quota period? */
+static int runtime_refresh_within(struct cfs_bandwidth *cfs_b, u64 min_expire)
+{
+	struct hrtimer *refresh_timer = &cfs_b->period_timer;
+	u64 remaining;
+
+	/* if the call-back is running a quota refresh is already occurring */
+	if (hrtimer_callback_running(refresh_timer))
+		return 1;
+
+	/* is a quota refresh about to occur? */
+	remaining = ktime_to_ns(hrtimer_expires_remaining(refresh_timer));
+	if (remaining < min_expire)
+		return 1;
+
+	return 0;
+}
+
+static void start_cfs_slack_bandwidth(struct cfs_bandwidth *cfs_b)
+{
+	u64 min_left = cfs_bandwidth_slack_period + min_bandwidth_expiration;
+
+	/* if there's a quota refresh soon don't bother with slack */
+	if (runtime_refresh_within(cfs_b, min_left))
+		return;
+
+	start_bandwidth_timer(&cfs_b->slack_timer,
+				ns_to_ktime(cfs_bandwidth_slack_period));
+}
+
+/* we know any runtime found here is valid as update_curr() precedes return */
+static void __return_cfs_rq_runtime(struct cfs_rq *cfs_rq)
+{
+	struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(cfs_rq->tg);
+	s64 slack_runtime = cfs_rq->runtime_remaining - min_cfs_rq_runtime;
+
+	if (slack_runtime <= 0)
+		return;
+
+	raw_spin_lock(&cfs_b->lock);
+	if (cfs_b->quota != RUNTIME_INF &&
+	    cfs_rq->runtime_expires == cfs_b->runtime_expires) {
+		cfs_b->runtime += slack_runtime;
+
+		/* we are under rq->lock, defer unthrottling using a timer */
+		if (cfs_b->runtime > sched_cfs_bandwidth_slice() &&
+		    !list_empty(&cfs_b->throttled_cfs_rq))
+			start_cfs_slack_bandwidth(cfs_b);
+	}
+	raw_spin_unlock(&cfs_b->lock);
+
+	/* even if it's not valid for return we don't want to try again */
+	cfs_rq->runtime_remaining -= slack_runtime;
+}
+
+static __always_inline void return_cfs_rq_runtime(struct cfs_rq *cfs_rq)
+{
+	if (!cfs_rq->runtime_enabled || cfs_rq->nr_running)
+		return;
+
+	__return_cfs_rq_runtime(cfs_rq);
+}
+
+/*
+ * This is done with a timer (instead of inline with bandwidth return) since
+ * it's necessary to juggle rq->locks to unthrottle their respective cfs_rqs.
+ */
+static void do_sched_cfs_slack_timer(struct cfs_bandwidth *cfs_b)
+{
+	u64 runtime = 0, slice = sched_cfs_bandwidth_slice();
+	u64 expires;
+
+	/* confirm we're still not at a refresh boundary */
+	if (runtime_refresh_within(cfs_b, min_bandwidth_expiration))
+		return;
+
+	raw_spin_lock(&cfs_b->lock);
+	if (cfs_b->quota != RUNTIME_INF && cfs_b->runtime > slice) {
+		runtime = cfs_b->runtime;
+		cfs_b->runtime = 0;
+	}
+	expires = cfs_b->runtime_expires;
+	raw_spin_unlock(&cfs_b->lock);
+
+	if (!runtime)
+		return;
+
+	runtime = distribute_cfs_runtime(cfs_b, runtime, expires);
+
+	raw_spin_lock(&cfs_b->lock);
+	if (expires == cfs_b->runtime_expires)
+		cfs_b->runtime = runtime;
+	raw_spin_unlock(&cfs_b->lock);
+}
+
+/*
+ * When a group wakes up we want to make sure that its quota is not already
+ * expired/exceeded, otherwise it may be allowed to steal additional ticks of
+ * runtime as update_curr() throttling can not not trigger until it's on-rq.
+ */
+static void check_enqueue_throttle(struct cfs_rq *cfs_rq)
+{
+	/* an active group must be handled by the update_curr()->put() path */
+	if (!cfs_rq->runtime_enabled || cfs_rq->curr)
+		return;
+
+	/* ensure the group is not already throttled */
+	if (cfs_rq_throttled(cfs_rq))
+		return;
+
+	/* update runtime allocation */
+	account_cfs_rq_runtime(cfs_rq, 0);
+	if (cfs_rq->runtime_remaining <= 0)
+		throttle_cfs_rq(cfs_rq);
+}
+
+/* conditionally throttle active cfs_rq's from put_prev_entity() */
+static void check_cfs_rq_runtime(struct cfs_rq *cfs_rq)
+{
+	if (likely(!cfs_rq->runtime_enabled || cfs_rq->runtime_remaining > 0))
+		return;
+
+	/*
+	 * it's possible for a throttled entity to be forced into a running
+	 * state (e.g. set_curr_task), in this case we're finished.
+	 */
+	if (cfs_rq_throttled(cfs_rq))
+		return;
+
+	throttle_cfs_rq(cfs_rq);
+}
+
+/*
+ * A cpu going down takes no more time from its groups, so it must not keep
+ * any of them throttled: its tasks could never be migrated away.
+ */
+static void unthrottle_offline_cfs_rqs(struct rq *rq)
+{
+	struct cfs_rq *cfs_rq;
+
+	for_each_leaf_cfs_rq(rq, cfs_rq) {
+		struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(cfs_rq->tg);
+
+		if (!cfs_rq->runtime_enabled)
+			continue;
+
+		/*
+		 * clock_task is not advancing so we just need to make sure
+		 * there's some valid quota amount
+		 */
+		cfs_rq->runtime_remaining = cfs_b->quota;
+		if (cfs_rq_throttled(cfs_rq))
+			unthrottle_cfs_rq(cfs_rq);
+	}
+}
+#else /* CONFIG_CFS_BANDWIDTH */
+static __always_inline
+void account_cfs_rq_runtime(struct cfs_rq *cfs_rq, unsigned long delta_exec) {}
+static void check_cfs_rq_runtime(struct cfs_rq *cfs_rq) {}
+static void check_enqueue_throttle(struct cfs_rq *cfs_rq) {}
+static __always_inline void return_cfs_rq_runtime(struct cfs_rq *cfs_rq) {}
+
+static inline int cfs_rq_throttled(struct cfs_rq *cfs_rq)
+{
+	return 0;
+}
+
+static inline int throttled_hierarchy(struct cfs_rq *cfs_rq)
+{
+	return 0;
+}
+
+static inline int throttled_lb_pair(struct task_group *tg,
+				    int src_cpu, int dest_cpu)
+{
+	return 0;
+}
+
+static inline void unthrottle_offline_cfs_rqs(struct rq *rq) {}
+#endif /* CONFIG_CFS_BANDWIDTH */
+
+/**************************************************
+ * Per-entity load tracking:
+ *
+ * Time is split into 1024us periods, and the contribution of a period
+ * decays by y per period, with y^32 = 1/2.  A task accumulates its
+ * runnable weight and its running time this way; the root cfs_rq of each
+ * cpu accumulates the same for all of its fair tasks, so its util_avg is
+ * the cpu utilization that cpufreq governors select frequencies from.
+ *
+ * Running time is scaled by the current frequency, so that util_avg
+ * reads the same for a given amount of work whatever speed it ran at.
+ */
+
+#define LOAD_AVG_PERIOD	32
+#define LOAD_AVG_MAX	47742	/* maximum possible load sum */
+#define LOAD_AVG_MAX_N	345	/* number of full periods to reach it */
+
+/* Precomputed fixed inverse multiplies for multiplication by y^n */
+static const u32 runnable_avg_yN_inv[] = {
+	0xffffffff, 0xfa83b2db, 0xf5257d15, 0xefe4b99b, 0xeac0c6e7, 0xe5b906e7,
+	0xe0ccdeec, 0xdbfbb797, 0xd744fcca, 0xd2a81d91, 0xce248c15, 0xc9b9bd86,
+	0xc5672a11, 0xc12c4cca, 0xbd08a39f, 0xb8fbaf47, 0xb504f333, 0xb123f581,
+	0xad583eea, 0xa9a15ab4, 0xa5fed6a9, 0xa2704303, 0x9ef53260, 0x9b8d39b9,
+	0x9837f051, 0x94f4efa8, 0x91c3d373, 0x8ea4398b, 0x8b95c1e3, 0x88980e80,
+	0x85aac367, 0x82cd8698,
+};
+
+/*
+ * Precomputed \Sum y^k { 1<=k<=n }, scaled by 1024.  These are the sums
+ * of n full periods.
+ */
+static const u32 runnable_avg_yN_sum[] = {
+	    0,  1002,  1982,  2941,  3879,  4797,  5696,  6575,  7436,  8278,
+	 9102,  9908, 10697, 11469, 12225, 12965, 13689, 14397, 15090, 15768,
+	16432, 17081, 17716, 18338, 18947, 19543, 20126, 20696, 21254, 21800,
+	22334, 22857, 23369,
+};
+
+static DEFINE_PER_CPU(unsigned long, cpu_freq_scale) = SCHED_POWER_SCALE;
+
+/**
+ * sched_set_freq_scale - report the current speed of a cpu
+ * @cpu: the cpu whose frequency changed
+ * @scale: current frequency relative to the highest, in SCHED_POWER_SCALE
+ *
+ * Called by cpufreq governors on frequency transitions.
+ */
+void sched_set_freq_scale(int cpu, unsigned long scale)
+{
+	per_cpu(cpu_freq_scale, cpu) = min_t(unsigned long, scale,
+					     SCHED_POWER_SCALE);
+}
+EXPORT_SYMBOL_GPL(sched_set_freq_scale);
+
+/* Multiplies @val by @mul / 2^32 without overflowing 64 bits */
+static inline u64 mul_u64_u32_shr32(u64 val, u32 mul)
+{
+	return ((u64)(u32)val * mul >> 32) + (val >> 32) * mul;
+}
+
+/* Decays @val by n periods: val * y^n */
+static u64 decay_load(u64 val, u64 n)
+{
+	unsigned int local_n;
+
+	if (!n)
+		return val;
+	else if (unlikely(n > LOAD_AVG_PERIOD * 63))
+		return 0;
+
+	local_n = n;
+	if (unlikely(local_n >= LOAD_AVG_PERIOD)) {
+		val >>= local_n / LOAD_AVG_PERIOD;
+		local_n %= LOAD_AVG_PERIOD;
+	}
+
+	return mul_u64_u32_shr32(val, runnable_avg_yN_inv[local_n]);
+}
+
+/* Contribution of n full periods: \Sum 1024 * y^k { 1<=k<=n } */
+static u32 __compute_runnable_contrib(u64 n)
+{
+	u32 contrib = 0;
+
+	if (likely(n <= LOAD_AVG_PERIOD))
+		return runnable_avg_yN_sum[n];
+	else if (unlikely(n >= LOAD_AVG_MAX_N))
+		return LOAD_AVG_MAX;
+
+	/* y^LOAD_AVG_PERIOD = 1/2 */
+	do {
+		contrib /= 2;
+		contrib += runnable_avg_yN_sum[LOAD_AVG_PERIOD];
+		n -= LOAD_AVG_PERIOD;
+	} while (n > LOAD_AVG_PERIOD);
+
+	contrib = decay_load(contrib, n);
+	return contrib + runnable_avg_yN_sum[n];
+}
+
+#define cap_scale(v, s)	((v) * (s) >> SCHED_POWER_SHIFT)
+
+/*
+ * Brings @sa up to @now.  @weight is the runnable weight and @running
+ * whether the entity ran, both over the whole interval since the last
+ * update.  Returns 1 when at least one period boundary was crossed and
+ * the averages were recomputed.
+ */
+static int __update_load_avg(u64 now, int cpu, struct sched_avg *sa,
+			     unsigned long weight, int running)
+{
+	unsigned long scale_freq = per_cpu(cpu_freq_scale, cpu);
+	u64 delta, periods;
+	u32 contrib, delta_w;
+	int decayed = 0;
+
+	delta = now - sa->last_update_time;
+	if ((s64)delta < 0) {
+		sa->last_update_time = now;
+		return 0;
+	}
+
+	/* Use 1024ns as the unit of measurement, it's close enough to 1us */
+	delta >>= 10;
+	if (!delta)
+		return 0;
+	sa->last_update_time += delta << 10;
+
+	delta_w = sa->period_contrib;
+	if (delta + delta_w >= 1024) {
+		decayed = 1;
+		sa->period_contrib = 0;
+
+		/* Complete the period left open by the last update */
+		delta_w = 1024 - delta_w;
+		if (weight)
+			sa->load_sum += weight * delta_w;
+		if (running)
+			sa->util_sum += cap_scale(delta_w, scale_freq) *
+					SCHED_POWER_SCALE;
+		delta -= delta_w;
+
+		periods = delta / 1024;
+		delta %= 1024;
+		sa->load_sum = decay_load(sa->load_sum, periods + 1);
+		sa->util_sum = decay_load(sa->util_sum, periods + 1);
+
+		/* Then the full periods in between */
+		contrib = __compute_runnable_contrib(periods);
+		if (weight)
+			sa->load_sum += weight * contrib;
+		if (running)
+			sa->util_sum += cap_scale(contrib, scale_freq) *
+					SCHED_POWER_SCALE;
+	}
+
+	/* And the start of the current period */
+	if (weight)
+		sa->load_sum += weight * delta;
+	if (running)
+		sa->util_sum += cap_scale(delta, scale_freq) * SCHED_POWER_SCALE;
+	sa->period_contrib += delta;
+
+	if (decayed) {
+		sa->load_avg = div_u64(sa->load_sum, LOAD_AVG_MAX);
+		sa->util_avg = div_u64(sa->util_sum, LOAD_AVG_MAX);
+	}
+	return decayed;
+}
+
+/*
+ * New tasks are assumed to keep their cpu half busy until they have a
+ * history of their own: a fork storm still raises the frequency, and a
+ * short-lived helper does not pin it at the top.
+ */
+static void init_entity_load_avg(struct sched_entity *se)
+{
+	struct sched_avg *sa = &se->avg;
+
+	sa->last_update_time = 0;
+	sa->period_contrib = 1023;
+	sa->load_avg = scale_load_down(se->load.weight);
+	sa->load_sum = (u64)sa->load_avg * LOAD_AVG_MAX;
+	sa->util_avg = SCHED_POWER_SCALE / 2;
+	sa->util_sum = (u64)sa->util_avg * LOAD_AVG_MAX;
+}
+
+static inline u64 cfs_rq_last_update_time(struct cfs_rq *cfs_rq)
+{
+#ifndef CONFIG_64BIT
+	u64 last_update_time_copy;
+	u64 last_update_time;
+
+	do {
+		last_update_time_copy = cfs_rq->load_last_update_time_copy;
+		smp_rmb();
+		last_update_time = cfs_rq->avg.last_update_time;
+	} while (last_update_time != last_update_time_copy);
+
+	return last_update_time;
+#else
+	return cfs_rq->avg.last_update_time;
+#endif
 }
 
-static int
-wakeup_preempt_entity(struct sched_entity *curr, struct sched_entity *se);
+/* Brings the cpu-wide average of the root @cfs_rq up to date */
+static void update_cfs_rq_load_avg(struct cfs_rq *cfs_rq)
+{
+	struct rq *rq = rq_of(cfs_rq);
+	struct sched_avg *sa = &cfs_rq->avg;
+	long r;
+
+	if (atomic_long_read(&cfs_rq->removed_load_avg)) {
+		r = atomic_long_xchg(&cfs_rq->removed_load_avg, 0);
+		sa->load_avg = max_t(long, sa->load_avg - r, 0);
+		sa->load_sum = max_t(s64, sa->load_sum - (s64)r * LOAD_AVG_MAX, 0);
+	}
+	if (atomic_long_read(&cfs_rq->removed_util_avg)) {
+		r = atomic_long_xchg(&cfs_rq->removed_util_avg, 0);
+		sa->util_avg = max_t(long, sa->util_avg - r, 0);
+		sa->util_sum = max_t(s64, sa->util_sum - (s64)r * LOAD_AVG_MAX, 0);
+	}
+
+	__update_load_avg(rq->clock_task, cpu_of(rq), sa,
+			  scale_load_down(cfs_rq->runnable_weight),
+			  cfs_rq->curr != NULL);
+
+#ifndef CONFIG_64BIT
+	smp_wmb();
+	cfs_rq->load_last_update_time_copy = sa->last_update_time;
+#endif
+}
 
 /*
- * Pick the next process, keeping these things in mind, in this order:
- * 1) keep things fair between processes/task groups
- * 2) pick the "next" process, since someone really wants that to run
- * 3) pick the "last" process, for cache locality
- * 4) do not run the "skip" process, if something else is available
+ * Brings task @se and its cpu's average up to date.  A task that is new or
+ * has just migrated here starts contributing to the cpu average now.
  */
-static struct sched_entity *pick_next_entity(struct cfs_rq *cfs_rq)
+static void update_task_load_avg(struct rq *rq, struct sched_entity *se)
 {
-	struct sched_entity *se = __pick_first_entity(cfs_rq);
-	struct sched_entity *left = se;
+	struct cfs_rq *cfs_rq = &rq->cfs;
 
-	/*
-	 * Avoid running the skip buddy, if running something else can
-	 * be done without getting too unfair.
-	 */
-	if (cfs_rq->skip == se) {
-		struct sched_entity *second = __pick_next_entity(se);
-		if (second && wakeup_preempt_entity(second, left) < 1)
-			se = second;
-	}
+	update_cfs_rq_load_avg(cfs_rq);
 
-	/*
-	 * Prefer last buddy, try to return the CPU to a preempted task.
-	 */
-	if (cfs_rq->last && wakeup_preempt_entity(cfs_rq->last, left) < 1)
-		se = cfs_rq->last;
+	if (!se->avg.last_update_time) {
+		se->avg.last_update_time = cfs_rq->avg.last_update_time;
+		cfs_rq->avg.load_avg += se->avg.load_avg;
+		cfs_rq->avg.load_sum += se->avg.load_sum;
+		cfs_rq->avg.util_avg += se->avg.util_avg;
+		cfs_rq->avg.util_sum += se->avg.util_sum;
+		return;
+	}
 
-	/*
-	 * Someone really wants this to run. If it's not unfair, run it.
-	 */
-	if (cfs_rq->next && wakeup_preempt_entity(cfs_rq->next, left) < 1)
-		se = cfs_rq->next;
+	__update_load_avg(rq->clock_task, cpu_of(rq), &se->avg,
+			  se->on_rq * scale_load_down(se->load.weight),
+			  cfs_rq_of(se)->curr == se);
+}
 
-	clear_buddies(cfs_rq, se);
+/* Takes task @se out of its cpu's average, with that rq locked */
+static void detach_task_load_avg(struct rq *rq, struct sched_entity *se)
+{
+	struct cfs_rq *cfs_rq = &rq->cfs;
 
-	return se;
+	update_task_load_avg(rq, se);
+	cfs_rq->avg.load_avg = max_t(long,
+			cfs_rq->avg.load_avg - se->avg.load_avg, 0);
+	cfs_rq->avg.load_sum = max_t(s64,
+			cfs_rq->avg.load_sum - se->avg.load_sum, 0);
+	cfs_rq->avg.util_avg = max_t(long,
+			cfs_rq->avg.util_avg - se->avg.util_avg, 0);
+	cfs_rq->avg.util_sum = max_t(s64,
+			cfs_rq->avg.util_sum - se->avg.util_sum, 0);
+	se->avg.last_update_time = 0;
 }
 
-static void put_prev_entity(struct cfs_rq *cfs_rq, struct sched_entity *prev)
+/**
+ * sched_cpu_util - utilization of a cpu by fair tasks
+ * @cpu: the cpu of interest
+ *
+ * Returns the decayed running time of the fair tasks of @cpu, scaled to
+ * SCHED_POWER_SCALE for a cpu that is always busy at its top frequency.
+ */
+unsigned long sched_cpu_util(int cpu)
 {
-	/*
-	 * If still on the runqueue then deactivate_task()
-	 * was not called and update_curr() has to be done:
-	 */
-	if (prev->on_rq)
-		update_curr(cfs_rq);
+	unsigned long util = cpu_rq(cpu)->cfs.avg.util_avg;
 
-	check_spread(cfs_rq, prev);
-	if (prev->on_rq) {
-		update_stats_wait_start(cfs_rq, prev);
-		/* Put 'current' back into the tree. */
-		__enqueue_entity(cfs_rq, prev);
-	}
-	cfs_rq->curr = NULL;
+	return min_t(unsigned long, util, SCHED_POWER_SCALE);
 }
+EXPORT_SYMBOL_GPL(sched_cpu_util);
 
-static void
-entity_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr, int queued)
-{
-	/*
-	 * Update run-time statistics of the 'current'.
-	 */
-	update_curr(cfs_rq);
+#ifdef CONFIG_CPU_FREQ
+static DEFINE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
 
-	/*
-	 * Update share accounting for long-running entities.
-	 */
-	update_entity_shares_tick(cfs_rq);
+/**
+ * cpufreq_set_update_util_data - install a utilization callback for a cpu
+ * @cpu: the cpu to be monitored
+ * @data: the callback, or %NULL to remove it
+ *
+ * After removing a callback the caller must synchronize_sched() before
+ * freeing it.
+ */
+void cpufreq_set_update_util_data(int cpu, struct update_util_data *data)
+{
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), data);
+}
+EXPORT_SYMBOL_GPL(cpufreq_set_update_util_data);
 
-#ifdef CONFIG_SCHED_HRTICK
-	/*
-	 * queued ticks are scheduled to match the slice, so don't bother
-	 * validating it and just reschedule.
-	 */
-	if (queued) {
-		resched_task(rq_of(cfs_rq)->curr);
-		return;
-	}
-	/*
-	 * don't let the period tick interfere with the hrtick preemption
-	 */
-	if (!sched_feat(DOUBLE_TICK) &&
-			hrtimer_active(&rq_of(cfs_rq)->hrtick_timer))
-		return;
-#endif
+static inline void cpufreq_update_util(struct rq *rq)
+{
+	struct update_util_data *data;
 
-	if (cfs_rq->nr_running > 1 || !sched_feat(WAKEUP_PREEMPT))
-		check_preempt_tick(cfs_rq, curr);
+	data = rcu_dereference_sched(per_cpu(cpufreq_update_util_data,
+					     cpu_of(rq)));
+	if (data)
+		data->func(data, rq->clock, sched_cpu_util(cpu_of(rq)),
+			   SCHED_POWER_SCALE);
+}
+#else
+static inline void cpufreq_update_util(struct rq *rq)
+{
 }
+#endif
 
 /**************************************************
  * CFS operations on tasks:
@@ -1327,21 +2301,42 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
 
+	update_task_load_avg(rq, se);
+
 	for_each_sched_entity(se) {
 		if (se->on_rq)
 			break;
 		cfs_rq = cfs_rq_of(se);
 		enqueue_entity(cfs_rq, se, flags);
+
+		/*
+		 * end evaluation on encountering a throttled cfs_rq
+		 *
+		 * note: in the case of encountering a throttled cfs_rq we will
+		 * post the final h_nr_running increment below.
+		 */
+		if (cfs_rq_throttled(cfs_rq))
+			break;
+		cfs_rq->h_nr_running++;
+
 		flags = ENQUEUE_WAKEUP;
 	}
 
 	for_each_sched_entity(se) {
-		struct cfs_rq *cfs_rq = cfs_rq_of(se);
+		cfs_rq = cfs_rq_of(se);
+		cfs_rq->h_nr_running++;
+
+		if (cfs_rq_throttled(cfs_rq))
+			break;
 
 		update_cfs_load(cfs_rq, 0);
 		update_cfs_shares(cfs_rq);
 	}
 
+	if (!se)
+		inc_nr_running(rq);
+	rq->cfs.runnable_weight += p->se.load.weight;
+	cpufreq_update_util(rq);
 	hrtick_update(rq);
 }
 
@@ -1358,10 +2353,22 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct sched_entity *se = &p->se;
 	int task_sleep = flags & DEQUEUE_SLEEP;
 
+	update_task_load_avg(rq, se);
+
 	for_each_sched_entity(se) {
 		cfs_rq = cfs_rq_of(se);
 		dequeue_entity(cfs_rq, se, flags);
 
+		/*
+		 * end evaluation on encountering a throttled cfs_rq
+		 *
+		 * note: in the case of encountering a throttled cfs_rq we will
+		 * post the final h_nr_running decrement below.
+		 */
+		if (cfs_rq_throttled(cfs_rq))
+			break;
+		cfs_rq->h_nr_running--;
+
 		/* Don't dequeue parent if it has other entities besides us */
 		if (cfs_rq->load.weight) {
 			/*
@@ -1370,23 +2377,55 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 			 */
 			if (task_sleep && parent_entity(se))
 				set_next_buddy(parent_entity(se));
+
+			/* avoid re-evaluating load for this entity */
+			se = parent_entity(se);
 			break;
 		}
 		flags |= DEQUEUE_SLEEP;
 	}
 
 	for_each_sched_entity(se) {
-		struct cfs_rq *cfs_rq = cfs_rq_of(se);
+		cfs_rq = cfs_rq_of(se);
+		cfs_rq->h_nr_running--;
+
+		if (cfs_rq_throttled(cfs_rq))
+			break;
 
 		update_cfs_load(cfs_rq, 0);
 		update_cfs_shares(cfs_rq);
 	}
 
+	if (!se)
+		dec_nr_running(rq);
+	rq->cfs.runnable_weight -= p->se.load.weight;
+	cpufreq_update_util(rq);
 	hrtick_update(rq);
 }
 
 #ifdef CONFIG_SMP
 
+/*
+ * Called with p->pi_lock held for waking tasks, or with the old rq lock held
+ * for queued ones.  The old runqueue may not be locked, so the task is
+ * decayed up to that cpu's last update and its share is left for the cpu
+ * to subtract.  The task is added to its new cpu when next enqueued.
+ */
+static void migrate_task_rq_fair(struct task_struct *p, int next_cpu)
+{
+	struct sched_entity *se = &p->se;
+	struct cfs_rq *cfs_rq = &task_rq(p)->cfs;
+
+	if (!se->avg.last_update_time)
+		return;
+
+	__update_load_avg(cfs_rq_last_update_time(cfs_rq), task_cpu(p),
+			  &se->avg, 0, 0);
+	atomic_long_add(se->avg.load_avg, &cfs_rq->removed_load_avg);
+	atomic_long_add(se->avg.util_avg, &cfs_rq->removed_util_avg);
+	se->avg.last_update_time = 0;
+}
+
 static void task_waking_fair(struct task_struct *p)
 {
 	struct sched_entity *se = &p->se;
@@ -1510,7 +2549,10 @@ static int wake_affine(struct sched_domain *sd, struct task_struct *p, int sync)
 		this_eff_load *= this_load +
 			effective_load(tg, this_cpu, weight, weight);
 
-		prev_eff_load = 100 + (sd->imbalance_pct - 100) / 2;
+		if (sysctl_sched_wake_affine_pct >= 0)
+			prev_eff_load = 100 + sysctl_sched_wake_affine_pct;
+		else
+			prev_eff_load = 100 + (sd->imbalance_pct - 100) / 2;
 		prev_eff_load *= power_of(this_cpu);
 		prev_eff_load *= load + effective_load(tg, prev_cpu, 0, weight);
 
@@ -1623,6 +2665,42 @@ find_idlest_cpu(struct sched_group *group, struct task_struct *p, int this_cpu)
 	return idlest;
 }
 
+/*
+ * Whether @cpu can take a wakeup right away: it runs the idle task and no
+ * other wakeup got to it first.
+ */
+static inline int wake_idle_cpu(int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+
+	return idle_cpu(cpu) && !rq->nr_running && !rq->wake_list;
+}
+
+/*
+ * Picks an idle cpu allowed for @p from the idle mask of the last level
+ * cache of @target, see attach_llc_idle(), or returns -1.  The mask is a
+ * hint, every cpu in it is checked again so that wakeups racing with the
+ * cpu leaving idle, or with each other, do not pile up on one cpu.
+ */
+static int select_idle_mask(struct task_struct *p, int target)
+{
+	struct cpumask *mask = ACCESS_ONCE(cpu_rq(target)->llc_idle);
+	int i;
+
+	if (!mask)
+		return -1;
+
+	for_each_cpu_and(i, mask, tsk_cpus_allowed(p)) {
+		if (cpu_active(i) && wake_idle_cpu(i)) {
+			schedstat_inc(this_rq(), ttwu_idle_sibling);
+			return i;
+		}
+		schedstat_inc(this_rq(), ttwu_idle_stale);
+	}
+
+	return -1;
+}
+
 /*
  * Try and locate an idle CPU in the sched_domain.
  */
@@ -1638,14 +2716,25 @@ static int select_idle_sibling(struct task_struct *p, int target)
 	 * already idle, then it is the right target.
 	 */
 	if (target == cpu && idle_cpu(cpu))
-		return cpu;
+		goto idle_target;
 
 	/*
 	 * If the task is going to be woken-up on the cpu where it previously
 	 * ran and if it is currently idle, then it the right target.
 	 */
 	if (target == prev_cpu && idle_cpu(prev_cpu))
-		return prev_cpu;
+		goto idle_target;
+
+	/*
+	 * With the idle mask of the last level cache of the target there is
+	 * no need to walk the domains.
+	 */
+	if (sched_feat(IDLE_MASK) && cpu_rq(target)->llc_idle) {
+		i = select_idle_mask(p, target);
+		if (i >= 0)
+			return i;
+		goto none;
+	}
 
 	/*
 	 * Otherwise, iterate the domains and find an elegible idle cpu.
@@ -1657,8 +2746,9 @@ static int select_idle_sibling(struct task_struct *p, int target)
 
 		for_each_cpu_and(i, sched_domain_span(sd), &p->cpus_allowed) {
 			if (idle_cpu(i)) {
-				target = i;
-				break;
+				rcu_read_unlock();
+				schedstat_inc(this_rq(), ttwu_idle_sibling);
+				return i;
 			}
 		}
 
@@ -1671,10 +2761,211 @@ static int select_idle_sibling(struct task_struct *p, int target)
 			break;
 	}
 	rcu_read_unlock();
+none:
+	schedstat_inc(this_rq(), ttwu_idle_none);
+	return target;
 
+idle_target:
+	schedstat_inc(this_rq(), ttwu_idle_target);
 	return target;
 }
 
+#ifdef CONFIG_SCHED_ENERGY
+/*
+ * Energy aware wakeup placement:
+ *
+ * Platforms register, for every group of cpus sharing a clock, the
+ * capacity and the power of one busy cpu at each operating point, and the
+ * power of a cpu clock gated between its tasks.  A cpu with no utilization
+ * left is taken to be power gated, it costs nothing.
+ *
+ * The energy rate of such a group follows from the utilization of its
+ * cpus: the clock is set for the busiest one, with the same 25% headroom
+ * as the sched cpufreq governor, and every cpu with some utilization pays
+ * for its busy part at that operating point and for the rest as clock
+ * gated idle.  A waking task is put on the cpu of the group of prev_cpu
+ * where that rate comes out lowest.  So small tasks are packed onto fewer
+ * cpus at a somewhat higher frequency when that is cheaper than waking up
+ * more cpus, and spread when the higher frequency costs more.
+ *
+ * All of this holds only while there is spare capacity.  As soon as a cpu
+ * of the group goes beyond 80% of the capacity of the fastest cpu, the
+ * usual throughput oriented placement and load balancing take over again.
+ */
+struct sched_energy {
+	struct cpumask			cpus;
+	unsigned long			idle_power;
+	int				nr_states;
+	struct sched_energy_state	states[0];
+};
+
+unsigned int sysctl_sched_energy_aware = 1;
+
+static DEFINE_PER_CPU(struct sched_energy *, cpu_energy);
+static DEFINE_MUTEX(sched_energy_mutex);
+
+/**
+ * sched_energy_register - describe the power of cpus sharing a clock
+ * @cpus: the cpus
+ * @states: capacity and busy power at each operating point, by increasing
+ *	capacity
+ * @nr_states: number of entries in @states
+ * @idle_power: power of one of @cpus while clock gated, in the unit of
+ *	@states
+ *
+ * The model is copied.  A cpu can only be described once.
+ */
+int sched_energy_register(const struct cpumask *cpus,
+			  const struct sched_energy_state *states,
+			  int nr_states, unsigned long idle_power)
+{
+	struct sched_energy *em;
+	int cpu, i, ret = 0;
+
+	if (nr_states <= 0 || cpumask_empty(cpus))
+		return -EINVAL;
+	for (i = 0; i < nr_states; i++)
+		if (!states[i].cap || (i && states[i].cap <= states[i - 1].cap))
+			return -EINVAL;
+
+	em = kzalloc(sizeof(*em) + nr_states * sizeof(*states), GFP_KERNEL);
+	if (!em)
+		return -ENOMEM;
+	cpumask_copy(&em->cpus, cpus);
+	em->idle_power = idle_power;
+	em->nr_states = nr_states;
+	memcpy(em->states, states, nr_states * sizeof(*states));
+
+	mutex_lock(&sched_energy_mutex);
+	for_each_cpu(cpu, cpus) {
+		if (per_cpu(cpu_energy, cpu)) {
+			ret = -EBUSY;
+			goto unlock;
+		}
+	}
+	for_each_cpu(cpu, cpus)
+		rcu_assign_pointer(per_cpu(cpu_energy, cpu), em);
+unlock:
+	mutex_unlock(&sched_energy_mutex);
+
+	if (ret)
+		kfree(em);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(sched_energy_register);
+
+static inline int energy_aware(int cpu)
+{
+	return sysctl_sched_energy_aware && per_cpu(cpu_energy, cpu);
+}
+
+/* Less than 20% of the capacity of the fastest cpu left */
+static inline int util_overutilized(unsigned long util)
+{
+	return util * 5 > SCHED_POWER_SCALE * 4;
+}
+
+static int energy_overutilized(const struct cpumask *cpus)
+{
+	int cpu;
+
+	for_each_cpu_and(cpu, cpus, cpu_online_mask)
+		if (util_overutilized(sched_cpu_util(cpu)))
+			return 1;
+	return 0;
+}
+
+/* Utilization of @cpu once @task_util moved from @src_cpu to @dst_cpu */
+static unsigned long energy_cpu_util(int cpu, unsigned long task_util,
+				     int src_cpu, int dst_cpu)
+{
+	unsigned long util = sched_cpu_util(cpu);
+
+	if (cpu == src_cpu)
+		util = util > task_util ? util - task_util : 0;
+	if (cpu == dst_cpu)
+		util += task_util;
+	return util;
+}
+
+/* Energy rate of the cpus of @em with @task_util moved as above */
+static unsigned long compute_energy(struct sched_energy *em,
+				    unsigned long task_util,
+				    int src_cpu, int dst_cpu)
+{
+	const struct sched_energy_state *s;
+	unsigned long util, max_util = 0, energy = 0;
+	int cpu;
+
+	for_each_cpu_and(cpu, &em->cpus, cpu_online_mask) {
+		util = energy_cpu_util(cpu, task_util, src_cpu, dst_cpu);
+		max_util = max(max_util, util);
+	}
+
+	for (s = em->states; s < em->states + em->nr_states - 1; s++)
+		if (s->cap >= max_util + (max_util >> 2))
+			break;
+
+	for_each_cpu_and(cpu, &em->cpus, cpu_online_mask) {
+		util = energy_cpu_util(cpu, task_util, src_cpu, dst_cpu);
+		if (!util)
+			continue;
+		util = min(util, s->cap);
+		energy += (util * s->power +
+			   (s->cap - util) * em->idle_power) / s->cap;
+	}
+
+	return energy;
+}
+
+/*
+ * Picks the cpu sharing a clock with @prev_cpu where waking @p costs the
+ * least energy, or returns -1 to leave @p to the usual placement.
+ */
+static int energy_aware_wake_cpu(struct task_struct *p, int prev_cpu)
+{
+	struct sched_energy *em = rcu_dereference(per_cpu(cpu_energy, prev_cpu));
+	unsigned long task_util = p->se.avg.util_avg;
+	unsigned long energy, best_energy = ULONG_MAX;
+	int cpu, best_cpu = -1;
+
+	if (!em || energy_overutilized(&em->cpus))
+		return -1;
+
+	for_each_cpu_and(cpu, &em->cpus, cpu_active_mask) {
+		if (!cpumask_test_cpu(cpu, tsk_cpus_allowed(p)))
+			continue;
+		if (util_overutilized(energy_cpu_util(cpu, task_util,
+						      prev_cpu, cpu)))
+			continue;
+
+		energy = compute_energy(em, task_util, prev_cpu, cpu);
+		if (energy < best_energy ||
+		    (energy == best_energy && cpu == prev_cpu)) {
+			best_energy = energy;
+			best_cpu = cpu;
+		}
+	}
+
+	return best_cpu;
+}
+#else
+static inline int energy_aware(int cpu)
+{
+	return 0;
+}
+
+static inline int energy_overutilized(const struct cpumask *cpus)
+{
+	return 1;
+}
+
+static inline int energy_aware_wake_cpu(struct task_struct *p, int prev_cpu)
+{
+	return -1;
+}
+#endif /* CONFIG_SCHED_ENERGY */
+
 /*
  * sched_balance_self: balance the current task (running on cpu) in domains
  * that have the 'flag' flag set. In practice, this is SD_BALANCE_FORK and
@@ -1695,7 +2986,7 @@ select_task_rq_fair(struct task_struct *p, int sd_flag, int wake_flags)
 	int new_cpu = cpu;
 	int want_affine = 0;
 	int want_sd = 1;
-	int sync = wake_flags & WF_SYNC;
+	int sync = (wake_flags & WF_SYNC) && sysctl_sched_wake_affine_sync;
 
 	if (sd_flag & SD_BALANCE_WAKE) {
 		if (cpumask_test_cpu(cpu, &p->cpus_allowed))
@@ -1704,6 +2995,15 @@ select_task_rq_fair(struct task_struct *p, int sd_flag, int wake_flags)
 	}
 
 	rcu_read_lock();
+	if ((sd_flag & SD_BALANCE_WAKE) && energy_aware(prev_cpu)) {
+		int energy_cpu = energy_aware_wake_cpu(p, prev_cpu);
+
+		if (energy_cpu >= 0) {
+			new_cpu = energy_cpu;
+			goto unlock;
+		}
+	}
+
 	for_each_domain(cpu, tmp) {
 		if (!(tmp->flags & SD_LOAD_BALANCE))
 			continue;
@@ -1720,7 +3020,7 @@ select_task_rq_fair(struct task_struct *p, int sd_flag, int wake_flags)
 
 			for_each_cpu(i, sched_domain_span(tmp)) {
 				power += power_of(i);
-				nr_running += cpu_rq(i)->cfs.nr_running;
+				nr_running += cpu_rq(i)->cfs.h_nr_running;
 			}
 
 			capacity = DIV_ROUND_CLOSEST(power, SCHED_POWER_SCALE);
@@ -1760,6 +3060,22 @@ select_task_rq_fair(struct task_struct *p, int sd_flag, int wake_flags)
 		goto unlock;
 	}
 
+	/*
+	 * Not an affine wakeup: an idle cpu sharing the cache of prev_cpu
+	 * is as good as anything find_idlest_group() would find, and does
+	 * not need a scan of the domains.
+	 */
+	if ((sd_flag & SD_BALANCE_WAKE) && sched_feat(IDLE_MASK)) {
+		int idle = prev_cpu;
+
+		if (!idle_cpu(prev_cpu))
+			idle = select_idle_mask(p, prev_cpu);
+		if (idle >= 0) {
+			new_cpu = idle;
+			goto unlock;
+		}
+	}
+
 	while (sd) {
 		int load_idx = sd->forkexec_idx;
 		struct sched_group *group;
@@ -1893,6 +3209,15 @@ static void check_preempt_wakeup(struct rq *rq, struct task_struct *p, int wake_
 	if (unlikely(se == pse))
 		return;
 
+	/*
+	 * This is possible from callers such as pull_task(), in which we
+	 * unconditionally check_prempt_curr() after an enqueue (which may have
+	 * lead to a throttle).  This both saves work and prevents false
+	 * next-buddy nomination below.
+	 */
+	if (unlikely(throttled_hierarchy(cfs_rq_of(pse))))
+		return;
+
 	if (sched_feat(NEXT_BUDDY) && scale && !(wake_flags & WF_FORK)) {
 		set_next_buddy(pse);
 		next_buddy_marked = 1;
@@ -1963,8 +3288,13 @@ static struct task_struct *pick_next_task_fair(struct rq *rq)
 	if (!cfs_rq->nr_running)
 		return NULL;
 
+	update_cfs_rq_load_avg(cfs_rq);
+
 	do {
 		se = pick_next_entity(cfs_rq);
+		/* it waited until now, it runs from now on */
+		if (entity_is_task(se))
+			update_task_load_avg(rq, se);
 		set_next_entity(cfs_rq, se);
 		cfs_rq = group_cfs_rq(se);
 	} while (cfs_rq);
@@ -1983,6 +3313,8 @@ static void put_prev_task_fair(struct rq *rq, struct task_struct *prev)
 	struct sched_entity *se = &prev->se;
 	struct cfs_rq *cfs_rq;
 
+	update_task_load_avg(rq, se);
+
 	for_each_sched_entity(se) {
 		cfs_rq = cfs_rq_of(se);
 		put_prev_entity(cfs_rq, se);
@@ -2023,7 +3355,8 @@ static bool yield_to_task_fair(struct rq *rq, struct task_struct *p, bool preemp
 {
 	struct sched_entity *se = &p->se;
 
-	if (!se->on_rq)
+	/* throttled hierarchies are not runnable */
+	if (!se->on_rq || throttled_hierarchy(cfs_rq_of(se)))
 		return false;
 
 	/* Tell the scheduler that we'd really like pse to run next. */
@@ -2120,6 +3453,9 @@ move_one_task(struct rq *this_rq, int this_cpu, struct rq *busiest,
 
 	for_each_leaf_cfs_rq(busiest, cfs_rq) {
 		list_for_each_entry_safe(p, n, &cfs_rq->tasks, se.group_node) {
+			if (throttled_lb_pair(task_group(p),
+					      busiest->cpu, this_cpu))
+				break;
 
 			if (!can_migrate_task(p, busiest, this_cpu,
 						sd, idle, &pinned))
@@ -2256,9 +3592,10 @@ load_balance_fair(struct rq *this_rq, int this_cpu, struct rq *busiest,
 		u64 rem_load, moved_load;
 
 		/*
-		 * empty group
+		 * empty group or part of a throttled hierarchy
 		 */
-		if (!busiest_cfs_rq->task_weight)
+		if (!busiest_cfs_rq->task_weight ||
+		    throttled_lb_pair(tg, busiest_cpu, this_cpu))
 			continue;
 
 		rem_load = (u64)rem_load_move * busiest_weight;
@@ -3346,6 +4683,10 @@ static int load_balance(int this_cpu, struct rq *this_rq,
 
 	schedstat_inc(sd, lb_count[idle]);
 
+	/* Placement is left to the energy model while there is spare capacity */
+	if (energy_aware(this_cpu) && !energy_overutilized(sched_domain_span(sd)))
+		goto out_balanced;
+
 redo:
 	group = find_busiest_group(sd, this_cpu, &imbalance, idle,
 				   cpus, balance);
@@ -4095,6 +5436,9 @@ static void rq_online_fair(struct rq *rq)
 static void rq_offline_fair(struct rq *rq)
 {
 	update_sysctl();
+
+	/* Ensure any throttled groups are reachable by pick_next_task */
+	unthrottle_offline_cfs_rqs(rq);
 }
 
 #else	/* CONFIG_SMP */
@@ -4120,6 +5464,9 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	update_task_load_avg(rq, &curr->se);
+	cpufreq_update_util(rq);
 }
 
 /*
@@ -4209,6 +5556,10 @@ static void switched_from_fair(struct rq *rq, struct task_struct *p)
 		place_entity(cfs_rq, se, 0);
 		se->vruntime -= cfs_rq->min_vruntime;
 	}
+
+	/* Its utilization is no longer fair class utilization */
+	if (se->avg.last_update_time)
+		detach_task_load_avg(rq, se);
 }
 
 /*
@@ -4299,6 +5650,7 @@ static const struct sched_class fair_sched_class = {
 
 #ifdef CONFIG_SMP
 	.select_task_rq		= select_task_rq_fair,
+	.migrate_task_rq	= migrate_task_rq_fair,
 
 	.rq_online		= rq_online_fair,
 	.rq_offline		= rq_offline_fair,
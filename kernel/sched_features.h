@@ -24,6 +24,12 @@ SCHED_FEAT(WAKEUP_PREEMPT, 1)
  */
 SCHED_FEAT(AFFINE_WAKEUPS, 1)
 
+/*
+ * Find idle cpus for wakeups in the idle mask of the last level cache
+ * instead of scanning the sched domains.
+ */
+SCHED_FEAT(IDLE_MASK, 1)
+
 /*
  * Prefer to schedule the task we woke last (assuming it failed
  * wakeup-preemption), since its likely going to consume data we
@@ -24,6 +24,10 @@ static struct task_struct *pick_next_task_idle(struct rq *rq)
 {
 	schedstat_inc(rq, sched_goidle);
 	calc_load_account_idle(rq);
+#ifdef CONFIG_SMP
+	if (rq->llc_idle)
+		cpumask_set_cpu(cpu_of(rq), rq->llc_idle);
+#endif
 	return rq->idle;
 }
 
@@ -42,6 +46,10 @@ dequeue_task_idle(struct rq *rq, struct task_struct *p, int flags)
 
 static void put_prev_task_idle(struct rq *rq, struct task_struct *prev)
 {
+#ifdef CONFIG_SMP
+	if (rq->llc_idle)
+		cpumask_clear_cpu(cpu_of(rq), rq->llc_idle);
+#endif
 }
 
 static void task_tick_idle(struct rq *rq, struct task_struct *curr, int queued)
@@ -4,7 +4,7 @@
  * bump this up when changing the output format or the meaning of an existing
  * format, so that tools can adapt (or abort)
  */
-#define SCHEDSTAT_VERSION 15
+#define SCHEDSTAT_VERSION 16
 
 static int show_schedstat(struct seq_file *seq, void *v)
 {
@@ -26,12 +26,14 @@ static int show_schedstat(struct seq_file *seq, void *v)
 
 		/* runqueue-specific stats */
 		seq_printf(seq,
-		    "cpu%d %u %u %u %u %u %u %llu %llu %lu",
+		    "cpu%d %u %u %u %u %u %u %llu %llu %lu %u %u %u %u",
 		    cpu, rq->yld_count,
 		    rq->sched_switch, rq->sched_count, rq->sched_goidle,
 		    rq->ttwu_count, rq->ttwu_local,
 		    rq->rq_cpu_time,
-		    rq->rq_sched_info.run_delay, rq->rq_sched_info.pcount);
+		    rq->rq_sched_info.run_delay, rq->rq_sched_info.pcount,
+		    rq->ttwu_idle_target, rq->ttwu_idle_sibling,
+		    rq->ttwu_idle_stale, rq->ttwu_idle_none);
 
 		seq_printf(seq, "\n");
 
@@ -97,9 +99,59 @@ static const struct file_operations proc_schedstat_operations = {
 	.release = single_release,
 };
 
+/*
+ * Wait latency histograms, see sched_lat_end().  Counters only increment,
+ * like those of /proc/schedstat.
+ */
+#define SCHEDSTAT_HIST_VERSION 1
+
+static void show_lat_hist(struct seq_file *seq, int cpu, const char *name,
+			  unsigned int *hist)
+{
+	int i;
+
+	seq_printf(seq, "cpu%d %s", cpu, name);
+	for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+		seq_printf(seq, " %u", hist[i]);
+	seq_printf(seq, "\n");
+}
+
+static int show_schedstat_hist(struct seq_file *seq, void *v)
+{
+	int cpu, i;
+
+	seq_printf(seq, "version %d\n", SCHEDSTAT_HIST_VERSION);
+	seq_printf(seq, "timestamp %lu\n", jiffies);
+	seq_printf(seq, "buckets");
+	for (i = 0; i < SCHED_LAT_BUCKETS - 1; i++)
+		seq_printf(seq, " %llu", 1ULL << (i + SCHED_LAT_SHIFT));
+	seq_printf(seq, " inf\n");
+
+	for_each_online_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		show_lat_hist(seq, cpu, "wakeup", rq->wakeup_lat);
+		show_lat_hist(seq, cpu, "preempt", rq->preempt_lat);
+	}
+	return 0;
+}
+
+static int schedstat_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_schedstat_hist, NULL);
+}
+
+static const struct file_operations proc_schedstat_hist_operations = {
+	.open    = schedstat_hist_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
 static int __init proc_schedstat_init(void)
 {
 	proc_create("schedstat", 0, NULL, &proc_schedstat_operations);
+	proc_create("schedstat-hist", 0, NULL, &proc_schedstat_hist_operations);
 	return 0;
 }
 module_init(proc_schedstat_init);
@@ -132,6 +184,56 @@ rq_sched_info_dequeued(struct rq *rq, unsigned long long delta)
 	if (rq)
 		rq->rq_sched_info.run_delay += delta;
 }
+
+/*
+ * Wait latencies: from the wakeup of a task, or from the moment it was
+ * switched out while still runnable (preempted, or yielding), until it
+ * runs again.  Unlike run_delay, a wait is not split when the task is
+ * migrated meanwhile, and a wakeup is timed from try_to_wake_up() so the
+ * time to get a remote cpu to queue the task is included.
+ *
+ * Every cpu counts the waits that ended on it in power of two buckets:
+ * bucket i holds the waits below 2^(i + SCHED_LAT_SHIFT) ns, that is about
+ * 1us, 2us, 4us..., and the last one every longer wait.  Every task keeps
+ * its longest wait of each kind, shown in /proc/<pid>/sched.
+ */
+static inline void sched_lat_start(struct task_struct *t, u64 now, int preempt)
+{
+	t->se.statistics.lat_start = now;
+	t->se.statistics.lat_preempt = preempt;
+}
+
+/* Only the first of try_to_wake_up() and enqueue_task() times a wakeup */
+static inline void sched_lat_wakeup(struct task_struct *t, u64 now)
+{
+	if (!t->se.statistics.lat_start)
+		sched_lat_start(t, now, 0);
+}
+
+static inline void sched_lat_end(struct rq *rq, struct task_struct *t)
+{
+	struct sched_statistics *stats = &t->se.statistics;
+	s64 delta;
+	int bucket;
+
+	if (!stats->lat_start)
+		return;
+	delta = rq->clock - stats->lat_start;
+	stats->lat_start = 0;
+
+	/* The wakeup may have been timed by another cpu's clock */
+	if (delta < 0)
+		delta = 0;
+	bucket = min(fls64(delta >> SCHED_LAT_SHIFT), SCHED_LAT_BUCKETS - 1);
+
+	if (stats->lat_preempt) {
+		rq->preempt_lat[bucket]++;
+		stats->preempt_lat_max = max_t(u64, stats->preempt_lat_max, delta);
+	} else {
+		rq->wakeup_lat[bucket]++;
+		stats->wakeup_lat_max = max_t(u64, stats->wakeup_lat_max, delta);
+	}
+}
 # define schedstat_inc(rq, field)	do { (rq)->field++; } while (0)
 # define schedstat_add(rq, field, amt)	do { (rq)->field += (amt); } while (0)
 # define schedstat_set(var, val)	do { var = (val); } while (0)
@@ -145,6 +247,12 @@ rq_sched_info_dequeued(struct rq *rq, unsigned long long delta)
 static inline void
 rq_sched_info_depart(struct rq *rq, unsigned long long delta)
 {}
+static inline void sched_lat_start(struct task_struct *t, u64 now, int preempt)
+{}
+static inline void sched_lat_wakeup(struct task_struct *t, u64 now)
+{}
+static inline void sched_lat_end(struct rq *rq, struct task_struct *t)
+{}
 # define schedstat_inc(rq, field)	do { } while (0)
 # define schedstat_add(rq, field, amt)	do { } while (0)
 # define schedstat_set(var, val)	do { } while (0)
@@ -192,6 +300,7 @@ static void sched_info_arrive(struct task_struct *t)
 	t->sched_info.pcount++;
 
 	rq_sched_info_arrive(task_rq(t), delta);
+	sched_lat_end(task_rq(t), t);
 }
 
 /*
@@ -220,8 +329,10 @@ static inline void sched_info_depart(struct task_struct *t)
 
 	rq_sched_info_depart(task_rq(t), delta);
 
-	if (t->state == TASK_RUNNING)
+	if (t->state == TASK_RUNNING) {
 		sched_info_queued(t);
+		sched_lat_start(t, task_rq(t)->clock, 1);
+	}
 }
 
 /*
@@ -0,0 +1,235 @@
+/*
+ * Timer wheel stress test
+ *
+ * Keeps a large number of timers pending with random timeouts, modifies
+ * some of them before they expire like network and block timeouts are,
+ * and reports how long the timer softirq runs, worst case and average,
+ * and how late the timers expire.  The softirq is timed through the
+ * softirq_entry/softirq_exit tracepoints, so all of it is measured: the
+ * wheel processing as well as the callbacks.
+ *
+ *	modprobe timer_stress nr_timers=20000 max_timeout_ms=60000 duration=60
+ *
+ * The module load returns, and the results are printed, when the test
+ * ends after duration seconds.  Unload the module to run it again.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/timer.h>
+#include <linux/jiffies.h>
+#include <linux/interrupt.h>
+#include <linux/kthread.h>
+#include <linux/random.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/delay.h>
+#include <linux/vmalloc.h>
+#include <trace/events/irq.h>
+
+static int nr_timers = 10000;
+module_param(nr_timers, int, 0444);
+MODULE_PARM_DESC(nr_timers, "Number of timers kept pending");
+
+static int max_timeout_ms = 30000;
+module_param(max_timeout_ms, int, 0444);
+MODULE_PARM_DESC(max_timeout_ms, "Timeouts are random up to this (ms)");
+
+static int modify_pct = 90;
+module_param(modify_pct, int, 0444);
+MODULE_PARM_DESC(modify_pct, "Percentage of timers modified before expiry");
+
+static int duration = 30;
+module_param(duration, int, 0444);
+MODULE_PARM_DESC(duration, "Duration of the test (s)");
+
+struct stress_timer {
+	struct timer_list timer;
+	bool modify;			/* modified before it expires */
+};
+
+struct stress_cpu {
+	u64 entry;
+	u64 max;
+	u64 sum;
+	unsigned long count;
+};
+
+static struct stress_timer *timers;
+static DEFINE_PER_CPU(struct stress_cpu, stress_cpu);
+static struct task_struct *stress_task;
+static bool stopping;
+
+static atomic_t nr_expired;
+static atomic_t nr_modified;
+static unsigned long max_late;		/* jiffies */
+
+static unsigned long random_timeout(void)
+{
+	return 1 + random32() % msecs_to_jiffies(max_timeout_ms);
+}
+
+static void stress_softirq_entry(void *ignore, unsigned int vec_nr)
+{
+	if (vec_nr == TIMER_SOFTIRQ)
+		__this_cpu_write(stress_cpu.entry, local_clock());
+}
+
+static void stress_softirq_exit(void *ignore, unsigned int vec_nr)
+{
+	struct stress_cpu *sc;
+	u64 delta;
+
+	if (vec_nr != TIMER_SOFTIRQ)
+		return;
+
+	sc = &__get_cpu_var(stress_cpu);
+	if (!sc->entry)
+		return;
+	delta = local_clock() - sc->entry;
+	sc->entry = 0;
+	if (delta > sc->max)
+		sc->max = delta;
+	sc->sum += delta;
+	sc->count++;
+}
+
+static void stress_timer_fn(unsigned long data)
+{
+	struct stress_timer *st = timers + data;
+	unsigned long late = jiffies - st->timer.expires;
+
+	atomic_inc(&nr_expired);
+	/* Racy, but this is only a statistic */
+	if ((long)late > 0 && late > max_late)
+		max_late = late;
+
+	if (ACCESS_ONCE(stopping))
+		return;
+	st->modify = random32() % 100 < modify_pct;
+	mod_timer(&st->timer, jiffies + random_timeout());
+}
+
+/*
+ * Every tick, push back the timeout of some of the timers meant to be
+ * modified before they expire: each of them is visited about every
+ * max_timeout_ms / 2, their average timeout.
+ */
+static int stress_thread(void *unused)
+{
+	int i = 0;
+
+	while (!kthread_should_stop()) {
+		unsigned long batch = nr_timers * 2 /
+				      msecs_to_jiffies(max_timeout_ms) + 1;
+
+		while (batch--) {
+			struct stress_timer *st = timers + i;
+
+			if (st->modify && mod_timer_pending(&st->timer,
+						jiffies + random_timeout()))
+				atomic_inc(&nr_modified);
+			if (++i == nr_timers)
+				i = 0;
+		}
+		schedule_timeout_interruptible(1);
+	}
+	return 0;
+}
+
+static void stress_report(void)
+{
+	u64 max = 0, sum = 0;
+	unsigned long count = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct stress_cpu *sc = &per_cpu(stress_cpu, cpu);
+		u64 avg = sc->count ? div64_u64(sc->sum, sc->count) : 0;
+
+		if (!sc->count)
+			continue;
+		printk(KERN_INFO "timer_stress: cpu%d: %lu softirqs, "
+		       "max %llu ns, avg %llu ns\n", cpu, sc->count,
+		       (unsigned long long)sc->max, (unsigned long long)avg);
+		if (sc->max > max)
+			max = sc->max;
+		sum += sc->sum;
+		count += sc->count;
+	}
+	printk(KERN_INFO "timer_stress: %d timers up to %d ms for %d s: "
+	       "%d expired, %d modified, max %u ms late\n", nr_timers,
+	       max_timeout_ms, duration, atomic_read(&nr_expired),
+	       atomic_read(&nr_modified), jiffies_to_msecs(max_late));
+	printk(KERN_INFO "timer_stress: run_timer_softirq max %llu ns, "
+	       "avg %llu ns\n", (unsigned long long)max,
+	       (unsigned long long)(count ? div64_u64(sum, count) : 0));
+}
+
+static int __init timer_stress_init(void)
+{
+	int i, err;
+
+	if (nr_timers <= 0 || max_timeout_ms <= 0 || duration <= 0 ||
+	    modify_pct < 0 || modify_pct > 100)
+		return -EINVAL;
+
+	timers = vzalloc(nr_timers * sizeof(*timers));
+	if (!timers)
+		return -ENOMEM;
+
+	err = register_trace_softirq_entry(stress_softirq_entry, NULL);
+	if (err)
+		goto out_free;
+	err = register_trace_softirq_exit(stress_softirq_exit, NULL);
+	if (err)
+		goto out_entry;
+
+	for (i = 0; i < nr_timers; i++) {
+		struct stress_timer *st = timers + i;
+
+		setup_timer(&st->timer, stress_timer_fn, i);
+		st->modify = random32() % 100 < modify_pct;
+		mod_timer(&st->timer, jiffies + random_timeout());
+	}
+
+	stress_task = kthread_run(stress_thread, NULL, "timer_stress");
+	if (IS_ERR(stress_task)) {
+		err = PTR_ERR(stress_task);
+	} else {
+		printk(KERN_INFO "timer_stress: started, results in %d s\n",
+		       duration);
+		msleep(duration * 1000);
+		kthread_stop(stress_task);
+	}
+
+	ACCESS_ONCE(stopping) = true;
+	for (i = 0; i < nr_timers; i++)
+		del_timer_sync(&timers[i].timer);
+
+	unregister_trace_softirq_exit(stress_softirq_exit, NULL);
+	tracepoint_synchronize_unregister();
+	if (!err)
+		stress_report();
+out_entry:
+	unregister_trace_softirq_entry(stress_softirq_entry, NULL);
+	tracepoint_synchronize_unregister();
+out_free:
+	vfree(timers);
+	return err;
+}
+
+static void __exit timer_stress_exit(void)
+{
+}
+
+module_init(timer_stress_init);
+module_exit(timer_stress_exit);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Timer wheel stress test");
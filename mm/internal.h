@@ -299,6 +299,63 @@ static inline void mminit_validate_memmodel_limits(unsigned long *start_pfn,
 #define ZONE_RECLAIM_FULL	-1
 #define ZONE_RECLAIM_SOME	0
 #define ZONE_RECLAIM_SUCCESS	1
+
+/*
+ * zone->lru_lock helpers.  With CONFIG_LRU_LOCK_STAT they account how
+ * often the lock is taken and contended, how long it is held and how many
+ * pages each hold dealt with.  The lock is always taken with interrupts
+ * disabled and never nested, so a per-cpu acquisition stamp is enough.
+ */
+#ifdef CONFIG_LRU_LOCK_STAT
+extern void __lru_lock(struct zone *zone);
+extern void __lru_unlock(struct zone *zone, unsigned long nr_pages);
+
+static inline void lru_lock_irq(struct zone *zone)
+{
+	local_irq_disable();
+	__lru_lock(zone);
+}
+
+static inline void lru_unlock_irq(struct zone *zone, unsigned long nr_pages)
+{
+	__lru_unlock(zone, nr_pages);
+	local_irq_enable();
+}
+
+#define lru_lock_irqsave(zone, flags)			\
+	do {						\
+		local_irq_save(flags);			\
+		__lru_lock(zone);			\
+	} while (0)
+
+static inline void lru_unlock_irqrestore(struct zone *zone,
+					 unsigned long flags,
+					 unsigned long nr_pages)
+{
+	__lru_unlock(zone, nr_pages);
+	local_irq_restore(flags);
+}
+#else
+static inline void lru_lock_irq(struct zone *zone)
+{
+	spin_lock_irq(&zone->lru_lock);
+}
+
+static inline void lru_unlock_irq(struct zone *zone, unsigned long nr_pages)
+{
+	spin_unlock_irq(&zone->lru_lock);
+}
+
+#define lru_lock_irqsave(zone, flags)			\
+	spin_lock_irqsave(&(zone)->lru_lock, flags)
+
+static inline void lru_unlock_irqrestore(struct zone *zone,
+					 unsigned long flags,
+					 unsigned long nr_pages)
+{
+	spin_unlock_irqrestore(&zone->lru_lock, flags);
+}
+#endif /* CONFIG_LRU_LOCK_STAT */
 #endif
 
 extern int hwpoison_filter(struct page *p);
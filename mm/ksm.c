@@ -115,11 +115,13 @@ struct ksm_scan {
  * @node: rb node of this ksm page in the stable tree
  * @hlist: hlist head of rmap_items using this ksm page
  * @kpfn: page frame number of this ksm page
+ * @checksum: checksum of this ksm page, the primary stable tree key
  */
 struct stable_node {
 	struct rb_node node;
 	struct hlist_head hlist;
 	unsigned long kpfn;
+	u32 checksum;
 };
 
 /**
@@ -129,6 +131,8 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @changes: consecutive scans that found the checksum changed
+ * @skips: scans still to be skipped because the page is volatile
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -139,6 +143,8 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	unsigned char changes;
+	unsigned char skips;
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -183,12 +189,40 @@ static unsigned long ksm_pages_unshared;
 /* The number of rmap_items in use: to calculate pages_volatile */
 static unsigned long ksm_rmap_items;
 
+/* The number of page scans skipped because the page kept changing */
+static unsigned long ksm_pages_skipped;
+
 /* Number of pages ksmd should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
 
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/*
+ * Adaptive scanning: after a full scan that merged little, ksmd doubles
+ * its sleep, up to ksm_max_sleep_millisecs; after one that merged well it
+ * goes back to ksm_thread_sleep_millisecs.
+ */
+static unsigned int ksm_adaptive_scan;
+static unsigned int ksm_max_sleep_millisecs = 2000;
+static unsigned int ksm_cur_sleep_millisecs = 20;
+
+/* Merges and scans seen during the current full scan */
+static unsigned long ksm_scan_merged;
+static unsigned long ksm_scan_scanned;
+
+/*
+ * A full scan that merged at least one page out of every
+ * KSM_ADAPTIVE_RATIO it looked at counts as worthwhile.
+ */
+#define KSM_ADAPTIVE_RATIO	64
+
+/*
+ * A page whose checksum changed on more than one scan in a row is skipped
+ * for 1, 2, 4, then at most 8 scans, instead of being hashed every time.
+ */
+#define KSM_MAX_SKIP_SHIFT	3
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -247,6 +281,7 @@ static inline struct rmap_item *alloc_rmap_item(void)
 static inline void free_rmap_item(struct rmap_item *rmap_item)
 {
 	ksm_rmap_items--;
+	rmap_item->mm->ksm_rmap_items--;
 	rmap_item->mm = NULL;	/* debug safety */
 	kmem_cache_free(rmap_item_cache, rmap_item);
 }
@@ -453,6 +488,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 			ksm_pages_sharing--;
 		else
 			ksm_pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
 		cond_resched();
@@ -540,6 +576,7 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 			ksm_pages_sharing--;
 		else
 			ksm_pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
@@ -669,11 +706,23 @@ error:
 }
 #endif /* CONFIG_SYSFS */
 
+/*
+ * The checksum samples KSM_CHECKSUM_WORDS out of every KSM_CHECKSUM_STRIDE
+ * words of the page.  It only has to notice most changes between scans and
+ * to order the trees ahead of memcmp_pages(); two pages with the same
+ * checksum are still compared in full before anything is merged.
+ */
+#define KSM_CHECKSUM_WORDS	4
+#define KSM_CHECKSUM_STRIDE	32
+
 static u32 calc_checksum(struct page *page)
 {
-	u32 checksum;
-	void *addr = kmap_atomic(page, KM_USER0);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	u32 checksum = 17;
+	u32 *addr = kmap_atomic(page, KM_USER0);
+	int i;
+
+	for (i = 0; i < PAGE_SIZE / 4; i += KSM_CHECKSUM_STRIDE)
+		checksum = jhash2(addr + i, KSM_CHECKSUM_WORDS, checksum);
 	kunmap_atomic(addr, KM_USER0);
 	return checksum;
 }
@@ -983,7 +1032,7 @@ static struct page *try_to_merge_two_pages(struct rmap_item *rmap_item,
  * This function returns the stable tree node of identical content if found,
  * NULL otherwise.
  */
-static struct page *stable_tree_search(struct page *page)
+static struct page *stable_tree_search(struct page *page, u32 checksum)
 {
 	struct rb_node *node = root_stable_tree.rb_node;
 	struct stable_node *stable_node;
@@ -1000,6 +1049,16 @@ static struct page *stable_tree_search(struct page *page)
 
 		cond_resched();
 		stable_node = rb_entry(node, struct stable_node, node);
+
+		/* The trees are ordered by checksum first, content second */
+		if (checksum != stable_node->checksum) {
+			if (checksum < stable_node->checksum)
+				node = node->rb_left;
+			else
+				node = node->rb_right;
+			continue;
+		}
+
 		tree_page = get_ksm_page(stable_node);
 		if (!tree_page)
 			return NULL;
@@ -1031,6 +1090,10 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 	struct rb_node **new = &root_stable_tree.rb_node;
 	struct rb_node *parent = NULL;
 	struct stable_node *stable_node;
+	u32 checksum;
+
+	/* kpage is write-protected now: its checksum can no longer change */
+	checksum = calc_checksum(kpage);
 
 	while (*new) {
 		struct page *tree_page;
@@ -1038,6 +1101,16 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 
 		cond_resched();
 		stable_node = rb_entry(*new, struct stable_node, node);
+
+		if (checksum != stable_node->checksum) {
+			parent = *new;
+			if (checksum < stable_node->checksum)
+				new = &parent->rb_left;
+			else
+				new = &parent->rb_right;
+			continue;
+		}
+
 		tree_page = get_ksm_page(stable_node);
 		if (!tree_page)
 			return NULL;
@@ -1070,6 +1143,7 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 	INIT_HLIST_HEAD(&stable_node->hlist);
 
 	stable_node->kpfn = page_to_pfn(kpage);
+	stable_node->checksum = checksum;
 	set_page_stable_node(kpage, stable_node);
 
 	return stable_node;
@@ -1105,6 +1179,22 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 
 		cond_resched();
 		tree_rmap_item = rb_entry(*new, struct rmap_item, node);
+
+		/*
+		 * Ordering by the checksum taken at insertion spares us
+		 * looking up and comparing most of the pages on the way.
+		 * The unstable tree is rebuilt on every scan, so the
+		 * checksum keys cannot go stale under it.
+		 */
+		if (rmap_item->oldchecksum != tree_rmap_item->oldchecksum) {
+			parent = *new;
+			if (rmap_item->oldchecksum < tree_rmap_item->oldchecksum)
+				new = &parent->rb_left;
+			else
+				new = &parent->rb_right;
+			continue;
+		}
+
 		tree_page = get_mergeable_page(tree_rmap_item);
 		if (IS_ERR_OR_NULL(tree_page))
 			return NULL;
@@ -1157,6 +1247,20 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 		ksm_pages_sharing++;
 	else
 		ksm_pages_shared++;
+	rmap_item->mm->ksm_merging_pages++;
+	ksm_scan_merged++;
+}
+
+/*
+ * The page at rmap_item changed again since the last scan: back off from
+ * it for longer each time it does so in a row.
+ */
+static void note_volatile_page(struct rmap_item *rmap_item)
+{
+	if (rmap_item->changes < KSM_MAX_SKIP_SHIFT + 2)
+		rmap_item->changes++;
+	if (rmap_item->changes > 1)
+		rmap_item->skips = 1 << (rmap_item->changes - 2);
 }
 
 /*
@@ -1179,8 +1283,10 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 
 	remove_rmap_item_from_tree(rmap_item);
 
+	checksum = calc_checksum(page);
+
 	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	kpage = stable_tree_search(page, checksum);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
 		if (!err) {
@@ -1202,11 +1308,12 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
+		note_volatile_page(rmap_item);
 		return;
 	}
+	rmap_item->changes = 0;
 
 	tree_rmap_item =
 		unstable_tree_search_insert(rmap_item, page, &tree_page);
@@ -1265,6 +1372,7 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	if (rmap_item) {
 		/* It has already been zeroed */
 		rmap_item->mm = mm_slot->mm;
+		rmap_item->mm->ksm_rmap_items++;
 		rmap_item->address = addr;
 		rmap_item->rmap_list = *rmap_list;
 		*rmap_list = rmap_item;
@@ -1272,6 +1380,27 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+/*
+ * Called at the end of each full scan: slow ksmd down while the scans
+ * keep coming up empty, and go back to full speed once merging pays off.
+ */
+static void ksm_adapt_scan_rate(void)
+{
+	unsigned int ceiling;
+
+	if (ksm_scan_merged * KSM_ADAPTIVE_RATIO >= ksm_scan_scanned)
+		ksm_cur_sleep_millisecs = ksm_thread_sleep_millisecs;
+	else {
+		ceiling = max(ksm_max_sleep_millisecs,
+			      ksm_thread_sleep_millisecs);
+		ksm_cur_sleep_millisecs =
+			clamp(max(ksm_cur_sleep_millisecs, 1U) * 2,
+			      ksm_thread_sleep_millisecs, ceiling);
+	}
+	ksm_scan_merged = 0;
+	ksm_scan_scanned = 0;
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -1400,6 +1529,7 @@ next_mm:
 		goto next_mm;
 
 	ksm_scan.seqnr++;
+	ksm_adapt_scan_rate();
 	return NULL;
 }
 
@@ -1417,8 +1547,14 @@ static void ksm_do_scan(unsigned int scan_npages)
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
 			return;
-		if (!PageKsm(page) || !in_stable_tree(rmap_item))
-			cmp_and_merge_page(page, rmap_item);
+		ksm_scan_scanned++;
+		if (!PageKsm(page) || !in_stable_tree(rmap_item)) {
+			if (rmap_item->skips) {
+				rmap_item->skips--;
+				ksm_pages_skipped++;
+			} else
+				cmp_and_merge_page(page, rmap_item);
+		}
 		put_page(page);
 	}
 }
@@ -1442,8 +1578,11 @@ static int ksm_scan_thread(void *nothing)
 		try_to_freeze();
 
 		if (ksmd_should_run()) {
-			schedule_timeout_interruptible(
-				msecs_to_jiffies(ksm_thread_sleep_millisecs));
+			unsigned int sleep = ksm_thread_sleep_millisecs;
+
+			if (ksm_adaptive_scan)
+				sleep = ksm_cur_sleep_millisecs;
+			schedule_timeout_interruptible(msecs_to_jiffies(sleep));
 		} else {
 			wait_event_freezable(ksm_thread_wait,
 				ksmd_should_run() || kthread_should_stop());
@@ -1844,11 +1983,67 @@ static ssize_t sleep_millisecs_store(struct kobject *kobj,
 		return -EINVAL;
 
 	ksm_thread_sleep_millisecs = msecs;
+	ksm_cur_sleep_millisecs = msecs;
 
 	return count;
 }
 KSM_ATTR(sleep_millisecs);
 
+static ssize_t adaptive_scan_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_adaptive_scan);
+}
+
+static ssize_t adaptive_scan_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	unsigned long enable;
+	int err;
+
+	err = strict_strtoul(buf, 10, &enable);
+	if (err || enable > 1)
+		return -EINVAL;
+
+	ksm_adaptive_scan = enable;
+	ksm_cur_sleep_millisecs = ksm_thread_sleep_millisecs;
+
+	return count;
+}
+KSM_ATTR(adaptive_scan);
+
+static ssize_t max_sleep_millisecs_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_max_sleep_millisecs);
+}
+
+static ssize_t max_sleep_millisecs_store(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &msecs);
+	if (err || msecs > UINT_MAX)
+		return -EINVAL;
+
+	ksm_max_sleep_millisecs = msecs;
+
+	return count;
+}
+KSM_ATTR(max_sleep_millisecs);
+
+static ssize_t cur_sleep_millisecs_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_adaptive_scan ?
+		       ksm_cur_sleep_millisecs : ksm_thread_sleep_millisecs);
+}
+KSM_ATTR_RO(cur_sleep_millisecs);
+
 static ssize_t pages_to_scan_show(struct kobject *kobj,
 				  struct kobj_attribute *attr, char *buf)
 {
@@ -1966,14 +2161,25 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_skipped);
+}
+KSM_ATTR_RO(pages_skipped);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
 	&run_attr.attr,
+	&adaptive_scan_attr.attr,
+	&max_sleep_millisecs_attr.attr,
+	&cur_sleep_millisecs_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
+	&pages_skipped_attr.attr,
 	&full_scans_attr.attr,
 	NULL,
 };
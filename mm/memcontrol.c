@@ -204,6 +204,7 @@ struct mem_cgroup_eventfd_list {
 
 static void mem_cgroup_threshold(struct mem_cgroup *mem);
 static void mem_cgroup_oom_notify(struct mem_cgroup *mem);
+static void mem_cgroup_check_wmark(struct mem_cgroup *mem);
 
 /*
  * The memory controller data structure. The memory controller controls both
@@ -211,10 +212,9 @@ static void mem_cgroup_oom_notify(struct mem_cgroup *mem);
  * statistics based on the statistics developed by Rik Van Riel for clock-pro,
  * to help the administrator determine what knobs to tune.
  *
- * TODO: Add a water mark for the memory controller. Reclaim will begin when
- * we hit the water mark. May be even add a low water mark, such that
- * no reclaim occurs from a cgroup at it's low water mark, this is
- * a feature that will be implemented much later in the future.
+ * With memory.wmark_ratio set, a cgroup whose usage crosses its high
+ * water mark is reclaimed in the background down to its low water mark,
+ * before its tasks run into the limit themselves.
  */
 struct mem_cgroup {
 	struct cgroup_subsys_state css;
@@ -268,6 +268,18 @@ struct mem_cgroup {
 	/* For oom notifier event fd */
 	struct list_head oom_notify;
 
+	/*
+	 * Background reclaim water marks, in pages, derived from the limit
+	 * and wmark_ratio under set_limit_mutex.  Usage above high_wmark
+	 * queues bgreclaim_work, which reclaims down to low_wmark.
+	 */
+	unsigned int	wmark_ratio;
+	unsigned long	high_wmark;
+	unsigned long	low_wmark;
+	struct work_struct bgreclaim_work;
+	unsigned long	bgreclaim_runs;
+	unsigned long	bgreclaim_pages;
+
 	/*
 	 * Should we move charges of a task when a task is moved into this
 	 * mem_cgroup ? And what type of charges should we move ?
@@ -702,6 +714,7 @@ static void memcg_check_events(struct mem_cgroup *mem, struct page *page)
 	/* threshold event is triggered in finer grain than soft limit */
 	if (unlikely(__memcg_event_check(mem, MEM_CGROUP_TARGET_THRESH))) {
 		mem_cgroup_threshold(mem);
+		mem_cgroup_check_wmark(mem);
 		__mem_cgroup_target_update(mem, MEM_CGROUP_TARGET_THRESH);
 		if (unlikely(__memcg_event_check(mem,
 			     MEM_CGROUP_TARGET_SOFTLIMIT))) {
@@ -1800,6 +1813,82 @@ static int mem_cgroup_hierarchical_reclaim(struct mem_cgroup *root_mem,
 	return total;
 }
 
+/*
+ * Background reclaim.  Reclaim for a cgroup normally starts only when a
+ * charge fails, in the context of the task that is charging.  With water
+ * marks set, the usage is checked along with the thresholds and a cgroup
+ * above its high water mark is shrunk to its low water mark from a
+ * workqueue, so that its tasks rarely have to reclaim themselves.
+ */
+static struct workqueue_struct *memcg_bgreclaim_wq;
+
+static unsigned long mem_cgroup_usage_pages(struct mem_cgroup *mem)
+{
+	return res_counter_read_u64(&mem->res, RES_USAGE) >> PAGE_SHIFT;
+}
+
+/*
+ * The high water mark is wmark_ratio percent of the limit; reclaim then
+ * goes on until half of the remaining headroom is free again.
+ */
+static void mem_cgroup_update_wmarks(struct mem_cgroup *mem)
+{
+	u64 limit = res_counter_read_u64(&mem->res, RES_LIMIT);
+	unsigned long limit_pages, high;
+
+	if (!mem->wmark_ratio || limit == RESOURCE_MAX) {
+		mem->high_wmark = ULONG_MAX;
+		mem->low_wmark = ULONG_MAX;
+		return;
+	}
+	limit_pages = limit >> PAGE_SHIFT;
+	high = limit_pages / 100 * mem->wmark_ratio +
+		limit_pages % 100 * mem->wmark_ratio / 100;
+	mem->low_wmark = high - (limit_pages - high) / 2;
+	mem->high_wmark = high;
+}
+
+static void mem_cgroup_bgreclaim(struct work_struct *work)
+{
+	struct mem_cgroup *mem = container_of(work, struct mem_cgroup,
+					      bgreclaim_work);
+	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
+
+	mem->bgreclaim_runs++;
+	while (mem_cgroup_usage_pages(mem) > mem->low_wmark) {
+		int progress;
+
+		if (css_is_removed(&mem->css))
+			break;
+		progress = mem_cgroup_hierarchical_reclaim(mem, NULL,
+					GFP_KERNEL, MEM_CGROUP_RECLAIM_SHRINK,
+					NULL);
+		mem->bgreclaim_pages += progress;
+		if (!progress && !--nr_retries)
+			break;
+		cond_resched();
+	}
+	mem_cgroup_put(mem);
+}
+
+/*
+ * Called from the charge and uncharge paths, with the threshold events.
+ * A charge counts against every ancestor with use_hierarchy, so check
+ * their water marks as well.
+ */
+static void mem_cgroup_check_wmark(struct mem_cgroup *mem)
+{
+	for (; mem; mem = parent_mem_cgroup(mem)) {
+		if (mem_cgroup_usage_pages(mem) <= mem->high_wmark)
+			continue;
+		if (!memcg_bgreclaim_wq || work_pending(&mem->bgreclaim_work))
+			continue;
+		mem_cgroup_get(mem);
+		if (!queue_work(memcg_bgreclaim_wq, &mem->bgreclaim_work))
+			mem_cgroup_put(mem);
+	}
+}
+
 /*
  * Check OOM-Killer is already running under our hierarchy.
  * If someone is running, return false.
@@ -3518,6 +3607,7 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 				memcg->memsw_is_minimum = true;
 			else
 				memcg->memsw_is_minimum = false;
+			mem_cgroup_update_wmarks(memcg);
 		}
 		mutex_unlock(&set_limit_mutex);
 
@@ -4284,6 +4374,46 @@ static int mem_control_stat_show(struct cgroup *cont, struct cftype *cft,
 	return 0;
 }
 
+static u64 mem_cgroup_wmark_ratio_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	return mem_cgroup_from_cont(cgrp)->wmark_ratio;
+}
+
+static int mem_cgroup_wmark_ratio_write(struct cgroup *cgrp,
+					struct cftype *cft, u64 val)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	/* The root cgroup has no limit to derive water marks from */
+	if (val > 99 || cgrp->parent == NULL)
+		return -EINVAL;
+
+	mutex_lock(&set_limit_mutex);
+	memcg->wmark_ratio = val;
+	mem_cgroup_update_wmarks(memcg);
+	mutex_unlock(&set_limit_mutex);
+
+	return 0;
+}
+
+static int mem_cgroup_wmarks_read(struct cgroup *cgrp, struct cftype *cft,
+				  struct cgroup_map_cb *cb)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	u64 high = RESOURCE_MAX, low = RESOURCE_MAX;
+
+	if (memcg->high_wmark != ULONG_MAX) {
+		high = (u64)memcg->high_wmark << PAGE_SHIFT;
+		low = (u64)memcg->low_wmark << PAGE_SHIFT;
+	}
+	cb->fill(cb, "high_wmark", high);
+	cb->fill(cb, "low_wmark", low);
+	cb->fill(cb, "bgreclaim_runs", memcg->bgreclaim_runs);
+	cb->fill(cb, "bgreclaim_pages", memcg->bgreclaim_pages);
+
+	return 0;
+}
+
 static u64 mem_cgroup_swappiness_read(struct cgroup *cgrp, struct cftype *cft)
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
@@ -4723,6 +4853,15 @@ static struct cftype mem_cgroup_files[] = {
 		.read_u64 = mem_cgroup_move_charge_read,
 		.write_u64 = mem_cgroup_move_charge_write,
 	},
+	{
+		.name = "wmark_ratio",
+		.read_u64 = mem_cgroup_wmark_ratio_read,
+		.write_u64 = mem_cgroup_wmark_ratio_write,
+	},
+	{
+		.name = "reclaim_wmarks",
+		.read_map = mem_cgroup_wmarks_read,
+	},
 	{
 		.name = "oom_control",
 		.read_map = mem_cgroup_oom_control_read,
@@ -4972,6 +5111,11 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 			INIT_WORK(&stock->work, drain_local_stock);
 		}
 		hotcpu_notifier(memcg_cpu_hotplug_callback, 0);
+		memcg_bgreclaim_wq = alloc_workqueue("memcg_bgreclaim",
+						     WQ_UNBOUND | WQ_FREEZABLE,
+						     0);
+		if (!memcg_bgreclaim_wq)
+			goto free_out;
 	} else {
 		parent = mem_cgroup_from_cont(cont->parent);
 		mem->use_hierarchy = parent->use_hierarchy;
@@ -4995,6 +5139,8 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 	mem->last_scanned_child = 0;
 	mem->last_scanned_node = MAX_NUMNODES;
 	INIT_LIST_HEAD(&mem->oom_notify);
+	INIT_WORK(&mem->bgreclaim_work, mem_cgroup_bgreclaim);
+	mem_cgroup_update_wmarks(mem);
 
 	if (parent)
 		mem->swappiness = get_swappiness(parent);
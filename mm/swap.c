@@ -31,15 +31,154 @@
 #include <linux/backing-dev.h>
 #include <linux/memcontrol.h>
 #include <linux/gfp.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "internal.h"
 
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
 
-static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
-static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
-static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
+/*
+ * The per-cpu LRU caches hold more pages than a pagevec.  Each drain takes
+ * zone->lru_lock once per zone run, so a bigger batch means fewer trips
+ * to a contended lock.  31 pointers and a count fill 128 bytes on 32-bit.
+ */
+#define LRU_PVEC_SIZE	31
+
+struct lru_pvec {
+	unsigned long nr;
+	struct page *pages[LRU_PVEC_SIZE];
+};
+
+static inline unsigned lru_pvec_count(struct lru_pvec *pvec)
+{
+	return pvec->nr;
+}
+
+/*
+ * Add a page to an lru_pvec.  Returns the number of slots still available,
+ * so a zero return means the batch is full and must be drained.
+ */
+static inline unsigned lru_pvec_add(struct lru_pvec *pvec, struct page *page)
+{
+	pvec->pages[pvec->nr++] = page;
+	return LRU_PVEC_SIZE - pvec->nr;
+}
+
+static DEFINE_PER_CPU(struct lru_pvec[NR_LRU_LISTS], lru_add_pvecs);
+static DEFINE_PER_CPU(struct lru_pvec, lru_rotate_pvecs);
+static DEFINE_PER_CPU(struct lru_pvec, lru_deactivate_pvecs);
+static DEFINE_PER_CPU(struct lru_pvec, activate_page_pvecs);
+
+#ifdef CONFIG_LRU_LOCK_STAT
+struct lru_lock_stat {
+	unsigned long acquired;		/* lock round trips */
+	unsigned long contended;	/* of which had to spin */
+	unsigned long pages;		/* pages handled under the lock */
+	u64 wait_ns;
+	u64 hold_ns;
+	u64 max_hold_ns;
+	u64 locked_at;			/* clock at the current acquisition */
+};
+
+static DEFINE_PER_CPU(struct lru_lock_stat, lru_lock_stats);
+
+/* Called with interrupts disabled */
+void __lru_lock(struct zone *zone)
+{
+	struct lru_lock_stat *stat = &__get_cpu_var(lru_lock_stats);
+	u64 start = local_clock();
+
+	stat->acquired++;
+	if (!spin_trylock(&zone->lru_lock)) {
+		spin_lock(&zone->lru_lock);
+		stat->contended++;
+		stat->locked_at = local_clock();
+		stat->wait_ns += stat->locked_at - start;
+	} else
+		stat->locked_at = start;
+}
+
+void __lru_unlock(struct zone *zone, unsigned long nr_pages)
+{
+	struct lru_lock_stat *stat = &__get_cpu_var(lru_lock_stats);
+	u64 held = local_clock() - stat->locked_at;
+
+	spin_unlock(&zone->lru_lock);
+
+	stat->pages += nr_pages;
+	stat->hold_ns += held;
+	if (held > stat->max_hold_ns)
+		stat->max_hold_ns = held;
+}
+
+static int lru_lock_stat_show(struct seq_file *m, void *v)
+{
+	struct lru_lock_stat sum;
+	int cpu;
+
+	memset(&sum, 0, sizeof(sum));
+	seq_printf(m, "%-6s %12s %12s %14s %14s %12s %12s\n",
+		   "cpu", "acquired", "contended", "wait_ns", "hold_ns",
+		   "max_hold_ns", "pages");
+	for_each_online_cpu(cpu) {
+		struct lru_lock_stat *stat = &per_cpu(lru_lock_stats, cpu);
+
+		seq_printf(m, "%-6d %12lu %12lu %14llu %14llu %12llu %12lu\n",
+			   cpu, stat->acquired, stat->contended,
+			   (unsigned long long)stat->wait_ns,
+			   (unsigned long long)stat->hold_ns,
+			   (unsigned long long)stat->max_hold_ns,
+			   stat->pages);
+		sum.acquired += stat->acquired;
+		sum.contended += stat->contended;
+		sum.pages += stat->pages;
+		sum.wait_ns += stat->wait_ns;
+		sum.hold_ns += stat->hold_ns;
+		sum.max_hold_ns = max(sum.max_hold_ns, stat->max_hold_ns);
+	}
+	seq_printf(m, "%-6s %12lu %12lu %14llu %14llu %12llu %12lu\n",
+		   "all", sum.acquired, sum.contended,
+		   (unsigned long long)sum.wait_ns,
+		   (unsigned long long)sum.hold_ns,
+		   (unsigned long long)sum.max_hold_ns, sum.pages);
+	return 0;
+}
+
+static int lru_lock_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lru_lock_stat_show, NULL);
+}
+
+/* Any write resets the counters; racing updates may survive the reset */
+static ssize_t lru_lock_stat_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(&per_cpu(lru_lock_stats, cpu), 0,
+		       sizeof(struct lru_lock_stat));
+	return count;
+}
+
+static const struct file_operations lru_lock_stat_fops = {
+	.open		= lru_lock_stat_open,
+	.read		= seq_read,
+	.write		= lru_lock_stat_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init lru_lock_stat_init(void)
+{
+	debugfs_create_file("lru_lock_stat", 0644, NULL, NULL,
+			    &lru_lock_stat_fops);
+	return 0;
+}
+late_initcall(lru_lock_stat_init);
+#endif /* CONFIG_LRU_LOCK_STAT */
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -51,11 +190,11 @@ static void __page_cache_release(struct page *page)
 		unsigned long flags;
 		struct zone *zone = page_zone(page);
 
-		spin_lock_irqsave(&zone->lru_lock, flags);
+		lru_lock_irqsave(zone, flags);
 		VM_BUG_ON(!PageLRU(page));
 		__ClearPageLRU(page);
 		del_page_from_lru(zone, page);
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+		lru_unlock_irqrestore(zone, flags, 1);
 	}
 }
 
@@ -202,33 +341,56 @@ void put_pages_list(struct list_head *pages)
 }
 EXPORT_SYMBOL(put_pages_list);
 
-static void pagevec_lru_move_fn(struct pagevec *pvec,
-				void (*move_fn)(struct page *page, void *arg),
-				void *arg)
+/*
+ * Apply @move_fn to each page under its zone's lru_lock, holding the lock
+ * across runs of pages from the same zone, then drop the references the
+ * batch held.
+ */
+static void lru_move_fn(struct page **pages, int nr, int cold,
+			void (*move_fn)(struct page *page, void *arg),
+			void *arg)
 {
 	int i;
 	struct zone *zone = NULL;
 	unsigned long flags = 0;
+	unsigned long held = 0;
 
-	for (i = 0; i < pagevec_count(pvec); i++) {
-		struct page *page = pvec->pages[i];
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
 		struct zone *pagezone = page_zone(page);
 
 		if (pagezone != zone) {
 			if (zone)
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
+				lru_unlock_irqrestore(zone, flags, held);
 			zone = pagezone;
-			spin_lock_irqsave(&zone->lru_lock, flags);
+			held = 0;
+			lru_lock_irqsave(zone, flags);
 		}
 
 		(*move_fn)(page, arg);
+		held++;
 	}
 	if (zone)
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
-	release_pages(pvec->pages, pvec->nr, pvec->cold);
+		lru_unlock_irqrestore(zone, flags, held);
+	release_pages(pages, nr, cold);
+}
+
+static void pagevec_lru_move_fn(struct pagevec *pvec,
+				void (*move_fn)(struct page *page, void *arg),
+				void *arg)
+{
+	lru_move_fn(pvec->pages, pagevec_count(pvec), pvec->cold, move_fn, arg);
 	pagevec_reinit(pvec);
 }
 
+static void lru_pvec_move_fn(struct lru_pvec *pvec,
+			     void (*move_fn)(struct page *page, void *arg),
+			     void *arg)
+{
+	lru_move_fn(pvec->pages, lru_pvec_count(pvec), 0, move_fn, arg);
+	pvec->nr = 0;
+}
+
 static void pagevec_move_tail_fn(struct page *page, void *arg)
 {
 	int *pgmoved = arg;
@@ -236,7 +398,7 @@ static void pagevec_move_tail_fn(struct page *page, void *arg)
 
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 		enum lru_list lru = page_lru_base_type(page);
-		list_move_tail(&page->lru, &zone->lru[lru].list);
+		list_move_tail(&page->lru, zone_lru_head(zone, lru));
 		mem_cgroup_rotate_reclaimable_page(page);
 		(*pgmoved)++;
 	}
@@ -246,11 +408,11 @@ static void pagevec_move_tail_fn(struct page *page, void *arg)
  * pagevec_move_tail() must be called with IRQ disabled.
  * Otherwise this may cause nasty races.
  */
-static void pagevec_move_tail(struct pagevec *pvec)
+static void pagevec_move_tail(struct lru_pvec *pvec)
 {
 	int pgmoved = 0;
 
-	pagevec_lru_move_fn(pvec, pagevec_move_tail_fn, &pgmoved);
+	lru_pvec_move_fn(pvec, pagevec_move_tail_fn, &pgmoved);
 	__count_vm_events(PGROTATED, pgmoved);
 }
 
@@ -263,13 +425,13 @@ void rotate_reclaimable_page(struct page *page)
 {
 	if (!PageLocked(page) && !PageDirty(page) && !PageActive(page) &&
 	    !PageUnevictable(page) && PageLRU(page)) {
-		struct pagevec *pvec;
+		struct lru_pvec *pvec;
 		unsigned long flags;
 
 		page_cache_get(page);
 		local_irq_save(flags);
 		pvec = &__get_cpu_var(lru_rotate_pvecs);
-		if (!pagevec_add(pvec, page))
+		if (!lru_pvec_add(pvec, page))
 			pagevec_move_tail(pvec);
 		local_irq_restore(flags);
 	}
@@ -313,44 +475,30 @@ static void __activate_page(struct page *page, void *arg)
 	}
 }
 
-#ifdef CONFIG_SMP
-static DEFINE_PER_CPU(struct pagevec, activate_page_pvecs);
-
+/*
+ * Activations are batched on UP as well: mark_page_accessed() is hot
+ * enough that the irq-off round trip per page shows up there too.
+ */
 static void activate_page_drain(int cpu)
 {
-	struct pagevec *pvec = &per_cpu(activate_page_pvecs, cpu);
+	struct lru_pvec *pvec = &per_cpu(activate_page_pvecs, cpu);
 
-	if (pagevec_count(pvec))
-		pagevec_lru_move_fn(pvec, __activate_page, NULL);
+	if (lru_pvec_count(pvec))
+		lru_pvec_move_fn(pvec, __activate_page, NULL);
 }
 
 void activate_page(struct page *page)
 {
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
-		struct pagevec *pvec = &get_cpu_var(activate_page_pvecs);
+		struct lru_pvec *pvec = &get_cpu_var(activate_page_pvecs);
 
 		page_cache_get(page);
-		if (!pagevec_add(pvec, page))
-			pagevec_lru_move_fn(pvec, __activate_page, NULL);
+		if (!lru_pvec_add(pvec, page))
+			lru_pvec_move_fn(pvec, __activate_page, NULL);
 		put_cpu_var(activate_page_pvecs);
 	}
 }
 
-#else
-static inline void activate_page_drain(int cpu)
-{
-}
-
-void activate_page(struct page *page)
-{
-	struct zone *zone = page_zone(page);
-
-	spin_lock_irq(&zone->lru_lock);
-	__activate_page(page, NULL);
-	spin_unlock_irq(&zone->lru_lock);
-}
-#endif
-
 /*
  * Mark a page as having seen activity.
  *
@@ -364,6 +512,8 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -371,13 +521,15 @@ void mark_page_accessed(struct page *page)
 
 EXPORT_SYMBOL(mark_page_accessed);
 
+static void lru_pvec_add_drain(struct lru_pvec *pvec, enum lru_list lru);
+
 void __lru_cache_add(struct page *page, enum lru_list lru)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvecs)[lru];
+	struct lru_pvec *pvec = &get_cpu_var(lru_add_pvecs)[lru];
 
 	page_cache_get(page);
-	if (!pagevec_add(pvec, page))
-		____pagevec_lru_add(pvec, lru);
+	if (!lru_pvec_add(pvec, page))
+		lru_pvec_add_drain(pvec, lru);
 	put_cpu_var(lru_add_pvecs);
 }
 EXPORT_SYMBOL(__lru_cache_add);
@@ -415,11 +567,11 @@ void add_page_to_unevictable_list(struct page *page)
 {
 	struct zone *zone = page_zone(page);
 
-	spin_lock_irq(&zone->lru_lock);
+	lru_lock_irq(zone);
 	SetPageUnevictable(page);
 	SetPageLRU(page);
 	add_page_to_lru_list(zone, page, LRU_UNEVICTABLE);
-	spin_unlock_irq(&zone->lru_lock);
+	lru_unlock_irq(zone, 1);
 }
 
 /*
@@ -480,7 +632,7 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 		 * The page's writeback ends up during pagevec
 		 * We moves tha page into tail of inactive.
 		 */
-		list_move_tail(&page->lru, &zone->lru[lru].list);
+		list_move_tail(&page->lru, zone_lru_head(zone, lru));
 		mem_cgroup_rotate_reclaimable_page(page);
 		__count_vm_event(PGROTATED);
 	}
@@ -497,18 +649,18 @@ static void lru_deactivate_fn(struct page *page, void *arg)
  */
 static void drain_cpu_pagevecs(int cpu)
 {
-	struct pagevec *pvecs = per_cpu(lru_add_pvecs, cpu);
-	struct pagevec *pvec;
+	struct lru_pvec *pvecs = per_cpu(lru_add_pvecs, cpu);
+	struct lru_pvec *pvec;
 	int lru;
 
 	for_each_lru(lru) {
 		pvec = &pvecs[lru - LRU_BASE];
-		if (pagevec_count(pvec))
-			____pagevec_lru_add(pvec, lru);
+		if (lru_pvec_count(pvec))
+			lru_pvec_add_drain(pvec, lru);
 	}
 
 	pvec = &per_cpu(lru_rotate_pvecs, cpu);
-	if (pagevec_count(pvec)) {
+	if (lru_pvec_count(pvec)) {
 		unsigned long flags;
 
 		/* No harm done if a racing interrupt already did this */
@@ -518,8 +670,8 @@ static void drain_cpu_pagevecs(int cpu)
 	}
 
 	pvec = &per_cpu(lru_deactivate_pvecs, cpu);
-	if (pagevec_count(pvec))
-		pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
+	if (lru_pvec_count(pvec))
+		lru_pvec_move_fn(pvec, lru_deactivate_fn, NULL);
 
 	activate_page_drain(cpu);
 }
@@ -542,10 +694,10 @@ void deactivate_page(struct page *page)
 		return;
 
 	if (likely(get_page_unless_zero(page))) {
-		struct pagevec *pvec = &get_cpu_var(lru_deactivate_pvecs);
+		struct lru_pvec *pvec = &get_cpu_var(lru_deactivate_pvecs);
 
-		if (!pagevec_add(pvec, page))
-			pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
+		if (!lru_pvec_add(pvec, page))
+			lru_pvec_move_fn(pvec, lru_deactivate_fn, NULL);
 		put_cpu_var(lru_deactivate_pvecs);
 	}
 }
@@ -588,6 +740,7 @@ void release_pages(struct page **pages, int nr, int cold)
 	struct pagevec pages_to_free;
 	struct zone *zone = NULL;
 	unsigned long uninitialized_var(flags);
+	unsigned long held = 0;
 
 	pagevec_init(&pages_to_free, cold);
 	for (i = 0; i < nr; i++) {
@@ -595,7 +748,7 @@ void release_pages(struct page **pages, int nr, int cold)
 
 		if (unlikely(PageCompound(page))) {
 			if (zone) {
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
+				lru_unlock_irqrestore(zone, flags, held);
 				zone = NULL;
 			}
 			put_compound_page(page);
@@ -610,19 +763,21 @@ void release_pages(struct page **pages, int nr, int cold)
 
 			if (pagezone != zone) {
 				if (zone)
-					spin_unlock_irqrestore(&zone->lru_lock,
-									flags);
+					lru_unlock_irqrestore(zone, flags,
+							      held);
 				zone = pagezone;
-				spin_lock_irqsave(&zone->lru_lock, flags);
+				held = 0;
+				lru_lock_irqsave(zone, flags);
 			}
 			VM_BUG_ON(!PageLRU(page));
 			__ClearPageLRU(page);
 			del_page_from_lru(zone, page);
+			held++;
 		}
 
 		if (!pagevec_add(&pages_to_free, page)) {
 			if (zone) {
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
+				lru_unlock_irqrestore(zone, flags, held);
 				zone = NULL;
 			}
 			__pagevec_free(&pages_to_free);
@@ -630,7 +785,7 @@ void release_pages(struct page **pages, int nr, int cold)
   		}
 	}
 	if (zone)
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+		lru_unlock_irqrestore(zone, flags, held);
 
 	pagevec_free(&pages_to_free);
 }
@@ -684,7 +839,7 @@ void lru_add_page_tail(struct zone* zone,
 		if (likely(PageLRU(page)))
 			head = page->lru.prev;
 		else
-			head = &zone->lru[lru].list;
+			head = zone_lru_head(zone, lru);
 		__add_page_to_lru_list(zone, page_tail, lru, head);
 	} else {
 		SetPageUnevictable(page_tail);
@@ -723,6 +878,13 @@ void ____pagevec_lru_add(struct pagevec *pvec, enum lru_list lru)
 
 EXPORT_SYMBOL(____pagevec_lru_add);
 
+static void lru_pvec_add_drain(struct lru_pvec *pvec, enum lru_list lru)
+{
+	VM_BUG_ON(is_unevictable_lru(lru));
+
+	lru_pvec_move_fn(pvec, ____pagevec_lru_add_fn, (void *)lru);
+}
+
 /*
  * Try to drop buffers from the pages in a pagevec
  */
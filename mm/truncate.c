@@ -217,12 +217,13 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	int i;
 
 	cleancache_flush_inode(mapping);
-	if (mapping->nrpages == 0)
-		return;
-
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
 	end = (lend >> PAGE_CACHE_SHIFT);
 
+	workingset_forget_shadows(mapping, start, end);
+	if (mapping->nrpages == 0)
+		return;
+
 	pagevec_init(&pvec, 0);
 	next = start;
 	while (next <= end &&
@@ -479,13 +479,23 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
 
 /*
  * Same as remove_mapping, but if the page is removed from the mapping, it
- * gets returned with a refcount of 0.
+ * gets returned with a refcount of 0.  @reclaimed tells whether the page
+ * is being evicted, in which case a shadow entry is stored in its place
+ * for workingset detection.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
+	bool preloaded = false;
+
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
 
+	/* the shadow's tree nodes, without touching the reserves */
+	if (reclaimed && page_is_file_cache(page))
+		preloaded = !radix_tree_preload(GFP_NOWAIT | __GFP_NOMEMALLOC |
+						__GFP_NOWARN);
+
 	spin_lock_irq(&mapping->tree_lock);
 	/*
 	 * The non racy check for a busy page.
@@ -527,11 +537,18 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
 
+		if (reclaimed && page_is_file_cache(page))
+			shadow = workingset_eviction(mapping, page);
 		__delete_from_page_cache(page);
+		if (shadow && preloaded)
+			workingset_store_shadow(mapping, page->index, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
+		if (preloaded)
+			radix_tree_preload_end();
 		mem_cgroup_uncharge_cache_page(page);
 
 		if (freepage != NULL)
@@ -542,6 +559,8 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 
 cannot_free:
 	spin_unlock_irq(&mapping->tree_lock);
+	if (preloaded)
+		radix_tree_preload_end();
 	return 0;
 }
 
@@ -553,7 +572,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -901,7 +920,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -1233,7 +1252,7 @@ int isolate_lru_page(struct page *page)
 	if (PageLRU(page)) {
 		struct zone *zone = page_zone(page);
 
-		spin_lock_irq(&zone->lru_lock);
+		lru_lock_irq(zone);
 		if (PageLRU(page)) {
 			int lru = page_lru(page);
 			ret = 0;
@@ -1242,7 +1261,7 @@ int isolate_lru_page(struct page *page)
 
 			del_page_from_lru_list(zone, page, lru);
 		}
-		spin_unlock_irq(&zone->lru_lock);
+		lru_unlock_irq(zone, !ret);
 	}
 	return ret;
 }
@@ -1419,7 +1438,7 @@ shrink_inactive_list(unsigned long nr_to_scan, struct zone *zone,
 
 	set_reclaim_mode(priority, sc, false);
 	lru_add_drain();
-	spin_lock_irq(&zone->lru_lock);
+	lru_lock_irq(zone);
 
 	if (scanning_global_lru(sc)) {
 		nr_taken = isolate_pages_global(nr_to_scan,
@@ -1448,13 +1467,13 @@ shrink_inactive_list(unsigned long nr_to_scan, struct zone *zone,
 	}
 
 	if (nr_taken == 0) {
-		spin_unlock_irq(&zone->lru_lock);
+		lru_unlock_irq(zone, 0);
 		return 0;
 	}
 
 	update_isolated_counts(zone, sc, &nr_anon, &nr_file, &page_list);
 
-	spin_unlock_irq(&zone->lru_lock);
+	lru_unlock_irq(zone, nr_taken);
 
 	nr_reclaimed = shrink_page_list(&page_list, zone, sc);
 
@@ -1513,7 +1532,7 @@ static void move_active_pages_to_lru(struct zone *zone,
 		VM_BUG_ON(PageLRU(page));
 		SetPageLRU(page);
 
-		list_move(&page->lru, &zone->lru[lru].list);
+		list_move(&page->lru, zone_lru_head(zone, lru));
 		mem_cgroup_add_lru_list(page, lru);
 		pgmoved += hpage_nr_pages(page);
 
@@ -1544,7 +1563,7 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 	unsigned long nr_rotated = 0;
 
 	lru_add_drain();
-	spin_lock_irq(&zone->lru_lock);
+	lru_lock_irq(zone);
 	if (scanning_global_lru(sc)) {
 		nr_taken = isolate_pages_global(nr_pages, &l_hold,
 						&pgscanned, sc->order,
@@ -1570,7 +1589,7 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 	else
 		__mod_zone_page_state(zone, NR_ACTIVE_ANON, -nr_taken);
 	__mod_zone_page_state(zone, NR_ISOLATED_ANON + file, nr_taken);
-	spin_unlock_irq(&zone->lru_lock);
+	lru_unlock_irq(zone, nr_taken);
 
 	while (!list_empty(&l_hold)) {
 		cond_resched();
@@ -1606,7 +1625,7 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 	/*
 	 * Move pages back to the lru list.
 	 */
-	spin_lock_irq(&zone->lru_lock);
+	lru_lock_irq(zone);
 	/*
 	 * Count referenced pages from currently used mappings as rotated,
 	 * even though only some of them are actually re-activated.  This
@@ -1620,7 +1639,7 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 	move_active_pages_to_lru(zone, &l_inactive,
 						LRU_BASE   + file * LRU_FILE);
 	__mod_zone_page_state(zone, NR_ISOLATED_ANON + file, -nr_taken);
-	spin_unlock_irq(&zone->lru_lock);
+	lru_unlock_irq(zone, nr_taken);
 }
 
 #ifdef CONFIG_SWAP
@@ -1656,9 +1675,12 @@ static int inactive_anon_is_low(struct zone *zone, struct scan_control *sc)
 	if (!total_swap_pages)
 		return 0;
 
-	if (scanning_global_lru(sc))
+	if (scanning_global_lru(sc)) {
+		/* the generations age anon pages on their own */
+		if (lru_gen_enabled(zone))
+			return 0;
 		low = inactive_anon_is_low_global(zone);
-	else
+	} else
 		low = mem_cgroup_inactive_anon_is_low(sc->mem_cgroup);
 	return low;
 }
@@ -1928,6 +1950,557 @@ static inline bool should_continue_reclaim(struct zone *zone,
 	}
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-generational LRU.
+ *
+ * Evictable pages of a zone are sorted into generations instead of the
+ * active/inactive lists.  Eviction always takes pages from the oldest
+ * generation of a type; once that runs dry its min_seq moves on.  When
+ * only MIN_NR_GENS generations are left, the zones of the node are aged:
+ * a new youngest generation is opened and kswapd walks the page tables
+ * of all processes, moving every page whose accessed bit was set into
+ * it.  Pages referenced through page tables thus survive a full trip
+ * across the generations, while a single rmap walk at eviction time
+ * still catches references that happened in between.
+ *
+ * Only global reclaim uses the generations, memcg reclaim keeps working
+ * on the memcg LRU lists.
+ */
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+static DEFINE_MUTEX(lru_gen_walk_mutex);
+static DEFINE_MUTEX(lru_gen_state_mutex);
+
+void lru_gen_init_zone(struct zone *zone)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	int gen, file;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		for (file = 0; file < 2; file++)
+			INIT_LIST_HEAD(&lrugen->lists[gen][file]);
+	lrugen->max_seq = MIN_NR_GENS - 1;
+	lrugen->min_seq[0] = lrugen->min_seq[1] = 0;
+#ifdef CONFIG_LRU_GEN_ENABLED
+	lrugen->enabled = 1;
+#else
+	lrugen->enabled = 0;
+#endif
+}
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_del_init(&mm->lru_gen_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+/*
+ * Returns the next mm on lru_gen_mm_list after @prev with a reference
+ * held, and drops the reference on @prev.  Holding mm_users keeps @prev
+ * on the list, so it is a stable cursor across the unlocked walk.
+ */
+static struct mm_struct *lru_gen_next_mm(struct mm_struct *prev)
+{
+	struct mm_struct *mm = NULL;
+	struct list_head *pos;
+
+	spin_lock(&lru_gen_mm_lock);
+	pos = prev ? prev->lru_gen_list.next : lru_gen_mm_list.next;
+	for (; pos != &lru_gen_mm_list; pos = pos->next) {
+		struct mm_struct *next;
+
+		next = list_entry(pos, struct mm_struct, lru_gen_list);
+		if (atomic_inc_not_zero(&next->mm_users)) {
+			mm = next;
+			break;
+		}
+	}
+	spin_unlock(&lru_gen_mm_lock);
+
+	if (prev)
+		mmput(prev);
+	return mm;
+}
+
+struct lru_gen_walk {
+	struct vm_area_struct *vma;
+	struct pagevec pvec;
+	unsigned long nr_promoted;
+};
+
+/*
+ * Move the pages found young by the page table walk into the youngest
+ * generation of their zone.  Pages that are currently isolated are left
+ * alone, reclaim will see their referenced ptes through rmap.
+ */
+static void lru_gen_promote_pages(struct lru_gen_walk *args)
+{
+	struct pagevec *pvec = &args->pvec;
+	struct zone *zone = NULL;
+	int pgactivate = 0;
+	int i;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct zone *pagezone = page_zone(page);
+		enum lru_list lru;
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+
+		if (!PageLRU(page) || PageUnevictable(page) ||
+		    !lru_gen_enabled(zone))
+			continue;
+
+		lru = page_lru(page);
+		del_page_from_lru_list(zone, page, lru);
+		if (!PageActive(page)) {
+			SetPageActive(page);
+			lru += LRU_ACTIVE;
+			zone->reclaim_stat.recent_rotated[is_file_lru(lru)]++;
+			workingset_activation(page);
+			pgactivate++;
+		}
+		add_page_to_lru_list(zone, page, lru);
+		args->nr_promoted++;
+	}
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+
+	count_vm_events(PGACTIVATE, pgactivate);
+	release_pages(pvec->pages, pagevec_count(pvec), pvec->cold);
+	pagevec_reinit(pvec);
+}
+
+static int lru_gen_walk_pmd(pmd_t *pmd, unsigned long addr,
+			    unsigned long end, struct mm_walk *walk)
+{
+	struct lru_gen_walk *args = walk->private;
+	struct vm_area_struct *vma = args->vma;
+	spinlock_t *ptl;
+	pte_t *pte, *orig_pte;
+
+	/* huge pmds are rare here, rmap still covers them at eviction */
+	if (pmd_trans_huge(*pmd) || pmd_bad(*pmd))
+		return 0;
+
+	while (addr != end) {
+		orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+		for (; addr != end; pte++, addr += PAGE_SIZE) {
+			struct page *page;
+
+			if (!pte_present(*pte) || !pte_young(*pte))
+				continue;
+			page = vm_normal_page(vma, addr, *pte);
+			if (!page || !PageLRU(page))
+				continue;
+			/*
+			 * No TLB flush: a stale young bit in the TLB only
+			 * delays the next update of this pte, which the
+			 * following aging pass will pick up.
+			 */
+			if (!ptep_test_and_clear_young(vma, addr, pte))
+				continue;
+			get_page(page);
+			if (!pagevec_add(&args->pvec, page)) {
+				addr += PAGE_SIZE;
+				break;
+			}
+		}
+		pte_unmap_unlock(orig_pte, ptl);
+
+		if (!pagevec_space(&args->pvec))
+			lru_gen_promote_pages(args);
+		cond_resched();
+	}
+	return 0;
+}
+
+static void lru_gen_walk_mm(struct mm_struct *mm, struct lru_gen_walk *args)
+{
+	struct vm_area_struct *vma;
+	struct mm_walk walk = {
+		.pmd_entry = lru_gen_walk_pmd,
+		.mm = mm,
+		.private = args,
+	};
+
+	if (!down_read_trylock(&mm->mmap_sem))
+		return;
+
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (vma->vm_flags & (VM_IO | VM_PFNMAP | VM_HUGETLB |
+				     VM_LOCKED | VM_RESERVED))
+			continue;
+		args->vma = vma;
+		walk_page_range(vma->vm_start, vma->vm_end, &walk);
+	}
+
+	up_read(&mm->mmap_sem);
+
+	if (pagevec_count(&args->pvec))
+		lru_gen_promote_pages(args);
+}
+
+/*
+ * Opens a new youngest generation.  When all MAX_NR_GENS generations of
+ * a type are in use, the oldest one is folded into the next oldest to
+ * make room.  Caller holds zone->lru_lock.
+ */
+static void lru_gen_inc_max_seq(struct zone *zone)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	int file;
+
+	for (file = 0; file < 2; file++) {
+		unsigned long seq = lrugen->min_seq[file];
+
+		if (lrugen->max_seq - seq + 1 < MAX_NR_GENS)
+			continue;
+
+		list_splice_tail_init(&lrugen->lists[lru_gen_from_seq(seq)][file],
+				&lrugen->lists[lru_gen_from_seq(seq + 1)][file]);
+		lrugen->min_seq[file]++;
+	}
+	lrugen->max_seq++;
+}
+
+/*
+ * Drops empty oldest generations, never going past max_seq.  Caller
+ * holds zone->lru_lock.
+ */
+static void lru_gen_inc_min_seq(struct zone *zone, int file)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+
+	while (lrugen->min_seq[file] < lrugen->max_seq) {
+		int gen = lru_gen_from_seq(lrugen->min_seq[file]);
+
+		if (!list_empty(&lrugen->lists[gen][file]))
+			break;
+		lrugen->min_seq[file]++;
+	}
+}
+
+static bool lru_gen_need_aging(struct zone *zone, int file)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+
+	return ACCESS_ONCE(lrugen->max_seq) -
+	       ACCESS_ONCE(lrugen->min_seq[file]) + 1 <= MIN_NR_GENS;
+}
+
+/*
+ * Ages all zones of @pgdat by one generation.  Only kswapd walks the page
+ * tables: it may drop the last reference to an mm it visited, and direct
+ * reclaimers cannot afford to tear down an address space.
+ */
+static void lru_gen_age_node(pg_data_t *pgdat, bool walk_mms)
+{
+	int i;
+
+	for (i = 0; i < pgdat->nr_zones; i++) {
+		struct zone *zone = pgdat->node_zones + i;
+
+		if (!populated_zone(zone))
+			continue;
+		spin_lock_irq(&zone->lru_lock);
+		if (lru_gen_enabled(zone))
+			lru_gen_inc_max_seq(zone);
+		spin_unlock_irq(&zone->lru_lock);
+	}
+	count_vm_event(LRU_GEN_AGING);
+
+	if (walk_mms && mutex_trylock(&lru_gen_walk_mutex)) {
+		struct lru_gen_walk args;
+		struct mm_struct *mm = NULL;
+
+		args.nr_promoted = 0;
+		pagevec_init(&args.pvec, 0);
+		while ((mm = lru_gen_next_mm(mm))) {
+			lru_gen_walk_mm(mm, &args);
+			if (fatal_signal_pending(current)) {
+				mmput(mm);
+				break;
+			}
+		}
+		mutex_unlock(&lru_gen_walk_mutex);
+		count_vm_events(LRU_GEN_PROMOTED, args.nr_promoted);
+	}
+}
+
+/*
+ * Anon pages are evicted only with swap available, and a type without
+ * pages is never picked.  Otherwise the type whose oldest generation is
+ * older goes first.  On a tie, swappiness and the recently rotated /
+ * recently scanned ratios decide, as in get_scan_count().
+ */
+static int lru_gen_pick_type(struct zone *zone, struct scan_control *sc)
+{
+	struct zone_reclaim_stat *reclaim_stat = get_reclaim_stat(zone, sc);
+	struct lru_gen *lrugen = &zone->lrugen;
+	unsigned long anon, file;
+	unsigned long ap, fp;
+
+	if (!sc->may_swap || nr_swap_pages <= 0)
+		return 1;
+
+	anon = zone_nr_lru_pages(zone, sc, LRU_ACTIVE_ANON) +
+		zone_nr_lru_pages(zone, sc, LRU_INACTIVE_ANON);
+	file = zone_nr_lru_pages(zone, sc, LRU_ACTIVE_FILE) +
+		zone_nr_lru_pages(zone, sc, LRU_INACTIVE_FILE);
+	if (!file)
+		return 0;
+	if (!anon)
+		return 1;
+	if (lrugen->min_seq[0] != lrugen->min_seq[1])
+		return lrugen->min_seq[0] > lrugen->min_seq[1];
+
+	spin_lock_irq(&zone->lru_lock);
+	if (unlikely(reclaim_stat->recent_scanned[0] > anon / 4)) {
+		reclaim_stat->recent_scanned[0] /= 2;
+		reclaim_stat->recent_rotated[0] /= 2;
+	}
+	if (unlikely(reclaim_stat->recent_scanned[1] > file / 4)) {
+		reclaim_stat->recent_scanned[1] /= 2;
+		reclaim_stat->recent_rotated[1] /= 2;
+	}
+
+	ap = (sc->swappiness + 1) * (reclaim_stat->recent_scanned[0] + 1);
+	ap /= reclaim_stat->recent_rotated[0] + 1;
+
+	fp = (200 - sc->swappiness + 1) * (reclaim_stat->recent_scanned[1] + 1);
+	fp /= reclaim_stat->recent_rotated[1] + 1;
+	spin_unlock_irq(&zone->lru_lock);
+
+	return fp >= ap;
+}
+
+static unsigned long lru_gen_evict(struct zone *zone, struct scan_control *sc,
+				   int priority, int file,
+				   unsigned long nr_to_scan,
+				   unsigned long *nr_scanned)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	LIST_HEAD(page_list);
+	struct list_head *src;
+	unsigned long nr_reclaimed;
+	unsigned long nr_taken;
+	unsigned long nr_anon;
+	unsigned long nr_file;
+
+	*nr_scanned = 0;
+	while (unlikely(too_many_isolated(zone, file, sc))) {
+		congestion_wait(BLK_RW_ASYNC, HZ/10);
+
+		/* We are about to die and free our memory. Return now. */
+		if (fatal_signal_pending(current))
+			return SWAP_CLUSTER_MAX;
+	}
+
+	set_reclaim_mode(priority, sc, false);
+	lru_add_drain();
+	lru_lock_irq(zone);
+
+	lru_gen_inc_min_seq(zone, file);
+	src = &lrugen->lists[lru_gen_from_seq(lrugen->min_seq[file])][file];
+
+	/* generations mix active and inactive pages of one type */
+	nr_taken = isolate_lru_pages(nr_to_scan, src, &page_list, nr_scanned,
+				     sc->order, ISOLATE_BOTH, file);
+	zone->pages_scanned += *nr_scanned;
+	if (current_is_kswapd())
+		__count_zone_vm_events(PGSCAN_KSWAPD, zone, *nr_scanned);
+	else
+		__count_zone_vm_events(PGSCAN_DIRECT, zone, *nr_scanned);
+
+	if (nr_taken == 0) {
+		lru_unlock_irq(zone, 0);
+		return 0;
+	}
+
+	update_isolated_counts(zone, sc, &nr_anon, &nr_file, &page_list);
+
+	lru_unlock_irq(zone, nr_taken);
+
+	nr_reclaimed = shrink_page_list(&page_list, zone, sc);
+
+	/* Check if we should syncronously wait for writeback */
+	if (should_reclaim_stall(nr_taken, nr_reclaimed, priority, sc)) {
+		set_reclaim_mode(priority, sc, true);
+		nr_reclaimed += shrink_page_list(&page_list, zone, sc);
+	}
+
+	local_irq_disable();
+	if (current_is_kswapd())
+		__count_vm_events(KSWAPD_STEAL, nr_reclaimed);
+	__count_zone_vm_events(PGSTEAL, zone, nr_reclaimed);
+
+	/* activated pages go to the youngest generation, the rest back */
+	putback_lru_pages(zone, sc, nr_anon, nr_file, &page_list);
+
+	trace_mm_vmscan_lru_shrink_inactive(zone->zone_pgdat->node_id,
+		zone_idx(zone),
+		*nr_scanned, nr_reclaimed,
+		priority,
+		trace_shrink_flags(file, sc->reclaim_mode));
+	return nr_reclaimed;
+}
+
+static void lru_gen_shrink_zone(int priority, struct zone *zone,
+				struct scan_control *sc)
+{
+	unsigned long nr_to_scan;
+	unsigned long nr_reclaimed = 0;
+
+	nr_to_scan = max_t(unsigned long, zone_reclaimable_pages(zone) >> priority,
+			   SWAP_CLUSTER_MAX);
+
+	while (nr_to_scan) {
+		unsigned long nr_scanned;
+		int file = lru_gen_pick_type(zone, sc);
+
+		if (lru_gen_need_aging(zone, file))
+			lru_gen_age_node(zone->zone_pgdat, current_is_kswapd());
+
+		nr_reclaimed += lru_gen_evict(zone, sc, priority, file,
+				min_t(unsigned long, nr_to_scan, SWAP_CLUSTER_MAX),
+				&nr_scanned);
+		if (!nr_scanned)
+			break;
+		nr_to_scan -= min(nr_to_scan, nr_scanned);
+
+		if (nr_reclaimed >= sc->nr_to_reclaim && priority < DEF_PRIORITY)
+			break;
+	}
+	sc->nr_reclaimed += nr_reclaimed;
+
+	throttle_vm_writeout(sc->gfp_mask);
+}
+
+/*
+ * Moves all evictable pages of @zone between the zone LRU lists and the
+ * generations.  Active pages enter the youngest generation, inactive
+ * ones the oldest.  On the way back, the generations are drained from
+ * the youngest so the zone lists end up sorted by age.
+ */
+static void lru_gen_change_state(struct zone *zone, int enable)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	enum lru_list l;
+
+	spin_lock_irq(&zone->lru_lock);
+	if (lrugen->enabled == enable)
+		goto out;
+
+	if (enable) {
+		for_each_evictable_lru(l)
+			list_splice_init(&zone->lru[l].list,
+					 lru_gen_list(zone, l));
+	} else {
+		int file;
+
+		for (file = 0; file < 2; file++) {
+			unsigned long seq;
+
+			for (seq = lrugen->max_seq + 1;
+			     seq-- > lrugen->min_seq[file]; ) {
+				struct list_head *list;
+
+				list = &lrugen->lists[lru_gen_from_seq(seq)][file];
+				while (!list_empty(list)) {
+					struct page *page;
+
+					page = list_entry(list->next,
+							  struct page, lru);
+					list_move_tail(&page->lru,
+						&zone->lru[page_lru(page)].list);
+				}
+			}
+			lrugen->min_seq[file] = lrugen->max_seq - MIN_NR_GENS + 1;
+		}
+	}
+	lrugen->enabled = enable;
+out:
+	spin_unlock_irq(&zone->lru_lock);
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t enabled_show(struct kobject *kobj, struct kobj_attribute *attr,
+			    char *buf)
+{
+	struct zone *zone;
+	int enabled = 0;
+
+	for_each_populated_zone(zone)
+		enabled |= lru_gen_enabled(zone);
+	return sprintf(buf, "%d\n", enabled);
+}
+
+static ssize_t enabled_store(struct kobject *kobj, struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct zone *zone;
+	unsigned long enable;
+	int err;
+
+	err = strict_strtoul(buf, 10, &enable);
+	if (err || enable > 1)
+		return -EINVAL;
+
+	mutex_lock(&lru_gen_state_mutex);
+	for_each_populated_zone(zone) {
+		lru_gen_change_state(zone, enable);
+		cond_resched();
+	}
+	mutex_unlock(&lru_gen_state_mutex);
+
+	return count;
+}
+static struct kobj_attribute lru_gen_enabled_attr =
+	__ATTR(enabled, 0644, enabled_show, enabled_store);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	NULL,
+};
+
+static struct attribute_group lru_gen_attr_group = {
+	.attrs = lru_gen_attrs,
+	.name = "lru_gen",
+};
+
+static int __init lru_gen_init(void)
+{
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &lru_gen_attr_group);
+	if (err)
+		printk(KERN_ERR "lru_gen: register sysfs failed\n");
+	return err;
+}
+module_init(lru_gen_init)
+#endif /* CONFIG_SYSFS */
+#else
+static inline void lru_gen_shrink_zone(int priority, struct zone *zone,
+				       struct scan_control *sc)
+{
+}
+#endif /* CONFIG_LRU_GEN */
+
 /*
  * This is a basic per-zone page freer.  Used by both kswapd and direct reclaim.
  */
@@ -1940,6 +2513,11 @@ static void shrink_zone(int priority, struct zone *zone,
 	unsigned long nr_reclaimed, nr_scanned;
 	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
 
+	if (scanning_global_lru(sc) && lru_gen_enabled(zone)) {
+		lru_gen_shrink_zone(priority, zone, sc);
+		return;
+	}
+
 restart:
 	nr_reclaimed = 0;
 	nr_scanned = sc->nr_scanned;
@@ -3237,7 +3815,7 @@ retry:
 		enum lru_list l = page_lru_base_type(page);
 
 		__dec_zone_state(zone, NR_UNEVICTABLE);
-		list_move(&page->lru, &zone->lru[l].list);
+		list_move(&page->lru, zone_lru_head(zone, l));
 		mem_cgroup_move_lists(page, LRU_UNEVICTABLE, l);
 		__inc_zone_state(zone, NR_INACTIVE_ANON + l);
 		__count_vm_event(UNEVICTABLE_PGRESCUED);
@@ -0,0 +1,250 @@
+/*
+ * Workingset detection
+ *
+ * When reclaim evicts a page cache page, nothing used to remember it: a
+ * page that is read back shortly after was treated like a first access
+ * and started over on the inactive list, only to be evicted again before
+ * it could ever be promoted.
+ *
+ * Instead, every zone keeps a clock, inactive_age, that ticks on each
+ * eviction and activation.  Evicting a page leaves a shadow entry in its
+ * mapping recording the zone and the clock at that time.  When the page
+ * is faulted back in, the difference between the current clock and the
+ * shadow is its refault distance: the minimum number of accesses the
+ * inactive list would have needed to hold on to it.  If that distance is
+ * no larger than the active list, the page would have stayed resident
+ * with an inactive list of the active list's size, so it is activated
+ * right away and has to compete with the established workingset.
+ *
+ * Shadow entries live in mapping->shadow_tree under mapping->tree_lock,
+ * so that the page cache lookups and the many direct users of page_tree
+ * never see anything but pages.  They are dropped on refault, on
+ * truncation and when the inode goes away.  Only reclaimed page cache
+ * pages leave shadows; anon and swap cache pages do not.
+ *
+ * Reclaim preloads the tree nodes for a shadow before taking the tree
+ * lock and never dips into the emergency reserves for them: a shadow is
+ * only a hint and is dropped when memory is that tight.  A mapping holds
+ * at most as many shadows as the active file lists have pages.  Past
+ * that, some of its shadows are older than any active list is long and
+ * could not activate a refault anymore, so stale ones are pruned to make
+ * room for new ones.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/pagevec.h>
+#include <linux/radix-tree.h>
+#include <linux/vmstat.h>
+#include <linux/mmzone.h>
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *evictionp)
+{
+	unsigned long entry = (unsigned long)shadow;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+	*evictionp = entry;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->shadow_tree in place
+ * of the evicted @page, or %NULL if the mapping cannot hold shadows.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	/*
+	 * Only an inode's own mapping is guaranteed to be torn down
+	 * through end_writeback(), which frees the shadows.
+	 */
+	if (!mapping->host || mapping != &mapping->host->i_data)
+		return NULL;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/*
+ * Returns the number of evictions and activations that happened in the
+ * zone of @shadow since it was stored, and that zone in *@zone.
+ */
+static unsigned long refault_distance(void *shadow, struct zone **zone)
+{
+	unsigned long eviction;
+	unsigned long refault;
+
+	unpack_shadow(shadow, zone, &eviction);
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	return (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long distance;
+	struct zone *zone;
+
+	distance = refault_distance(shadow, &zone);
+
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * Drops the shadows that can no longer activate a refault from the batch
+ * following @index, wrapping around to the start of the mapping, or the
+ * first shadow of the batch if none is stale.  Returns the number of
+ * shadows dropped.  Caller holds mapping->tree_lock.
+ */
+static unsigned int prune_shadows(struct address_space *mapping, pgoff_t index)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned int nr, nr_stale = 0, i;
+	struct zone *zone;
+
+	nr = radix_tree_gang_lookup_slot(&mapping->shadow_tree, slots,
+					 indices, index + 1, PAGEVEC_SIZE);
+	if (!nr)
+		nr = radix_tree_gang_lookup_slot(&mapping->shadow_tree, slots,
+						 indices, 0, PAGEVEC_SIZE);
+	if (!nr)
+		return 0;
+
+	/* deletion may free the nodes the slots point into, look first */
+	for (i = 0; i < nr; i++) {
+		void *shadow = radix_tree_deref_slot(slots[i]);
+
+		if (refault_distance(shadow, &zone) >
+		    zone_page_state(zone, NR_ACTIVE_FILE))
+			indices[nr_stale++] = indices[i];
+	}
+	if (!nr_stale)
+		nr_stale = 1;
+
+	for (i = 0; i < nr_stale; i++)
+		radix_tree_delete(&mapping->shadow_tree, indices[i]);
+	mapping->nrshadows -= nr_stale;
+	return nr_stale;
+}
+
+/*
+ * Stores @shadow for @index.  A stale shadow left at @index is replaced.
+ * The shadow is silently dropped when no tree node can be allocated: it
+ * is only a hint.  Caller holds mapping->tree_lock and has preloaded the
+ * radix tree.
+ */
+void workingset_store_shadow(struct address_space *mapping, pgoff_t index,
+			     void *shadow)
+{
+	void **slot;
+
+	slot = radix_tree_lookup_slot(&mapping->shadow_tree, index);
+	if (slot) {
+		radix_tree_replace_slot(slot, shadow);
+		return;
+	}
+	if (mapping->nrshadows >= global_page_state(NR_ACTIVE_FILE) &&
+	    !prune_shadows(mapping, index))
+		return;
+	if (!radix_tree_insert(&mapping->shadow_tree, index, shadow))
+		mapping->nrshadows++;
+}
+
+/*
+ * Removes and returns the shadow entry for @index, if any.  Caller holds
+ * mapping->tree_lock.
+ */
+void *workingset_take_shadow(struct address_space *mapping, pgoff_t index)
+{
+	void *shadow;
+
+	if (!mapping->nrshadows)
+		return NULL;
+	shadow = radix_tree_delete(&mapping->shadow_tree, index);
+	if (shadow)
+		mapping->nrshadows--;
+	return shadow;
+}
+
+/**
+ * workingset_forget_shadows - drop shadow entries of a range
+ * @mapping: address space to clean
+ * @start: first page index
+ * @end: last page index, inclusive
+ *
+ * Called on truncation: pages brought in afterwards are new data, not
+ * refaults.  Takes mapping->tree_lock.
+ */
+void workingset_forget_shadows(struct address_space *mapping,
+			       pgoff_t start, pgoff_t end)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned int nr, i;
+
+	spin_lock_irq(&mapping->tree_lock);
+	while (mapping->nrshadows) {
+		nr = radix_tree_gang_lookup_slot(&mapping->shadow_tree, slots,
+						 indices, start, PAGEVEC_SIZE);
+		for (i = 0; i < nr && indices[i] <= end; i++) {
+			radix_tree_delete(&mapping->shadow_tree, indices[i]);
+			mapping->nrshadows--;
+		}
+		if (i < PAGEVEC_SIZE || indices[i - 1] == end)
+			break;
+		start = indices[i - 1] + 1;
+	}
+	spin_unlock_irq(&mapping->tree_lock);
+}
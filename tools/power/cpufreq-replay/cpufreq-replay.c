@@ -0,0 +1,327 @@
+/*
+ * cpufreq-replay -- replay a trace of per-frame cpu work under several
+ * cpufreq governors and count the frames that miss their deadline.
+ *
+ * A trace has one frame per line:
+ *
+ *	<work_us> [<deadline_us>]
+ *
+ * where work_us is the cpu time the frame takes at the highest frequency
+ * and deadline_us, the frame period by default, is the time from the start
+ * of the frame by which the work has to be done.  Lines starting with '#'
+ * are ignored.  Frames start every period (-p, 16667us by default); a frame
+ * that overruns delays the following ones, as in a real render loop.
+ * Without a trace file a built-in one is used, alternating idle, light and
+ * heavy frames as in scrolling a list.
+ *
+ * The work is calibrated under the "performance" governor first.  Every
+ * governor is then given a second of idle time and the trace, on the cpu
+ * selected with -c, and the original governor is restored at the end:
+ *
+ *	cpufreq-replay -c 0 -g interactive,sched,ondemand trace.txt
+ *
+ * The average frequency while replaying is read from cpufreq stats when
+ * CONFIG_CPU_FREQ_STAT is enabled, as a rough measure of the energy spent.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+
+#define CPUFREQ_DIR	"/sys/devices/system/cpu/cpu%d/cpufreq/"
+#define MAX_FREQS	64
+
+struct frame {
+	long work_us;
+	long deadline_us;
+};
+
+struct time_in_state {
+	int nr;
+	unsigned long freq[MAX_FREQS];
+	unsigned long long time[MAX_FREQS];
+};
+
+static int cpu;
+static long period_us = 16667;
+static double loops_per_us;
+
+static struct frame *frames;
+static int nr_frames;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-c cpu] [-g governor[,governor...]] "
+		"[-p period_us] [trace]\n", prog);
+	exit(1);
+}
+
+static void fatal(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void sleep_until(long long us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+static void spin(unsigned long loops)
+{
+	volatile unsigned long i;
+
+	for (i = 0; i < loops; i++)
+		;
+}
+
+static int read_governor(char *buf, size_t len)
+{
+	char path[256];
+	FILE *f;
+
+	snprintf(path, sizeof(path), CPUFREQ_DIR "scaling_governor", cpu);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (!fgets(buf, len, f)) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+static int write_governor(const char *gov)
+{
+	char path[256];
+	FILE *f;
+
+	snprintf(path, sizeof(path), CPUFREQ_DIR "scaling_governor", cpu);
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+	fprintf(f, "%s\n", gov);
+	if (fclose(f))
+		return -1;
+	return 0;
+}
+
+static void read_time_in_state(struct time_in_state *tis)
+{
+	char path[256];
+	FILE *f;
+
+	tis->nr = 0;
+	snprintf(path, sizeof(path), CPUFREQ_DIR "stats/time_in_state", cpu);
+	f = fopen(path, "r");
+	if (!f)
+		return;
+	while (tis->nr < MAX_FREQS &&
+	       fscanf(f, "%lu %llu", &tis->freq[tis->nr],
+		      &tis->time[tis->nr]) == 2)
+		tis->nr++;
+	fclose(f);
+}
+
+/* Average frequency in MHz between two time_in_state samples, or 0 */
+static double average_mhz(struct time_in_state *a, struct time_in_state *b)
+{
+	double sum = 0, time = 0;
+	int i;
+
+	if (!a->nr || a->nr != b->nr)
+		return 0;
+	for (i = 0; i < a->nr; i++) {
+		unsigned long long dt = b->time[i] - a->time[i];
+
+		sum += (double)a->freq[i] / 1000 * dt;
+		time += dt;
+	}
+	return time ? sum / time : 0;
+}
+
+static void add_frame(long work_us, long deadline_us)
+{
+	if (!(nr_frames % 256)) {
+		frames = realloc(frames, (nr_frames + 256) * sizeof(*frames));
+		if (!frames)
+			fatal("realloc");
+	}
+	frames[nr_frames].work_us = work_us;
+	frames[nr_frames].deadline_us = deadline_us;
+	nr_frames++;
+}
+
+static void load_trace(const char *file)
+{
+	char line[256];
+	FILE *f = fopen(file, "r");
+
+	if (!f)
+		fatal(file);
+	while (fgets(line, sizeof(line), f)) {
+		long work, deadline;
+		int n;
+
+		if (line[0] == '#')
+			continue;
+		n = sscanf(line, "%ld %ld", &work, &deadline);
+		if (n < 1)
+			continue;
+		add_frame(work, n > 1 ? deadline : period_us);
+	}
+	fclose(f);
+}
+
+/*
+ * Ten seconds of a list being flung and settling: mostly idle frames, a
+ * burst of heavy ones at each fling, and lighter ones while it slows down.
+ */
+static void builtin_trace(void)
+{
+	int i, j;
+
+	for (i = 0; i < 10; i++) {
+		for (j = 0; j < 20; j++)
+			add_frame(500, period_us);
+		for (j = 0; j < 15; j++)
+			add_frame(period_us * 3 / 5, period_us);
+		for (j = 0; j < 25; j++)
+			add_frame(period_us / 4, period_us);
+	}
+}
+
+static void calibrate(void)
+{
+	unsigned long loops = 1000000;
+	long long start, elapsed;
+
+	if (write_governor("performance"))
+		fprintf(stderr, "cannot select performance governor, "
+			"calibrating at the current speed\n");
+	spin(loops * 100);
+
+	do {
+		loops *= 2;
+		start = now_us();
+		spin(loops);
+		elapsed = now_us() - start;
+	} while (elapsed < 100000);
+
+	loops_per_us = (double)loops / elapsed;
+}
+
+static void replay(const char *gov)
+{
+	struct time_in_state before, after;
+	long long start, t0, lat, sum = 0, max = 0;
+	int i, missed = 0;
+
+	if (write_governor(gov)) {
+		fprintf(stderr, "%s: cannot select governor\n", gov);
+		return;
+	}
+	sleep(1);
+
+	read_time_in_state(&before);
+	t0 = now_us();
+	for (i = 0; i < nr_frames; i++) {
+		start = t0 + (long long)i * period_us;
+		if (now_us() < start)
+			sleep_until(start);
+
+		spin(frames[i].work_us * loops_per_us);
+
+		lat = now_us() - start;
+		if (lat > frames[i].deadline_us)
+			missed++;
+		sum += lat;
+		if (lat > max)
+			max = lat;
+	}
+	read_time_in_state(&after);
+
+	printf("%-14s %7d %7d %6.2f%% %9lld %9lld %8.0f\n", gov, nr_frames,
+	       missed, 100.0 * missed / nr_frames, sum / nr_frames, max,
+	       average_mhz(&before, &after));
+}
+
+int main(int argc, char *argv[])
+{
+	char *governors = "interactive,sched";
+	char orig[64], *gov;
+	cpu_set_t cpus;
+	int c;
+
+	while ((c = getopt(argc, argv, "c:g:p:")) != -1) {
+		switch (c) {
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 'g':
+			governors = optarg;
+			break;
+		case 'p':
+			period_us = atol(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (period_us <= 0)
+		usage(argv[0]);
+
+	if (optind < argc)
+		load_trace(argv[optind]);
+	else
+		builtin_trace();
+	if (!nr_frames) {
+		fprintf(stderr, "empty trace\n");
+		return 1;
+	}
+
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus))
+		fatal("sched_setaffinity");
+	if (read_governor(orig, sizeof(orig)))
+		fatal("scaling_governor");
+
+	calibrate();
+	printf("cpu%d: %.1f loops/us at the top speed, %d frames of %ldus\n\n",
+	       cpu, loops_per_us, nr_frames, period_us);
+	printf("%-14s %7s %7s %7s %9s %9s %8s\n", "governor", "frames",
+	       "missed", "miss", "mean(us)", "max(us)", "avg MHz");
+
+	for (gov = strtok(governors, ","); gov; gov = strtok(NULL, ","))
+		replay(gov);
+
+	write_governor(orig);
+	return 0;
+}
@@ -0,0 +1,405 @@
+/*
+ * energy-bench -- work done per joule with and without energy aware task
+ * placement, in a simulated power model.
+ *
+ * A number of workers (-w, 4 by default) each do a fixed chunk of work
+ * every period (-p, 10000us), sized to take a given share of one cpu at
+ * the speed reached after a second of spinning (-d, 30%).  So the same
+ * work is done however the tasks are placed, as long as no cpu saturates,
+ * and only the energy differs.
+ *
+ * The energy is not measured, it is computed from a power model every
+ * 10ms: a cpu is charged the busy power at the current frequency of cpu0
+ * for its busy time in /proc/stat, and the clock gated power for its idle
+ * time if it ran anything in those 10ms.  A cpu that stayed idle, or went
+ * offline, is taken to be power gated and costs nothing.  The built-in
+ * model is that of the kernel for EXYNOS4412 (arch/arm/mach-exynos/
+ * cpufreq.c); another one can be given with -m, one operating point per
+ * line and the clock gated power on a line of its own:
+ *
+ *	<kHz> <busy mW>
+ *	...
+ *	idle <mW>
+ *
+ * Each run lasts -t seconds (10).  With -e both, the default when the
+ * kernel has CONFIG_SCHED_ENERGY, the benchmark runs once with
+ * kernel.sched_energy_aware off and once with it on, and restores it:
+ *
+ *	energy-bench -w 4 -d 20 -t 20
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#define ENERGY_AWARE	"/proc/sys/kernel/sched_energy_aware"
+#define CUR_FREQ	"/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq"
+#define MAX_CPUS	64
+#define MAX_OPPS	32
+#define SAMPLE_US	10000
+
+struct opp {
+	unsigned long khz;
+	double mw;
+};
+
+static struct opp opps[MAX_OPPS];
+static int nr_opps;
+static double idle_mw;
+
+static int nr_workers = 4;
+static long period_us = 10000;
+static int duty = 30;
+static int seconds = 10;
+
+static double loops_per_us;
+static unsigned long chunk_loops;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned long chunks;
+	unsigned long late;
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-w workers] [-d duty %%] [-p period_us] "
+		"[-t seconds] [-m model] [-e 0|1|both|current]\n", prog);
+	exit(1);
+}
+
+static void fatal(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void sleep_until(long long us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+static void spin(unsigned long loops)
+{
+	volatile unsigned long i;
+
+	for (i = 0; i < loops; i++)
+		;
+}
+
+/* EXYNOS4412: C * V^2 * f with C = 0.42mW / (MHz V^2), 25mW in WFI */
+static void builtin_model(void)
+{
+	static const unsigned int mhz_mv[][2] = {
+		{  200,  900 }, {  300,  900 }, {  400,  925 }, {  500,  950 },
+		{  600,  975 }, {  700,  987 }, {  800, 1000 }, {  900, 1037 },
+		{ 1000, 1087 }, { 1100, 1125 }, { 1200, 1175 }, { 1300, 1225 },
+		{ 1400, 1287 },
+	};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(mhz_mv) / sizeof(mhz_mv[0]); i++) {
+		double v = mhz_mv[i][1] / 1000.0;
+
+		opps[i].khz = mhz_mv[i][0] * 1000;
+		opps[i].mw = 0.42 * mhz_mv[i][0] * v * v;
+	}
+	nr_opps = i;
+	idle_mw = 25;
+}
+
+static void load_model(const char *file)
+{
+	char line[256];
+	FILE *f = fopen(file, "r");
+
+	if (!f)
+		fatal(file);
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long khz;
+		double mw;
+
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "idle %lf", &mw) == 1)
+			idle_mw = mw;
+		else if (sscanf(line, "%lu %lf", &khz, &mw) == 2 &&
+			 nr_opps < MAX_OPPS) {
+			opps[nr_opps].khz = khz;
+			opps[nr_opps].mw = mw;
+			nr_opps++;
+		}
+	}
+	fclose(f);
+	if (!nr_opps) {
+		fprintf(stderr, "%s: no operating points\n", file);
+		exit(1);
+	}
+}
+
+/* Busy power at @khz: the first operating point at or above it */
+static double busy_mw(unsigned long khz)
+{
+	int i;
+
+	for (i = 0; i < nr_opps; i++)
+		if (opps[i].khz >= khz)
+			return opps[i].mw;
+	return opps[nr_opps - 1].mw;
+}
+
+static unsigned long read_cur_freq(void)
+{
+	unsigned long khz = 0;
+	FILE *f = fopen(CUR_FREQ, "r");
+
+	if (!f)
+		return opps[nr_opps - 1].khz;
+	if (fscanf(f, "%lu", &khz) != 1)
+		khz = opps[nr_opps - 1].khz;
+	fclose(f);
+	return khz;
+}
+
+/* Busy and idle jiffies of every cpu in /proc/stat, absent cpus are 0 */
+static void read_cpu_times(unsigned long long *busy,
+			   unsigned long long *idle)
+{
+	char line[512];
+	FILE *f = fopen("/proc/stat", "r");
+
+	memset(busy, 0, MAX_CPUS * sizeof(*busy));
+	memset(idle, 0, MAX_CPUS * sizeof(*idle));
+	if (!f)
+		fatal("/proc/stat");
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long user, nice, sys, idl, iow, irq, sirq;
+		int cpu;
+
+		if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu",
+			   &cpu, &user, &nice, &sys, &idl, &iow, &irq,
+			   &sirq) != 8 || cpu >= MAX_CPUS)
+			continue;
+		busy[cpu] = user + nice + sys + irq + sirq;
+		idle[cpu] = idl + iow;
+	}
+	fclose(f);
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	long long next = now_us();
+
+	while (!stop) {
+		spin(chunk_loops);
+		w->chunks++;
+
+		next += period_us;
+		if (now_us() > next) {
+			w->late++;
+			next = now_us();
+		} else {
+			sleep_until(next);
+		}
+	}
+	return NULL;
+}
+
+static void calibrate(void)
+{
+	unsigned long loops = 1000000;
+	long long start, elapsed;
+
+	/* Give the cpufreq governor a second to reach its top speed */
+	start = now_us();
+	while (now_us() - start < 1000000)
+		spin(100000);
+
+	do {
+		loops *= 2;
+		start = now_us();
+		spin(loops);
+		elapsed = now_us() - start;
+	} while (elapsed < 100000);
+
+	loops_per_us = (double)loops / elapsed;
+	chunk_loops = loops_per_us * period_us * duty / 100;
+}
+
+static int write_energy_aware(int val)
+{
+	FILE *f = fopen(ENERGY_AWARE, "w");
+
+	if (!f)
+		return -1;
+	fprintf(f, "%d\n", val);
+	return fclose(f);
+}
+
+static int read_energy_aware(void)
+{
+	FILE *f = fopen(ENERGY_AWARE, "r");
+	int val = -1;
+
+	if (!f)
+		return -1;
+	if (fscanf(f, "%d", &val) != 1)
+		val = -1;
+	fclose(f);
+	return val;
+}
+
+static void run(const char *name)
+{
+	static unsigned long long busy0[MAX_CPUS], idle0[MAX_CPUS];
+	static unsigned long long busy1[MAX_CPUS], idle1[MAX_CPUS];
+	struct worker *workers;
+	double joules = 0, tick = sysconf(_SC_CLK_TCK);
+	unsigned long chunks = 0, late = 0;
+	long long start, next;
+	int i, cpu;
+
+	workers = calloc(nr_workers, sizeof(*workers));
+	if (!workers)
+		fatal("calloc");
+
+	stop = 0;
+	for (i = 0; i < nr_workers; i++)
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i]))
+			fatal("pthread_create");
+
+	read_cpu_times(busy0, idle0);
+	start = next = now_us();
+	while (now_us() - start < seconds * 1000000LL) {
+		double mw;
+
+		next += SAMPLE_US;
+		sleep_until(next);
+
+		mw = busy_mw(read_cur_freq());
+		read_cpu_times(busy1, idle1);
+		for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+			double busy = (busy1[cpu] - busy0[cpu]) / tick;
+			double idle = (idle1[cpu] - idle0[cpu]) / tick;
+
+			if (busy1[cpu] < busy0[cpu] || idle1[cpu] < idle0[cpu])
+				continue;	/* went offline and back */
+			joules += busy * mw / 1000;
+			if (busy > 0)
+				joules += idle * idle_mw / 1000;
+		}
+		memcpy(busy0, busy1, sizeof(busy0));
+		memcpy(idle0, idle1, sizeof(idle0));
+	}
+
+	stop = 1;
+	for (i = 0; i < nr_workers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		chunks += workers[i].chunks;
+		late += workers[i].late;
+	}
+	free(workers);
+
+	printf("%-14s %9lu %7lu %9.2f %9.1f %11.1f\n", name, chunks, late,
+	       joules, joules * 1000 / seconds, joules ? chunks / joules : 0);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *mode = NULL;
+	int orig, c;
+
+	while ((c = getopt(argc, argv, "w:d:p:t:m:e:")) != -1) {
+		switch (c) {
+		case 'w':
+			nr_workers = atoi(optarg);
+			break;
+		case 'd':
+			duty = atoi(optarg);
+			break;
+		case 'p':
+			period_us = atol(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'm':
+			load_model(optarg);
+			break;
+		case 'e':
+			mode = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_workers <= 0 || duty <= 0 || duty > 100 || period_us <= 0 ||
+	    seconds <= 0)
+		usage(argv[0]);
+	if (!nr_opps)
+		builtin_model();
+
+	orig = read_energy_aware();
+	if (!mode)
+		mode = orig < 0 ? "current" : "both";
+	if (strcmp(mode, "0") && strcmp(mode, "1") && strcmp(mode, "both") &&
+	    strcmp(mode, "current"))
+		usage(argv[0]);
+
+	calibrate();
+	printf("%d workers, %d%% of a cpu every %ldus, %ds per run\n\n",
+	       nr_workers, duty, period_us, seconds);
+	printf("%-14s %9s %7s %9s %9s %11s\n", "placement", "chunks", "late",
+	       "energy(J)", "avg(mW)", "chunks/J");
+
+	if (!strcmp(mode, "current")) {
+		run("current");
+		return 0;
+	}
+	if (orig < 0) {
+		fprintf(stderr, "%s: not available, kernel built without "
+			"CONFIG_SCHED_ENERGY?\n", ENERGY_AWARE);
+		return 1;
+	}
+
+	if (!strcmp(mode, "0") || !strcmp(mode, "both")) {
+		if (write_energy_aware(0))
+			fatal(ENERGY_AWARE);
+		run("throughput");
+	}
+	if (!strcmp(mode, "1") || !strcmp(mode, "both")) {
+		if (write_energy_aware(1))
+			fatal(ENERGY_AWARE);
+		run("energy aware");
+	}
+
+	write_energy_aware(orig);
+	return 0;
+}
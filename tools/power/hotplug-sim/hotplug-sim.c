@@ -0,0 +1,216 @@
+/*
+ * hotplug-sim -- replay a load trace through the EXYNOS load based cpu
+ * hotplug policy (arch/arm/mach-exynos/load-hotplug.c) to compare tunables
+ * without a board.
+ *
+ * The trace is either the text of the load_hotplug:load_hotplug_sample
+ * event, as read from /sys/kernel/debug/tracing/trace, or one sample per
+ * line:
+ *
+ *	<nr_running> <util>
+ *
+ * with util the total utilization in percent of one cpu.  Lines starting
+ * with '#' are ignored.  Samples are taken to be sample_ms apart.  The
+ * utilization is capped to what the cpus online in the replay can give,
+ * so a trace recorded with more cpus online than the replay has shows the
+ * load the replay could not serve.
+ *
+ * Tunables have the names of /sys/devices/system/cpu/hotplug:
+ *
+ *	hotplug-sim -n 4 -t up_delay_ms=100 -t down_util=30 trace.txt
+ *
+ * The summary gives the hotplug operations, the average of online cpus
+ * and the fraction of samples where the cpus were overloaded (more
+ * runnable tasks than cpus, all of them busy) or one of them could have
+ * been taken down.  -v prints every decision.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "../../../arch/arm/mach-exynos/load-hotplug.h"
+
+/* A cpu busier than this, in percent, counts as saturated */
+#define BUSY_UTIL	90
+
+static const char * const decision_names[] = {
+	[LHP_HOLD]		= "hold",
+	[LHP_UP_PENDING]	= "up_pending",
+	[LHP_DOWN_PENDING]	= "down_pending",
+	[LHP_UP]		= "up",
+	[LHP_DOWN]		= "down",
+};
+
+#define TUNABLE(name) { #name, offsetof(struct lhp_tunables, name) }
+
+static const struct {
+	const char *name;
+	size_t offset;
+} tunables[] = {
+	TUNABLE(min_cpus),
+	TUNABLE(max_cpus),
+	TUNABLE(sample_ms),
+	TUNABLE(up_nr_running),
+	TUNABLE(down_nr_running),
+	TUNABLE(up_util),
+	TUNABLE(down_util),
+	TUNABLE(up_delay_ms),
+	TUNABLE(down_delay_ms),
+};
+
+static void usage(const char *prog)
+{
+	unsigned int i;
+
+	fprintf(stderr,
+		"Usage: %s [-n cpus] [-c online] [-t tunable=value]... "
+		"[-v] [trace]\n\ntunables:", prog);
+	for (i = 0; i < sizeof(tunables) / sizeof(tunables[0]); i++)
+		fprintf(stderr, " %s", tunables[i].name);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static int set_tunable(struct lhp_tunables *t, const char *arg)
+{
+	const char *eq = strchr(arg, '=');
+	unsigned int i;
+
+	if (!eq)
+		return -1;
+	for (i = 0; i < sizeof(tunables) / sizeof(tunables[0]); i++) {
+		if (strlen(tunables[i].name) != (size_t)(eq - arg) ||
+		    strncmp(tunables[i].name, arg, eq - arg))
+			continue;
+		*(unsigned int *)((char *)t + tunables[i].offset) =
+			strtoul(eq + 1, NULL, 0);
+		return 0;
+	}
+	return -1;
+}
+
+/* Returns 1 if @line holds a sample */
+static int parse_sample(const char *line, unsigned int *nr,
+			unsigned int *util)
+{
+	const char *p, *q;
+
+	if (line[0] == '#')
+		return 0;
+	if (strstr(line, "load_hotplug_sample:")) {
+		p = strstr(line, "nr_running=");
+		q = strstr(line, "util=");
+		if (!p || !q)
+			return 0;
+		*nr = strtoul(p + strlen("nr_running="), NULL, 10);
+		*util = strtoul(q + strlen("util="), NULL, 10);
+		return 1;
+	}
+	return sscanf(line, "%u %u", nr, util) == 2;
+}
+
+int main(int argc, char *argv[])
+{
+	struct lhp_tunables t = LHP_DEFAULT_TUNABLES(4);
+	struct lhp_state s = { 0 };
+	unsigned int ncpus = 4, online = 1, verbose = 0;
+	unsigned long samples = 0, ups = 0, downs = 0;
+	unsigned long overloaded = 0, spare = 0, online_sum = 0;
+	int max_cpus_set = 0;
+	char line[512];
+	FILE *f = stdin;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:c:t:v")) != -1) {
+		switch (c) {
+		case 'n':
+			ncpus = atoi(optarg);
+			break;
+		case 'c':
+			online = atoi(optarg);
+			break;
+		case 't':
+			if (set_tunable(&t, optarg))
+				usage(argv[0]);
+			if (!strncmp(optarg, "max_cpus=", 9))
+				max_cpus_set = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!max_cpus_set)
+		t.max_cpus = ncpus;
+	if (!ncpus || !online || online > ncpus || !t.sample_ms ||
+	    t.min_cpus < 1 || t.max_cpus > ncpus || t.min_cpus > t.max_cpus)
+		usage(argv[0]);
+
+	if (optind < argc) {
+		f = fopen(argv[optind], "r");
+		if (!f) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		enum lhp_decision d;
+		unsigned int nr, util;
+
+		if (!parse_sample(line, &nr, &util))
+			continue;
+		if (util > online * 100)
+			util = online * 100;
+
+		if (nr > online && util >= online * BUSY_UTIL)
+			overloaded++;
+		if (online > 1 && nr < online &&
+		    util <= (online - 1) * t.down_util)
+			spare++;
+		online_sum += online;
+		samples++;
+
+		d = lhp_evaluate(&t, &s, nr, util, online);
+		if (verbose)
+			printf("%8lu.%03lu nr_running=%u avg_nr=%u.%02u "
+			       "util=%u online=%u %s\n",
+			       samples * t.sample_ms / 1000,
+			       samples * t.sample_ms % 1000, nr,
+			       s.avg_nr / 100, s.avg_nr % 100, util, online,
+			       decision_names[d]);
+
+		if (d == LHP_UP && online < ncpus) {
+			online++;
+			ups++;
+		} else if (d == LHP_DOWN && online > 1) {
+			online--;
+			downs++;
+		}
+	}
+	if (f != stdin)
+		fclose(f);
+
+	if (!samples) {
+		fprintf(stderr, "no samples\n");
+		return 1;
+	}
+
+	printf("%lu samples, %.1fs\n", samples,
+	       samples * t.sample_ms / 1000.0);
+	printf("cpu up         %8lu\n", ups);
+	printf("cpu down       %8lu\n", downs);
+	printf("online (avg)   %8.2f\n", (double)online_sum / samples);
+	printf("overloaded     %7.2f%%\n", 100.0 * overloaded / samples);
+	printf("spare cpu      %7.2f%%\n", 100.0 * spare / samples);
+	return 0;
+}
@@ -0,0 +1,323 @@
+/*
+ * dl-test -- run periodic SCHED_DEADLINE tasks and report the jobs that
+ * missed their deadline.
+ *
+ * Every task is given as
+ *
+ *	runtime:deadline:period[:work]
+ *
+ * in microseconds: the reservation asked with sched_setattr(), and the cpu
+ * time every job really takes, 3/4 of the runtime by default.  The work is
+ * measured on the thread's cpu clock, so it needs no calibration and stays
+ * right under QEMU.  Jobs are released every period from a common start;
+ * a job misses its deadline when it finishes later than its release plus
+ * the deadline.  A job still running at the next release delays it, and
+ * the releases it overran are counted as skipped.
+ *
+ * -b starts SCHED_NORMAL threads spinning on every cpu as background load,
+ * -P runs the tasks as SCHED_FIFO or SCHED_NORMAL instead, to compare:
+ *
+ *	dl-test -t 20 -b 4 2000:10000:10000 5000:20000:20000:4000
+ *	dl-test -t 20 -b 4 -P normal 2000:10000:10000 5000:20000:20000:4000
+ *
+ * The exit status is 2 if a deadline was missed.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE	6
+#endif
+
+#ifndef __NR_sched_setattr
+#if defined(__arm__)
+#define __NR_sched_setattr	380
+#elif defined(__x86_64__)
+#define __NR_sched_setattr	314
+#elif defined(__i386__)
+#define __NR_sched_setattr	351
+#else
+#error "__NR_sched_setattr unknown on this architecture"
+#endif
+#endif
+
+#define MAX_TASKS	32
+
+struct sched_attr {
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+};
+
+struct task {
+	const char *spec;
+	long long runtime, deadline, period, work;	/* us */
+	pthread_t thread;
+	int error;
+
+	unsigned long jobs;
+	unsigned long misses;
+	unsigned long skipped;
+	long long max_lateness;
+	long long max_response;
+	long long sum_response;
+};
+
+static struct task tasks[MAX_TASKS];
+static int nr_tasks;
+
+static int seconds = 10;
+static int nr_hogs;
+static int policy = SCHED_DEADLINE;
+static long long start_us, stop_us;
+static volatile int stop;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-t seconds] [-b hogs] [-P deadline|fifo|normal] "
+		"runtime:deadline:period[:work]...\n", prog);
+	exit(1);
+}
+
+static void fatal(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static long long thread_cpu_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void sleep_until(long long us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+/* Run for @us of this thread's cpu time, however long that takes */
+static void burn(long long us)
+{
+	long long end = thread_cpu_us() + us;
+
+	while (thread_cpu_us() < end)
+		;
+}
+
+static int set_policy(struct task *t)
+{
+	struct sched_attr attr;
+	struct sched_param param;
+
+	switch (policy) {
+	case SCHED_DEADLINE:
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.sched_policy = SCHED_DEADLINE;
+		attr.sched_runtime = t->runtime * 1000;
+		attr.sched_deadline = t->deadline * 1000;
+		attr.sched_period = t->period * 1000;
+		return syscall(__NR_sched_setattr, 0, &attr, 0);
+	case SCHED_FIFO:
+		/* shortest deadline first, as rate monotonic would */
+		param.sched_priority = 90 - (t - tasks);
+		return pthread_setschedparam(pthread_self(), SCHED_FIFO,
+					     &param) ? -1 : 0;
+	}
+	return 0;
+}
+
+static void *task_fn(void *arg)
+{
+	struct task *t = arg;
+	long long release = start_us;
+
+	if (set_policy(t)) {
+		t->error = errno;
+		return NULL;
+	}
+
+	while (release < stop_us) {
+		long long finish, lateness;
+
+		sleep_until(release);
+		burn(t->work);
+		finish = now_us();
+
+		lateness = finish - (release + t->deadline);
+		if (lateness > 0)
+			t->misses++;
+		if (lateness > t->max_lateness || !t->jobs)
+			t->max_lateness = lateness;
+		if (finish - release > t->max_response)
+			t->max_response = finish - release;
+		t->sum_response += finish - release;
+		t->jobs++;
+
+		release += t->period;
+		while (release < finish) {
+			release += t->period;
+			t->skipped++;
+		}
+	}
+	return NULL;
+}
+
+static void *hog_fn(void *arg)
+{
+	while (!stop)
+		;
+	return NULL;
+}
+
+static int parse_task(struct task *t, const char *spec)
+{
+	int n;
+
+	t->spec = spec;
+	t->work = -1;
+	n = sscanf(spec, "%lld:%lld:%lld:%lld", &t->runtime, &t->deadline,
+		   &t->period, &t->work);
+	if (n < 3)
+		return -1;
+	if (n == 3)
+		t->work = t->runtime * 3 / 4;
+	if (t->runtime <= 0 || t->deadline < t->runtime ||
+	    t->period < t->deadline || t->work <= 0)
+		return -1;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long misses = 0;
+	pthread_t *hogs = NULL;
+	double bw = 0;
+	int i, c;
+
+	while ((c = getopt(argc, argv, "t:b:P:")) != -1) {
+		switch (c) {
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'b':
+			nr_hogs = atoi(optarg);
+			break;
+		case 'P':
+			if (!strcmp(optarg, "deadline"))
+				policy = SCHED_DEADLINE;
+			else if (!strcmp(optarg, "fifo"))
+				policy = SCHED_FIFO;
+			else if (!strcmp(optarg, "normal"))
+				policy = SCHED_OTHER;
+			else
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (seconds <= 0 || nr_hogs < 0 || optind == argc ||
+	    argc - optind > MAX_TASKS)
+		usage(argv[0]);
+
+	for (i = optind; i < argc; i++) {
+		struct task *t = &tasks[nr_tasks++];
+
+		if (parse_task(t, argv[i])) {
+			fprintf(stderr, "%s: bad task, need runtime <= "
+				"deadline <= period and work > 0\n", argv[i]);
+			return 1;
+		}
+		bw += (double)t->runtime / t->period;
+	}
+
+	if (nr_hogs) {
+		hogs = calloc(nr_hogs, sizeof(*hogs));
+		if (!hogs)
+			fatal("calloc");
+		for (i = 0; i < nr_hogs; i++)
+			if (pthread_create(&hogs[i], NULL, hog_fn, NULL))
+				fatal("pthread_create");
+	}
+
+	/* Leave the threads time to set their policy before the first job */
+	start_us = now_us() + 100000;
+	stop_us = start_us + seconds * 1000000LL;
+	for (i = 0; i < nr_tasks; i++)
+		if (pthread_create(&tasks[i].thread, NULL, task_fn, &tasks[i]))
+			fatal("pthread_create");
+	for (i = 0; i < nr_tasks; i++)
+		pthread_join(tasks[i].thread, NULL);
+
+	stop = 1;
+	for (i = 0; i < nr_hogs; i++)
+		pthread_join(hogs[i], NULL);
+	free(hogs);
+
+	printf("%d tasks, %.1f%% of a cpu reserved, %d hogs, %ds\n\n",
+	       nr_tasks, bw * 100, nr_hogs, seconds);
+	printf("%-24s %8s %8s %7s %8s %12s %12s %12s\n", "task", "jobs",
+	       "missed", "miss%", "skipped", "max_late(us)", "max_resp(us)",
+	       "avg_resp(us)");
+
+	for (i = 0; i < nr_tasks; i++) {
+		struct task *t = &tasks[i];
+
+		if (t->error) {
+			errno = t->error;
+			fprintf(stderr, "%s: %s%s\n", t->spec, strerror(errno),
+				errno == EBUSY ? " (over the admission limit)" :
+				errno == EPERM ? " (needs CAP_SYS_NICE)" :
+				errno == ENOSYS ? " (no SCHED_DEADLINE in the "
+				"kernel)" : "");
+			return 1;
+		}
+
+		printf("%-24s %8lu %8lu %6.2f%% %8lu %12lld %12lld %12lld\n",
+		       t->spec, t->jobs, t->misses,
+		       t->jobs ? 100.0 * t->misses / t->jobs : 0, t->skipped,
+		       t->max_lateness, t->max_response,
+		       t->jobs ? t->sum_response / (long long)t->jobs : 0);
+		misses += t->misses;
+	}
+
+	return misses ? 2 : 0;
+}
@@ -0,0 +1,111 @@
+#!/bin/sh
+#
+# dm-crypt-bench.sh -- measure the throughput of dm-crypt over a ramdisk.
+#
+# A crypt mapping is set up over /dev/ram0 (brd), so that the encryption
+# and the kcryptd workers are all that is measured, once per set of
+# optional parameters.  For each, fio runs
+#
+#   bufwrite	buffered sequential writes, written back by the flusher
+#		thread, the case of a single submitter
+#   write	O_DIRECT sequential writes, queue depth 16
+#   read	O_DIRECT sequential reads, queue depth 16
+#
+# and the bandwidths are reported in kB/s:
+#
+#	dm-crypt-bench.sh [-c cipher] [-m size_mb] [-s secs] [opts ...]
+#
+# Each opts argument is a space separated list of dm-crypt optional
+# parameters, eg. "same_cpu_crypt"; "" is the default mapping.  Without
+# any, the default and same_cpu_crypt are compared.
+#
+# brd is loaded with rd_size to fit size_mb if /dev/ram0 does not exist;
+# its content is overwritten.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms and conditions of the GNU General Public License,
+# version 2, as published by the Free Software Foundation.
+
+cipher=aes-cbc-essiv:sha256
+size_mb=256
+runtime=20
+name=dm-crypt-bench
+key=0123456789abcdef0123456789abcdef
+
+usage()
+{
+	echo "usage: $0 [-c cipher] [-m size_mb] [-s secs] [opts ...]" >&2
+	exit 1
+}
+
+while getopts "c:m:s:" opt; do
+	case $opt in
+	c) cipher="$OPTARG" ;;
+	m) size_mb="$OPTARG" ;;
+	s) runtime="$OPTARG" ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -gt 0 ] || set -- "" "same_cpu_crypt"
+
+command -v fio >/dev/null || { echo "$0: fio not found" >&2; exit 1; }
+command -v dmsetup >/dev/null || { echo "$0: dmsetup not found" >&2; exit 1; }
+
+if [ ! -b /dev/ram0 ]; then
+	modprobe brd rd_nr=1 rd_size=$((size_mb * 1024)) ||
+		{ echo "$0: cannot load brd" >&2; exit 1; }
+fi
+sectors=$(blockdev --getsz /dev/ram0)
+dev=/dev/mapper/$name
+jobfile=/tmp/$name.fio
+trap 'dmsetup remove $name 2>/dev/null; rm -f $jobfile' EXIT
+trap 'exit 1' INT TERM
+
+cat > "$jobfile" <<EOF
+[global]
+filename=$dev
+bs=1m
+runtime=$runtime
+time_based
+group_reporting
+
+[bufwrite]
+rw=write
+ioengine=sync
+end_fsync=1
+
+[write]
+stonewall
+rw=write
+ioengine=libaio
+iodepth=16
+direct=1
+
+[read]
+stonewall
+rw=read
+ioengine=libaio
+iodepth=16
+direct=1
+EOF
+
+printf "%-40s %12s %12s %12s\n" opts bufwrite_kb/s write_kb/s read_kb/s
+
+for opts in "$@"; do
+	set -- $opts
+	table="0 $sectors crypt $cipher $key 0 /dev/ram0 0"
+	[ $# -gt 0 ] && table="$table $# $opts"
+
+	dmsetup create $name --table "$table" || continue
+	udevadm settle 2>/dev/null
+
+	# terse version 3: field 7 is the read bandwidth, 48 the write one
+	fio --minimal --terse-version=3 "$jobfile" | awk -F';' -v o="${opts:-default}" '
+		$3 == "bufwrite" { bw = $48 }
+		$3 == "write" { w = $48 }
+		$3 == "read" { r = $7 }
+		END { printf "%-40s %12s %12s %12s\n", o, bw, w, r }'
+
+	dmsetup remove $name
+done
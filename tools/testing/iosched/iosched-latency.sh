@@ -0,0 +1,112 @@
+#!/bin/sh
+#
+# iosched-latency.sh -- compare the read latency of the io schedulers under
+# background writes, with fio.
+#
+# For each scheduler, one job does 4k random O_DIRECT reads, one at a time,
+# while buffered sequential writers fill the same filesystem, the way an
+# application starts during a package install.  The reads are what the
+# user waits for, their completion latency is reported in usecs:
+#
+#	iosched-latency.sh [-s "bfq cfq deadline"] [-t secs] [-w writers] \
+#		[-S write_size] disk dir
+#
+# disk is the block device under dir, as in /sys/block/<disk>, eg.
+# mmcblk0.  dir is where the test files are created and must have room for
+# the writers.  The scheduler of the disk is restored at the end.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms and conditions of the GNU General Public License,
+# version 2, as published by the Free Software Foundation.
+
+scheds="bfq cfq deadline"
+runtime=30
+writers=2
+wsize=1g
+
+usage()
+{
+	echo "usage: $0 [-s schedulers] [-t secs] [-w writers] [-S write_size] disk dir" >&2
+	exit 1
+}
+
+while getopts "s:t:w:S:" opt; do
+	case $opt in
+	s) scheds="$OPTARG" ;;
+	t) runtime="$OPTARG" ;;
+	w) writers="$OPTARG" ;;
+	S) wsize="$OPTARG" ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 2 ] || usage
+
+disk=$1
+dir=$2
+sched_file=/sys/block/$disk/queue/scheduler
+
+[ -w "$sched_file" ] || { echo "$0: no $sched_file" >&2; exit 1; }
+[ -d "$dir" ] || { echo "$0: no directory $dir" >&2; exit 1; }
+command -v fio >/dev/null || { echo "$0: fio not found" >&2; exit 1; }
+
+old_sched=$(sed 's/.*\[\(.*\)\].*/\1/' "$sched_file")
+jobfile=$dir/iosched-latency.fio
+trap 'echo $old_sched > $sched_file; rm -f $jobfile' EXIT
+trap 'exit 1' INT TERM
+
+cat > "$jobfile" <<EOF
+[global]
+directory=$dir
+runtime=$runtime
+time_based
+group_reporting
+
+[writers]
+rw=write
+bs=128k
+ioengine=sync
+size=$wsize
+numjobs=$writers
+
+[reader]
+new_group
+rw=randread
+bs=4k
+direct=1
+ioengine=sync
+size=256m
+EOF
+
+printf "%-10s %8s %10s %10s %10s %10s %12s\n" \
+	sched r_iops clat_mean clat_p50 clat_p99 clat_p99.9 w_kb/s
+
+for sched in $scheds; do
+	if ! grep -qw "$sched" "$sched_file"; then
+		echo "$sched: not available, skipped" >&2
+		continue
+	fi
+	echo "$sched" > "$sched_file"
+
+	sync
+	echo 3 > /proc/sys/vm/drop_caches
+
+	# terse version 3: field 8 is the read iops, 16 the mean read
+	# completion latency, 18-37 its percentiles as "pct%=usecs", 48
+	# the write bandwidth
+	fio --minimal --terse-version=3 "$jobfile" | awk -F';' -v s="$sched" '
+		$3 == "writers" { wbw = $48 }
+		$3 == "reader" {
+			iops = $8; mean = $16
+			for (i = 18; i <= 37; i++) {
+				split($i, p, "%=")
+				if (p[1] + 0 == 50) p50 = p[2]
+				if (p[1] + 0 == 99) p99 = p[2]
+				if (p[1] + 0 == 99.9) p999 = p[2]
+			}
+		}
+		END {
+			printf "%-10s %8s %10.0f %10s %10s %10s %12s\n",
+				s, iops, mean, p50, p99, p999, wbw
+		}'
+done